@@ -26,6 +26,17 @@ KERNEL_START_SECTOR	equ 	0x9
 ; 内核映像的入口地址
 KERNEL_ENTRY_POINT	equ 	0xc0001500
 
+; ------------------ initramfs 的配置信息 -----------------
+; 主机上用cpio打包的initramfs在硬盘中的起始扇区号，见prog/compile.sh
+INITRD_START_SECTOR	equ	300
+
+; loader固定读入的扇区数，initramfs最大512KB，须与ramdisk.h一致
+INITRD_SECTORS		equ	1024
+
+; initramfs在内存中的物理地址，紧接在页表之后，是内核物理内存池的开头，
+; 内核解包后归还给内存池
+INITRD_BASE_ADDR	equ	0x200000
+
 ; ------------------ 页表配置 -----------------
 ; 页目录表的起始地址
 PAGE_DIR_TABLE_POS	equ	0x100000
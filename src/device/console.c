@@ -6,25 +6,25 @@
 #include <print.h>
 #include <thread.h>
 
-/* 控制台锁 */
-static struct lock console_lock;
+/* 控制台锁，每次只持有输出一个字符串的时间，用自适应互斥锁 */
+static struct mutex console_lock;
 
 /* 初始化终端 */
 void console_init(void)
 {
-    lock_init(&console_lock);
+    mutex_init(&console_lock);
 }
 
 /* 获取终端 */
 void console_acquire(void)
 {
-    lock_acquire(&console_lock);
+    mutex_lock(&console_lock);
 }
 
 /* 释放终端 */
 void console_release(void)
 {
-    lock_release(&console_lock);
+    mutex_unlock(&console_lock);
 }
 
 /* 终端中输出字符串 */
@@ -12,6 +12,10 @@
 #include <debug.h>
 #include <io.h>
 #include <timer.h>
+#include <softirq.h>
+#include <thread.h>
+#include <tsc.h>
+#include <ramdisk.h>
 
 /* 定义硬盘各寄存器的端口号 */
 #define reg_data(channel)	 (channel->port_base + 0)
@@ -54,6 +58,7 @@ int32_t ext_lba_base = 0;
 uint8_t p_no = 0, l_no = 0;     /* 用来记录硬盘主分区和逻辑分区的下标 */
 
 struct list partition_list;     /* 分区队列 */
+struct rwlock partition_list_lock;  /* 保护partition_list，多数时候只读 */
 
 /* 构建一个16字节大小的结构体，用来存分区表项 
  * 最后的((packed))用于告诉编译器，不允许为对齐而在此结构中
@@ -210,6 +215,13 @@ static bool busy_wait(struct disk *hd)
 /* 从硬盘读取sec_cnt个扇区到buf */
 void ide_read(struct disk *hd, uint32_t lba, void *buf, uint32_t sec_cnt)
 {
+    /* 内存盘不经过ide通道 */
+    if (hd->ram_base != NULL)
+    {
+        ramdisk_read(hd, lba, buf, sec_cnt);
+        return;
+    }
+
     kassert(lba <= max_lba);
     kassert(sec_cnt > 0);
     lock_acquire(&hd->my_channel->lock);
@@ -249,7 +261,9 @@ void ide_read(struct disk *hd, uint32_t lba, void *buf, uint32_t sec_cnt)
          * 硬盘是低速设备，此期间最好让出CPU，故将自己阻塞，
          * 等待硬盘完成读操作后通过中断处理程序唤醒自己
          ***********************************************/
+        uint64_t wait_start = rdtsc();
         sema_down(&hd->my_channel->disk_done);
+        running_thread()->acct.blkio_delay += rdtsc() - wait_start;
 
         /* 4.检测硬盘状态是否可读 
          * 醒来后开始执行下面代码
@@ -265,6 +279,7 @@ void ide_read(struct disk *hd, uint32_t lba, void *buf, uint32_t sec_cnt)
         /* 5.把数据从硬盘的缓冲区中读出 */
         read_from_sector(hd, (void *)((uint32_t)buf + secs_done * 512), 
                         secs_op);
+        running_thread()->acct.read_bytes += secs_op * 512;
         secs_done += secs_op;
     }
     lock_release(&hd->my_channel->lock);
@@ -273,6 +288,12 @@ void ide_read(struct disk *hd, uint32_t lba, void *buf, uint32_t sec_cnt)
 /* 将buf中sec_cnt个扇区数据写入硬盘 */
 void ide_write(struct disk *hd, uint32_t lba, void *buf, uint32_t sec_cnt)
 {
+    if (hd->ram_base != NULL)
+    {
+        ramdisk_write(hd, lba, buf, sec_cnt);
+        return;
+    }
+
     kassert(lba <= max_lba);
     kassert(sec_cnt > 0);
     lock_acquire(&hd->my_channel->lock);
@@ -318,8 +339,11 @@ void ide_write(struct disk *hd, uint32_t lba, void *buf, uint32_t sec_cnt)
         write2sector(hd, (void *)((uint32_t)buf + secs_done * 512), secs_op);
 
         /* 在硬盘响应期间阻塞自己 */
+        uint64_t wait_start = rdtsc();
         sema_down(&hd->my_channel->disk_done);
-        
+        running_thread()->acct.blkio_delay += rdtsc() - wait_start;
+        running_thread()->acct.write_bytes += secs_op * 512;
+
         secs_done += secs_op;
     }
     /* 醒来后开始释放锁 */
@@ -414,7 +438,9 @@ static void partition_scan(struct disk *hd, uint32_t ext_lba)
                 hd->prim_parts[p_no].sec_cnt = p->sec_cnt;
                 hd->prim_parts[p_no].my_disk = hd;
 
+                write_lock(&partition_list_lock);
                 list_append(&partition_list, &hd->prim_parts[p_no].part_tag);
+                write_unlock(&partition_list_lock);
                 sprintf(hd->prim_parts[p_no].name, "%s%d", hd->name, p_no + 1);
 
                 p_no++;
@@ -426,7 +452,9 @@ static void partition_scan(struct disk *hd, uint32_t ext_lba)
                 hd->logic_parts[l_no].sec_cnt = p->sec_cnt;
                 hd->logic_parts[l_no].my_disk = hd;
 
+                write_lock(&partition_list_lock);
                 list_append(&partition_list, &hd->logic_parts[l_no].part_tag);
+                write_unlock(&partition_list_lock);
 
                 /* 逻辑分区数字是从5开始，主分区是1～4 */
                 sprintf(hd->logic_parts[l_no].name, "%s%d", hd->name, l_no + 5);
@@ -475,13 +503,29 @@ void intr_hd_handler(uint8_t irq_no)
     {
         channel->expecting_intr = false;
 
-        /* 唤醒读/写硬盘的程序 */
-        sema_up(&channel->disk_done);
-
         /* 读取状态寄存器使硬盘控制器认为此次的中断已被处理，
          * 从而硬盘可以继续执行新的读写 
          */
         inb(reg_status(channel));
+
+        /* 唤醒读/写硬盘的程序留给软中断 */
+        channel->intr_done = true;
+        raise_softirq(BLOCK_SOFTIRQ);
+    }
+}
+
+/* 硬盘软中断，唤醒中断已到来的通道上等待的驱动程序 */
+static void ide_softirq(void)
+{
+    uint8_t ch_no;
+    for (ch_no = 0; ch_no < channel_cnt; ch_no++)
+    {
+        struct ide_channel * channel = &channels[ch_no];
+        if (channel->intr_done)
+        {
+            channel->intr_done = false;
+            sema_up(&channel->disk_done);
+        }
     }
 }
 
@@ -494,6 +538,8 @@ void ide_init(void)
     kassert(hd_cnt > 0);
 
     list_init(&partition_list);
+    rwlock_init(&partition_list_lock);
+    open_softirq(BLOCK_SOFTIRQ, ide_softirq);
 
     /* 一个ide通道上有两个硬盘，根据硬盘数量反推有几个ide通道 */
     channel_cnt = DIV_ROUND_UP(hd_cnt, 2);
@@ -538,6 +584,7 @@ void ide_init(void)
          * 唤醒线程
          */
         sema_init(&channel->disk_done, 0);
+        channel->intr_done = false;
 
         register_handler(channel->irq_no, intr_hd_handler);
 
@@ -569,7 +616,9 @@ void ide_init(void)
     printk("\n   all partition info\n");
 
     /* 打印所有分区信息 */
+    read_lock(&partition_list_lock);
     list_traversal(&partition_list, partition_info, (int)NULL);
+    read_unlock(&partition_list_lock);
 
     put_str("ide_init done\n");
 }
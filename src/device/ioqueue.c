@@ -3,13 +3,14 @@
 #include <ioqueue.h>
 #include <interrupt.h>
 #include <debug.h>
+#include <poll.h>
 
 /* 初始化io队列ioq */
 void ioqueue_init(struct ioqueue * ioq)
 {
-    lock_init(&ioq->lock);      /* 初始化io队列的锁 */
-    ioq->producer = NULL;       /* 生产者和消费者置空 */
-    ioq->consumer = NULL;
+    spin_init(&ioq->lock);      /* 初始化io队列的锁 */
+    wait_queue_init(&ioq->producers);   /* 生产者和消费者队列置空 */
+    wait_queue_init(&ioq->consumers);
     ioq->head = 0;      /* 队列的首尾指针指向缓冲区数组第0个位置 */
     ioq->tail = 0;
 }
@@ -38,73 +39,78 @@ bool ioq_empty(struct ioqueue * ioq)
     return ioq->head == ioq->tail;
 }
 
-/* 使当前生产者或消费者在此缓冲区上等待 */
-static void ioq_wait(struct task_struct ** waiter)
-{
-    kassert(*waiter == NULL && waiter != NULL);
-    *waiter = running_thread();
-    thread_block(TASK_BLOCKED);
-}
-
-/* 唤醒waiter */
-static void wakeup(struct task_struct ** waiter)
-{
-    kassert(*waiter != NULL);
-    thread_unblock(*waiter);
-    *waiter = NULL;
-}
-
 /* 消费者从ioq队列中获取一个字符 */
 char ioq_getchar(struct ioqueue * ioq)
 {
-    kassert(intr_get_status() == INTR_OFF);
+    intr_status old_status = spin_lock_irqsave(&ioq->lock);
 
-    /* 缓冲区(队列)为空，把消费者ioq->consumer记为当前线程自己，
-     * 目的是将来生产者往缓冲区里装商品后，生产者知道唤醒哪个消费者，
-     * 也就是唤醒当前线程自己
+    /* 缓冲区(队列)为空，把当前线程加入消费者队列，
+     * 将来生产者往缓冲区里装商品后，从队列中唤醒一个消费者。
+     * 阻塞时释放ioq->lock，被唤醒后重新获取
      */
     while (ioq_empty(ioq))
     {
-        lock_acquire(&ioq->lock);
-        ioq_wait(&ioq->consumer);
-        lock_release(&ioq->lock);
+        wait_queue_sleep(&ioq->consumers, &ioq->lock);
     }
 
     char byte = ioq->buf[ioq->tail];    /* 从缓冲区中取出 */
     ioq->tail = next_pos(ioq->tail);    /* 把读游标移到下一位置 */
 
-    /* 如果下面的判断不为空，说明有生产者往缓冲区中添加数据时
-     * 因为缓冲区满而休眠
-     * 取出数据后，唤醒生产者
+    /* 若有生产者往缓冲区中添加数据时因为缓冲区满而休眠，
+     * 取出数据后，唤醒一个生产者
      */
-    if (ioq->producer != NULL)
+    wait_queue_wake_one(&ioq->producers);
+
+    spin_unlock_irqrestore(&ioq->lock, old_status);
+    return byte;
+}
+
+/* 队列不空时取出一个字符存入byte并返回true，空时不等待，返回false */
+bool ioq_trygetchar(struct ioqueue * ioq, char * byte)
+{
+    intr_status old_status = spin_lock_irqsave(&ioq->lock);
+    if (ioq_empty(ioq))
     {
-        wakeup(&ioq->producer);     /* 唤醒生产者 */
+        spin_unlock_irqrestore(&ioq->lock, old_status);
+        return false;
     }
 
-    return byte;
+    *byte = ioq->buf[ioq->tail];
+    ioq->tail = next_pos(ioq->tail);
+    wait_queue_wake_one(&ioq->producers);
+
+    spin_unlock_irqrestore(&ioq->lock, old_status);
+    return true;
 }
 
 /* 生产者往ioq队列中写入一个字符byte */
 void ioq_putchar(struct ioqueue * ioq, char byte)
 {
-    kassert(intr_get_status() == INTR_OFF);
+    intr_status old_status = spin_lock_irqsave(&ioq->lock);
 
-    /* 若缓冲区(队列)已经满了，把生产者ioq->producer记为自己，
-     * 为的是当缓冲区里的东西被消费者取完后让消费者知道唤醒哪个生产者，
-     *  也就是唤醒当前线程自己
+    /* 若缓冲区(队列)已经满了，把当前线程加入生产者队列，
+     * 当缓冲区里的东西被消费者取走后由消费者唤醒
      */
     while (ioq_full(ioq))
     {
-        lock_acquire(&ioq->lock);
-        ioq_wait(&ioq->producer);
-        lock_release(&ioq->lock);
+        wait_queue_sleep(&ioq->producers, &ioq->lock);
     }
     ioq->buf[ioq->head] = byte;         /* 把字符放入缓冲区中 */
     ioq->head = next_pos(ioq->head);    /* 把写游标移到下一位置 */
 
-    if (ioq->consumer != NULL)
+    wait_queue_wake_one(&ioq->consumers);   /* 唤醒一个消费者 */
+    spin_unlock_irqrestore(&ioq->lock, old_status);
+}
+
+/* 有数据可读时返回POLLIN，pe不为NULL时登记到消费者队列上 */
+int16_t ioq_poll(struct ioqueue * ioq, struct poll_entry * pe)
+{
+    intr_status old_status = spin_lock_irqsave(&ioq->lock);
+    int16_t revents = ioq_empty(ioq) ? 0 : POLLIN;
+    if (pe != NULL)
     {
-        wakeup(&ioq->consumer);     /* 唤醒消费者 */
+        poll_wait(pe, &ioq->consumers, &ioq->lock);
     }
+    spin_unlock_irqrestore(&ioq->lock, old_status);
+    return revents;
 }
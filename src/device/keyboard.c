@@ -9,6 +9,8 @@
 #include <stddef.h>
 #include <print.h>
 #include <ioqueue.h>
+#include <softirq.h>
+#include <spinlock.h>
 
 #define KBD_BUF_PORT    0x60    /* 键盘buffer寄存器端口号为0x60 */
 
@@ -48,6 +50,12 @@ static bool ctrl_status, shift_status, alt_status, caps_lock_status;
 /* ext_scancode用于记录makecode是否以0xe0开头（扩展的扫描码） */
 static bool ext_scancode;
 
+/* 中断处理程序读出的原始扫描码，由软中断取出解码 */
+#define KBD_RAW_SIZE    16
+static uint8_t kbd_raw[KBD_RAW_SIZE];
+static uint32_t kbd_raw_head, kbd_raw_tail;
+static struct spinlock kbd_raw_lock;
+
 /* 以通码make_code为索引的二维数组
  * 扫描码未与shift组合
  */
@@ -114,8 +122,8 @@ static char keymap[][2] = {
 /*其它按键暂不处理*/
 };
 
-/* 键盘中断处理程序 */
-static void intr_keyboard_handler(void)
+/* 解码一个扫描码，得到的字符放入键盘缓冲区，在软中断中执行 */
+static void keyboard_decode(uint8_t raw_code)
 {
     /* 这次中断发生前的上一次中断，以下任意三个键是否有按下
      * 即这三个键曾经是否被按下且尚未松开
@@ -127,7 +135,7 @@ static void intr_keyboard_handler(void)
     /* 判断扫描码是否为断码（松开） */
     bool break_code;
 
-   uint16_t scancode = inb(KBD_BUF_PORT);
+    uint16_t scancode = raw_code;
 
     /* 若扫描码是e0开头的，表示此键的按下将产生多个扫描码，
      * 所以先结束此次中断处理函数，等待下一个扫描码进来
@@ -233,23 +241,27 @@ static void intr_keyboard_handler(void)
         /* 只处理ascii码不为0的键 */
         if (cur_char)
         {
-            /***************** 快捷键ctrl+l和ctrl+u的处理 ***************
-             * 下面是把ctrl+l和ctrl+u这两种组合键产生的字符置为：
+            /*********** 快捷键ctrl+l、ctrl+u和ctrl+d的处理 ***********
+             * 下面是把这几种组合键产生的字符置为：
              * cur_char的ascii码-字符a的ascii码，此差值比较小，
              * 属于asc码表中不可见的字符部分，故不会产生可见字符，
-             * 我们在shell中将ascii值为l-a和u-a的分别处理为清屏
-             * 和删除输入的快捷键
+             * tty的行规程将ascii值为l-a、u-a和d-a的分别处理为清屏、
+             * 删除输入和文件结束
              */
             if ((ctrl_down_last && cur_char == 'l') ||
-                (ctrl_down_last && cur_char == 'u'))
+                (ctrl_down_last && cur_char == 'u') ||
+                (ctrl_down_last && cur_char == 'd'))
             {
                 cur_char -= 'a';
             }
             
+            /* 软中断中不能阻塞，缓冲区满时丢弃 */
+            intr_status old_status = intr_disable();
             if (!ioq_full(&kbd_buf))
             {
                 ioq_putchar(&kbd_buf, cur_char);
             }
+            intr_set_status(old_status);
             return;
         }
 
@@ -281,11 +293,50 @@ static void intr_keyboard_handler(void)
     }
 }
 
+/* 键盘中断处理程序，只读出扫描码，解码留给软中断 */
+static void intr_keyboard_handler(void)
+{
+    /* 必须读出扫描码，否则键盘控制器不再产生中断 */
+    uint8_t scancode = inb(KBD_BUF_PORT);
+
+    spin_lock(&kbd_raw_lock);
+    uint32_t next = (kbd_raw_head + 1) % KBD_RAW_SIZE;
+    if (next != kbd_raw_tail)   /* 满了就丢弃 */
+    {
+        kbd_raw[kbd_raw_head] = scancode;
+        kbd_raw_head = next;
+    }
+    spin_unlock(&kbd_raw_lock);
+
+    raise_softirq(KEYBOARD_SOFTIRQ);
+}
+
+/* 键盘软中断，逐个解码中断处理程序读出的扫描码 */
+static void keyboard_softirq(void)
+{
+    while (1)
+    {
+        intr_status old_status = spin_lock_irqsave(&kbd_raw_lock);
+        if (kbd_raw_tail == kbd_raw_head)
+        {
+            spin_unlock_irqrestore(&kbd_raw_lock, old_status);
+            break;
+        }
+        uint8_t scancode = kbd_raw[kbd_raw_tail];
+        kbd_raw_tail = (kbd_raw_tail + 1) % KBD_RAW_SIZE;
+        spin_unlock_irqrestore(&kbd_raw_lock, old_status);
+
+        keyboard_decode(scancode);
+    }
+}
+
 /* 键盘初始化 */
 void keyboard_init(void)
 {
     put_str("keyboard_init ... ");
     ioqueue_init(&kbd_buf);     /* 初始化环形缓冲区 */
+    spin_init(&kbd_raw_lock);
+    open_softirq(KEYBOARD_SOFTIRQ, keyboard_softirq);
     register_handler(0x21, intr_keyboard_handler);
     put_str("ok\n");
 }
@@ -0,0 +1,105 @@
+/* ramdisk.c
+ *   以内存为存储的块设备
+ *
+ * 内存盘和硬盘一样用struct disk描述，ide_read/ide_write发现ram_base
+ * 不为NULL时转到这里，文件系统不用区分两者。
+ * loader留下的initramfs占着内核内存池开头的INITRD_PAGES页，
+ * 解包之后释放；没有initramfs时不建立内存盘，仍从硬盘挂载根文件系统
+ */
+
+#include <ramdisk.h>
+#include <ide.h>
+#include <memory.h>
+#include <sync.h>
+#include <string.h>
+#include <printk.h>
+#include <print.h>
+#include <debug.h>
+#include <global.h>
+#include <fs.h>
+
+#define CPIO_NEWC_MAGIC     "070701"
+
+static struct disk ram_disk;
+static struct lock ram_lock;    /* 与硬盘的通道锁一样，串行化读写 */
+static char * initrd;           /* initramfs在内核中的虚拟地址 */
+
+/* 从内存盘hd读取sec_cnt个扇区到buf */
+void ramdisk_read(struct disk * hd, uint32_t lba, void * buf, uint32_t sec_cnt)
+{
+    kassert(sec_cnt > 0 && lba + sec_cnt <= RAMDISK_SECTORS);
+    lock_acquire(&ram_lock);
+    memcpy(buf, hd->ram_base + lba * SECTOR_SIZE, sec_cnt * SECTOR_SIZE);
+    lock_release(&ram_lock);
+}
+
+/* 将buf中sec_cnt个扇区写入内存盘hd */
+void ramdisk_write(struct disk * hd, uint32_t lba, void * buf, uint32_t sec_cnt)
+{
+    kassert(sec_cnt > 0 && lba + sec_cnt <= RAMDISK_SECTORS);
+    lock_acquire(&ram_lock);
+    memcpy(hd->ram_base + lba * SECTOR_SIZE, buf, sec_cnt * SECTOR_SIZE);
+    lock_release(&ram_lock);
+}
+
+/* 返回内存盘上唯一的分区，没有内存盘时返回NULL */
+struct partition * ramdisk_partition(void)
+{
+    return (ram_disk.ram_base != NULL) ? &ram_disk.prim_parts[0] : NULL;
+}
+
+/* 返回initramfs的内容，共INITRD_SECTORS个扇区，已释放或没有时返回NULL */
+const char * ramdisk_initrd(void)
+{
+    return initrd;
+}
+
+/* 解包完成后释放initramfs占用的内存 */
+void ramdisk_initrd_free(void)
+{
+    if (initrd != NULL)
+    {
+        mfree_page(PF_KERNEL, initrd, INITRD_PAGES);
+        initrd = NULL;
+    }
+}
+
+/* 检查loader是否读入了initramfs，有则建立内存盘并加入分区链表
+ * 须在ide_init之后、filesys_init之前调用
+ */
+void ramdisk_init(void)
+{
+    put_str("ramdisk_init ... ");
+    lock_init(&ram_lock);
+
+    initrd = kernel_pages_map(INITRD_BASE_ADDR, INITRD_PAGES);
+    kassert(initrd != NULL);
+    if (memcmp(initrd, CPIO_NEWC_MAGIC, strlen(CPIO_NEWC_MAGIC)))
+    {
+        /* 硬盘上没有写入initramfs */
+        ramdisk_initrd_free();
+        put_str("no initramfs\n");
+        return;
+    }
+
+    /* 申请的内存已清0，filesys_init会把它格式化 */
+    ram_disk.ram_base = get_kernel_pages(RAMDISK_SECTORS * SECTOR_SIZE / PG_SIZE);
+    if (ram_disk.ram_base == NULL)
+    {
+        ramdisk_initrd_free();
+        put_str("no memory\n");
+        return;
+    }
+    strcpy(ram_disk.name, "ram");
+
+    struct partition * part = &ram_disk.prim_parts[0];
+    part->start_lba = 0;
+    part->sec_cnt = RAMDISK_SECTORS;
+    part->my_disk = &ram_disk;
+    strcpy(part->name, "ram0");
+
+    write_lock(&partition_list_lock);
+    list_append(&partition_list, &part->part_tag);
+    write_unlock(&partition_list_lock);
+    put_str("ok\n");
+}
@@ -9,8 +9,13 @@
 #include <debug.h>
 #include <interrupt.h>
 #include <global.h>
+#include <smp.h>
+#include <tsc.h>
+#include <schedstat.h>
+#include <spinlock.h>
+#include <list.h>
+#include <vdso.h>
 
-#define IRQ0_FREQUENCY      100     /* 时钟中断频率：100Hz */
 #define INPUT_FREQUENCY     1193180 /* 定时器/计数器的工作频率 */
 /* 计数初值 */
 #define TIMER0_INITIAL_VALUE    INPUT_FREQUENCY / IRQ0_FREQUENCY
@@ -27,6 +32,11 @@
 #define mil_seconds_per_intr    (1000 / IRQ0_FREQUENCY)
 
 uint32_t ticks;     /* ticks是内核自中断开启以来总共的嘀嗒数 */
+uint32_t tsc_per_tick;  /* 一个嘀嗒内tsc增加的时钟周期数，未测量时为0 */
+
+static struct list sleep_list;      /* 休眠的任务，按唤醒时刻从早到晚排列 */
+static struct spinlock sleep_lock;  /* 保护sleep_list和timer_list */
+static struct list timer_list;      /* 定时器，按到时时刻从早到晚排列 */
 
 /* 初始化模式控制寄存器，并给计数器赋初始值 */
 static void set_timer(uint8_t port, uint8_t no, uint8_t rwl,
@@ -40,8 +50,10 @@ static void set_timer(uint8_t port, uint8_t no, uint8_t rwl,
     outb(port, (uint8_t)value >> 8);
 }
 
-/* 时钟中断的中断处理函数 */
-static void intr_timer_handler(void)
+/* 当前任务的时间片处理，
+ * BSP的PIT时钟中断和AP的本地APIC时钟中断共用
+ */
+void task_tick(void)
 {
     struct task_struct * cur_thread = running_thread();
 
@@ -50,16 +62,14 @@ static void intr_timer_handler(void)
 
     /* 记录此线程占用的cpu时间嘀嗒数 */
     cur_thread->elapsed_ticks++;
+    sched_tick(this_cpu(), cur_thread);
 
-    /* 从内核第一次处理时间中断后开始至今的滴哒数，
-     * 内核态和用户态总共的嘀哒数
+    /* 若进程时间片用完就开始调度新的进程上cpu，
+     * 调度推迟到irq_exit中软中断处理完之后
      */
-    ticks++;
-
-    /* 若进程时间片用完就开始调度新的进程上cpu */
     if(cur_thread->ticks == 0)
     {
-        schedule();
+        this_cpu()->need_resched = true;
     }
     else
     {
@@ -67,20 +77,134 @@ static void intr_timer_handler(void)
         cur_thread->ticks--;
     }
 }
+
+/* 唤醒到时的休眠任务，在时钟中断中调用 */
+static void sleep_wakeup(void)
+{
+    spin_lock(&sleep_lock);
+    while (!list_empty(&sleep_list))
+    {
+        struct task_struct * pthread = container_of(struct task_struct,
+                    general_tag, sleep_list.head.next);
+
+        /* 用差值比较，ticks回绕后仍然正确 */
+        if ((int32_t)(ticks - pthread->wake_tick) < 0)
+        {
+            break;
+        }
+        list_remove(&pthread->general_tag);
+        thread_unblock(pthread);
+    }
+    spin_unlock(&sleep_lock);
+}
+
+/* 执行到时的定时器，在时钟中断中调用 */
+static void timer_run(void)
+{
+    spin_lock(&sleep_lock);
+    while (!list_empty(&timer_list))
+    {
+        struct timer * t = container_of(struct timer, tag, timer_list.head.next);
+        if ((int32_t)(ticks - t->expires) < 0)
+        {
+            break;
+        }
+        list_remove(&t->tag);
+        t->pending = false;
+        t->func(t->arg);
+    }
+    spin_unlock(&sleep_lock);
+}
+
+/* 时钟中断的中断处理函数 */
+static void intr_timer_handler(void)
+{
+    /* 从内核第一次处理时间中断后开始至今的滴哒数，
+     * 内核态和用户态总共的嘀哒数，只由BSP累加
+     */
+    ticks++;
+    vdso_update_tick();
+
+    sleep_wakeup();
+    timer_run();
+    calc_global_load();
+    task_tick();
+}
                         
 
 /* 让任务休眠sleep_ticks个嘀哒
- * 以tick为单位的sleep，任何时间形式的sleep会转换此ticks形式 
+ * 以tick为单位的sleep，任何时间形式的sleep会转换此ticks形式。
+ * 任务阻塞在sleep_list上，由时钟中断到时唤醒，休眠期间不占用cpu
  */
 static void ticks_to_sleep(uint32_t sleep_ticks)
 {  
-    uint32_t start_tick = ticks;
+    struct task_struct * cur = running_thread();
+    intr_status old_status = intr_disable();
+
+    spin_lock(&sleep_lock);
+    cur->wake_tick = ticks + sleep_ticks;
 
-    /* 若间隔的ticks数不够便让出cpu */
-    while (ticks - start_tick < sleep_ticks)
-    {
-        thread_yield();
+    /* 插到第一个比它晚唤醒的任务之前，同时到时的按先后排列 */
+    struct node * pelem = sleep_list.head.next;
+    while (pelem != &sleep_list.tail)
+    {
+        struct task_struct * pthread =
+                    container_of(struct task_struct, general_tag, pelem);
+        if ((int32_t)(pthread->wake_tick - cur->wake_tick) > 0)
+        {
+            break;
+        }
+        pelem = pelem->next;
     }
+    list_insert(pelem, &cur->general_tag);
+
+    thread_block_unlock(TASK_BLOCKED, &sleep_lock);
+    intr_set_status(old_status);
+}
+
+/* 加入定时器t，delay_ticks个嘀嗒后在时钟中断中调用t->func
+ * 回调时持有sleep_lock并已关中断，不能睡眠
+ */
+void timer_add(struct timer * t, uint32_t delay_ticks)
+{
+    intr_status old_status = spin_lock_irqsave(&sleep_lock);
+    t->expires = ticks + delay_ticks;
+
+    struct node * pelem = timer_list.head.next;
+    while (pelem != &timer_list.tail)
+    {
+        struct timer * other = container_of(struct timer, tag, pelem);
+        if ((int32_t)(other->expires - t->expires) > 0)
+        {
+            break;
+        }
+        pelem = pelem->next;
+    }
+    list_insert(pelem, &t->tag);
+    t->pending = true;
+    spin_unlock_irqrestore(&sleep_lock, old_status);
+}
+
+/* 删除还未到时的定时器t，返回它删除前是否还未到时
+ * 返回后回调不会再执行
+ */
+bool timer_del(struct timer * t)
+{
+    intr_status old_status = spin_lock_irqsave(&sleep_lock);
+    bool pending = t->pending;
+    if (pending)
+    {
+        list_remove(&t->tag);
+        t->pending = false;
+    }
+    spin_unlock_irqrestore(&sleep_lock, old_status);
+    return pending;
+}
+
+/* 毫秒数换算为嘀嗒数，向上取整 */
+uint32_t msecs_to_ticks(uint32_t m_seconds)
+{
+    return DIV_ROUND_UP(m_seconds, mil_seconds_per_intr);
 }
 
 /* 以毫秒为单位的sleep   1秒= 1000毫秒 */
@@ -91,6 +215,36 @@ void mtime_sleep(uint32_t m_seconds)
     ticks_to_sleep(sleep_ticks);
 }
 
+/* 系统调用sleep，休眠m_seconds毫秒，为0时直接返回 */
+void sys_sleep(uint32_t m_seconds)
+{
+    if (m_seconds == 0)
+    {
+        return;
+    }
+    mtime_sleep(m_seconds);
+}
+
+/* 以PIT时钟为基准测量tsc的频率，须在开中断后调用 */
+void tsc_calibrate(void)
+{
+    uint32_t start;
+    uint64_t start_tsc;
+
+    /* 先对齐到嘀嗒的边界 */
+    start = *(volatile uint32_t *)&ticks;
+    while (*(volatile uint32_t *)&ticks == start)
+        ;
+
+    start_tsc = rdtsc();
+    start = *(volatile uint32_t *)&ticks;
+    while (*(volatile uint32_t *)&ticks == start)
+        ;
+
+    tsc_per_tick = (uint32_t)(rdtsc() - start_tsc);
+    vdso_set_tsc(tsc_per_tick);
+}
+
 /* 初始化定时器/计数器 PIT 8253 */
 void timer_init(void)
 {
@@ -98,6 +252,9 @@ void timer_init(void)
     /* 设置8253的定时周期,也就是发中断的周期 */
     set_timer(TIMER0_PORT, TIMER0_NO, READ_WRITE_LATCH,
             TIMER_MODE, TIMER0_INITIAL_VALUE);
+    list_init(&sleep_list);
+    list_init(&timer_list);
+    spin_init(&sleep_lock);
     register_handler(0x20, intr_timer_handler);
     put_str("ok\n");
 }
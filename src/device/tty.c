@@ -0,0 +1,248 @@
+/* tty.c
+ *   控制台的终端行规程
+ *
+ * 键盘中断的软中断只把字符放入kbd_buf，
+ * 行编辑和回显在读者的上下文中进行，因为控制台输出要获取互斥锁，
+ * 软中断中不能睡眠。编辑中的行和已完成的行共用line，
+ * 已完成的行读完之前不再从kbd_buf取字符
+ */
+
+#include <tty.h>
+#include <ioqueue.h>
+#include <keyboard.h>
+#include <console.h>
+#include <print.h>
+#include <sync.h>
+#include <poll.h>
+#include <string.h>
+
+struct tty
+{
+    struct mutex lock;          /* 串行化读者，保护下面各项 */
+    uint32_t mode;              /* TTY_CANON、TTY_ECHO的组合 */
+    char line[TTY_LINE_MAX];    /* 编辑中或已完成的行 */
+    uint32_t len;               /* line中的字符数 */
+    uint32_t rd_pos;            /* 已完成的行中已被读出的字节数 */
+    bool line_ready;            /* line已是完整的一行 */
+    bool eof;                   /* 在空行上按了ctrl+d */
+};
+
+static struct tty console_tty;
+
+/* 开启回显时输出字符c */
+static void tty_echo(struct tty * tty, char c)
+{
+    if (tty->mode & TTY_ECHO)
+    {
+        console_put_char(c);
+    }
+}
+
+/* 规范模式下处理一个键入的字符 */
+static void tty_input_char(struct tty * tty, char c)
+{
+    uint32_t i;
+
+    switch (c)
+    {
+    case '\r':
+    case '\n':
+        tty->line[tty->len++] = '\n';
+        tty_echo(tty, '\n');
+        tty->line_ready = true;
+        break;
+
+    case '\b':
+        if (tty->len > 0)
+        {
+            tty->len--;
+            tty_echo(tty, '\b');
+        }
+        break;
+
+    /* ctrl+u 清掉本行的输入 */
+    case TTY_CTRL('u'):
+        while (tty->len > 0)
+        {
+            tty->len--;
+            tty_echo(tty, '\b');
+        }
+        break;
+
+    /* ctrl+l 清屏后重新显示本行的输入 */
+    case TTY_CTRL('l'):
+        console_acquire();
+        cls_screen();
+        if (tty->mode & TTY_ECHO)
+        {
+            for (i = 0; i < tty->len; i++)
+            {
+                put_char(tty->line[i]);
+            }
+        }
+        console_release();
+        break;
+
+    /* ctrl+d 空行上表示文件结束，否则不带换行符交出已输入的部分 */
+    case TTY_CTRL('d'):
+        if (tty->len == 0)
+        {
+            tty->eof = true;
+        }
+        else
+        {
+            tty->line_ready = true;
+        }
+        break;
+
+    default:
+        /* 留一个位置给换行符，行满后丢弃多出的字符 */
+        if (tty->len < TTY_LINE_MAX - 1)
+        {
+            tty->line[tty->len++] = c;
+            tty_echo(tty, c);
+        }
+        break;
+    }
+}
+
+/* 从kbd_buf取字符做行编辑，直到得到完整的一行或文件结束，返回true
+ * block为false时kbd_buf空了就返回false，不等待
+ */
+static bool tty_fill_line(struct tty * tty, bool block)
+{
+    char c;
+
+    while (!tty->line_ready && !tty->eof)
+    {
+        if (block)
+        {
+            c = ioq_getchar(&kbd_buf);
+        }
+        else if (!ioq_trygetchar(&kbd_buf, &c))
+        {
+            return false;
+        }
+        tty_input_char(tty, c);
+    }
+    return true;
+}
+
+/* 原始模式下等到至少有一个字符，再取走已到达的字符，最多count个 */
+static int32_t tty_read_raw(struct tty * tty, char * buf, uint32_t count)
+{
+    uint32_t n = 0;
+
+    buf[n] = ioq_getchar(&kbd_buf);
+    do
+    {
+        tty_echo(tty, buf[n]);
+        n++;
+    } while (n < count && ioq_trygetchar(&kbd_buf, &buf[n]));
+    return n;
+}
+
+/* 从控制台读入最多count个字节到buf，返回读出的字节数
+ * 规范模式下一次最多返回一行，一行没读完时剩下的留给下次；
+ * 在空行上按ctrl+d时返回-1
+ */
+int32_t tty_read(char * buf, uint32_t count)
+{
+    struct tty * tty = &console_tty;
+    int32_t ret;
+
+    if (count == 0)
+    {
+        return 0;
+    }
+
+    mutex_lock(&tty->lock);
+    if (!(tty->mode & TTY_CANON))
+    {
+        ret = tty_read_raw(tty, buf, count);
+        mutex_unlock(&tty->lock);
+        return ret;
+    }
+
+    tty_fill_line(tty, true);
+    if (tty->eof)
+    {
+        tty->eof = false;
+        mutex_unlock(&tty->lock);
+        return -1;
+    }
+
+    uint32_t n = tty->len - tty->rd_pos;
+    if (n > count)
+    {
+        n = count;
+    }
+    memcpy(buf, tty->line + tty->rd_pos, n);
+    tty->rd_pos += n;
+
+    /* 整行读完后才开始编辑下一行 */
+    if (tty->rd_pos == tty->len)
+    {
+        tty->len = 0;
+        tty->rd_pos = 0;
+        tty->line_ready = false;
+    }
+    mutex_unlock(&tty->lock);
+    return n;
+}
+
+/* 控制台可读时返回POLLIN，pe不为NULL时登记到kbd_buf的消费者队列上
+ * 规范模式下顺便编辑已键入的字符，有完整的一行才算可读。
+ * 别的线程正在读时不检查，由它取走输入
+ */
+int16_t tty_poll(struct poll_entry * pe)
+{
+    struct tty * tty = &console_tty;
+    int16_t revents = ioq_poll(&kbd_buf, pe);
+
+    if (!mutex_trylock(&tty->lock))
+    {
+        return 0;
+    }
+    if (tty->mode & TTY_CANON)
+    {
+        revents = tty_fill_line(tty, false) ? POLLIN : 0;
+    }
+    mutex_unlock(&tty->lock);
+    return revents;
+}
+
+/* 设置控制台的模式为mode，mode为负数时只查询，返回原来的模式
+ * 切换模式时丢弃编辑中的行
+ */
+int32_t sys_tty_mode(int32_t mode)
+{
+    struct tty * tty = &console_tty;
+
+    mutex_lock(&tty->lock);
+    int32_t old_mode = tty->mode;
+    if (mode >= 0)
+    {
+        tty->mode = mode & (TTY_CANON | TTY_ECHO);
+        if (tty->mode != (uint32_t)old_mode)
+        {
+            tty->len = 0;
+            tty->rd_pos = 0;
+            tty->line_ready = false;
+            tty->eof = false;
+        }
+    }
+    mutex_unlock(&tty->lock);
+    return old_mode;
+}
+
+/* 初始化控制台的行规程，默认为规范模式并回显 */
+void tty_init(void)
+{
+    mutex_init(&console_tty.lock);
+    console_tty.mode = TTY_CANON | TTY_ECHO;
+    console_tty.len = 0;
+    console_tty.rd_pos = 0;
+    console_tty.line_ready = false;
+    console_tty.eof = false;
+}
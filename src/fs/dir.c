@@ -36,7 +36,7 @@ struct dir * dir_open(struct partition *part, uint32_t inode_no)
 /* 在part分区内的pdir目录内寻找名为name的文件或目录，
  * 找到后返回true并将其目录项存入dir_e，否则返回false 
  */
-bool search_dir_entry(struct partition *part, struct dir *pdir, 
+static bool do_search_dir_entry(struct partition *part, struct dir *pdir, 
 		     const char *name, struct dir_entry *dir_e) 
 {
     /* inode中总的块数，
@@ -121,6 +121,18 @@ bool search_dir_entry(struct partition *part, struct dir *pdir,
     return false;
 }
 
+/* 在目录中查找目录项，只读取目录项，持有分区目录的读锁，
+ * 多个线程可以同时查找
+ */
+bool search_dir_entry(struct partition *part, struct dir *pdir, 
+		     const char *name, struct dir_entry *dir_e) 
+{
+    read_lock(&part->dir_lock);
+    bool found = do_search_dir_entry(part, pdir, name, dir_e);
+    read_unlock(&part->dir_lock);
+    return found;
+}
+
 
 /* 关闭目录 
  * 根目录不能关闭
@@ -154,8 +166,8 @@ void create_dir_entry(char* filename, uint32_t inode_no,
 
 
 /* 将目录项p_de写入父目录parent_dir中，io_buf由主调函数提供 */
-bool sync_dir_entry(struct dir * parent_dir, struct dir_entry * p_de, 
-                            void * io_buf) 
+static bool do_sync_dir_entry(struct dir * parent_dir, 
+                struct dir_entry * p_de, void * io_buf) 
 {
     struct inode* dir_inode = parent_dir->inode;
     uint32_t dir_size = dir_inode->i_size;
@@ -290,9 +302,19 @@ bool sync_dir_entry(struct dir * parent_dir, struct dir_entry * p_de,
     return false;
 }
 
+/* 写入目录项，持有分区目录的写锁 */
+bool sync_dir_entry(struct dir * parent_dir, struct dir_entry * p_de, 
+                            void * io_buf) 
+{
+    write_lock(&cur_part->dir_lock);
+    bool ret = do_sync_dir_entry(parent_dir, p_de, io_buf);
+    write_unlock(&cur_part->dir_lock);
+    return ret;
+}
+
 
 /* 把分区part目录pdir中编号为inode_no的目录项删除 */
-bool delete_dir_entry(struct partition* part, struct dir* pdir, 
+static bool do_delete_dir_entry(struct partition* part, struct dir* pdir, 
                         uint32_t inode_no, void* io_buf) 
 {
     struct inode* dir_inode = pdir->inode;
@@ -463,9 +485,19 @@ bool delete_dir_entry(struct partition* part, struct dir* pdir,
     return false;
 }
 
+/* 删除目录项，持有分区目录的写锁 */
+bool delete_dir_entry(struct partition* part, struct dir* pdir, 
+                        uint32_t inode_no, void* io_buf) 
+{
+    write_lock(&part->dir_lock);
+    bool ret = do_delete_dir_entry(part, pdir, inode_no, io_buf);
+    write_unlock(&part->dir_lock);
+    return ret;
+}
+
 
 /* 读取目录，成功返回1个目录项，失败返回NULL */
-struct dir_entry* dir_read(struct dir* dir) 
+static struct dir_entry* do_dir_read(struct dir* dir) 
 {
     struct dir_entry* dir_e = (struct dir_entry*)dir->dir_buf;
     struct inode* dir_inode = dir->inode; 
@@ -542,6 +574,15 @@ struct dir_entry* dir_read(struct dir* dir)
     return NULL;
 }
 
+/* 读取目录项，持有分区目录的读锁 */
+struct dir_entry* dir_read(struct dir* dir) 
+{
+    read_lock(&cur_part->dir_lock);
+    struct dir_entry * dir_e = do_dir_read(dir);
+    read_unlock(&cur_part->dir_lock);
+    return dir_e;
+}
+
 
 /* 判断目录是否为空 */
 bool dir_is_empty(struct dir* dir) 
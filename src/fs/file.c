@@ -12,6 +12,9 @@
 #include <printk.h>
 #include <string.h>
 #include <global.h>
+#include <atomic.h>
+#include <pipe.h>
+#include <image_cache.h>
 
 
 #define DEFAULT_SECS    1
@@ -26,7 +29,8 @@ int32_t get_free_slot_in_global(void)
     uint32_t fd_idx = 3;    /* 跨过stdin, stdout, stderr */
     while (fd_idx < MAX_FILE_OPEN) 
     {
-        if (file_table[fd_idx].fd_inode == NULL)
+        if (file_table[fd_idx].fd_inode == NULL && 
+                file_table[fd_idx].fd_pipe == NULL)
         {
             break;
         }
@@ -46,7 +50,8 @@ int32_t get_free_slot_in_global(void)
  * 成功返回下标，失败返回-1 
  */
 int32_t pcb_fd_install(int32_t global_fd_idx) {
-    struct task_struct* cur = running_thread();
+    /* 同组的线程共用组长的文件描述符数组 */
+    struct task_struct* cur = running_thread()->group_leader;
     uint8_t local_fd_idx = 3;   /* 跨过stdin, stdout, stderr */
     while (local_fd_idx < MAX_FILES_OPEN_PER_PROC) 
     {
@@ -174,6 +179,7 @@ int32_t file_create(struct dir* parent_dir, char* filename, uint8_t flag)
     file_table[fd_idx].fd_inode = new_file_inode;
     file_table[fd_idx].fd_pos = 0;
     file_table[fd_idx].fd_flag = flag;
+    file_table[fd_idx].fd_refs = 1;
     file_table[fd_idx].fd_inode->write_deny = false;
 
     struct dir_entry new_dir_entry;
@@ -205,8 +211,10 @@ int32_t file_create(struct dir* parent_dir, char* filename, uint8_t flag)
     bitmap_sync(cur_part, inode_no, INODE_BITMAP);
 
     /* 5.将创建的文件i结点添加到open_inodes链表 */
+    write_lock(&cur_part->inode_lock);
     list_push(&cur_part->open_inodes, &new_file_inode->inode_tag);
     new_file_inode->i_open_cnts = 1;
+    write_unlock(&cur_part->inode_lock);
 
     sys_free(io_buf);
     return pcb_fd_install(fd_idx);
@@ -252,6 +260,7 @@ int32_t file_open(uint32_t inode_no, uint8_t flag)
     /* 每次打开文件，要将fd_pos还原为0，即让文件内的指针指向开头 */
     file_table[fd_idx].fd_pos = 0;	     
     file_table[fd_idx].fd_flag = flag;
+    file_table[fd_idx].fd_refs = 1;
     bool* write_deny = &file_table[fd_idx].fd_inode->write_deny; 
 
     /* 只要是关于写文件，判断是否有其它进程正写此文件 
@@ -298,10 +307,36 @@ int32_t file_close(struct file * file)
 }
 
 
-/* 把buf中的count个字节写入file，
+/* 文件表的第global_fd项多了一个文件描述符引用它 */
+void file_get(int32_t global_fd)
+{
+    atomic_inc(&file_table[global_fd].fd_refs);
+}
+
+/* 文件表的第global_fd项少了一个引用，最后一个引用去掉时关闭文件
+ * 成功返回0，失败返回-1
+ */
+int32_t file_put(int32_t global_fd)
+{
+    struct file * file = &file_table[global_fd];
+    if (atomic_add(&file->fd_refs, -1) != 1)
+    {
+        return 0;
+    }
+    if (file->fd_pipe != NULL)
+    {
+        pipe_close(file);
+        return 0;
+    }
+    return file_close(file);
+}
+
+
+/* file_write的主体，把buf中的count个字节写入file的数据块，
  * 成功则返回写入的字节数，失败则返回-1 
  */
-int32_t file_write(struct file *file, const void *buf, uint32_t count) 
+static int32_t file_write_blocks(struct file *file, const void *buf,
+                uint32_t count) 
 {
     /* 文件目前最大只支持512*140=71680字节 */
     if ((file->fd_inode->i_size + count) > (BLOCK_SIZE * 140))	
@@ -309,7 +344,7 @@ int32_t file_write(struct file *file, const void *buf, uint32_t count)
         printk("exceed max file_size 71680 bytes, write file failed\n");
         return -1;
     }
-    
+
     uint8_t* io_buf = sys_malloc(BLOCK_SIZE);
     if (io_buf == NULL) 
     {
@@ -586,6 +621,20 @@ int32_t file_write(struct file *file, const void *buf, uint32_t count)
     return bytes_written;
 }
 
+/* 把buf中的count个字节写入file，
+ * 成功则返回写入的字节数，失败则返回-1 
+ */
+int32_t file_write(struct file *file, const void *buf, uint32_t count) 
+{
+    /* 缓存中此文件的程序页已过时。写的过程中会睡眠，
+     * 别的进程可能在这期间读入旧的或写了一半的块加入缓存，写完后再丢一次
+     */
+    image_cache_invalidate(file->fd_inode->i_no);
+    int32_t ret = file_write_blocks(file, buf, count);
+    image_cache_invalidate(file->fd_inode->i_no);
+    return ret;
+}
+
 
 /* 从文件file中读取count个字节写入buf，
  * 返回读出的字节数，若到文件尾则返回-1 
@@ -13,9 +13,13 @@
 #include <global.h>
 #include <debug.h>
 #include <memory.h>
+#include <thread.h>
 #include <console.h>
-#include <keyboard.h>
-#include <ioqueue.h>
+#include <tty.h>
+#include <pipe.h>
+#include <vma.h>
+#include <image_cache.h>
+#include <ramdisk.h>
 
 struct partition * cur_part;    /* 默认情况下操作的是哪个分区 */
 
@@ -76,6 +80,8 @@ static bool mount_partition(struct node *pelem, int arg)
                     sb_buf->inode_bitmap_sects);
 
         list_init(&cur_part->open_inodes);
+        rwlock_init(&cur_part->inode_lock);
+        rwlock_init(&cur_part->dir_lock);
         printk("mount %s done!\n", part->name);
 
         /* 此处返回true是为了迎合主调函数list_traversal的实现，
@@ -464,7 +470,8 @@ int32_t sys_open(const char* pathname, uint8_t flags)
 /* 将文件描述符转化为文件表的下标 */
 static uint32_t fd_local2global(uint32_t local_fd) 
 {
-    struct task_struct* cur = running_thread();
+    /* 同组的线程共用组长的文件描述符数组 */
+    struct task_struct* cur = running_thread()->group_leader;
     int32_t global_fd = cur->fd_table[local_fd];  
     kassert(global_fd >= 0 && global_fd < MAX_FILE_OPEN);
     return (uint32_t)global_fd;
@@ -476,15 +483,71 @@ static uint32_t fd_local2global(uint32_t local_fd)
  */
 int32_t sys_close(int32_t fd) 
 {
-    int32_t ret = -1;    /* 返回值默认为-1，即失败 */
-    if (fd > 2) 
+    if (fd < 0 || fd >= MAX_FILES_OPEN_PER_PROC)
     {
-        uint32_t _fd = fd_local2global(fd);
-        ret = file_close(&file_table[_fd]);
-        running_thread()->fd_table[fd] = -1; /* 使该文件描述符位可用 */
+        return -1;
     }
-    
-    return ret;
+
+    /* 未打开的描述符，或没有被重定向的标准输入输出 */
+    struct task_struct* cur = running_thread()->group_leader;
+    int32_t global_fd = cur->fd_table[fd];
+    if (global_fd <= stderr_no)
+    {
+        return -1;
+    }
+
+    /* 还有异步读写在使用此文件 */
+    if (file_table[global_fd].fd_inflight > 0)
+    {
+        return -1;
+    }
+
+    /* 使该文件描述符位可用，重定向过的标准输入输出恢复为控制台 */
+    cur->fd_table[fd] = (fd <= stderr_no) ? fd : -1;
+    return file_put(global_fd);
+}
+
+
+/* 使文件描述符newfd指向oldfd所指的文件，newfd原来打开的文件先关闭
+ * 可用来把标准输入输出重定向到管道或文件，成功返回newfd，失败返回-1
+ */
+int32_t sys_dup2(int32_t oldfd, int32_t newfd)
+{
+    if (oldfd < 0 || oldfd >= MAX_FILES_OPEN_PER_PROC ||
+            newfd < 0 || newfd >= MAX_FILES_OPEN_PER_PROC)
+    {
+        return -1;
+    }
+
+    struct task_struct* cur = running_thread()->group_leader;
+    int32_t global_fd = cur->fd_table[oldfd];
+    if (global_fd == -1)
+    {
+        return -1;
+    }
+    if (oldfd == newfd)
+    {
+        return newfd;
+    }
+
+    /* newfd上还有异步读写时关闭会被拒绝，此时不能覆盖，否则原来的引用就丢了
+     * file_put出错时描述符已经释放，所以看描述符是否还在，而不是看返回值
+     */
+    int32_t old_global_fd = cur->fd_table[newfd];
+    if (old_global_fd > stderr_no)
+    {
+        sys_close(newfd);
+        if (cur->fd_table[newfd] == old_global_fd)
+        {
+            return -1;
+        }
+    }
+    if (global_fd > stderr_no)
+    {
+        file_get(global_fd);
+    }
+    cur->fd_table[newfd] = global_fd;
+    return newfd;
 }
 
 
@@ -493,21 +556,32 @@ int32_t sys_close(int32_t fd)
  */
 int32_t sys_write(int32_t fd, const void* buf, uint32_t count) 
 {
-    if (fd < 0) 
+    if (fd < 0 || fd >= MAX_FILES_OPEN_PER_PROC) 
     {
         printk("sys_write: fd error\n");
         return -1;
     }
-    if (fd == stdout_no) 
+
+    /* 标准输出可能被重定向，以描述符指向的文件表项为准 */
+    int32_t global_fd = running_thread()->group_leader->fd_table[fd];
+    if (global_fd == stdout_no) 
     {  
         char tmp_buf[1024] = {0};
         memcpy(tmp_buf, buf, count);
         console_put_str(tmp_buf);
         return count;
     }
+    if (global_fd <= stderr_no) 
+    {
+        printk("sys_write: fd error\n");
+        return -1;
+    }
 
-    uint32_t _fd = fd_local2global(fd);
-    struct file* wr_file = &file_table[_fd];
+    struct file* wr_file = &file_table[global_fd];
+    if (wr_file->fd_pipe != NULL)
+    {
+        return pipe_write(wr_file, buf, count);
+    }
 
     if (wr_file->fd_flag & O_WRONLY || wr_file->fd_flag & O_RDWR) 
     {
@@ -531,26 +605,33 @@ int32_t sys_read(int32_t fd, void* buf, uint32_t count)
     kassert(buf != NULL);
     int32_t ret = -1;
     
-    if (fd < 0 || fd == stdout_no || fd == stderr_no) 
+    /* 标准输入可能被重定向，以描述符指向的文件表项为准 */
+    int32_t global_fd = -1;
+    if (fd >= 0 && fd < MAX_FILES_OPEN_PER_PROC)
+    {
+        global_fd = running_thread()->group_leader->fd_table[fd];
+    }
+
+    if (global_fd < 0 || global_fd == stdout_no || global_fd == stderr_no) 
     {
         printk("sys_read: fd error\n");
     } 
-    else if (fd == stdin_no) 
+    else if ((uint32_t)buf < 0xc0000000 && !user_fault_in(buf, count, true))
     {
-        char* buffer = buf;
-        uint32_t bytes_read = 0;
-        while (bytes_read < count) 
-        {
-            *buffer = ioq_getchar(&kbd_buf);
-            bytes_read++;
-            buffer++;
-        }
-        ret = (bytes_read == 0 ? -1 : (int32_t)bytes_read);
+        /* 内核不能写只读的用户页，提前检查 */
+        printk("sys_read: bad buffer\n");
+    }
+    else if (global_fd == stdin_no) 
+    {
+        ret = tty_read(buf, count);
     } 
+    else if (file_table[global_fd].fd_pipe != NULL)
+    {
+        ret = pipe_read(&file_table[global_fd], buf, count);
+    }
     else 
     {
-        uint32_t _fd = fd_local2global(fd);
-        ret = file_read(&file_table[_fd], buf, count);   
+        ret = file_read(&file_table[global_fd], buf, count);   
     }
     return ret;
 }
@@ -566,6 +647,10 @@ int32_t sys_lseek(int32_t fd, int32_t offset, uint8_t whence)
         printk("sys_lseek: fd error\n");
         return -1;
     }
+    if (is_pipe(fd))
+    {
+        return -1;
+    }
     
     kassert(whence > 0 && whence < 4);
     
@@ -640,14 +725,14 @@ int32_t sys_unlink(const char* pathname)
         file_idx++;
     }
 
-    if (file_idx < MAX_FILE_OPEN) 
+    /* 正在运行的程序会按需从文件中读入页面，inode一直打开着 */
+    if (file_idx < MAX_FILE_OPEN || inode_is_open(cur_part, inode_no)) 
     {
         dir_close(searched_record.parent_dir);
         printk("file %s is in use, not allow to delete!\n", pathname);
         return -1;
     }
     
-    kassert(file_idx == MAX_FILE_OPEN);
 
     /* 为delete_dir_entry申请缓冲区 */
     void* io_buf = sys_malloc(SECTOR_SIZE + SECTOR_SIZE);
@@ -661,6 +746,7 @@ int32_t sys_unlink(const char* pathname)
     struct dir* parent_dir = searched_record.parent_dir;  
     delete_dir_entry(cur_part, parent_dir, inode_no, io_buf);
     inode_release(cur_part, inode_no);
+    image_cache_invalidate(inode_no);   /* inode号会被新文件重用 */
     sys_free(io_buf);
     dir_close(searched_record.parent_dir);
     
@@ -1030,7 +1116,7 @@ char* sys_getcwd(char* buf, uint32_t size)
 
     struct task_struct* cur_thread = running_thread();
     int32_t parent_inode_nr = 0;
-    int32_t child_inode_nr = cur_thread->cwd_inode_nr;
+    int32_t child_inode_nr = cur_thread->group_leader->cwd_inode_nr;
 
     /* 最大支持4096个inode */
     kassert(child_inode_nr >= 0 && child_inode_nr < 4096);   
@@ -1097,7 +1183,7 @@ int32_t sys_chdir(const char* path)
     {
         if (searched_record.file_type == FT_DIRECTORY)
         {
-            running_thread()->cwd_inode_nr = inode_no;
+            running_thread()->group_leader->cwd_inode_nr = inode_no;
             ret = 0;
         } 
         else 
@@ -1170,9 +1256,19 @@ void filesys_init(void)
         PANIC("alloc memory failed!\n");
     }
 
-    printk("\nsearching filesystem ... \n");
+    /* 有内存盘时根文件系统建在内存盘上，不再查找硬盘上的分区 */
+    struct partition * ram_part = ramdisk_partition();
+    if (ram_part != NULL)
+    {
+        printk("\nformatting %s ... \n", ram_part->name);
+        partition_format(ram_part);
+    }
+    else
+    {
+        printk("\nsearching filesystem ... \n");
+    }
 
-    while (channel_no < channel_cnt)
+    while (ram_part == NULL && channel_no < channel_cnt)
     {
         dev_no = 0;
         while (dev_no < 2)
@@ -1235,9 +1331,15 @@ void filesys_init(void)
 
     /* 确定默认操作的分区 */
     char default_part[8] = "sdb1";
+    if (ram_part != NULL)
+    {
+        strcpy(default_part, ram_part->name);
+    }
 
     /* 挂载分区 */
+    read_lock(&partition_list_lock);
     list_traversal(&partition_list, mount_partition, (int)default_part);
+    read_unlock(&partition_list_lock);
 
     /* 将当前分区的根目录打开 */
     open_root_dir(cur_part);
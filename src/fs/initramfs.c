@@ -0,0 +1,169 @@
+/* initramfs.c
+ *   把loader读入的initramfs解包到根文件系统
+ *
+ * initramfs是主机上用cpio -H newc打包的归档，每项依次是110字节的ascii头、
+ * 以0结尾的名字和文件内容，名字和内容都从4字节对齐处开始，
+ * 最后一项名为TRAILER!!!。只处理目录和普通文件，其余类型跳过
+ */
+
+#include <initramfs.h>
+#include <ramdisk.h>
+#include <fs.h>
+#include <string.h>
+#include <printk.h>
+#include <global.h>
+
+/* newc格式的头，数值都是8位十六进制的ascii */
+struct cpio_newc_header
+{
+    char c_magic[6];
+    char c_ino[8];
+    char c_mode[8];
+    char c_uid[8];
+    char c_gid[8];
+    char c_nlink[8];
+    char c_mtime[8];
+    char c_filesize[8];
+    char c_devmajor[8];
+    char c_devminor[8];
+    char c_rdevmajor[8];
+    char c_rdevminor[8];
+    char c_namesize[8];
+    char c_check[8];
+};
+
+#define CPIO_HDR_SIZE   sizeof(struct cpio_newc_header)
+
+/* c_mode中的文件类型 */
+#define CPIO_S_IFMT     0170000
+#define CPIO_S_IFDIR    0040000
+#define CPIO_S_IFREG    0100000
+
+#define CPIO_ALIGN(x)   (((x) + 3) & ~3)
+
+/* 只在启动时用一次，不放在栈上 */
+static char initramfs_path[MAX_PATH_LEN];
+
+/* 把8位十六进制的ascii转换为数值 */
+static uint32_t cpio_hex(const char * s)
+{
+    uint32_t val = 0;
+    uint32_t i;
+    for (i = 0; i < 8; i++)
+    {
+        char c = s[i];
+        val <<= 4;
+        if (c >= '0' && c <= '9')
+        {
+            val |= c - '0';
+        }
+        else if (c >= 'a' && c <= 'f')
+        {
+            val |= c - 'a' + 10;
+        }
+        else if (c >= 'A' && c <= 'F')
+        {
+            val |= c - 'A' + 10;
+        }
+    }
+    return val;
+}
+
+/* 建立文件path，内容为data开始的size字节，成功返回true */
+static bool initramfs_create(const char * path, const char * data, uint32_t size)
+{
+    int32_t fd = sys_open(path, O_CREAT | O_RDWR);
+    if (fd == -1)
+    {
+        return false;
+    }
+    bool ok = (size == 0 || sys_write(fd, data, size) == (int32_t)size);
+    sys_close(fd);
+    return ok;
+}
+
+/* 把initramfs中的目录和文件建立到根文件系统中，然后释放initramfs
+ * 须在filesys_init挂载内存盘之后调用，没有initramfs时什么都不做
+ */
+void initramfs_unpack(void)
+{
+    const char * archive = ramdisk_initrd();
+    if (archive == NULL)
+    {
+        return;
+    }
+
+    uint32_t archive_size = INITRD_SECTORS * SECTOR_SIZE;
+    uint32_t pos = 0;
+    uint32_t files = 0;
+    while (pos + CPIO_HDR_SIZE <= archive_size)
+    {
+        const struct cpio_newc_header * hdr =
+                    (const struct cpio_newc_header *)(archive + pos);
+        if (memcmp(hdr->c_magic, "070701", sizeof(hdr->c_magic)))
+        {
+            printk("initramfs: bad header at 0x%x\n", pos);
+            break;
+        }
+
+        /* 名字和内容都不能超出initramfs */
+        uint32_t mode = cpio_hex(hdr->c_mode);
+        uint32_t namesize = cpio_hex(hdr->c_namesize);
+        uint32_t filesize = cpio_hex(hdr->c_filesize);
+        const char * name = archive + pos + CPIO_HDR_SIZE;
+        if (namesize == 0 ||
+                namesize > archive_size - pos - CPIO_HDR_SIZE ||
+                name[namesize - 1] != 0)
+        {
+            printk("initramfs: bad name at 0x%x\n", pos);
+            break;
+        }
+        uint32_t data_off = CPIO_ALIGN(pos + CPIO_HDR_SIZE + namesize);
+        if (data_off > archive_size || filesize > archive_size - data_off)
+        {
+            printk("initramfs: %s is truncated\n", name);
+            break;
+        }
+        if (!strcmp(name, "TRAILER!!!"))
+        {
+            break;
+        }
+
+        /* 归档中的名字相对于根目录，可能以./或/开头 */
+        if (name[0] == '.' && name[1] == '/')
+        {
+            name += 2;
+        }
+        while (name[0] == '/')
+        {
+            name++;
+        }
+
+        if (name[0] != 0 && strcmp(name, ".") &&
+                strlen(name) + 1 < MAX_PATH_LEN)
+        {
+            initramfs_path[0] = '/';
+            strcpy(initramfs_path + 1, name);
+            if ((mode & CPIO_S_IFMT) == CPIO_S_IFDIR)
+            {
+                sys_mkdir(initramfs_path);
+            }
+            else if ((mode & CPIO_S_IFMT) == CPIO_S_IFREG)
+            {
+                if (initramfs_create(initramfs_path, archive + data_off,
+                            filesize))
+                {
+                    files++;
+                }
+                else
+                {
+                    printk("initramfs: create %s failed\n", initramfs_path);
+                }
+            }
+        }
+        pos = CPIO_ALIGN(data_off + filesize);
+    }
+
+    printk("initramfs: %d files unpacked\n", files);
+    ramdisk_initrd_free();
+}
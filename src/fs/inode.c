@@ -7,11 +7,13 @@
 #include <global.h>
 #include <debug.h>
 #include <memory.h>
+#include <thread.h>
 #include <interrupt.h>
 #include <list.h>
 #include <printk.h>
 #include <string.h>
 #include <super_block.h>
+#include <atomic.h>
 
 /* 用来定位inode在磁盘上的位置 */
 struct inode_position {
@@ -111,24 +113,75 @@ void inode_sync(struct partition *part, struct inode *inode, void *io_buf)
 }
 
 
-/* 根据i结点号返回相应的i结点 */
-struct inode * inode_open(struct partition *part, uint32_t inode_no) 
+/* 在分区part的已打开inode链表中查找i结点号为inode_no的inode，
+ * 找到则增加其打开次数并返回，否则返回NULL
+ * 调用时已持有part->inode_lock，持有读锁时可能有多个线程同时查找，
+ * 所以打开次数要原子地增加
+ */
+static struct inode * inode_find_open(struct partition * part, 
+                uint32_t inode_no)
 {
-    /* 先在已打开inode链表中找inode，
-     * 此链表是为提速而在内存中创建的缓冲区 
-     */
     struct node * elem = part->open_inodes.head.next;
-    struct inode * inode_found;
     while (elem != &part->open_inodes.tail) 
     {
-        inode_found = container_of(struct inode, inode_tag, elem);
+        struct inode * inode_found = container_of(struct inode, 
+                    inode_tag, elem);
         if (inode_found->i_no == inode_no) 
         {
-            inode_found->i_open_cnts++;
+            atomic_inc(&inode_found->i_open_cnts);
             return inode_found;
         }
         elem = elem->next;
     }
+    return NULL;
+}
+
+/* 分区part上i结点号为inode_no的inode是否有人打开着 */
+bool inode_is_open(struct partition * part, uint32_t inode_no)
+{
+    bool found = false;
+    read_lock(&part->inode_lock);
+    struct node * elem = part->open_inodes.head.next;
+    while (elem != &part->open_inodes.tail) 
+    {
+        if (container_of(struct inode, inode_tag, elem)->i_no == inode_no) 
+        {
+            found = true;
+            break;
+        }
+        elem = elem->next;
+    }
+    read_unlock(&part->inode_lock);
+    return found;
+}
+
+/* 释放inode_open时在内核内存池中分配的inode */
+static void inode_free(struct inode * inode)
+{
+    /* inode_open时为实现inode被所有进程共享，
+     * 已经在sys_malloc为inode分配了内核空间，
+     * 释放inode时也要确保释放的是内核内存池 
+     */
+    struct task_struct* cur = running_thread();
+    uint32_t* cur_pagedir_bak = cur->pgdir;
+    cur->pgdir = NULL;
+    sys_free(inode);
+    cur->pgdir = cur_pagedir_bak;
+}
+
+/* 根据i结点号返回相应的i结点 */
+struct inode * inode_open(struct partition *part, uint32_t inode_no) 
+{
+    /* 先在已打开inode链表中找inode，
+     * 此链表是为提速而在内存中创建的缓冲区，查找时只需读锁
+     */
+    read_lock(&part->inode_lock);
+    struct inode * inode_found = inode_find_open(part, inode_no);
+    read_unlock(&part->inode_lock);
+    if (inode_found != NULL)
+    {
+        return inode_found;
+    }
 
     /*由于open_inodes链表中找不到，下面从硬盘上读入此inode并加入到此链表 */
     struct inode_position inode_pos;
@@ -168,35 +221,41 @@ struct inode * inode_open(struct partition *part, uint32_t inode_no)
     }
     memcpy(inode_found, inode_buf + inode_pos.off_size, sizeof(struct inode));
 
+    sys_free(inode_buf);
+
+    /* 读盘期间别的线程可能已打开了同一inode，加写锁后再查找一次 */
+    write_lock(&part->inode_lock);
+    struct inode * inode_exist = inode_find_open(part, inode_no);
+    if (inode_exist != NULL)
+    {
+        write_unlock(&part->inode_lock);
+        inode_free(inode_found);
+        return inode_exist;
+    }
+
     /* 因为一会很可能要用到此inode，故将其插入到队首便于提前检索到 */
     list_push(&part->open_inodes, &inode_found->inode_tag);
     inode_found->i_open_cnts = 1;
+    write_unlock(&part->inode_lock);
 
-    sys_free(inode_buf);
     return inode_found;
 }
 
 /* 关闭inode或减少inode的打开数 */
 void inode_close(struct inode * inode) 
 {
-    /* 若没有进程再打开此文件，将此inode去掉并释放空间 */
-    intr_status old_status = intr_disable();
+    /* 若没有进程再打开此文件，将此inode去掉并释放空间
+     * 加写锁，防止别的线程在链表中查找到此inode并增加打开次数。
+     * inode中没有记录所属分区，inode都是在cur_part上打开的
+     */
+    write_lock(&cur_part->inode_lock);
     if (--inode->i_open_cnts == 0) 
     {
         /* 将I结点从part->open_inodes中去掉 */
         list_remove(&inode->inode_tag);	  
-        
-        /* inode_open时为实现inode被所有进程共享，
-         * 已经在sys_malloc为inode分配了内核空间，
-         * 释放inode时也要确保释放的是内核内存池 
-         */
-        struct task_struct* cur = running_thread();
-        uint32_t* cur_pagedir_bak = cur->pgdir;
-        cur->pgdir = NULL;
-        sys_free(inode);
-        cur->pgdir = cur_pagedir_bak;
+        inode_free(inode);
     }
-    intr_set_status(old_status);
+    write_unlock(&cur_part->inode_lock);
 }
 
 
@@ -0,0 +1,403 @@
+/* ioring.c
+ *   批量异步提交文件操作的环形队列
+ *
+ * ring_enter在进程上下文中逐个取出提交项：
+ * open/close/stat和标准输入输出、管道的读写直接执行并写入完成队列；
+ * 文件的读写交给io_wq的工作线程，数据经内核缓冲区中转，
+ * 因为工作线程用的是内核页表，访问不到进程的用户空间。
+ * 工作线程做完后把请求挂到done链表，
+ * 由之后的ring_enter在进程上下文中拷回数据并写入完成队列
+ */
+
+#include <ioring.h>
+#include <thread.h>
+#include <memory.h>
+#include <workqueue.h>
+#include <sync.h>
+#include <spinlock.h>
+#include <interrupt.h>
+#include <fs.h>
+#include <file.h>
+#include <string.h>
+#include <debug.h>
+#include <global.h>
+#include <pipe.h>
+#include <vma.h>
+
+/* 交给工作线程的一次读写 */
+struct io_req
+{
+    struct work_struct work;
+    struct node tag;            /* 在ctx的free_reqs或done链表中的结点 */
+    struct io_ring_ctx * ctx;
+    uint8_t opcode;
+    struct file * file;
+    void * kbuf;                /* 内核中转缓冲区 */
+    void * ubuf;                /* 进程的缓冲区 */
+    uint32_t len;
+    int32_t res;
+    uint32_t user_data;
+};
+
+/* 每个进程的环的内核部分 */
+struct io_ring_ctx
+{
+    struct io_ring * ring;      /* 进程空间中的共享页 */
+    struct lock enter_lock;     /* 串行化同一进程的ring_enter */
+    struct list free_reqs;      /* 空闲的请求，由enter_lock保护 */
+    uint32_t inflight;          /* 交给工作线程、还未写入完成队列的请求数 */
+
+    struct spinlock lock;       /* 保护done和wq，工作线程也会访问 */
+    struct list done;           /* 工作线程已完成的请求 */
+    struct wait_queue wq;       /* 等待完成的进程 */
+
+    struct io_req reqs[IORING_ENTRIES];
+};
+
+/* 执行异步读写的工作队列
+ * 文件系统没有针对并发写同一文件的保护，只用一个工作线程，
+ * 请求按提交的顺序执行
+ */
+static struct workqueue * io_wq;
+
+/* 工作线程中执行一次读写 */
+static void io_req_work(void * arg)
+{
+    struct io_req * req = arg;
+    struct io_ring_ctx * ctx = req->ctx;
+
+    if (req->opcode == IORING_OP_READ)
+    {
+        req->res = file_read(req->file, req->kbuf, req->len);
+    }
+    else
+    {
+        req->res = file_write(req->file, req->kbuf, req->len);
+    }
+
+    intr_status old_status = spin_lock_irqsave(&ctx->lock);
+    list_append(&ctx->done, &req->tag);
+    wait_queue_wake_one(&ctx->wq);
+    spin_unlock_irqrestore(&ctx->lock, old_status);
+}
+
+/* 写入一个完成项，调用者已保证完成队列有空位 */
+static void io_post_cqe(struct io_ring * ring, uint32_t user_data, int32_t res)
+{
+    uint32_t tail = ring->cq_tail;
+    ring->cqes[tail & IORING_MASK].user_data = user_data;
+    ring->cqes[tail & IORING_MASK].res = res;
+
+    /* 先写完成项再移动队尾 */
+    asm volatile ("" : : : "memory");
+    ring->cq_tail = tail + 1;
+}
+
+/* 将进程的文件描述符fd转换为文件表中的文件，无效时返回NULL */
+static struct file * io_fd2file(int32_t fd)
+{
+    if (fd <= stderr_no || fd >= MAX_FILES_OPEN_PER_PROC)
+    {
+        return NULL;
+    }
+    int32_t global_fd = running_thread()->group_leader->fd_table[fd];
+    if (global_fd < 0 || global_fd >= MAX_FILE_OPEN ||
+            file_table[global_fd].fd_inode == NULL)
+    {
+        return NULL;
+    }
+    return &file_table[global_fd];
+}
+
+/* 把文件读写交给工作线程，成功返回true
+ * 失败时不占用请求，由调用者直接写入出错的完成项
+ */
+static bool io_queue_rw(struct io_ring_ctx * ctx, struct io_sqe * sqe)
+{
+    struct file * file = io_fd2file(sqe->fd);
+    if (file == NULL)
+    {
+        return false;
+    }
+    if (sqe->opcode == IORING_OP_WRITE &&
+            !(file->fd_flag & O_WRONLY || file->fd_flag & O_RDWR))
+    {
+        return false;
+    }
+
+    /* 完成时才拷回用户缓冲区，先确认它可写 */
+    if (sqe->opcode == IORING_OP_READ &&
+            !user_fault_in(sqe->addr, sqe->len, true))
+    {
+        return false;
+    }
+
+    void * kbuf = kmalloc(sqe->len);
+    if (kbuf == NULL)
+    {
+        return false;
+    }
+    if (sqe->opcode == IORING_OP_WRITE)
+    {
+        memcpy(kbuf, sqe->addr, sqe->len);
+    }
+
+    /* 提交前已保证在途请求数小于IORING_ENTRIES */
+    struct io_req * req = container_of(struct io_req, tag,
+                list_pop(&ctx->free_reqs));
+    req->opcode = sqe->opcode;
+    req->file = file;
+    req->kbuf = kbuf;
+    req->ubuf = sqe->addr;
+    req->len = sqe->len;
+    req->res = -1;
+    req->user_data = sqe->user_data;
+
+    /* 读写完成之前不允许关闭此文件 */
+    file->fd_inflight++;
+    ctx->inflight++;
+    queue_work(io_wq, &req->work);
+    return true;
+}
+
+/* 处理一个提交项，同步完成的写入完成队列，返回写入的完成项数 */
+static uint32_t io_submit_sqe(struct io_ring_ctx * ctx, struct io_sqe * sqe)
+{
+    int32_t res = -1;
+
+    switch (sqe->opcode)
+    {
+    case IORING_OP_NOP:
+        res = 0;
+        break;
+
+    case IORING_OP_READ:
+    case IORING_OP_WRITE:
+        if (sqe->len == 0)
+        {
+            res = 0;
+        }
+        else if (sqe->fd == stdin_no && sqe->opcode == IORING_OP_READ)
+        {
+            res = sys_read(sqe->fd, sqe->addr, sqe->len);
+        }
+        else if (sqe->fd == stdout_no && sqe->opcode == IORING_OP_WRITE)
+        {
+            res = sys_write(sqe->fd, sqe->addr, sqe->len);
+        }
+        else if (is_pipe(sqe->fd))
+        {
+            /* 管道的缓冲区在内核中，直接在进程上下文中读写 */
+            res = (sqe->opcode == IORING_OP_READ) ?
+                        sys_read(sqe->fd, sqe->addr, sqe->len) :
+                        sys_write(sqe->fd, sqe->addr, sqe->len);
+        }
+        else if (io_queue_rw(ctx, sqe))
+        {
+            return 0;
+        }
+        break;
+
+    case IORING_OP_OPEN:
+        res = sys_open(sqe->addr, sqe->flags);
+        break;
+
+    case IORING_OP_CLOSE:
+        res = sys_close(sqe->fd);
+        break;
+
+    case IORING_OP_STAT:
+        res = sys_stat(sqe->addr, sqe->addr2);
+        break;
+
+    default:
+        break;
+    }
+
+    io_post_cqe(ctx->ring, sqe->user_data, res);
+    return 1;
+}
+
+/* 回收工作线程做完的请求，post为true时写入完成队列，
+ * 返回回收的请求数
+ */
+static uint32_t io_reap(struct io_ring_ctx * ctx, bool post)
+{
+    uint32_t cnt = 0;
+
+    while (true)
+    {
+        intr_status old_status = spin_lock_irqsave(&ctx->lock);
+        if (list_empty(&ctx->done))
+        {
+            spin_unlock_irqrestore(&ctx->lock, old_status);
+            break;
+        }
+        struct io_req * req = container_of(struct io_req, tag,
+                    list_pop(&ctx->done));
+        spin_unlock_irqrestore(&ctx->lock, old_status);
+
+        /* 回到进程上下文后才能把数据拷回用户空间 */
+        if (post)
+        {
+            if (req->opcode == IORING_OP_READ && req->res > 0)
+            {
+                memcpy(req->ubuf, req->kbuf, req->res);
+            }
+            io_post_cqe(ctx->ring, req->user_data, req->res);
+        }
+
+        kfree(req->kbuf);
+        req->file->fd_inflight--;
+        list_append(&ctx->free_reqs, &req->tag);
+        ctx->inflight--;
+        cnt++;
+    }
+    return cnt;
+}
+
+/* 睡眠到有请求完成 */
+static void io_wait(struct io_ring_ctx * ctx)
+{
+    intr_status old_status = spin_lock_irqsave(&ctx->lock);
+    while (list_empty(&ctx->done))
+    {
+        wait_queue_sleep(&ctx->wq, &ctx->lock);
+    }
+    spin_unlock_irqrestore(&ctx->lock, old_status);
+}
+
+/* 为当前进程建立环，返回映射到进程空间的共享页，失败返回NULL
+ * 已建立过则返回原来的共享页
+ */
+struct io_ring * sys_ring_setup(void)
+{
+    struct task_struct * cur = running_thread();
+
+    if (cur->ioring != NULL)
+    {
+        return cur->ioring->ring;
+    }
+
+    /* 共享页在进程的用户空间中，内核线程不能使用 */
+    if (cur->pgdir == NULL)
+    {
+        return NULL;
+    }
+
+    struct io_ring_ctx * ctx = kmalloc(sizeof(struct io_ring_ctx));
+    if (ctx == NULL)
+    {
+        return NULL;
+    }
+    ctx->ring = get_user_pages(DIV_ROUND_UP(sizeof(struct io_ring), PG_SIZE));
+    if (ctx->ring == NULL)
+    {
+        kfree(ctx);
+        return NULL;
+    }
+
+    lock_init(&ctx->enter_lock);
+    list_init(&ctx->free_reqs);
+    ctx->inflight = 0;
+    spin_init(&ctx->lock);
+    list_init(&ctx->done);
+    wait_queue_init(&ctx->wq);
+
+    uint32_t i;
+    for (i = 0; i < IORING_ENTRIES; i++)
+    {
+        ctx->reqs[i].ctx = ctx;
+        work_init(&ctx->reqs[i].work, io_req_work, &ctx->reqs[i]);
+        list_append(&ctx->free_reqs, &ctx->reqs[i].tag);
+    }
+
+    cur->ioring = ctx;
+    return ctx->ring;
+}
+
+/* 提交最多to_submit个提交项，并等到至少min_complete个完成项写入完成队列
+ * 没有在途的请求时不再等待。返回提交的个数，没有建立环时返回-1
+ */
+int32_t sys_ring_enter(uint32_t to_submit, uint32_t min_complete)
+{
+    struct io_ring_ctx * ctx = running_thread()->ioring;
+    if (ctx == NULL)
+    {
+        return -1;
+    }
+
+    struct io_ring * ring = ctx->ring;
+    uint32_t submitted = 0;
+    uint32_t completed = 0;
+
+    lock_acquire(&ctx->enter_lock);
+
+    while (submitted < to_submit)
+    {
+        uint32_t head = ring->sq_head;
+        if (head == ring->sq_tail)
+        {
+            break;
+        }
+
+        /* 在途的请求加上未取走的完成项不超过完成队列的大小，
+         * 保证每个请求完成时都有空位
+         */
+        if (ctx->inflight + (ring->cq_tail - ring->cq_head) >= IORING_ENTRIES)
+        {
+            break;
+        }
+
+        /* 复制一份，避免处理过程中进程改动提交项 */
+        struct io_sqe sqe;
+        asm volatile ("" : : : "memory");
+        memcpy(&sqe, &ring->sqes[head & IORING_MASK], sizeof(sqe));
+        ring->sq_head = head + 1;
+
+        completed += io_submit_sqe(ctx, &sqe);
+        submitted++;
+    }
+
+    completed += io_reap(ctx, true);
+    while (completed < min_complete && ctx->inflight > 0)
+    {
+        io_wait(ctx);
+        completed += io_reap(ctx, true);
+    }
+
+    lock_release(&ctx->enter_lock);
+    return submitted;
+}
+
+/* exec时丢弃进程的环，等待在途的请求做完再释放
+ * 共享页和其它用户内存一样留在进程空间中
+ */
+void ioring_release(struct task_struct * pthread)
+{
+    struct io_ring_ctx * ctx = pthread->ioring;
+    if (ctx == NULL)
+    {
+        return;
+    }
+
+    /* 不再写入完成队列，只释放请求 */
+    lock_acquire(&ctx->enter_lock);
+    io_reap(ctx, false);
+    while (ctx->inflight > 0)
+    {
+        io_wait(ctx);
+        io_reap(ctx, false);
+    }
+    lock_release(&ctx->enter_lock);
+
+    pthread->ioring = NULL;
+    kfree(ctx);
+}
+
+/* 创建执行异步读写的工作队列 */
+void ioring_init(void)
+{
+    io_wq = workqueue_create("io_wq", 1);
+    kassert(io_wq != NULL);
+}
@@ -0,0 +1,254 @@
+/* pipe.c
+ *   进程间传递字节流的管道
+ *
+ * 读写都在管道的自旋锁内整块memcpy，一次最多两段（环形缓冲区绕回时）。
+ * 缓冲区空时读者睡眠，写端全部关闭后读到结尾；
+ * 缓冲区满时写者睡眠，读端全部关闭后写入失败
+ */
+
+#include <pipe.h>
+#include <file.h>
+#include <fs.h>
+#include <thread.h>
+#include <memory.h>
+#include <vma.h>
+#include <interrupt.h>
+#include <string.h>
+#include <global.h>
+#include <poll.h>
+
+/* 判断进程的文件描述符local_fd是否指向管道 */
+bool is_pipe(int32_t local_fd)
+{
+    if (local_fd < 0 || local_fd >= MAX_FILES_OPEN_PER_PROC)
+    {
+        return false;
+    }
+    int32_t global_fd = running_thread()->group_leader->fd_table[local_fd];
+    return global_fd > stderr_no && global_fd < MAX_FILE_OPEN &&
+                file_table[global_fd].fd_pipe != NULL;
+}
+
+/* 把文件表的第global_fd项设为管道p的一端 */
+static void pipe_file_init(int32_t global_fd, struct pipe * p, uint8_t flag)
+{
+    file_table[global_fd].fd_inode = NULL;
+    file_table[global_fd].fd_pipe = p;
+    file_table[global_fd].fd_pos = 0;
+    file_table[global_fd].fd_flag = flag;
+    file_table[global_fd].fd_refs = 1;
+    file_table[global_fd].fd_inflight = 0;
+}
+
+/* 创建管道，pipefd[0]为读端，pipefd[1]为写端，成功返回0，失败返回-1 */
+int32_t sys_pipe(int32_t pipefd[2])
+{
+    struct pipe * p = kmalloc(sizeof(struct pipe));
+    if (p == NULL)
+    {
+        return -1;
+    }
+    p->buf = get_kernel_pages(PIPE_PAGES);
+    if (p->buf == NULL)
+    {
+        kfree(p);
+        return -1;
+    }
+    spin_init(&p->lock);
+    p->head = p->tail = 0;
+    p->readers = p->writers = 1;
+    wait_queue_init(&p->rd_wq);
+    wait_queue_init(&p->wr_wq);
+
+    /* 先占住读端的项，再找写端的项 */
+    int32_t rd = get_free_slot_in_global();
+    if (rd == -1)
+    {
+        goto free_pipe;
+    }
+    pipe_file_init(rd, p, O_RDONLY);
+
+    int32_t wr = get_free_slot_in_global();
+    if (wr == -1)
+    {
+        goto free_rd;
+    }
+    pipe_file_init(wr, p, O_WRONLY);
+
+    pipefd[0] = pcb_fd_install(rd);
+    if (pipefd[0] == -1)
+    {
+        goto free_wr;
+    }
+    pipefd[1] = pcb_fd_install(wr);
+    if (pipefd[1] == -1)
+    {
+        running_thread()->group_leader->fd_table[pipefd[0]] = -1;
+        goto free_wr;
+    }
+    return 0;
+
+free_wr:
+    file_table[wr].fd_pipe = NULL;
+free_rd:
+    file_table[rd].fd_pipe = NULL;
+free_pipe:
+    mfree_page(PF_KERNEL, p->buf, PIPE_PAGES);
+    kfree(p);
+    return -1;
+}
+
+/* 从管道中读出最多count个字节，缓冲区空时等待写入
+ * 返回读出的字节数，写端都已关闭且没有数据时返回-1
+ */
+int32_t pipe_read(struct file * file, void * buf, uint32_t count)
+{
+    struct pipe * p = file->fd_pipe;
+    if (count == 0)
+    {
+        return 0;
+    }
+
+    /* 持有自旋锁时不能缺页，先映射好缓冲区 */
+    if (!user_fault_in(buf, count, true))
+    {
+        return -1;
+    }
+
+    intr_status old_status = spin_lock_irqsave(&p->lock);
+    while (p->head == p->tail)
+    {
+        if (p->writers == 0)
+        {
+            spin_unlock_irqrestore(&p->lock, old_status);
+            return -1;
+        }
+        wait_queue_sleep(&p->rd_wq, &p->lock);
+    }
+
+    uint32_t avail = p->tail - p->head;
+    uint32_t n = count < avail ? count : avail;
+    uint32_t off = p->head % PIPE_SIZE;
+    uint32_t chunk = n < PIPE_SIZE - off ? n : PIPE_SIZE - off;
+
+    memcpy(buf, p->buf + off, chunk);
+    memcpy((char *)buf + chunk, p->buf, n - chunk);
+    p->head += n;
+
+    wait_queue_wake_all(&p->wr_wq);
+    spin_unlock_irqrestore(&p->lock, old_status);
+    return n;
+}
+
+/* 把buf中的count个字节全部写入管道，缓冲区满时等待读出
+ * 返回写入的字节数，读端都已关闭时返回已写入的字节数，一个都没写入则返回-1
+ */
+int32_t pipe_write(struct file * file, const void * buf, uint32_t count)
+{
+    struct pipe * p = file->fd_pipe;
+    const char * src = buf;
+    uint32_t written = 0;
+    if (count == 0)
+    {
+        return 0;
+    }
+    if (!user_fault_in(buf, count, false))
+    {
+        return -1;
+    }
+
+    intr_status old_status = spin_lock_irqsave(&p->lock);
+    while (written < count && p->readers > 0)
+    {
+        uint32_t space = PIPE_SIZE - (p->tail - p->head);
+        if (space == 0)
+        {
+            wait_queue_sleep(&p->wr_wq, &p->lock);
+            continue;
+        }
+
+        uint32_t n = count - written < space ? count - written : space;
+        uint32_t off = p->tail % PIPE_SIZE;
+        uint32_t chunk = n < PIPE_SIZE - off ? n : PIPE_SIZE - off;
+
+        memcpy(p->buf + off, src + written, chunk);
+        memcpy(p->buf, src + written + chunk, n - chunk);
+        p->tail += n;
+        written += n;
+
+        wait_queue_wake_all(&p->rd_wq);
+    }
+    spin_unlock_irqrestore(&p->lock, old_status);
+
+    return written > 0 ? (int32_t)written : -1;
+}
+
+/* 文件表中管道的一端的最后一个引用去掉时调用，两端都关闭后释放管道 */
+void pipe_close(struct file * file)
+{
+    struct pipe * p = file->fd_pipe;
+
+    intr_status old_status = spin_lock_irqsave(&p->lock);
+    if (file->fd_flag == O_RDONLY)
+    {
+        p->readers--;
+    }
+    else
+    {
+        p->writers--;
+    }
+    /* 让对端的读者看到结尾、写者看到读端已关闭 */
+    wait_queue_wake_all(&p->rd_wq);
+    wait_queue_wake_all(&p->wr_wq);
+    bool release = (p->readers == 0 && p->writers == 0);
+    spin_unlock_irqrestore(&p->lock, old_status);
+
+    file->fd_pipe = NULL;
+    if (release)
+    {
+        mfree_page(PF_KERNEL, p->buf, PIPE_PAGES);
+        kfree(p);
+    }
+}
+
+/* 检查管道的一端上发生的事件，pe不为NULL时登记到这一端等待的队列上 */
+int16_t pipe_poll(struct file * file, int16_t events, struct poll_entry * pe)
+{
+    struct pipe * p = file->fd_pipe;
+    int16_t revents = 0;
+
+    intr_status old_status = spin_lock_irqsave(&p->lock);
+    if (file->fd_flag == O_RDONLY)
+    {
+        if (p->tail != p->head)
+        {
+            revents |= POLLIN;
+        }
+        if (p->writers == 0)
+        {
+            revents |= POLLIN | POLLHUP;
+        }
+        if (pe != NULL)
+        {
+            poll_wait(pe, &p->rd_wq, &p->lock);
+        }
+    }
+    else
+    {
+        if (p->readers == 0)
+        {
+            revents |= POLLERR;
+        }
+        else if (p->tail - p->head < PIPE_SIZE)
+        {
+            revents |= POLLOUT;
+        }
+        if (pe != NULL)
+        {
+            poll_wait(pe, &p->wr_wq, &p->lock);
+        }
+    }
+    spin_unlock_irqrestore(&p->lock, old_status);
+
+    return revents & events;
+}
@@ -0,0 +1,218 @@
+/* poll.c
+ *   同时等待多个文件描述符可读写
+ *
+ * 第一遍检查时把每个描述符的登记项挂到对应的等待队列上，
+ * 之后任何一个队列被唤醒都会把poll_table的triggered置位并唤醒调用者，
+ * 调用者醒来后重新检查，直到有描述符就绪或超时，最后把登记项全部取下
+ */
+
+#include <poll.h>
+#include <thread.h>
+#include <memory.h>
+#include <vma.h>
+#include <file.h>
+#include <fs.h>
+#include <pipe.h>
+#include <tty.h>
+#include <timer.h>
+#include <interrupt.h>
+#include <spinlock.h>
+#include <debug.h>
+#include <global.h>
+
+/* 一次poll调用的状态，在调用者的内核栈上 */
+struct poll_table
+{
+    struct spinlock lock;       /* 保护以下各项 */
+    struct task_struct * task;
+    bool triggered;             /* 上次检查之后有队列被唤醒过 */
+    bool sleeping;              /* 调用者已阻塞，等待唤醒 */
+    bool timed_out;
+};
+
+/* 唤醒阻塞在pt上的调用者，调用时已关中断 */
+static void poll_trigger(struct poll_table * pt, bool timeout)
+{
+    spin_lock(&pt->lock);
+    pt->triggered = true;
+    if (timeout)
+    {
+        pt->timed_out = true;
+    }
+    if (pt->sleeping)
+    {
+        pt->sleeping = false;
+        thread_unblock(pt->task);
+    }
+    spin_unlock(&pt->lock);
+}
+
+/* 登记的等待队列被唤醒时调用 */
+static void poll_wake(struct wait_entry * entry)
+{
+    struct poll_entry * pe = container_of(struct poll_entry, entry, entry);
+    poll_trigger(pe->pt, false);
+}
+
+/* 超时的定时器 */
+static void poll_timeout(void * arg)
+{
+    poll_trigger(arg, true);
+}
+
+/* 把pe登记到wq上，调用时已持有保护wq的锁lock
+ * 由各文件的检查函数调用，每个登记项只登记一次
+ */
+void poll_wait(struct poll_entry * pe, struct wait_queue * wq,
+            struct spinlock * lock)
+{
+    kassert(pe->lock == NULL);
+    pe->entry.func = poll_wake;
+    pe->lock = lock;
+    wait_queue_add_entry(wq, &pe->entry);
+}
+
+/* 检查进程的文件描述符fd上发生的事件，pe不为NULL时顺便登记 */
+static int16_t fd_poll(int32_t fd, int16_t events, struct poll_entry * pe)
+{
+    if (fd < 0 || fd >= MAX_FILES_OPEN_PER_PROC)
+    {
+        return POLLNVAL;
+    }
+    int32_t global_fd = running_thread()->group_leader->fd_table[fd];
+
+    /* 没有重定向的标准输入输出是控制台 */
+    if (global_fd == stdin_no)
+    {
+        return (events & POLLIN) ? tty_poll(pe) : 0;
+    }
+    if (global_fd == stdout_no || global_fd == stderr_no)
+    {
+        return events & POLLOUT;
+    }
+    if (global_fd < 0 || global_fd >= MAX_FILE_OPEN)
+    {
+        return POLLNVAL;
+    }
+
+    struct file * file = &file_table[global_fd];
+    if (file->fd_pipe != NULL)
+    {
+        return pipe_poll(file, events, pe);
+    }
+    if (file->fd_inode == NULL)
+    {
+        return POLLNVAL;
+    }
+
+    /* 普通文件的读写不会等待，总是就绪 */
+    int16_t revents = POLLIN;
+    if (file->fd_flag & O_WRONLY || file->fd_flag & O_RDWR)
+    {
+        revents |= POLLOUT;
+    }
+    return revents & events;
+}
+
+/* 等待fds中的nfds个文件描述符上发生关心的事件，最多等timeout毫秒，
+ * 为0时只检查一遍，为负数时一直等待。
+ * 返回发生了事件的描述符数，超时返回0，参数错误返回-1
+ */
+int32_t sys_poll(struct pollfd * fds, uint32_t nfds, int32_t timeout)
+{
+    if (nfds == 0 || nfds > MAX_FILES_OPEN_PER_PROC ||
+            !user_fault_in(fds, nfds * sizeof(struct pollfd), true))
+    {
+        return -1;
+    }
+
+    struct poll_table pt;
+    spin_init(&pt.lock);
+    pt.task = running_thread();
+    pt.triggered = false;
+    pt.sleeping = false;
+    pt.timed_out = false;
+
+    struct poll_entry pes[MAX_FILES_OPEN_PER_PROC];
+    int32_t pipe_fds[MAX_FILES_OPEN_PER_PROC];
+    uint32_t i;
+    for (i = 0; i < nfds; i++)
+    {
+        pes[i].pt = &pt;
+        pes[i].lock = NULL;
+
+        /* 等待期间别的线程可能关闭管道，持有一个引用 */
+        pipe_fds[i] = -1;
+        if (is_pipe(fds[i].fd))
+        {
+            pipe_fds[i] = pt.task->group_leader->fd_table[fds[i].fd];
+            file_get(pipe_fds[i]);
+        }
+    }
+
+    struct timer timer;
+    if (timeout > 0)
+    {
+        timer.func = poll_timeout;
+        timer.arg = &pt;
+        timer_add(&timer, msecs_to_ticks(timeout));
+    }
+
+    int32_t cnt;
+    bool first = true;
+    while (true)
+    {
+        intr_status old_status = spin_lock_irqsave(&pt.lock);
+        pt.triggered = false;
+        spin_unlock_irqrestore(&pt.lock, old_status);
+
+        cnt = 0;
+        for (i = 0; i < nfds; i++)
+        {
+            /* 只在第一遍登记，之后登记项一直留在队列上 */
+            fds[i].revents = fd_poll(fds[i].fd, fds[i].events | POLLERR | POLLHUP,
+                        (first && timeout != 0) ? &pes[i] : NULL);
+            if (fds[i].revents != 0)
+            {
+                cnt++;
+            }
+        }
+        first = false;
+
+        if (cnt > 0 || timeout == 0 || pt.timed_out)
+        {
+            break;
+        }
+
+        old_status = spin_lock_irqsave(&pt.lock);
+        if (!pt.triggered)
+        {
+            pt.sleeping = true;
+            thread_block_unlock(TASK_BLOCKED, &pt.lock);
+        }
+        else
+        {
+            spin_unlock(&pt.lock);
+        }
+        intr_set_status(old_status);
+    }
+
+    if (timeout > 0)
+    {
+        timer_del(&timer);
+    }
+    for (i = 0; i < nfds; i++)
+    {
+        if (pes[i].lock != NULL)
+        {
+            intr_status old_status = spin_lock_irqsave(pes[i].lock);
+            wait_queue_del_entry(&pes[i].entry);
+            spin_unlock_irqrestore(pes[i].lock, old_status);
+        }
+        if (pipe_fds[i] != -1)
+        {
+            file_put(pipe_fds[i]);
+        }
+    }
+    return cnt;
+}
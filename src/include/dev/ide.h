@@ -19,6 +19,8 @@ struct partition {
     bitmap block_bm;            /* 块位图 */
     bitmap inode_bm;            /* i结点位图 */
     struct list open_inodes;    /* 本分区打开的i结点队列 */
+    struct rwlock inode_lock;   /* 保护open_inodes */
+    struct rwlock dir_lock;     /* 保护本分区各目录的目录项 */
 };
 
 /* 硬盘结构 */
@@ -30,6 +32,8 @@ struct disk {
 
     /* 逻辑分区数量无限，本系统暂支持8个 */
     struct partition logic_parts[8];
+
+    uint8_t * ram_base; /* 内存盘的存储区，硬盘为NULL，见ramdisk.c */
 };
 
 /* ide/ata通道结构 */
@@ -39,6 +43,7 @@ struct ide_channel {
     uint8_t  irq_no;    /* 本通道所用的中断号 */
     struct lock lock;           /* 通道锁 */
     bool expecting_intr;        /* 表示等待硬盘的中断 */
+    volatile bool intr_done;    /* 中断已到来，待软中断唤醒驱动程序 */
     struct semaphore disk_done; /* 用于阻塞、唤醒驱动程序 */
     struct disk devices[2];     /* 一个通道上连接两个硬盘，一主一从 */
 };
@@ -47,6 +52,7 @@ struct ide_channel {
 extern uint8_t channel_cnt;
 extern struct ide_channel channels[];
 extern struct list partition_list;
+extern struct rwlock partition_list_lock;
 
 void intr_hd_handler(uint8_t irq_no);
 void ide_init(void);
@@ -7,23 +7,28 @@
 #include <stdint.h>
 #include <thread.h>
 #include <sync.h>
+#include <spinlock.h>
 
 #define bufsize     64
 
+struct poll_entry;
+
 /* 环形队列 */
 typedef struct ioqueue {
-    /* 生产者消费者问题 */
-    struct lock lock;
+    /* 生产者消费者问题，生产者可能是中断处理程序，
+     * 消费者可能在别的cpu上，用关中断的自旋锁保护
+     */
+    struct spinlock lock;
 
     /* 生产者，缓冲区不满时就继续往里面放数据，
-     * 否则就睡眠，此项记录哪个生产者在此缓冲区上睡眠
+     * 否则就睡眠，在此等待队列上睡眠的生产者可以有多个
      */
-    struct task_struct * producer;
+    struct wait_queue producers;
 
     /* 消费者，缓冲区不空时就继续从往里面拿数据，
-     * 否则就睡眠，此项记录哪个消费者在此缓冲区上睡眠
+     * 否则就睡眠，在此等待队列上睡眠的消费者可以有多个
      */
-    struct task_struct * consumer;
+    struct wait_queue consumers;
 
     char buf[bufsize];      /* 缓冲区 */
     int32_t head;           /* 队首，数据往队首处写入 */
@@ -34,6 +39,8 @@ void ioqueue_init(struct ioqueue * ioq);
 bool ioq_full(struct ioqueue * ioq);
 bool ioq_empty(struct ioqueue * ioq);
 char ioq_getchar(struct ioqueue * ioq);
+bool ioq_trygetchar(struct ioqueue * ioq, char * byte);
 void ioq_putchar(struct ioqueue * ioq, char ch);
+int16_t ioq_poll(struct ioqueue * ioq, struct poll_entry * pe);
 
 #endif  /* __DEVICE_IOQUEUE_H */
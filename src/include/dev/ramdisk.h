@@ -0,0 +1,31 @@
+/* ramdisk.h
+ *   以内存为存储的块设备
+ *
+ * loader把主机上打包好的initramfs读入到INITRD_BASE_ADDR处，
+ * 内核用一块内存建立内存盘ram0，格式化后作为根文件系统挂载，
+ * 再把initramfs中的文件解包进去，启动后不用再读硬盘
+ */
+
+#ifndef __DEVICE_RAMDISK_H
+#define __DEVICE_RAMDISK_H
+
+#include <stdint.h>
+
+/* 须与boot.h中的定义一致 */
+#define INITRD_BASE_ADDR    0x200000    /* 内核物理内存池的开头 */
+#define INITRD_SECTORS      1024        /* loader固定读入的扇区数 */
+#define INITRD_PAGES        (INITRD_SECTORS * 512 / 4096)
+
+#define RAMDISK_SECTORS     4096        /* 内存盘2MB */
+
+struct disk;
+struct partition;
+
+void ramdisk_init(void);
+void ramdisk_read(struct disk * hd, uint32_t lba, void * buf, uint32_t sec_cnt);
+void ramdisk_write(struct disk * hd, uint32_t lba, void * buf, uint32_t sec_cnt);
+struct partition * ramdisk_partition(void);
+const char * ramdisk_initrd(void);
+void ramdisk_initrd_free(void);
+
+#endif  /* __DEVICE_RAMDISK_H */
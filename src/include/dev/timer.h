@@ -5,7 +5,30 @@
 #define __DEVICE_TIMER_H
 
 #include <stdint.h>
+#include <list.h>
+
+#define IRQ0_FREQUENCY      100     /* 时钟中断频率：100Hz */
+
+/* 到时在时钟中断中调用func(arg)的定时器 */
+struct timer
+{
+    struct node tag;        /* 在timer_list中的结点 */
+    uint32_t expires;       /* 到时的嘀嗒数 */
+    void (*func)(void * arg);
+    void * arg;
+    bool pending;           /* 是否已加入、还未到时 */
+};
+
+extern uint32_t ticks;
+extern uint32_t tsc_per_tick;
+
 void timer_init(void);
+void task_tick(void);
 void mtime_sleep(uint32_t m_seconds); 
+void tsc_calibrate(void);
+void sys_sleep(uint32_t m_seconds);
+void timer_add(struct timer * t, uint32_t delay_ticks);
+bool timer_del(struct timer * t);
+uint32_t msecs_to_ticks(uint32_t m_seconds);
 
 #endif  /* __DEVICE_TIMER_H */
@@ -0,0 +1,28 @@
+/* tty.h
+ *   键盘和sys_read之间的终端行规程
+ *
+ * 规范模式下在内核中做行编辑和回显，read一次返回完整的一行；
+ * 原始模式下键入的字符原样交给read
+ */
+
+#ifndef __DEVICE_TTY_H
+#define __DEVICE_TTY_H
+
+#include <stdint.h>
+
+#define TTY_CANON       0x1     /* 规范模式，按行编辑，整行返回 */
+#define TTY_ECHO        0x2     /* 回显键入的字符 */
+
+#define TTY_LINE_MAX    128     /* 一行最多的字符数，含结尾的换行符 */
+
+/* 键盘驱动把ctrl+字母转换成的控制字符 */
+#define TTY_CTRL(c)     ((c) - 'a')
+
+struct poll_entry;
+
+void tty_init(void);
+int32_t tty_read(char * buf, uint32_t count);
+int16_t tty_poll(struct poll_entry * pe);
+int32_t sys_tty_mode(int32_t mode);
+
+#endif  /* __DEVICE_TTY_H */
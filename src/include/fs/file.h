@@ -13,6 +13,9 @@
     uint32_t fd_pos;        /* 当前文件操作的偏移地址 */
     uint32_t fd_flag;       /* 文件操作标识 */
     struct inode * fd_inode; /* 位于内存中inode缓冲队列的指针 */
+    uint32_t fd_inflight;   /* 交给io_wq还未完成的异步读写数 */
+    struct pipe * fd_pipe;  /* 管道的一端时指向管道，此时fd_inode为NULL */
+    uint32_t fd_refs;       /* 引用此项的文件描述符数，fork和dup2会增加 */
  };
  
  /* 标准输入输出描述符 */
@@ -42,6 +45,8 @@ int32_t file_open(uint32_t inode_no, uint8_t flag);
 int32_t file_close(struct file *file);
 int32_t file_write(struct file *file, const void *buf, uint32_t count);
 int32_t file_read(struct file *file, void *buf, uint32_t count);
+void file_get(int32_t global_fd);
+int32_t file_put(int32_t global_fd);
 
 #endif
 
@@ -0,0 +1,10 @@
+/* initramfs.h
+ *   把loader读入的initramfs解包到内存盘上的根文件系统
+ */
+
+#ifndef __FS_INITRAMFS_H
+#define __FS_INITRAMFS_H
+
+void initramfs_unpack(void);
+
+#endif  /* __FS_INITRAMFS_H */
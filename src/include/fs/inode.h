@@ -27,6 +27,7 @@ struct inode {
 };
 
 struct inode * inode_open(struct partition *part, uint32_t inode_no);
+bool inode_is_open(struct partition *part, uint32_t inode_no);
 void inode_sync(struct partition *part, struct inode *inode, void *io_buf);
 void inode_init(uint32_t inode_no, struct inode *new_inode);
 void inode_close(struct inode *inode);
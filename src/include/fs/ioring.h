@@ -0,0 +1,107 @@
+/* ioring.h
+ *   批量异步提交文件操作的环形队列
+ *
+ * 提交队列和完成队列放在映射到进程空间的一页共享内存中，
+ * 进程填好若干提交项后用一次ring_enter交给内核，
+ * 读写由内核工作线程异步完成，结果在之后的ring_enter中写入完成队列
+ */
+
+#ifndef __FS_IORING_H
+#define __FS_IORING_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define IORING_ENTRIES  64      /* 两个队列的大小，须为2的幂 */
+#define IORING_MASK     (IORING_ENTRIES - 1)
+
+/* 提交项的操作码 */
+enum ioring_op {
+    IORING_OP_NOP = 0,
+    IORING_OP_READ,     /* 异步，read(fd, addr, len) */
+    IORING_OP_WRITE,    /* 异步，write(fd, addr, len) */
+    IORING_OP_OPEN,     /* 同步，open(addr, flags) */
+    IORING_OP_CLOSE,    /* 同步，close(fd) */
+    IORING_OP_STAT,     /* 同步，stat(addr, addr2) */
+};
+
+/* 提交项，由进程填写 */
+struct io_sqe
+{
+    uint8_t opcode;
+    uint8_t flags;          /* OPEN的打开标志 */
+    uint16_t pad;
+    int32_t fd;
+    void * addr;            /* READ/WRITE的缓冲区，OPEN/STAT的路径 */
+    void * addr2;           /* STAT的struct stat */
+    uint32_t len;
+    uint32_t user_data;     /* 原样带回到完成项中 */
+};
+
+/* 完成项，由内核填写 */
+struct io_cqe
+{
+    uint32_t user_data;
+    int32_t res;            /* 对应系统调用的返回值 */
+};
+
+/* 共享页的布局
+ * 头尾都是只增不减的计数，取模IORING_ENTRIES得到下标。
+ * 进程只写sq_tail和cq_head，内核只写sq_head和cq_tail
+ */
+struct io_ring
+{
+    volatile uint32_t sq_head;
+    volatile uint32_t sq_tail;
+    volatile uint32_t cq_head;
+    volatile uint32_t cq_tail;
+    struct io_sqe sqes[IORING_ENTRIES];
+    struct io_cqe cqes[IORING_ENTRIES];
+};
+
+/* 取下一个空闲的提交项，提交队列已满时返回NULL */
+static inline struct io_sqe * ioring_get_sqe(struct io_ring * ring)
+{
+    uint32_t tail = ring->sq_tail;
+    if (tail - ring->sq_head >= IORING_ENTRIES)
+    {
+        return NULL;
+    }
+    return &ring->sqes[tail & IORING_MASK];
+}
+
+/* 把ioring_get_sqe取到的提交项放入提交队列 */
+static inline void ioring_sqe_commit(struct io_ring * ring)
+{
+    /* 先填好提交项再移动队尾 */
+    asm volatile ("" : : : "memory");
+    ring->sq_tail++;
+}
+
+/* 取最早的完成项，没有时返回NULL */
+static inline struct io_cqe * ioring_peek_cqe(struct io_ring * ring)
+{
+    uint32_t head = ring->cq_head;
+    if (head == ring->cq_tail)
+    {
+        return NULL;
+    }
+    asm volatile ("" : : : "memory");
+    return &ring->cqes[head & IORING_MASK];
+}
+
+/* 用完ioring_peek_cqe取到的完成项后释放它 */
+static inline void ioring_cqe_seen(struct io_ring * ring)
+{
+    asm volatile ("" : : : "memory");
+    ring->cq_head++;
+}
+
+struct task_struct;
+
+void ioring_init(void);
+struct io_ring * sys_ring_setup(void);
+int32_t sys_ring_enter(uint32_t to_submit, uint32_t min_complete);
+void ioring_release(struct task_struct * pthread);
+
+#endif  /* __FS_IORING_H */
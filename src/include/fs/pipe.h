@@ -0,0 +1,41 @@
+/* pipe.h
+ *   进程间传递字节流的管道
+ *
+ * 读端和写端各占文件表中的一项，file的fd_pipe指向同一个pipe，
+ * 安装到进程的文件描述符数组后和普通文件一样fork、dup2和close
+ */
+
+#ifndef __FS_PIPE_H
+#define __FS_PIPE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <spinlock.h>
+#include <sync.h>
+
+#define PIPE_PAGES  4                       /* 缓冲区的页数 */
+#define PIPE_SIZE   (PIPE_PAGES * PG_SIZE)  /* 缓冲区的字节数 */
+
+struct pipe
+{
+    struct spinlock lock;       /* 保护以下各项 */
+    char * buf;                 /* PIPE_SIZE字节的环形缓冲区 */
+    uint32_t head;              /* 读出的总字节数，取模PIPE_SIZE得到读位置 */
+    uint32_t tail;              /* 写入的总字节数 */
+    uint32_t readers;           /* 未关闭的读端数 */
+    uint32_t writers;           /* 未关闭的写端数 */
+    struct wait_queue rd_wq;    /* 等待数据的读者 */
+    struct wait_queue wr_wq;    /* 等待空间的写者 */
+};
+
+struct file;
+struct poll_entry;
+
+bool is_pipe(int32_t local_fd);
+int32_t sys_pipe(int32_t pipefd[2]);
+int32_t pipe_read(struct file * file, void * buf, uint32_t count);
+int32_t pipe_write(struct file * file, const void * buf, uint32_t count);
+void pipe_close(struct file * file);
+int16_t pipe_poll(struct file * file, int16_t events, struct poll_entry * pe);
+
+#endif  /* __FS_PIPE_H */
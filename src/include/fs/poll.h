@@ -0,0 +1,42 @@
+/* poll.h
+ *   同时等待多个文件描述符可读写
+ *
+ * 每种文件提供一个检查函数，返回当前就绪的事件，
+ * 给出poll_entry时还用poll_wait把它登记到状态变化时会被唤醒的等待队列上
+ */
+
+#ifndef __FS_POLL_H
+#define __FS_POLL_H
+
+#include <stdint.h>
+#include <sync.h>
+
+/* 事件 */
+#define POLLIN      0x01    /* 有数据可读，或已读到结尾 */
+#define POLLOUT     0x04    /* 可以写入 */
+#define POLLERR     0x08    /* 出错，如管道的读端都已关闭 */
+#define POLLHUP     0x10    /* 对端已关闭，如管道的写端都已关闭 */
+#define POLLNVAL    0x20    /* 文件描述符无效 */
+
+struct pollfd
+{
+    int32_t fd;
+    int16_t events;         /* 关心的事件 */
+    int16_t revents;        /* 返回时为发生的事件，出错和关闭总会报告 */
+};
+
+struct poll_table;
+
+/* sys_poll为每个文件描述符准备的登记项 */
+struct poll_entry
+{
+    struct wait_entry entry;
+    struct poll_table * pt;
+    struct spinlock * lock;     /* 保护所登记的等待队列的锁，为NULL表示未登记 */
+};
+
+void poll_wait(struct poll_entry * pe, struct wait_queue * wq,
+            struct spinlock * lock);
+int32_t sys_poll(struct pollfd * fds, uint32_t nfds, int32_t timeout);
+
+#endif  /* __FS_POLL_H */
@@ -0,0 +1,67 @@
+/* acct.h
+ *   任务的资源使用统计：用户态/内核态时间、上下文切换、硬盘读写及缺页
+ */
+
+#ifndef __KERNEL_ACCT_H
+#define __KERNEL_ACCT_H
+
+#include <stdint.h>
+
+struct task_struct;
+
+/* 每个任务的统计数据，时间均以tsc时钟周期为单位 */
+struct task_acct
+{
+    uint64_t acct_tsc;      /* 上次结算时的tsc，之后的时间尚未计入 */
+    uint64_t utime;         /* 用户态执行时间 */
+    uint64_t stime;         /* 内核态执行时间 */
+    uint64_t blkio_delay;   /* 等待硬盘完成读写的时间 */
+    uint64_t read_bytes;    /* 从硬盘读入的字节数 */
+    uint64_t write_bytes;   /* 写入硬盘的字节数 */
+    uint32_t nvcsw;         /* 因阻塞而主动让出cpu的次数 */
+    uint32_t nivcsw;        /* 时间片用完或让出cpu后仍就绪的次数 */
+    uint32_t min_flt;       /* 不需要读硬盘的缺页次数 */
+    uint32_t maj_flt;       /* 需要读硬盘的缺页次数 */
+};
+
+/* getrusage的who参数 */
+#define RUSAGE_SELF         0
+#define RUSAGE_CHILDREN     (-1)
+
+struct timeval
+{
+    uint32_t tv_sec;
+    uint32_t tv_usec;
+};
+
+struct rusage
+{
+    struct timeval ru_utime;    /* 用户态时间 */
+    struct timeval ru_stime;    /* 内核态时间 */
+    uint32_t ru_minflt;
+    uint32_t ru_majflt;
+    uint32_t ru_inblock;        /* 读入的扇区数 */
+    uint32_t ru_oublock;        /* 写出的扇区数 */
+    uint32_t ru_nvcsw;
+    uint32_t ru_nivcsw;
+};
+
+/* times返回的各项时间，以时钟嘀嗒为单位 */
+struct tms
+{
+    uint32_t tms_utime;
+    uint32_t tms_stime;
+    uint32_t tms_cutime;
+    uint32_t tms_cstime;
+};
+
+void acct_init_task(struct task_struct * pthread);
+void acct_user_exit(void);
+void acct_user_enter(void);
+void acct_switch(struct task_struct * prev, struct task_struct * next);
+uint32_t acct_cycles_to_ms(uint64_t cycles);
+int32_t sys_getrusage(int32_t who, struct rusage * ru);
+uint32_t sys_times(struct tms * buf);
+void acct_ps(void);
+
+#endif  /* __KERNEL_ACCT_H */
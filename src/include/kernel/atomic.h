@@ -0,0 +1,77 @@
+/* atomic.h
+ *   用内联汇编实现的原子操作，供多处理器间的同步使用
+ *   带lock前缀的指令在执行期间独占对应的缓存行或总线
+ */
+
+#ifndef __KERNEL_ATOMIC_H
+#define __KERNEL_ATOMIC_H
+
+#include <stdint.h>
+
+/* 原子地将*addr置为newval，并返回其原来的值 */
+static inline uint32_t xchg(volatile uint32_t * addr, uint32_t newval)
+{
+    uint32_t result;
+
+    /* xchg指令带有内存操作数时，处理器会自动加上lock前缀 */
+    asm volatile ("lock; xchgl %0, %1"
+                : "+m"(*addr), "=a"(result)
+                : "1"(newval)
+                : "cc", "memory");
+    return result;
+}
+
+/* 若*addr等于old，则将其置为newval
+ * 返回*addr原来的值，与old相等即表示交换成功
+ */
+static inline uint32_t cmpxchg(volatile uint32_t * addr,
+                uint32_t old, uint32_t newval)
+{
+    uint32_t prev;
+
+    asm volatile ("lock; cmpxchgl %2, %1"
+                : "=a"(prev), "+m"(*addr)
+                : "r"(newval), "0"(old)
+                : "cc", "memory");
+    return prev;
+}
+
+/* 原子地将*addr加上value，并返回相加之前的值 */
+static inline uint32_t atomic_add(volatile uint32_t * addr, uint32_t value)
+{
+    asm volatile ("lock; xaddl %0, %1"
+                : "+r"(value), "+m"(*addr)
+                :
+                : "cc", "memory");
+    return value;
+}
+
+/* 原子地将16位的*addr加上value，并返回相加之前的值 */
+static inline uint16_t atomic_add16(volatile uint16_t * addr, uint16_t value)
+{
+    asm volatile ("lock; xaddw %0, %1"
+                : "+r"(value), "+m"(*addr)
+                :
+                : "cc", "memory");
+    return value;
+}
+
+/* 原子地将*addr加1 */
+static inline void atomic_inc(volatile uint32_t * addr)
+{
+    asm volatile ("lock; incl %0" : "+m"(*addr) : : "cc", "memory");
+}
+
+/* 原子地将*addr减1 */
+static inline void atomic_dec(volatile uint32_t * addr)
+{
+    asm volatile ("lock; decl %0" : "+m"(*addr) : : "cc", "memory");
+}
+
+/* 自旋等待时提示处理器，降低功耗并避免退出循环时的流水线惩罚 */
+static inline void cpu_relax(void)
+{
+    asm volatile ("pause" : : : "memory");
+}
+
+#endif  /* __KERNEL_ATOMIC_H */
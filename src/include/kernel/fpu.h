@@ -0,0 +1,25 @@
+/* fpu.h
+ *   x87/SSE浮点状态的惰性保存与恢复
+ */
+
+#ifndef __KERNEL_FPU_H
+#define __KERNEL_FPU_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+struct task_struct;
+
+/* fxsave保存的512字节状态，要求16字节对齐，不支持fxsave时用fnsave */
+struct fpu_state
+{
+    uint8_t regs[512];
+} __attribute__ ((aligned (16)));
+
+void fpu_init(void);
+void fpu_cpu_init(void);
+void fpu_switch(struct task_struct * prev);
+int32_t fpu_fork(struct task_struct * child, struct task_struct * parent);
+void fpu_release(struct task_struct * pthread);
+
+#endif  /* __KERNEL_FPU_H */
@@ -55,12 +55,27 @@
 #define SELECTOR_U_DATA     ((6<<3) + (TI_GDT << 2) + RPL3)
 #define SELECTOR_U_STACK    SELECTOR_U_DATA
 
+/* 第7~10个描述符供sysenter/sysexit使用，处理器要求它们依次是
+ * 内核代码段、内核栈段、用户代码段、用户栈段，段基址和界限与上面的相同
+ */
+#define SELECTOR_SYSENTER_CS    ((7<<3) + (TI_GDT << 2) + RPL0)
+
+/* 第11个描述符是用户线程局部存储的数据段，
+ * 基址在切换到用户线程时改为该线程的tls
+ */
+#define GDT_TLS_IDX         11
+#define SELECTOR_U_TLS      ((GDT_TLS_IDX<<3) + (TI_GDT << 2) + RPL3)
+
 #define GDT_ATTR_HIGH		 ((DESC_G_4K << 7) + (DESC_D_32 << 6) \
                     + (DESC_L << 5) + (DESC_AVL << 4))
 #define GDT_CODE_ATTR_LOW_DPL3	 ((DESC_P << 7) + (DESC_DPL_3 << 5) \
                     + (DESC_S_CODE << 4) + DESC_TYPE_CODE)
 #define GDT_DATA_ATTR_LOW_DPL3	 ((DESC_P << 7) + (DESC_DPL_3 << 5) \
                     + (DESC_S_DATA << 4) + DESC_TYPE_DATA)
+#define GDT_CODE_ATTR_LOW_DPL0	 ((DESC_P << 7) + (DESC_DPL_0 << 5) \
+                    + (DESC_S_CODE << 4) + DESC_TYPE_CODE)
+#define GDT_DATA_ATTR_LOW_DPL0	 ((DESC_P << 7) + (DESC_DPL_0 << 5) \
+                    + (DESC_S_DATA << 4) + DESC_TYPE_DATA)
 
 
 /* ---------------  TSS描述符属性  ------------ */
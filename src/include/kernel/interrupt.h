@@ -10,6 +10,11 @@
 /* 目前总共支持的中断数 */
 #define IDT_DESC_CNT    0x81
 
+/* intr_entry.S中定义了入口的中断数，0x00~0x2f为异常和8259A，
+ * 0x30~0x3f为本地APIC
+ */
+#define INTR_ENTRY_CNT  0x40
+
 /* --------------   IDT描述符属性       ------------ */
 #define IDT_DESC_P      1
 #define IDT_DESC_DPL0   0
@@ -46,11 +51,14 @@ typedef enum
 
 /* 函数声明 */
 void idt_init(void);
+void idt_load(void);
 
 intr_status intr_get_status(void);
 intr_status intr_set_status(intr_status status);
 intr_status intr_enable(void);
 intr_status intr_disable(void);
+intr_status intr_disable_at(void * ip);
+intr_status intr_set_status_at(intr_status status, void * ip);
 void register_handler(uint8_t vec_no, intr_handler func);
 
 #endif  /* __KERNEL_INTERRUPT_H */
@@ -29,6 +29,9 @@
 #define PG_RW_W     2   /* R/W 属性位值，读/写/执行 */
 #define PG_US_S     0   /* U/S 属性位值, 系统级 */
 #define PG_US_U     4   /* U/S 属性位值, 用户级 */
+#define PG_PWT_1    8   /* PWT 属性位值, 写直达 */
+#define PG_PCD_1    16  /* PCD 属性位值, 禁止缓存，用于映射设备寄存器 */
+#define PG_SHARED   0x200   /* 页表项中留给系统使用的位：共享页，fork时不复制 */
 
 /* 内存池标记，用于判断用哪个内存池 */
 typedef enum pool_flag {
@@ -64,6 +67,8 @@ extern struct vm_pool  kvm_pool;
 extern struct phm_pool kernel_pool;
 extern struct phm_pool user_pool;
 
+struct task_struct;
+
 void mem_init(void);
 uint32_t * get_pte(uint32_t vaddr);
 uint32_t * get_pde(uint32_t vaddr);
@@ -71,6 +76,8 @@ void * get_kernel_pages(uint32_t pg_need);
 void * malloc_page(poolfg fg, uint32_t pg_need);
 void malloc_init(void);
 uint32_t addr_v2p(uint32_t vaddr);
+void * ioremap(uint32_t paddr, uint32_t size);
+void * kernel_pages_map(uint32_t pg_phy_addr, uint32_t pg_cnt);
 void * get_a_page(poolfg pf, uint32_t vaddr);
 void * get_user_pages(uint32_t pg_cnt);
 void block_desc_init(struct mem_block_desc * desc_array);
@@ -78,7 +85,21 @@ void * sys_malloc(uint32_t size);
 void mfree_page(poolfg pf, void * _vaddr, uint32_t pg_cnt);
 void pfree(uint32_t pg_phy_addr);
 void sys_free(void *ptr);
+void * kmalloc(uint32_t size);
+void page_map(void *_vaddr, void *_page_phyaddr, uint32_t attr);
+uint32_t mem_free_pages(poolfg pf);
+uint32_t mem_total_pages(poolfg pf);
+void kfree(void * ptr);
 void* get_a_page_without_opvaddrbitmap(poolfg pf, 
                         uint32_t vaddr);
+bool user_page_mapped(uint32_t vaddr);
+void page_ref_get(uint32_t pg_phy_addr);
+uint32_t page_ref_put(uint32_t pg_phy_addr);
+uint32_t page_ref_cnt(uint32_t pg_phy_addr);
+uint32_t user_frame_alloc(void);
+void * map_shared_pages(uint32_t * phy_addrs, uint32_t pg_cnt);
+void * kmap_atomic(uint32_t paddr);
+uint32_t task_v2p(struct task_struct * pthread, uint32_t vaddr, bool write);
+void * sys_mmap_shared(uint32_t size);
 
 #endif  /* __KERNEL_MEMORY_H */
@@ -0,0 +1,29 @@
+/* msr.h
+ *   读写模型特定寄存器(MSR)
+ */
+
+#ifndef __KERNEL_MSR_H
+#define __KERNEL_MSR_H
+
+#include <stdint.h>
+
+#define MSR_SYSENTER_CS     0x174   /* sysenter进入后的代码段选择子 */
+#define MSR_SYSENTER_ESP    0x175   /* sysenter进入后的esp */
+#define MSR_SYSENTER_EIP    0x176   /* sysenter进入后的eip */
+
+static inline uint64_t rdmsr(uint32_t msr)
+{
+    uint32_t low, high;
+
+    asm volatile ("rdmsr" : "=a"(low), "=d"(high) : "c"(msr));
+    return ((uint64_t)high << 32) | low;
+}
+
+static inline void wrmsr(uint32_t msr, uint64_t value)
+{
+    asm volatile ("wrmsr"
+                : : "c"(msr), "a"((uint32_t)value),
+                    "d"((uint32_t)(value >> 32)));
+}
+
+#endif  /* __KERNEL_MSR_H */
@@ -0,0 +1,23 @@
+/* shm.h
+ *   按名字打开的共享内存段
+ *
+ * 互不相关的进程用同一个名字打开同一个段，再各自映射到自己的空间中，
+ * 映射的是同一组物理页，进程之间交换数据不必经过内核复制
+ */
+
+#ifndef __KERNEL_SHM_H
+#define __KERNEL_SHM_H
+
+#include <stdint.h>
+
+#define SHM_NAME_LEN    16      /* 名字的最大长度，含结尾的0 */
+#define SHM_MAX_SEGS    16      /* 系统中最多的段数 */
+#define SHM_MAX_PAGES   16      /* 每个段最多的页数 */
+
+void shm_init(void);
+int32_t sys_shm_open(const char * name, uint32_t size);
+void * sys_shm_map(int32_t shmid);
+int32_t sys_shm_unmap(void * addr);
+void shm_reap(void);
+
+#endif  /* __KERNEL_SHM_H */
@@ -0,0 +1,67 @@
+/* smp.h
+ *   多处理器支持：cpu描述结构、本地APIC及处理器间中断
+ */
+
+#ifndef __KERNEL_SMP_H
+#define __KERNEL_SMP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <list.h>
+#include <spinlock.h>
+#include <schedstat.h>
+
+#define MAX_CPUS    8       /* 最多支持的cpu个数 */
+
+/* AP启动代码被复制到的物理地址，须4K对齐且位于低端1M内，
+ * 0x90000位于内存位图(0x9a000)之前。内核映像加载缓冲区(0x70000~0x94000)
+ * 与之重叠，但smp_init时内核早已从缓冲区中展开，缓冲区不再使用
+ */
+#define AP_BOOT_ADDR    0x90000
+
+/* 本地APIC使用的中断向量号，紧接在8259A的0x20~0x2f之后 */
+#define LAPIC_TIMER_VEC     0x30    /* 本地APIC时钟中断 */
+#define RESCHED_IPI_VEC     0x31    /* 重新调度的处理器间中断 */
+#define TLB_IPI_VEC         0x32    /* 刷新快表的处理器间中断 */
+#define SPURIOUS_VEC        0x3f    /* 伪中断，低4位必须为1 */
+
+struct task_struct;
+
+/* 每个cpu私有的数据 */
+typedef struct cpu
+{
+    uint8_t id;                 /* 逻辑cpu号，BSP为0 */
+    uint8_t apic_id;            /* 本地APIC的ID */
+    volatile bool online;       /* 是否已启动完成 */
+
+    struct spinlock rq_lock;    /* 保护本cpu的就绪队列 */
+    struct list ready_list;     /* 本cpu的就绪队列 */
+    uint32_t nr_ready;          /* 就绪队列中的任务数 */
+
+    struct task_struct * idle;  /* 本cpu的idle线程，不进入就绪队列 */
+    struct task_struct * curr;  /* 本cpu上正在运行的任务 */
+    struct task_struct * prev;  /* 刚切换下来的任务，由schedule_tail处理 */
+
+    volatile bool tlb_flush_pending;    /* 是否有待处理的快表刷新请求 */
+    uint32_t nr_steal;          /* 从其它cpu偷取任务的次数 */
+    struct cpu_sched_stat sched_stat;   /* 调度统计 */
+
+    volatile uint32_t softirq_pending;  /* 待处理的软中断位图 */
+    bool in_softirq;            /* 是否正在处理软中断 */
+    volatile bool need_resched; /* 中断返回前是否需要调度 */
+    uint64_t irq_enter_tsc;     /* 进入当前硬件中断处理程序时的tsc */
+
+    uint64_t irqsoff_start_tsc; /* 本段关中断开始时的tsc，0表示未在跟踪 */
+    void * irqsoff_start_ip;    /* 本段关中断的调用者 */
+} cpu;
+
+extern struct cpu cpus[MAX_CPUS];
+extern uint8_t nr_cpus;         /* 已启动的cpu个数 */
+
+void cpu_init(struct cpu * c, uint8_t id);
+struct cpu * this_cpu(void);
+void smp_init(void);
+void smp_send_resched(struct cpu * c);
+void smp_tlb_shootdown(void);
+
+#endif  /* __KERNEL_SMP_H */
@@ -0,0 +1,45 @@
+/* softirq.h
+ *   软中断：硬件中断处理程序之后开中断执行的下半部，
+ *   以及各中断处理耗时的统计
+ */
+
+#ifndef __KERNEL_SOFTIRQ_H
+#define __KERNEL_SOFTIRQ_H
+
+#include <stdint.h>
+#include <interrupt.h>
+
+/* 软中断号，数值越小越先处理 */
+enum softirq_nr
+{
+    KEYBOARD_SOFTIRQ = 0,   /* 键盘扫描码解码 */
+    BLOCK_SOFTIRQ,          /* 唤醒等待硬盘的线程 */
+    NR_SOFTIRQS
+};
+
+/* 处理完一轮后又有新的软中断到来时最多重新处理的轮数，
+ * 超过后留到下一次中断退出时再处理，避免被中断的任务长时间得不到运行
+ */
+#define SOFTIRQ_MAX_RESTART     10
+
+typedef void (*softirq_handler)(void);
+
+/* 中断处理耗时的统计，单位为时钟周期，不要求精确 */
+struct irq_stat
+{
+    uint32_t count;         /* 发生次数 */
+    uint32_t max_cycles;    /* 最长一次的耗时 */
+    uint32_t avg_cycles;    /* 耗时的滑动平均值 */
+};
+
+extern struct irq_stat irq_stats[INTR_ENTRY_CNT];
+extern struct irq_stat softirq_stats[NR_SOFTIRQS];
+
+void open_softirq(uint8_t nr, softirq_handler handler);
+void raise_softirq(uint8_t nr);
+void do_softirq(void);
+void irq_enter(uint8_t vec_nr, uint32_t cs);
+void irq_exit(uint8_t vec_nr);
+void sys_irqstat(void);
+
+#endif  /* __KERNEL_SOFTIRQ_H */
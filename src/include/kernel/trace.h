@@ -0,0 +1,32 @@
+/* trace.h
+ *   关中断和禁止抢占时长的跟踪，记录最长的一段及其起止位置
+ */
+
+#ifndef __KERNEL_TRACE_H
+#define __KERNEL_TRACE_H
+
+#include <stdint.h>
+
+/* 一类时长的最大值记录 */
+struct trace_record
+{
+    uint32_t max_cycles;    /* 最长一段的时钟周期数 */
+    void * start_ip;        /* 这一段开始处的调用者地址 */
+    void * end_ip;          /* 这一段结束处的调用者地址 */
+    uint8_t cpu_id;         /* 发生在哪个cpu上 */
+    uint32_t pid;           /* 结束时运行的任务 */
+};
+
+extern struct trace_record irqsoff_max;
+extern struct trace_record preemptoff_max;
+
+void trace_init(void);
+void trace_reset(void);
+void trace_irqs_off(void * ip);
+void trace_irqs_on(void * ip);
+void trace_irqs_clear(void);
+void trace_preempt_off(void * ip);
+void trace_preempt_on(void * ip);
+void sys_latency(int32_t reset);
+
+#endif  /* __KERNEL_TRACE_H */
@@ -0,0 +1,36 @@
+/* tsc.h
+ *   读取时间戳计数器(TSC)，用于高精度的耗时统计
+ */
+
+#ifndef __KERNEL_TSC_H
+#define __KERNEL_TSC_H
+
+#include <stdint.h>
+
+/* 读取自处理器上电以来的时钟周期数 */
+static inline uint64_t rdtsc(void)
+{
+    uint32_t low, high;
+
+    asm volatile ("rdtsc" : "=a"(low), "=d"(high));
+    return ((uint64_t)high << 32) | low;
+}
+
+/* 64位数除以32位数，返回商，余数存入*rem
+ * 用两次32位除法完成，不依赖libgcc中的__udivdi3
+ */
+static inline uint64_t div_u64_rem(uint64_t n, uint32_t d, uint32_t * rem)
+{
+    uint32_t high = (uint32_t)(n >> 32);
+    uint32_t low = (uint32_t)n;
+    uint32_t q_high = high / d;
+    uint32_t q_low;
+
+    /* 高位的余数小于d，和低32位组成的被除数除以d时商不会溢出 */
+    asm ("divl %4"
+        : "=a"(q_low), "=d"(*rem)
+        : "a"(low), "d"(high % d), "rm"(d));
+    return ((uint64_t)q_high << 32) | q_low;
+}
+
+#endif  /* __KERNEL_TSC_H */
@@ -0,0 +1,62 @@
+/* vdso.h
+ *   映射到每个进程中的只读数据页，用户态不用陷入内核即可读取
+ *
+ * 固定地址处有两页：全局数据页为所有进程共享，由BSP的时钟中断更新；
+ * 进程数据页每个进程一份，保存pid等不变的信息
+ */
+
+#ifndef __KERNEL_VDSO_H
+#define __KERNEL_VDSO_H
+
+#include <stdint.h>
+
+/* 在USER_VADDR_START之下，不占用进程的虚拟地址位图，fork时也不会被复制 */
+#define VDSO_DATA_VADDR     0x08000000
+#define VDSO_PROC_VADDR     (VDSO_DATA_VADDR + 0x1000)
+
+#define VDSO_TSC_SHIFT      24      /* tsc_mult的定点小数位数 */
+
+/* 全局数据页
+ * 读者先读seq，为奇数说明正在更新；读完后seq没有变化数据才有效
+ */
+struct vdso_data
+{
+    volatile uint32_t seq;
+    uint32_t ticks;             /* 开机以来的嘀嗒数 */
+    uint32_t hz;                /* 每秒的嘀嗒数 */
+    uint32_t ns_per_tick;
+
+    /* 纳秒 = ns_base + ((rdtsc() - tsc_base) * tsc_mult >> VDSO_TSC_SHIFT)
+     * 差值不超过一个嘀嗒，tsc尚未校准时tsc_mult为0，只能精确到嘀嗒
+     */
+    uint64_t tsc_base;          /* 最近一次时钟中断时BSP的tsc */
+    uint64_t ns_base;           /* 对应的开机以来的纳秒数 */
+    uint32_t tsc_per_tick;
+    uint32_t tsc_mult;
+
+    /* 每5秒随负载均值一起更新的提示 */
+    uint32_t loadavg[3];        /* 1、5、15分钟的负载均值，FSHIFT位定点数 */
+    uint32_t nr_running;        /* 可运行的任务数 */
+    uint32_t nr_cpus;
+    uint32_t user_total_pages;  /* 用户内存池的总页数 */
+    uint32_t user_free_pages;   /* 用户内存池的空闲页数 */
+    uint32_t kernel_total_pages;
+    uint32_t kernel_free_pages;
+};
+
+/* 进程数据页 */
+struct vdso_proc
+{
+    int16_t pid;
+    int16_t ppid;
+};
+
+struct task_struct;
+
+void vdso_init(void);
+int32_t vdso_map(struct task_struct * pthread);
+void vdso_update_tick(void);
+void vdso_set_tsc(uint32_t tsc_per_tick);
+void vdso_update_load(uint32_t * avenrun, uint32_t nr_running);
+
+#endif  /* __KERNEL_VDSO_H */
@@ -16,6 +16,12 @@ int32_t buildin_rm(uint32_t argc, char** argv);
 void make_clear_abs_path(char* path, char* wash_buf);
 void buildin_pwd(uint32_t argc, char** argv);
 void buildin_ps(uint32_t argc, char** argv);
+void buildin_irqstat(uint32_t argc, char** argv);
+void buildin_latency(uint32_t argc, char** argv);
+void buildin_top(uint32_t argc, char** argv);
+void buildin_sysbench(uint32_t argc, char** argv);
+void buildin_ringbench(uint32_t argc, char** argv);
+void buildin_uptime(uint32_t argc, char** argv);
 void buildin_clear(uint32_t argc, char** argv);
 
 #endif  /* __SHELL_BUILDIN_CMD_H */
\ No newline at end of file
@@ -0,0 +1,27 @@
+/* futex.h
+ *   用户态同步用的快速互斥
+ *
+ * 用户态用原子操作修改一个32位的字，只有需要等待或唤醒时才陷入内核。
+ * 等待者以这个字的物理地址为键挂在散列桶中，
+ * 线程之间、以及fork出的进程之间在共享页中都能用同一个字同步
+ */
+
+#ifndef __THREAD_FUTEX_H
+#define __THREAD_FUTEX_H
+
+#include <stdint.h>
+
+/* sys_futex的操作 */
+#define FUTEX_WAIT      0   /* *uaddr等于val时睡眠，直到被唤醒 */
+#define FUTEX_WAKE      1   /* 唤醒最多val个在uaddr上睡眠的线程 */
+#define FUTEX_REQUEUE   2   /* 唤醒一个，其余转到val所指的字上睡眠 */
+
+/* 散列表的桶数，须为2的幂 */
+#define FUTEX_HASH_BITS 6
+#define FUTEX_HASH_SIZE (1 << FUTEX_HASH_BITS)
+
+void futex_init(void);
+int32_t futex_wake(volatile uint32_t * uaddr, uint32_t nr_wake);
+int32_t sys_futex(volatile uint32_t * uaddr, uint32_t op, uint32_t val);
+
+#endif  /* __THREAD_FUTEX_H */
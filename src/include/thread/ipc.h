@@ -0,0 +1,62 @@
+/* ipc.h
+ *   线程之间同步的消息传递
+ *
+ * 消息的两个字放在esi、edi中传递，不经过内存；
+ * 较长的消息另带一个缓冲区，由内核从发送者的空间直接复制到接收者的空间。
+ * 发送和接收都会阻塞到对方到来，接收者已在等待时直接切换到它
+ */
+
+#ifndef __THREAD_IPC_H
+#define __THREAD_IPC_H
+
+#include <stdint.h>
+#include <list.h>
+
+/* sys_ipc的操作 */
+#define IPC_SEND        0   /* 发送给partner，等到对方收下 */
+#define IPC_RECEIVE     1   /* 接收partner发来的消息，IPC_ANY表示任意发送者 */
+#define IPC_CALL        2   /* 发送给partner，接着等待它的回复 */
+#define IPC_REPLY       3   /* 回复正在等待的partner，对方未在等待时失败 */
+
+#define IPC_ANY         (-1)
+#define IPC_MAX_LEN     4096    /* 长消息的最大字节数 */
+
+/* 用户态的消息 */
+struct ipc_msg
+{
+    uint32_t words[2];      /* 在寄存器中传递 */
+    void * buf;             /* 长消息的缓冲区，为NULL时只传两个字 */
+    uint32_t len;           /* 发送的字节数，接收后为收到的字节数 */
+    uint32_t size;          /* 接收时缓冲区的大小，多出的部分被截掉 */
+};
+
+/* 线程的消息传递状态 */
+enum ipc_state
+{
+    IPC_IDLE = 0,
+    IPC_SENDING,            /* 在partner的senders中等待对方接收 */
+    IPC_RECEIVING,          /* 等待partner发来消息 */
+    IPC_DEAD                /* 线程正在退出 */
+};
+
+struct ipc_tcb
+{
+    uint8_t state;
+    bool calling;           /* 发送完成后接着接收对方的回复 */
+    int16_t partner;        /* 发送的目标，或接收时等待的发送者 */
+    uint32_t buf;           /* 长消息缓冲区在本线程空间中的地址 */
+    uint32_t len;
+    uint32_t size;
+    int32_t result;         /* 阻塞结束后系统调用的返回值 */
+    struct list senders;    /* 等待向本线程发送的线程 */
+    struct node send_tag;   /* 在接收者的senders中的结点 */
+};
+
+struct task_struct;
+
+void ipc_init(void);
+void ipc_tcb_init(struct ipc_tcb * ipc);
+int32_t sys_ipc(uint32_t op, int32_t partner, struct ipc_msg * msg);
+void ipc_exit(struct task_struct * pthread);
+
+#endif  /* __THREAD_IPC_H */
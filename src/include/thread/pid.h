@@ -0,0 +1,24 @@
+/* pid.h
+ *   pid的分配、回收，以及由pid查找任务的散列表
+ */
+
+#ifndef __THREAD_PID_H
+#define __THREAD_PID_H
+
+#include <stdint.h>
+#include <thread.h>
+
+/* pid_t为int16_t，可用的pid为1~32767，0保留不用 */
+#define PID_MAX         32768
+
+/* 散列表的桶数，须为2的幂 */
+#define PID_HASH_SIZE   128
+
+void pid_init(void);
+pid_t pid_alloc(void);
+void pid_free(pid_t pid);
+void pid_hash_add(struct task_struct * pthread);
+void pid_hash_remove(struct task_struct * pthread);
+struct task_struct * pid2thread(pid_t pid);
+
+#endif  /* __THREAD_PID_H */
@@ -0,0 +1,65 @@
+/* schedstat.h
+ *   调度统计：就绪等待时间、唤醒到运行的延迟分布、负载均值和空闲比例
+ */
+
+#ifndef __THREAD_SCHEDSTAT_H
+#define __THREAD_SCHEDSTAT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* 延迟直方图的桶数，第i个桶统计[2^i, 2^(i+1))个时钟周期的延迟，
+ * 第0个桶还包括0，更长的延迟都计入最后一个桶
+ */
+#define SCHED_HIST_BUCKETS  32
+
+/* 负载均值用定点数表示，低FSHIFT位为小数部分 */
+#define FSHIFT      11
+#define FIXED_1     (1 << FSHIFT)
+
+struct task_struct;
+struct cpu;
+
+/* 每个任务的调度统计 */
+struct sched_info
+{
+    uint64_t last_queued;   /* 最近一次进入就绪队列时的tsc */
+    uint64_t run_delay;     /* 在就绪队列中等待的总时间 */
+    uint32_t pcount;        /* 被调度上cpu的次数 */
+    bool wakeup;            /* 本次入队是否由阻塞后被唤醒引起 */
+};
+
+/* 每个cpu的调度统计，持有该cpu的rq_lock或在该cpu的时钟中断中更新 */
+struct cpu_sched_stat
+{
+    uint32_t nr_switches;   /* 任务切换次数 */
+    uint32_t nr_idle;       /* 切换到idle的次数 */
+    uint32_t nr_ticks;      /* 时钟嘀嗒数 */
+    uint32_t idle_ticks;    /* 其中运行idle的嘀嗒数 */
+    uint64_t run_delay;     /* 任务在本cpu上被调度前的等待时间之和 */
+    uint32_t lat_hist[SCHED_HIST_BUCKETS];  /* 唤醒到运行的延迟分布 */
+};
+
+/* sys_schedstat返回的全局统计，各cpu的计数之和 */
+struct schedstat
+{
+    uint32_t loadavg[3];    /* 1、5、15分钟的负载均值，定点数 */
+    uint32_t nr_cpus;
+    uint32_t nr_running;    /* 正在运行和就绪的任务数，不含idle */
+    uint32_t nr_switches;
+    uint32_t nr_ticks;
+    uint32_t idle_ticks;
+    uint32_t run_delay_ms;
+    uint32_t cycles_per_us; /* 用于把直方图的桶换算成微秒，未测量时为0 */
+    uint32_t lat_hist[SCHED_HIST_BUCKETS];
+};
+
+void sched_info_queued(struct task_struct * pthread, bool wakeup);
+void sched_info_switch(struct cpu * c, struct task_struct * prev,
+            struct task_struct * next);
+void sched_tick(struct cpu * c, struct task_struct * cur);
+void calc_global_load(void);
+int32_t sys_schedstat(struct schedstat * buf);
+void schedstat_ps(void);
+
+#endif  /* __THREAD_SCHEDSTAT_H */
@@ -0,0 +1,34 @@
+/* spinlock.h
+ *   自旋锁，用于多处理器之间的短时间互斥
+ */
+
+#ifndef __THREAD_SPINLOCK_H
+#define __THREAD_SPINLOCK_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <interrupt.h>
+
+/* 排队自旋锁(ticket spinlock)
+ * 申请者原子地取号next，等到owner轮到自己的号时获得锁，
+ * 保证各cpu按申请的先后顺序获得锁
+ */
+typedef struct spinlock
+{
+    volatile uint16_t owner;    /* 当前持有锁的号 */
+    volatile uint16_t next;     /* 下一个申请者取到的号 */
+
+    /* 统计信息，在持有锁时更新 */
+    uint32_t acquire_cnt;       /* 获得锁的次数 */
+    uint32_t contend_cnt;       /* 需要等待才获得锁的次数 */
+} spinlock;
+
+void spin_init(struct spinlock * plock);
+void spin_lock(struct spinlock * plock);
+void spin_unlock(struct spinlock * plock);
+bool spin_trylock(struct spinlock * plock);
+bool spin_is_locked(struct spinlock * plock);
+intr_status spin_lock_irqsave(struct spinlock * plock);
+void spin_unlock_irqrestore(struct spinlock * plock, intr_status status);
+
+#endif  /* __THREAD_SPINLOCK_H */
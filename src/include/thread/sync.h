@@ -6,14 +6,36 @@
 
 #include <list.h>
 #include <stdint.h>
-#include <thread.h>
+#include <spinlock.h>
 
-/* 信号量结构 */
+struct task_struct;
+
+/* 等待队列
+ * 本身不带锁，由使用者用自己的自旋锁保护，
+ * 睡眠时把这把锁交给wait_queue_sleep，阻塞后释放、被唤醒后重新获取
+ */
+typedef struct wait_queue
+{
+    struct list waiters;    /* 在此队列上阻塞的线程 */
+    struct list entries;    /* 观察此队列的wait_entry，每次唤醒都通知 */
+} wait_queue;
+
+/* 等待队列的观察者，队列被唤醒时调用func，调用时持有保护队列的锁
+ * 不占用线程的general_tag，一个线程可以同时观察多个队列，poll用它注册
+ */
+struct wait_entry
+{
+    struct node tag;        /* 在队列的entries中的结点 */
+    void (*func)(struct wait_entry * entry);
+};
+
+/* 信号量结构，value可大于1，即计数信号量 */
 typedef struct semaphore 
 {
-    uint8_t value;
+    struct spinlock lock;   /* 保护value和wq */
+    uint32_t value;
     /* 在此信号量上阻塞的队列 */
-    struct list waiters;
+    struct wait_queue wq;
 } semaphore; 
 
 /* 锁结构 */
@@ -22,13 +44,80 @@ typedef struct lock
     struct   task_struct * holder;  /* 锁的持有者 */
     struct   semaphore semaphore;   /* 用二元信号量实现锁 */
     uint32_t holder_repeat_nr;      /* 锁的持有者重复申请此锁的次数 */
+    struct   node holder_tag;       /* 在持有者held_locks队列中的结点 */
+    uint32_t acquire_cnt;           /* 获得锁的次数 */
+    uint32_t contend_cnt;           /* 需要等待才获得锁的次数 */
 } lock;
 
-void sema_init(struct semaphore * psema, uint8_t value);
+/* 条件变量，与struct lock配合使用
+ * 被唤醒后需重新检查等待的条件
+ */
+typedef struct condition
+{
+    struct spinlock lock;   /* 保护wq */
+    struct wait_queue wq;   /* 等待此条件的线程 */
+} condition;
+
+/* 读写锁
+ * 允许多个读者同时持有，写者独占。有写者在等待时新来的读者也要等待，
+ * 避免读者源源不断时写者饿死，所以同一线程不能重复获取读锁
+ */
+typedef struct rwlock
+{
+    struct spinlock lock;           /* 保护下面各项 */
+    uint32_t readers;               /* 持有读锁的读者数 */
+    uint32_t writers_waiting;       /* 等待写锁的写者数 */
+    struct task_struct * writer;    /* 持有写锁的写者 */
+    struct wait_queue read_wq;      /* 等待读锁的读者 */
+    struct wait_queue write_wq;     /* 等待写锁的写者 */
+} rwlock;
+
+/* 优先级继承时沿锁的等待链最多提升的层数，防止死锁成环时无限循环 */
+#define PI_CHAIN_MAX    8
+
+/* 自适应互斥锁自旋等待的最大次数 */
+#define MUTEX_SPIN_MAX  1000
+
+/* 自适应互斥锁
+ * 未被持有时用一条cmpxchg指令获得，不关中断也不扫描等待队列；
+ * 持有者正在别的cpu上运行时，它很可能很快释放，先自旋等待，
+ * 自旋MUTEX_SPIN_MAX次仍未获得或持有者不在运行时再阻塞
+ */
+typedef struct mutex
+{
+    struct   task_struct * volatile owner;  /* 锁的持有者 */
+    struct   spinlock wait_lock;    /* 保护wq */
+    struct   wait_queue wq;         /* 阻塞在此锁上的线程 */
+    uint32_t acquire_cnt;           /* 获得锁的次数 */
+    uint32_t contend_cnt;           /* 未能直接获得锁的次数 */
+    uint32_t block_cnt;             /* 自旋后仍需阻塞的次数 */
+} mutex;
+
+void wait_queue_init(struct wait_queue * wq);
+bool wait_queue_empty(struct wait_queue * wq);
+void wait_queue_sleep(struct wait_queue * wq, struct spinlock * plock);
+bool wait_queue_wake_one(struct wait_queue * wq);
+uint32_t wait_queue_wake_all(struct wait_queue * wq);
+void wait_queue_add_entry(struct wait_queue * wq, struct wait_entry * entry);
+void wait_queue_del_entry(struct wait_entry * entry);
+void sema_init(struct semaphore * psema, uint32_t value);
 void sema_down(struct semaphore * psema);
 void sema_up(struct semaphore * psema);
 void lock_init(struct lock * plock);
 void lock_acquire(struct lock * plock);
 void lock_release(struct lock * plock);
+void mutex_init(struct mutex * pmutex);
+void mutex_lock(struct mutex * pmutex);
+bool mutex_trylock(struct mutex * pmutex);
+void mutex_unlock(struct mutex * pmutex);
+void cond_init(struct condition * cond);
+void cond_wait(struct condition * cond, struct lock * plock);
+void cond_signal(struct condition * cond);
+void cond_broadcast(struct condition * cond);
+void rwlock_init(struct rwlock * rw);
+void read_lock(struct rwlock * rw);
+void read_unlock(struct rwlock * rw);
+void write_lock(struct rwlock * rw);
+void write_unlock(struct rwlock * rw);
 
 #endif  /* __THREAD_SYNC_H */
\ No newline at end of file
@@ -7,6 +7,11 @@
 #include <list.h>
 #include <memory.h>
 #include <bitmap.h>
+#include <acct.h>
+#include <schedstat.h>
+#include <fpu.h>
+#include <ipc.h>
+#include <sync.h>
 
 /* 下面的魔数作为栈的边界标记，用于检测栈的溢出 */
 #define STACK_BORDER_MAGIC  0x20170620
@@ -21,6 +26,13 @@ typedef void thread_func(void *);
 
 typedef int16_t pid_t;
 
+/* 一个任务的信息在ps输出中最多占的字节数 */
+#define TASK_INFO_LEN 128
+
+struct cpu;
+struct spinlock;
+struct lock;
+
 /* 进程或线程的状态 */
 typedef enum {
     TASK_RUNNING = 0,
@@ -91,16 +103,34 @@ typedef struct task_struct{
     pid_t pid;
     task_status status;
     char name[TASK_NAME_LEN];
-    uint8_t priority;       /* 线程优先级 */
+    uint8_t priority;       /* 线程优先级，可能因优先级继承而被临时提升 */
+    uint8_t base_priority;  /* 线程本身的优先级 */
     uint8_t ticks;          /* 每次在处理器上执行的时间嘀嗒数 */
     uint32_t elapsed_ticks; /* 此任务执行了多久 */ 
 
+    /* 任务所在的cpu，就绪时为所在就绪队列的cpu，运行时为正在运行的cpu */
+    struct cpu * cpu;
+
+    /* 正在某个cpu上运行，从被选中到换下后上下文保存完为止都为true。
+     * 阻塞的任务在换下之前就可能被唤醒放入就绪队列，
+     * 此时还不能被别的cpu运行，也不能被释放
+     */
+    volatile bool on_cpu;
+
+    /* 抢占计数，大于0时中断返回前不调度，推迟到计数减为0时 */
+    int32_t preempt_count;
+    uint64_t preempt_start_tsc; /* 本段禁止抢占开始时的tsc，供跟踪用 */
+    void * preempt_start_ip;    /* 本段禁止抢占的调用者 */
+
     /* general_tag的作用是用于线程在一般的队列中的结点 */
     struct node general_tag;
 
     /* all_list_tag的作用是用于全部线程队列中的结点 */
     struct node all_list_tag;
 
+    /* pid_tag用于pid散列表中的结点 */
+    struct node pid_tag;
+
     /* 进程自己页表的虚拟地址，如果是线程，则为NULL */
     uint32_t * pgdir;
 
@@ -115,11 +145,37 @@ typedef struct task_struct{
     uint32_t cwd_inode_nr;  /* 进程所在的工作目录的inode编号 */
 
     int16_t parent_pid;     /* 父进程pid */
+    int8_t exit_status;     /* 退出状态，进程退出后由父进程在wait中取走 */
+
+    /* 优先级继承 */
+    struct lock * blocked_on;   /* 正在等待的锁 */
+    struct list held_locks;     /* 持有的锁 */
+
+    struct task_acct acct;      /* 资源使用统计 */
+    struct sched_info sched;    /* 调度统计 */
+    uint32_t wake_tick;         /* 休眠的任务被唤醒的时刻 */
+
+    /* 浮点状态的保存区，第一次使用浮点单元时才分配 */
+    struct fpu_state * fpu;
+    bool fpu_used;              /* 本时间片内是否用过浮点单元 */
+
+    struct io_ring_ctx * ioring;    /* 异步提交文件操作的环，未建立时为NULL */
+    struct vdso_proc * vdso;    /* 进程数据页的内核地址，内核线程为NULL */
+
+    /* 线程组：clone出的线程与创建者共享页表、虚拟地址空间、
+     * 文件描述符、工作目录和堆，共享的部分都以组长pcb中的为准
+     */
+    struct task_struct * group_leader;
+    uint32_t nr_threads;        /* 组内存活的线程数，只在组长中有效 */
+    struct list vmas;           /* 按需映射的区域，只在组长中有效 */
+    struct lock vma_lock;       /* 保护vmas和缺页时的映射，只在组长中有效 */
+    uint32_t tls;               /* 线程局部存储的基址，由gs经TLS描述符访问 */
+
+    struct ipc_tcb ipc;         /* 消息传递的状态 */
     
     uint32_t stack_magic;   /* 用这串数字做栈的边界标记，用于检测栈的溢出 */
 } task_struct;
 
-extern struct list thread_ready_list;
 extern struct list thread_all_list;
 
 void thread_create(task_struct * pthread, thread_func func,
@@ -129,11 +185,28 @@ struct task_struct * thread_start(char *name, int pri,
         thread_func func, void * func_arg);
 struct task_struct * running_thread(void);
 void schedule(void);
+void schedule_tail(void);
 void thread_init(void);
 void thread_block(task_status stat);
+void thread_block_unlock(task_status stat, struct spinlock * plock);
 void thread_unblock(struct task_struct * pthread);
 void thread_yield(void);
-pid_t fork_pid(void);
-void sys_ps(void);
+void thread_handoff(struct task_struct * next);
+void preempt_disable(void);
+void preempt_enable(void);
+void thread_set_priority(struct task_struct * pthread, uint8_t pri);
+void thread_enqueue(struct task_struct * pthread);
+void thread_all_list_add(struct task_struct * pthread);
+void thread_all_list_remove(struct task_struct * pthread);
+struct task_struct * thread_all_list_find(check_elem check, int arg);
+
+/* 把pthread的信息格式化到buf中，返回长度，不超过TASK_INFO_LEN */
+typedef uint32_t task_info_fmt(struct task_struct * pthread, char * buf);
+void thread_all_list_print(task_info_fmt * fmt);
+void thread_exit_current(void);
+void thread_reap_dead(void);
+void thread_wait_off_cpu(struct task_struct * pthread);
+void thread_ap_idle(struct cpu * c);
+void sys_ps(int32_t mode);
 
 #endif  /* __THREAD_THREAD_H */
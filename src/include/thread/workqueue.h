@@ -0,0 +1,48 @@
+/* workqueue.h
+ *   工作队列：由内核工作线程执行的延迟任务
+ */
+
+#ifndef __THREAD_WORKQUEUE_H
+#define __THREAD_WORKQUEUE_H
+
+#include <stdint.h>
+#include <list.h>
+#include <sync.h>
+#include <spinlock.h>
+
+#define WQ_MAX_WORKERS  4       /* 每个工作队列最多的工作线程数 */
+#define WQ_WORKER_PRIO  8       /* 工作线程的优先级 */
+
+typedef void (*work_func)(void * arg);
+
+/* 一项工作，由提交者分配，执行完之前不能释放 */
+typedef struct work_struct
+{
+    struct node entry;          /* 在工作队列中的结点 */
+    work_func func;             /* 要执行的函数 */
+    void * arg;                 /* func的参数 */
+    volatile bool pending;      /* 是否已在队列中尚未执行 */
+} work_struct;
+
+/* 工作队列 */
+typedef struct workqueue
+{
+    const char * name;
+    struct spinlock lock;       /* 保护works和idle_workers */
+    struct list works;          /* 待执行的工作 */
+    struct wait_queue idle_workers;     /* 没有工作时睡眠的工作线程 */
+    uint8_t nr_workers;
+    struct task_struct * workers[WQ_MAX_WORKERS];
+    uint32_t nr_queued;         /* 提交的工作数 */
+    uint32_t nr_done;           /* 执行完的工作数 */
+} workqueue;
+
+extern struct workqueue * system_wq;
+
+void work_init(struct work_struct * work, work_func func, void * arg);
+struct workqueue * workqueue_create(const char * name, uint8_t nr_workers);
+bool queue_work(struct workqueue * wq, struct work_struct * work);
+bool schedule_work(struct work_struct * work);
+void workqueue_init(void);
+
+#endif  /* __THREAD_WORKQUEUE_H */
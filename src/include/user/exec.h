@@ -5,7 +5,9 @@
 #define __USERPROG_EXEC_H
 
 #include <stdint.h>
+#include <thread.h>
 
 int32_t sys_execv(const char* path, const char*  argv[]);
+pid_t sys_spawn(const char* path, const char* argv[], const int32_t* fds);
 
 #endif
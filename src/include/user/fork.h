@@ -11,4 +11,7 @@
   */
  pid_t sys_fork(void);
 
+pid_t sys_clone(void * entry, void * stack, void * tls);
+void sys_thread_exit(volatile uint32_t * done);
+
 #endif  /* __USERPROG_FORK_H */
\ No newline at end of file
@@ -0,0 +1,22 @@
+/* image_cache.h
+ *   可执行文件只读页的缓存
+ *
+ * 以inode编号和页的虚拟地址为键，保存已读入的代码和只读数据页，
+ * 执行同一文件的进程直接映射缓存中的物理页，不再读硬盘
+ */
+
+#ifndef __USERPROG_IMAGE_CACHE_H
+#define __USERPROG_IMAGE_CACHE_H
+
+#include <stdint.h>
+
+#define IMAGE_CACHE_MAX     256     /* 缓存的最大页数 */
+
+void image_cache_init(void);
+uint32_t image_cache_get(uint32_t i_no, uint32_t vaddr);
+uint32_t image_cache_gen(void);
+void image_cache_add(uint32_t i_no, uint32_t vaddr, uint32_t pg_phy_addr,
+                uint32_t gen);
+void image_cache_invalidate(uint32_t i_no);
+
+#endif  /* __USERPROG_IMAGE_CACHE_H */
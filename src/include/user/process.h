@@ -8,14 +8,16 @@
 #include <stdint.h>
 
 #define default_prio    31
-/* 用户栈空间的下边界 */
-#define USER_STACK3_VADDR   (0xc0000000 - 0x1000)
+/* 用户栈在用户空间的顶端，最多USER_STACK_MAX字节，页在访问时才分配 */
+#define USER_STACK_TOP      0xc0000000
+#define USER_STACK_MAX      (8 * 1024 * 1024)
 
 /* linux用户程序入口地址 */
 #define USER_VADDR_START    0x8048000
 
 void process_execute(void * filename, char *name);
 void start_process(void * filename);
+void process_enter_user(void * entry, void * esp, char ** argv, uint32_t argc);
 void process_activate(struct task_struct * pthread);
 void page_dir_activate(struct task_struct * pthread);
 uint32_t * create_page_dir(void);
@@ -0,0 +1,64 @@
+/* pthread.h
+ *   基于clone的用户线程
+ *
+ * 线程控制块放在线程栈的顶端，gs:0处是它自己的地址。
+ * 互斥锁和条件变量基于futex，没有争用时不陷入内核；
+ * 放在mmap_shared得到的共享内存中时，fork出的进程之间也能使用
+ */
+
+#ifndef __LIB_USER_PTHREAD_H
+#define __LIB_USER_PTHREAD_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define PTHREAD_STACK_SIZE  (16 * 1024)     /* 每个线程的用户栈大小 */
+
+/* 线程控制块 */
+struct pthread
+{
+    struct pthread * self;      /* 须为第一个成员，pthread_self读gs:0 */
+    void * (*start_routine)(void *);
+    void * arg;
+    void * retval;
+    void * stack;               /* malloc得到的栈，join之后释放 */
+    volatile uint32_t done;     /* 内核不再使用线程的栈之后置1 */
+    int32_t tid;
+};
+
+typedef struct pthread * pthread_t;
+
+/* 互斥锁，locked为0表示空闲，1表示被持有，2表示被持有且可能有等待者 */
+typedef struct
+{
+    volatile uint32_t locked;
+} pthread_mutex_t;
+
+#define PTHREAD_MUTEX_INITIALIZER   { 0 }
+
+/* 条件变量，每次signal或broadcast时seq加1 */
+typedef struct
+{
+    volatile uint32_t seq;
+    pthread_mutex_t * mutex;    /* 等待时使用的互斥锁，broadcast把等待者转到它上面 */
+} pthread_cond_t;
+
+#define PTHREAD_COND_INITIALIZER    { 0, NULL }
+
+int32_t pthread_create(pthread_t * thread,
+                void * (*start_routine)(void *), void * arg);
+int32_t pthread_join(pthread_t thread, void ** retval);
+void pthread_exit(void * retval);
+pthread_t pthread_self(void);
+
+void pthread_mutex_init(pthread_mutex_t * mutex);
+void pthread_mutex_lock(pthread_mutex_t * mutex);
+bool pthread_mutex_trylock(pthread_mutex_t * mutex);
+void pthread_mutex_unlock(pthread_mutex_t * mutex);
+
+void pthread_cond_init(pthread_cond_t * cond);
+void pthread_cond_wait(pthread_cond_t * cond, pthread_mutex_t * mutex);
+void pthread_cond_signal(pthread_cond_t * cond);
+void pthread_cond_broadcast(pthread_cond_t * cond);
+
+#endif  /* __LIB_USER_PTHREAD_H */
@@ -0,0 +1,36 @@
+/* shm_ring.h
+ *   放在共享内存段中的单生产者单消费者环
+ *
+ * 环由等长的槽组成，生产者直接在槽里写数据，消费者直接在槽里读，
+ * 两个进程之间不经过内核复制。环满或空时在futex上睡眠
+ */
+
+#ifndef __LIB_USER_SHM_RING_H
+#define __LIB_USER_SHM_RING_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* 环头，后面紧跟nr_slots个槽
+ * head和tail都是只增不减的计数，取模nr_slots得到槽的下标。
+ * 生产者只写head和wr_waiting，消费者只写tail和rd_waiting，
+ * 对方的等待标志由唤醒者清0
+ */
+struct shm_ring
+{
+    volatile uint32_t head;         /* 下一个要写的槽 */
+    volatile uint32_t tail;         /* 下一个要读的槽 */
+    volatile uint32_t rd_waiting;   /* 消费者在head上睡眠 */
+    volatile uint32_t wr_waiting;   /* 生产者在tail上睡眠 */
+    uint32_t slot_size;
+    uint32_t nr_slots;              /* 2的幂 */
+    uint32_t pad[2];
+};
+
+struct shm_ring * shm_ring_init(void * mem, uint32_t size, uint32_t slot_size);
+void * shm_ring_produce(struct shm_ring * ring);
+void shm_ring_publish(struct shm_ring * ring);
+void * shm_ring_consume(struct shm_ring * ring);
+void shm_ring_release(struct shm_ring * ring);
+
+#endif  /* __LIB_USER_SHM_RING_H */
@@ -9,5 +9,7 @@
 void syscall_init(void);
 
 uint32_t sys_getpid(void);
+uint32_t sys_gettid(void);
+int16_t sys_getppid(void);
 
 #endif  /* __USERPROG_SYS_H */
@@ -6,6 +6,14 @@
 
 #include <stdint.h>
 #include <fs.h>
+#include <acct.h>
+#include <schedstat.h>
+#include <ioring.h>
+#include <vdso.h>
+#include <futex.h>
+#include <ipc.h>
+#include <poll.h>
+#include <tty.h>
 
 /* 系统调用子功能号 */
 enum SYSCALL_NR {
@@ -32,9 +40,40 @@ enum SYSCALL_NR {
     SYS_STAT,
     SYS_PS,
     SYS_EXECV,
+    SYS_IRQSTAT,
+    SYS_LATENCY,
+    SYS_GETRUSAGE,
+    SYS_TIMES,
+    SYS_SCHEDSTAT,
+    SYS_SLEEP,
+    SYS_FASTCALL,
+    SYS_RING_SETUP,
+    SYS_RING_ENTER,
+    SYS_GETPPID,
+    SYS_CLONE,
+    SYS_THREAD_EXIT,
+    SYS_GETTID,
+    SYS_SCHED_YIELD,
+    SYS_FUTEX,
+    SYS_MMAP_SHARED,
+    SYS_EXIT,
+    SYS_WAIT,
+    SYS_PIPE,
+    SYS_DUP2,
+    SYS_SHM_OPEN,
+    SYS_SHM_MAP,
+    SYS_SHM_UNMAP,
+    SYS_IPC,
+    SYS_POLL,
+    SYS_TTY_MODE,
+    SYS_SPAWN,
 };
 
 uint32_t getpid(void);
+int16_t getppid(void);
+uint32_t getticks(void);
+uint64_t clock_ns(void);
+const struct vdso_data * vdso(void);
 uint32_t write(int32_t fd, const void * buf, uint32_t count);
 void * malloc(uint32_t size);
 void free(void * ptr);
@@ -55,8 +94,42 @@ struct dir_entry* readdir(struct dir* dir);
 void rewinddir(struct dir* dir);
 int32_t stat(const char* path, struct stat* buf);
 int32_t chdir(const char* path);
-void ps(void);
+/* ps的显示模式 */
+#define PS_DEFAULT  0   /* 任务列表 */
+#define PS_RUSAGE   1   /* 资源使用情况 */
+#define PS_SCHED    2   /* 调度统计 */
+
+void ps(int32_t mode);
 int execv(const char* pathname, char** argv);
+void irqstat(void);
+void latency(int32_t reset);
+int32_t getrusage(int32_t who, struct rusage * ru);
+uint32_t times(struct tms * buf);
+int32_t schedstat(struct schedstat * buf);
+void msleep(uint32_t m_seconds);
+bool fast_syscall(bool enable);
+struct io_ring * ring_setup(void);
+int32_t ring_enter(uint32_t to_submit, uint32_t min_complete);
+int32_t clone(void * entry, void * stack, void * tls);
+void thread_exit(volatile uint32_t * done);
+uint32_t gettid(void);
+void sched_yield(void);
+int32_t futex(volatile uint32_t * uaddr, uint32_t op, uint32_t val);
+void * mmap_shared(uint32_t size);
+void exit(int32_t status);
+int16_t wait(int32_t * status);
+int32_t pipe(int32_t pipefd[2]);
+int32_t dup2(int32_t oldfd, int32_t newfd);
+int32_t shm_open(const char * name, uint32_t size);
+void * shm_map(int32_t shmid);
+int32_t shm_unmap(void * addr);
+int32_t ipc_send(int32_t dest, struct ipc_msg * msg);
+int32_t ipc_receive(int32_t from, struct ipc_msg * msg);
+int32_t ipc_call(int32_t dest, struct ipc_msg * msg);
+int32_t ipc_reply(int32_t dest, struct ipc_msg * msg);
+int32_t poll(struct pollfd * fds, uint32_t nfds, int32_t timeout);
+int32_t tty_mode(int32_t mode);
+int16_t spawn(const char* pathname, char** argv, const int32_t* fds);
 
 
 #endif  /* __LIB_USER_SYSCALL_H */
@@ -7,6 +7,9 @@
 #include <thread.h>
 
 void update_tss_esp(struct task_struct * pthread);
+void tls_switch(struct task_struct * pthread);
 void tss_init(void);
+void tss_cpu_init(uint8_t cpu_id);
+int32_t sys_fastcall(void);
 
 #endif  /* __USERPROG_TSS_H */
@@ -0,0 +1,47 @@
+/* vma.h
+ *   进程虚拟地址空间中按需建立映射的区域
+ *
+ * exec只记录elf各可加载段的位置，不分配物理页。
+ * 进程第一次访问某页时，在缺页异常中分配物理页，
+ * 从文件读入此页的内容，文件之外的部分(bss)填0
+ */
+
+#ifndef __USERPROG_VMA_H
+#define __USERPROG_VMA_H
+
+#include <stdint.h>
+#include <list.h>
+
+#define VMA_WRITE   0x1     /* 可写，否则映射为只读 */
+#define VMA_STACK   0x2     /* 用户栈，其下有一页保护页 */
+
+struct inode;
+struct task_struct;
+
+/* 一段连续的虚拟地址区域，只在组长的vmas链表中 */
+struct vm_area
+{
+    struct node tag;        /* 在进程vmas链表中的结点 */
+    uint32_t start;         /* 起始地址，页对齐 */
+    uint32_t end;           /* 结束地址，页对齐，不含 */
+    uint32_t flags;
+
+    /* [file_vaddr, file_vaddr + file_size)的内容来自inode中偏移file_off处，
+     * 区域中的其余部分填0，inode为NULL时全部填0
+     */
+    struct inode * inode;
+    uint32_t file_vaddr;
+    uint32_t file_size;
+    uint32_t file_off;
+};
+
+void vma_init(void);
+void vma_cpu_init(void);
+int32_t vma_add(uint32_t vaddr, uint32_t mem_size, uint32_t flags,
+            struct inode * inode, uint32_t file_off, uint32_t file_size);
+int32_t vma_add_stack(void);
+void vma_release(struct task_struct * pthread, bool unmap);
+int32_t vma_copy(struct task_struct * child, struct task_struct * parent);
+bool user_fault_in(const void * addr, uint32_t len, bool write);
+
+#endif  /* __USERPROG_VMA_H */
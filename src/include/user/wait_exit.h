@@ -0,0 +1,17 @@
+/* wait_exit.h
+ *   进程的退出和父进程对子进程的回收
+ */
+
+#ifndef __USERPROG_WAIT_EXIT_H
+#define __USERPROG_WAIT_EXIT_H
+
+#include <thread.h>
+
+#define INIT_PID    1   /* 父进程先退出的子进程过继给init */
+
+void wait_exit_init(void);
+pid_t sys_wait(int32_t * status);
+void sys_exit(int32_t status);
+void thread_group_put(struct task_struct * leader);
+
+#endif  /* __USERPROG_WAIT_EXIT_H */
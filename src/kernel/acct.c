@@ -0,0 +1,214 @@
+/* acct.c
+ *   任务的资源使用统计
+ *
+ * 执行时间按tsc精确结算：从用户态进入内核（系统调用、中断、异常）时，
+ * 把上次结算以来的时间计入用户态；返回用户态和切换任务时计入内核态。
+ * 内核中嵌套的中断不改变所处的态，其耗时计入被中断的任务的内核态时间
+ */
+
+#include <acct.h>
+#include <thread.h>
+#include <timer.h>
+#include <tsc.h>
+#include <list.h>
+#include <stdio.h>
+#include <string.h>
+#include <file.h>
+#include <fs.h>
+#include <global.h>
+#include <interrupt.h>
+
+/* 初始化任务的统计数据，创建任务和fork时调用 */
+void acct_init_task(struct task_struct * pthread)
+{
+    memset(&pthread->acct, 0, sizeof(struct task_acct));
+    pthread->acct.acct_tsc = rdtsc();
+}
+
+/* 从用户态进入内核时调用，之前的时间计入用户态，调用时已关中断 */
+void acct_user_exit(void)
+{
+    struct task_acct * acct = &running_thread()->acct;
+    uint64_t now = rdtsc();
+
+    acct->utime += now - acct->acct_tsc;
+    acct->acct_tsc = now;
+}
+
+/* 返回用户态之前调用，之前的时间计入内核态，调用时已关中断 */
+void acct_user_enter(void)
+{
+    struct task_acct * acct = &running_thread()->acct;
+    uint64_t now = rdtsc();
+
+    acct->stime += now - acct->acct_tsc;
+    acct->acct_tsc = now;
+}
+
+/* 任务切换前在schedule中调用，调用时已关中断并持有就绪队列锁
+ * prev被换下时仍为就绪状态，说明是时间片用完或主动让出，记为非自愿切换
+ */
+void acct_switch(struct task_struct * prev, struct task_struct * next)
+{
+    uint64_t now = rdtsc();
+
+    prev->acct.stime += now - prev->acct.acct_tsc;
+    prev->acct.acct_tsc = now;
+    next->acct.acct_tsc = now;
+
+    if (TASK_READY == prev->status)
+    {
+        prev->acct.nivcsw++;
+    }
+    else
+    {
+        prev->acct.nvcsw++;
+    }
+}
+
+/* 把当前任务尚未结算的时间计入内核态，在系统调用中读取自己的统计前调用 */
+static void acct_update_self(void)
+{
+    intr_status old_status = intr_disable();
+    acct_user_enter();
+    intr_set_status(old_status);
+}
+
+/* 时钟周期数换算成嘀嗒数，tsc频率未测量时返回0 */
+static uint32_t acct_cycles_to_ticks(uint64_t cycles, uint32_t * rem)
+{
+    if (tsc_per_tick == 0)
+    {
+        *rem = 0;
+        return 0;
+    }
+    return (uint32_t)div_u64_rem(cycles, tsc_per_tick, rem);
+}
+
+/* 时钟周期数换算成毫秒 */
+uint32_t acct_cycles_to_ms(uint64_t cycles)
+{
+    uint32_t rem;
+    uint32_t t = acct_cycles_to_ticks(cycles, &rem);
+
+    if (tsc_per_tick == 0)
+    {
+        return 0;
+    }
+    return t * (1000 / IRQ0_FREQUENCY) +
+                rem * (1000 / IRQ0_FREQUENCY) / tsc_per_tick;
+}
+
+/* 时钟周期数换算成秒和微秒 */
+static void acct_cycles_to_timeval(uint64_t cycles, struct timeval * tv)
+{
+    uint32_t rem;
+    uint32_t t = acct_cycles_to_ticks(cycles, &rem);
+
+    tv->tv_sec = t / IRQ0_FREQUENCY;
+    tv->tv_usec = (t % IRQ0_FREQUENCY) * (1000000 / IRQ0_FREQUENCY);
+    if (tsc_per_tick != 0)
+    {
+        /* 余数乘以10000可能超过32位 */
+        tv->tv_usec += (uint32_t)div_u64_rem(
+                    (uint64_t)rem * (1000000 / IRQ0_FREQUENCY),
+                    tsc_per_tick, &rem);
+    }
+}
+
+/* 获取资源使用情况，成功返回0，失败返回-1
+ * 子进程的统计要在其退出并被回收后才能累加，目前没有exit/wait，
+ * RUSAGE_CHILDREN总是返回全0
+ */
+int32_t sys_getrusage(int32_t who, struct rusage * ru)
+{
+    if (ru == NULL || (who != RUSAGE_SELF && who != RUSAGE_CHILDREN))
+    {
+        return -1;
+    }
+
+    memset(ru, 0, sizeof(struct rusage));
+    if (RUSAGE_CHILDREN == who)
+    {
+        return 0;
+    }
+
+    acct_update_self();
+    struct task_acct * acct = &running_thread()->acct;
+
+    acct_cycles_to_timeval(acct->utime, &ru->ru_utime);
+    acct_cycles_to_timeval(acct->stime, &ru->ru_stime);
+    ru->ru_minflt  = acct->min_flt;
+    ru->ru_majflt  = acct->maj_flt;
+    ru->ru_inblock = (uint32_t)(acct->read_bytes >> 9);
+    ru->ru_oublock = (uint32_t)(acct->write_bytes >> 9);
+    ru->ru_nvcsw   = acct->nvcsw;
+    ru->ru_nivcsw  = acct->nivcsw;
+    return 0;
+}
+
+/* 获取当前进程的执行时间，buf可以为NULL
+ * 返回开机以来的嘀嗒数
+ */
+uint32_t sys_times(struct tms * buf)
+{
+    if (buf != NULL)
+    {
+        uint32_t rem;
+
+        acct_update_self();
+        struct task_acct * acct = &running_thread()->acct;
+
+        buf->tms_utime = acct_cycles_to_ticks(acct->utime, &rem);
+        buf->tms_stime = acct_cycles_to_ticks(acct->stime, &rem);
+        buf->tms_cutime = 0;
+        buf->tms_cstime = 0;
+    }
+    return ticks;
+}
+
+/* 在buf末尾追加value，用空格补齐到8个字符宽 */
+static void acct_column(char * buf, uint32_t value)
+{
+    uint32_t len = strlen(buf);
+    uint32_t end = len + 8;
+
+    sprintf(buf + len, "%d", value);
+    len = strlen(buf);
+    do
+    {
+        buf[len++] = ' ';
+    } while (len < end);
+    buf[len] = '\0';
+}
+
+/* thread_all_list_print的回调函数，把一个任务的统计数据格式化到buf中 */
+static uint32_t acct_task_info(struct task_struct * pthread, char * buf)
+{
+    struct task_acct * acct = &pthread->acct;
+
+    buf[0] = '\0';
+    acct_column(buf, pthread->pid);
+    acct_column(buf, acct_cycles_to_ms(acct->utime));
+    acct_column(buf, acct_cycles_to_ms(acct->stime));
+    acct_column(buf, acct->nvcsw);
+    acct_column(buf, acct->nivcsw);
+    acct_column(buf, (uint32_t)(acct->read_bytes >> 10));
+    acct_column(buf, (uint32_t)(acct->write_bytes >> 10));
+    acct_column(buf, acct_cycles_to_ms(acct->blkio_delay));
+    acct_column(buf, acct->min_flt + acct->maj_flt);
+    strcat(buf, pthread->name);
+    strcat(buf, "\n");
+    return strlen(buf);
+}
+
+/* 打印各任务的资源使用情况，时间单位为毫秒，读写单位为KB */
+void acct_ps(void)
+{
+    char * title = "PID     UTIME   STIME   VCSW    IVCSW   "
+                   "READ    WRITE   IOWAIT  PF      COMMAND\n";
+
+    acct_update_self();
+    sys_write(stdout_no, title, strlen(title));
+    thread_all_list_print(acct_task_info);
+}
@@ -0,0 +1,239 @@
+/* fpu.c
+ *   x87/SSE浮点状态的惰性保存与恢复
+ *
+ * 任务切换时不恢复浮点寄存器，只置cr0.TS。任务第一次执行浮点或SSE指令时
+ * 触发#NM(7号异常)，在处理程序中清TS并恢复该任务的浮点状态，
+ * 本时间片内再用浮点指令就不会再陷入。
+ * 任务被换下时，只有本时间片内用过浮点单元才保存其状态，
+ * 从不使用浮点的任务没有任何额外开销。
+ * 换下时就保存，任务被别的cpu偷走后也能在那里正确恢复
+ */
+
+#include <fpu.h>
+#include <thread.h>
+#include <interrupt.h>
+#include <memory.h>
+#include <string.h>
+#include <global.h>
+#include <debug.h>
+#include <print.h>
+
+#define CR0_MP      (1 << 1)    /* 配合TS使wait/fwait也触发#NM */
+#define CR0_EM      (1 << 2)    /* 置位时浮点指令一律触发#NM，表示没有浮点单元 */
+#define CR0_TS      (1 << 3)    /* 任务切换标志，置位时浮点指令触发#NM */
+#define CR0_NE      (1 << 5)    /* 浮点异常以#MF报告，而不是经8259A的IRQ13 */
+#define CR4_OSFXSR      (1 << 9)    /* 允许fxsave/fxrstor及SSE指令 */
+#define CR4_OSXMMEXCPT  (1 << 10)   /* SSE浮点异常以#XM报告 */
+
+#define CPUID_FPU   (1 << 0)
+#define CPUID_FXSR  (1 << 24)
+#define CPUID_SSE   (1 << 25)
+
+#define MXCSR_DEFAULT   0x1f80  /* 屏蔽所有SSE浮点异常，就近舍入 */
+
+static bool has_fpu;
+static bool has_fxsr;
+static bool has_sse;
+
+static inline void clts(void)
+{
+    asm volatile ("clts");
+}
+
+/* 置cr0.TS，之后的浮点指令会触发#NM */
+static inline void stts(void)
+{
+    uint32_t cr0;
+    asm volatile ("movl %%cr0, %0" : "=r"(cr0));
+    asm volatile ("movl %0, %%cr0" : : "r"(cr0 | CR0_TS));
+}
+
+/* 把浮点寄存器保存到st */
+static void fpu_save(struct fpu_state * st)
+{
+    if (has_fxsr)
+    {
+        asm volatile ("fxsave %0" : "=m"(*st));
+    }
+    else
+    {
+        /* fnsave保存之后会重新初始化浮点单元 */
+        asm volatile ("fnsave %0; fwait" : "=m"(*st));
+    }
+}
+
+/* 从st恢复浮点寄存器 */
+static void fpu_restore(struct fpu_state * st)
+{
+    if (has_fxsr)
+    {
+        asm volatile ("fxrstor %0" : : "m"(*st));
+    }
+    else
+    {
+        asm volatile ("frstor %0" : : "m"(*st));
+    }
+}
+
+/* 把浮点单元初始化为默认状态 */
+static void fpu_reset(void)
+{
+    asm volatile ("fninit");
+    if (has_sse)
+    {
+        uint32_t mxcsr = MXCSR_DEFAULT;
+        asm volatile ("ldmxcsr %0" : : "m"(mxcsr));
+    }
+}
+
+/* #NM的处理函数，当前任务在TS置位时执行了浮点指令 */
+static void intr_nm_handler(uint8_t vec_nr UNUSED)
+{
+    struct task_struct * cur = running_thread();
+
+    /* 第一次使用时才分配保存区，分配时可能阻塞，
+     * 此时还没有动浮点单元，被换下再换上后TS仍是置位的
+     */
+    if (cur->fpu == NULL)
+    {
+        struct fpu_state * st = get_kernel_pages(1);
+        if (st == NULL)
+        {
+            PANIC("fpu: no memory for fpu state\n");
+        }
+
+        intr_status old_status = intr_disable();
+        cur->fpu = st;
+        clts();
+        fpu_reset();
+        cur->fpu_used = true;
+        intr_set_status(old_status);
+        return;
+    }
+
+    intr_status old_status = intr_disable();
+    clts();
+    fpu_restore(cur->fpu);
+    cur->fpu_used = true;
+    intr_set_status(old_status);
+}
+
+/* 设置本cpu的cr0和cr4，每个cpu都要调用一次 */
+void fpu_cpu_init(void)
+{
+    if (!has_fpu)
+    {
+        return;
+    }
+
+    uint32_t cr0, cr4;
+    asm volatile ("movl %%cr0, %0" : "=r"(cr0));
+    cr0 &= ~CR0_EM;
+    cr0 |= CR0_MP | CR0_NE;
+    asm volatile ("movl %0, %%cr0" : : "r"(cr0));
+
+    if (has_fxsr)
+    {
+        asm volatile ("movl %%cr4, %0" : "=r"(cr4));
+        cr4 |= CR4_OSFXSR;
+        if (has_sse)
+        {
+            cr4 |= CR4_OSXMMEXCPT;
+        }
+        asm volatile ("movl %0, %%cr4" : : "r"(cr4));
+    }
+
+    fpu_reset();
+    stts();
+}
+
+/* 检测浮点单元及SSE的支持情况，注册#NM的处理函数 */
+void fpu_init(void)
+{
+    put_str("fpu_init ... ");
+
+    uint32_t eax = 1, ebx, ecx, edx;
+    asm volatile ("cpuid"
+                : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+
+    has_fpu = (edx & CPUID_FPU) != 0;
+    has_fxsr = (edx & CPUID_FXSR) != 0;
+    has_sse = has_fxsr && (edx & CPUID_SSE) != 0;
+    if (!has_fpu)
+    {
+        put_str("no fpu\n");
+        return;
+    }
+
+    register_handler(7, intr_nm_handler);
+    fpu_cpu_init();
+    put_str(has_sse ? "sse ok\n" : "x87 ok\n");
+}
+
+/* 任务切换前在schedule中调用，调用时已关中断
+ * prev在本时间片内用过浮点单元时保存其状态，并置TS
+ */
+void fpu_switch(struct task_struct * prev)
+{
+    if (prev->fpu_used)
+    {
+        fpu_save(prev->fpu);
+        prev->fpu_used = false;
+        stts();
+    }
+}
+
+/* fork时为子进程复制父进程的浮点状态，失败返回-1
+ * copy_pcb时子进程的fpu指针还指向父进程的保存区，这里换成新的
+ */
+int32_t fpu_fork(struct task_struct * child, struct task_struct * parent)
+{
+    child->fpu_used = false;
+    if (parent->fpu == NULL)
+    {
+        child->fpu = NULL;
+        return 0;
+    }
+
+    struct fpu_state * st = get_kernel_pages(1);
+    if (st == NULL)
+    {
+        child->fpu = NULL;
+        return -1;
+    }
+
+    /* 父进程的最新状态可能还在浮点寄存器中 */
+    intr_status old_status = intr_disable();
+    if (parent->fpu_used)
+    {
+        fpu_save(parent->fpu);
+        if (!has_fxsr)
+        {
+            /* fnsave破坏了寄存器中的状态，重新装回 */
+            fpu_restore(parent->fpu);
+        }
+    }
+    memcpy(st, parent->fpu, sizeof(struct fpu_state));
+    intr_set_status(old_status);
+
+    child->fpu = st;
+    return 0;
+}
+
+/* 释放任务的浮点状态，exec载入新程序时调用，新程序从默认状态开始 */
+void fpu_release(struct task_struct * pthread)
+{
+    intr_status old_status = intr_disable();
+    if (pthread->fpu_used)
+    {
+        pthread->fpu_used = false;
+        stts();
+    }
+    intr_set_status(old_status);
+
+    if (pthread->fpu != NULL)
+    {
+        mfree_page(PF_KERNEL, pthread->fpu, 1);
+        pthread->fpu = NULL;
+    }
+}
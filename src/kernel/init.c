@@ -10,10 +10,24 @@
 #include <thread.h>
 #include <console.h>
 #include <keyboard.h>
+#include <tty.h>
 #include <tss.h>
 #include <sys.h>
 #include <ide.h>
 #include <fs.h>
+#include <smp.h>
+#include <workqueue.h>
+#include <trace.h>
+#include <fpu.h>
+#include <ioring.h>
+#include <vdso.h>
+#include <futex.h>
+#include <wait_exit.h>
+#include <shm.h>
+#include <ipc.h>
+#include <vma.h>
+#include <ramdisk.h>
+#include <initramfs.h>
 
 /* 负责初始化所有模块 */
 void init_all(void)
@@ -22,15 +36,30 @@ void init_all(void)
 
     console_init();     /* 初始化控制台 */
     idt_init();         /* 初始化中断 */
+    fpu_init();         /* 检测浮点单元，开启浮点状态的惰性切换 */
     mem_init();         /* 初始化内存管理系统 */
+    vdso_init();        /* 分配映射到各进程中的只读数据页 */
     timer_init();       /* 初始化定时器/计数器，设置时钟中断频率 */
     thread_init();      /* 初始化线程相关结构 */
+    futex_init();       /* 初始化futex的散列桶 */
+    wait_exit_init();   /* 初始化进程退出和回收用的锁 */
+    shm_init();         /* 初始化共享内存段表 */
+    ipc_init();         /* 初始化消息传递用的锁 */
+    vma_init();         /* 注册缺页异常处理程序，按需读入程序的页 */
+    trace_init();       /* 开始跟踪关中断和禁止抢占的时长 */
     keyboard_init();    /* 键盘初始化 */
+    tty_init();         /* 初始化控制台的行规程 */
+    workqueue_init();   /* 创建通用工作队列及其工作线程 */
     tss_init();         /* tss初始化 */
     syscall_init();     /* 初始化系统调用 */
     intr_enable();      /* 后面的ide_init需要打开中断 */
+    tsc_calibrate();    /* 测量tsc频率，用于换算任务的执行时间 */
     ide_init();         /* 初始化硬盘 */
-    filesys_init();     /* 初始化文件系统 */
+    ramdisk_init();     /* 有initramfs时建立内存盘 */
+    filesys_init();     /* 初始化文件系统，有内存盘时以它为根 */
+    initramfs_unpack(); /* 把initramfs中的程序放到根文件系统中 */
+    ioring_init();      /* 创建执行异步读写的工作队列 */
+    smp_init();         /* 启动其它cpu，需要开中断来计时 */
 
     put_str("init_all done.\n\n");
 }
@@ -8,6 +8,8 @@
 #include <io.h>
 #include <print.h>
 #include <printk.h>
+#include <trace.h>
+#include <thread.h>
 
 /* 这里用的可编程中断控制器是8259A */
 #define PIC_M_CTRL  0x20    /* 主片的控制端口是0x20 */
@@ -41,7 +43,7 @@ char* intr_name[IDT_DESC_CNT];
 intr_handler intr_handler_table[IDT_DESC_CNT];
 
 /* 声明引用定义在kernel.S中的中断处理函数入口数组 */
-extern intr_handler intr_entry_table[IDT_DESC_CNT];
+extern intr_handler intr_entry_table[INTR_ENTRY_CNT];
 
 /* 初始化可编程中断控制器8259A */
 static void pic_init(void)
@@ -99,7 +101,8 @@ static void idt_desc_init(void)
     int i;
     int last_index = IDT_DESC_CNT - 1;
 
-    for (i = 0; i < IDT_DESC_CNT; i++)
+    /* intr_entry.S中只定义了0x00~0x3f号中断的入口 */
+    for (i = 0; i < INTR_ENTRY_CNT; i++)
     {
         create_idt_desc(&idt[i], IDT_DESC_ATTR_DPL0,
                     intr_entry_table[i]);
@@ -143,6 +146,7 @@ static void general_intr_handler(uint8_t vec_nr)
 
         /* cr2中存放造成page_fault的地址 */
         asm ("movl %%cr2, %0" : "=r"(page_fault_vaddr));
+        running_thread()->acct.min_flt++;
         printk("page fault vaddr is: 0x%x\n", page_fault_vaddr);
     }
 
@@ -209,7 +213,14 @@ void idt_init(void)
     idt_desc_init();    /* 初始化中断描述符表 */
     exception_init();   /* 异常名初始化并注册通常的中断处理函数 */
     pic_init();         /* 初始化8259A */
+    idt_load();
+
+    put_str("idt_init done\n");
+}
 
+/* 加载idt，各cpu共用同一个idt */
+void idt_load(void)
+{
     /* 加载idt，前16位为表界限，后32位为表基址
      * 因为C语言中没有48位的数据类型，这里用64位来代替
      * 只要保证64位变量的前48位数据正确就可以
@@ -227,12 +238,10 @@ void idt_init(void)
      *    但AT&T语法把数字当成内存地址，所以直接从该地址处取得数据
      */
     asm volatile("lidt %0": : "m"(idt_operand));
-
-    put_str("idt_init done\n");
 }
 
-/* 开中断，并返回开中断前的状态 */
-intr_status intr_enable(void)
+/* 开中断，并返回开中断前的状态，ip为调用者地址，供跟踪关中断时长用 */
+static intr_status intr_enable_at(void * ip)
 {
     if (INTR_ON == intr_get_status())
     {
@@ -240,18 +249,20 @@ intr_status intr_enable(void)
     }
     else
     {
+        trace_irqs_on(ip);
         asm volatile ("sti");   /* 开中断，sti指令将IF位置1 */
         return INTR_OFF;
     }
 }
 
-/* 关中断，并返回关中断前的状态 */
-intr_status intr_disable(void)
+/* 关中断，并返回关中断前的状态，ip为调用者地址 */
+intr_status intr_disable_at(void * ip)
 {
     if (INTR_ON == intr_get_status())
     {
         /* 关中断，cli指令将IF位置0 */
         asm volatile ("cli" : : : "memory");
+        trace_irqs_off(ip);
         return INTR_ON;
     }
     else
@@ -260,10 +271,28 @@ intr_status intr_disable(void)
     }
 }
 
+/* 将中断状态设置为status，ip为调用者地址 */
+intr_status intr_set_status_at(intr_status status, void * ip)
+{
+    return (status && INTR_ON) ? intr_enable_at(ip) : intr_disable_at(ip);
+}
+
+/* 开中断，并返回开中断前的状态 */
+intr_status intr_enable(void)
+{
+    return intr_enable_at(__builtin_return_address(0));
+}
+
+/* 关中断，并返回关中断前的状态 */
+intr_status intr_disable(void)
+{
+    return intr_disable_at(__builtin_return_address(0));
+}
+
 /* 将中断状态设置为status */
 intr_status intr_set_status(intr_status status)
 {
-    return (status && INTR_ON) ? intr_enable() : intr_disable();
+    return intr_set_status_at(status, __builtin_return_address(0));
 }
 
 /* 获取当前中断状态 */
@@ -21,35 +21,119 @@
 #include <dir.h>
 #include <shell.h>
 #include <assert.h>
+#include <sync.h>
+#include <spinlock.h>
+#include <list.h>
+#include <debug.h>
 
 void init(void);
 
+/* 优先级继承自检：低优先级线程持锁时，中、高优先级线程先后来申请该锁。
+ * 低优先级线程应继承高优先级，释放后恢复；锁应先交给高优先级线程。
+ * 各线程做完后退出，结果由主线程汇总
+ */
+#define PI_LOW_PRI      4
+#define PI_MID_PRI      16
+#define PI_HIGH_PRI     31
+
+static struct lock pi_test_lock;
+static struct semaphore pi_test_ready;  /* 低优先级线程已持锁 */
+static struct semaphore pi_test_done;   /* 各线程结束 */
+static volatile bool pi_test_ok;
+static volatile char pi_test_order[2];
+static volatile uint32_t pi_test_idx;
+
+/* 锁上的等待者个数 */
+static uint32_t pi_waiters(void)
+{
+    struct semaphore * psema = &pi_test_lock.semaphore;
+    intr_status old_status = spin_lock_irqsave(&psema->lock);
+    uint32_t cnt = list_len(&psema->wq.waiters);
+    spin_unlock_irqrestore(&psema->lock, old_status);
+    return cnt;
+}
+
+static void pi_low_thread(void * arg UNUSED)
+{
+    struct task_struct * cur = running_thread();
+
+    lock_acquire(&pi_test_lock);
+    sema_up(&pi_test_ready);
+
+    /* 等中、高优先级线程都睡在锁上，最多等1秒 */
+    uint32_t retry = 0;
+    while (pi_waiters() < 2 && retry++ < 100)
+    {
+        mtime_sleep(10);
+    }
+    if (pi_waiters() < 2 || cur->priority != PI_HIGH_PRI)
+    {
+        printk("pi test: holder priority %d, want %d\n",
+                    cur->priority, PI_HIGH_PRI);
+        pi_test_ok = false;
+    }
+
+    lock_release(&pi_test_lock);
+    if (cur->priority != PI_LOW_PRI)
+    {
+        printk("pi test: priority %d after release, want %d\n",
+                    cur->priority, PI_LOW_PRI);
+        pi_test_ok = false;
+    }
+    sema_up(&pi_test_done);
+    thread_exit_current();
+}
+
+/* 拿到锁时记下顺序 */
+static void pi_waiter_thread(void * arg)
+{
+    lock_acquire(&pi_test_lock);
+    pi_test_order[pi_test_idx++] = (char)(uint32_t)arg;
+    lock_release(&pi_test_lock);
+    sema_up(&pi_test_done);
+    thread_exit_current();
+}
+
+static bool pi_selftest(void)
+{
+    lock_init(&pi_test_lock);
+    sema_init(&pi_test_ready, 0);
+    sema_init(&pi_test_done, 0);
+    pi_test_ok = true;
+    pi_test_idx = 0;
+
+    thread_start("pi_low", PI_LOW_PRI, pi_low_thread, NULL);
+    sema_down(&pi_test_ready);
+    thread_start("pi_mid", PI_MID_PRI, pi_waiter_thread, (void *)'m');
+    thread_start("pi_high", PI_HIGH_PRI, pi_waiter_thread, (void *)'h');
+
+    uint32_t i;
+    for (i = 0; i < 3; i++)
+    {
+        sema_down(&pi_test_done);
+    }
+    if (pi_test_order[0] != 'h' || pi_test_order[1] != 'm')
+    {
+        printk("pi test: lock handed over in order %c%c, want hm\n",
+                    pi_test_order[0], pi_test_order[1]);
+        pi_test_ok = false;
+    }
+    printk("pi test: %s\n", pi_test_ok ? "pass" : "FAIL");
+    return pi_test_ok;
+}
+
 int main(void)
 {
     put_str("kernel start ... \n");
     init_all();     /* 初始化所有模块 */
 
     /************ test code start ***************/
-#if 1
-    /*************    写入应用程序    *************/
-    uint32_t file_size = 7791; 
-    uint32_t sec_cnt = DIV_ROUND_UP(file_size, 512);
-    struct disk* sda = &channels[0].devices[0];
-    void* prog_buf = sys_malloc(file_size);
-    ide_read(sda, 300, prog_buf, sec_cnt);
-    int32_t fd = sys_open("/prog_arg", O_CREAT|O_RDWR);
-    if (fd != -1) 
+    /*************    优先级继承测试    *************/
+    if (!pi_selftest())
     {
-        if(sys_write(fd, prog_buf, file_size) == -1) 
-        {
-            printk("file write error!\n");
-            while(1);
-        }
+        PANIC("priority inheritance selftest failed\n");
     }
-    sys_close(fd);
-    sys_free(prog_buf);
-    /*************    写入应用程序结束   *************/
-#endif    
+    /*************    优先级继承测试结束   *************/
     /************ test code end ***************/
 
     cls_screen();
@@ -68,8 +152,13 @@ void init(void)
     {
         printf("I am father, my pid is %d, child pid is %d\n", 
                     getpid(), ret_pid);
+
+        /* 回收过继来的子进程 */
+        int32_t status;
         while(1)
-            ;
+        {
+            wait(&status);
+        }
     } 
     else    /* 子进程 */
     {
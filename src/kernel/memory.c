@@ -11,8 +11,12 @@
 #include <debug.h>
 #include <print.h>
 #include <sync.h>
+#include <thread.h>
 #include <global.h>
 #include <interrupt.h>
+#include <spinlock.h>
+#include <smp.h>
+#include <ramdisk.h>
 
 /* 获取虚拟地址的高10位，即pde索引部分 */
 #define PDE_IDX(addr)   ((addr & 0xffc00000) >> 22)
@@ -27,6 +31,8 @@ typedef struct phm_pool {
     uint32_t pm_start;  /* 本内存池所管理物理内存的起始地址 */
     uint32_t size;      /* 本内存池字节容量 */
     struct lock lock;   /* 申请内存时互斥 */
+    struct spinlock bm_lock;    /* 保护位图bm，palloc和pfree只持有很短的时间 */
+    uint32_t free_pages;        /* 空闲的物理页数，由bm_lock保护 */
 } phm_pool;
 
 /* 内存仓库arena元信息 */
@@ -45,6 +51,14 @@ phm_pool kernel_pool;   /* 内核物理内存池 */
 phm_pool user_pool;     /* 用户物理内存池 */
 vm_pool  kvm_pool;      /* 给内核分配虚拟内存地址 */
 
+/* 用户物理页的引用计数，只对共享页有意义，由user_pool.bm_lock保护
+ * 普通的用户页只有一个映射，计数始终为0
+ */
+static uint16_t * user_page_refs;
+
+/* 每个cpu一页临时映射用的内核虚拟地址，见kmap_atomic */
+static uint32_t kmap_base;
+
 
 /* 在pf表示的虚拟内存池中申请pg_need个虚拟页,
  * 成功则返回虚拟页的起始地址, 失败则返回NULL
@@ -119,19 +133,29 @@ uint32_t * get_pde(uint32_t vaddr)
  */
 static void * palloc(phm_pool *pool)
 {
-    /* 扫描或设置位图要保证原子操作 */
+    /* 扫描或设置位图要保证原子操作，
+     * 用户内存池的页表从内核内存池分配，此时并未持有kernel_pool.lock
+     */
+    intr_status old_status = spin_lock_irqsave(&pool->bm_lock);
     int bit_idx = bitmap_alloc(&pool->bm, 1);   /* 分配一个物理页面 */
     if (-1 == bit_idx)
+    {
+        spin_unlock_irqrestore(&pool->bm_lock, old_status);
         return NULL;
+    }
 
     bitmap_set(&pool->bm, bit_idx, 1);
+    pool->free_pages--;
+    spin_unlock_irqrestore(&pool->bm_lock, old_status);
 
     uint32_t page_phyaddr = (pool->pm_start + (bit_idx * PG_SIZE));
     return (void *)page_phyaddr;
 }
 
-/* 页表中添加虚拟地址_vaddr与物理地址_page_phyaddr的映射 */
-static void page_table_add(void *_vaddr, void *_page_phyaddr)
+/* 页表中添加虚拟地址_vaddr与物理地址_page_phyaddr的映射，
+ * 页表项的属性为attr（PG_US_x | PG_RW_x），只改动当前页表
+ */
+void page_map(void *_vaddr, void *_page_phyaddr, uint32_t attr)
 {
     uint32_t vaddr = (uint32_t)_vaddr;
     uint32_t paddr = (uint32_t)_page_phyaddr;
@@ -153,12 +177,12 @@ static void page_table_add(void *_vaddr, void *_page_phyaddr)
         if (!(*pte & 0x00000001))  /* 页表项不存在，创建页表项 */
         {
 
-			*pte = (paddr | PG_US_U | PG_RW_W | PG_P_1);
+			*pte = (paddr | attr | PG_P_1);
         }
         else  /* 页表已存在 */
         {
 			PANIC("pte repeat\n");
-            *pte = (paddr | PG_US_U | PG_RW_W | PG_P_1);
+            *pte = (paddr | attr | PG_P_1);
         }
     }
     /* 页目录项不存在，所以要先创建页目录项再创建页表项 */
@@ -175,10 +199,16 @@ static void page_table_add(void *_vaddr, void *_page_phyaddr)
          **********************************************************/
         memset((void *)((int)pte & 0xfffff000), 0, PG_SIZE);
         kassert((*pte & 0x00000001) == 0);
-        *pte = (paddr | PG_US_U | PG_RW_W | PG_P_1);
+        *pte = (paddr | attr | PG_P_1);
     }
 }
 
+/* 页表中添加可读写的用户页映射 */
+static void page_table_add(void *_vaddr, void *_page_phyaddr)
+{
+    page_map(_vaddr, _page_phyaddr, PG_US_U | PG_RW_W);
+}
+
 /* 分配pg_need个物理页空间
  * 成功则返回起始虚拟地址，失败时返回NULL
  *
@@ -236,7 +266,10 @@ void * get_kernel_pages(uint32_t pg_need)
     lock_acquire(&kernel_pool.lock);
     void * vaddr = malloc_page(PF_KERNEL, pg_need);
     if (NULL == vaddr)
+    {
+        lock_release(&kernel_pool.lock);
         return NULL;
+    }
 
     /* 若分配的地址不为空，将页框清0后返回 */
     memset (vaddr, 0, pg_need * PG_SIZE);
@@ -321,6 +354,64 @@ void* get_a_page_without_opvaddrbitmap(poolfg pf, uint32_t vaddr)
 }
 
 
+/* 将物理地址paddr起始的size字节映射到内核虚拟地址空间，
+ * 用于访问APIC寄存器、BIOS和ACPI表等不在内存池中的物理内存，
+ * 映射时关闭缓存。成功则返回paddr对应的虚拟地址，失败则返回NULL
+ */
+void * ioremap(uint32_t paddr, uint32_t size)
+{
+    uint32_t pg_start = paddr & 0xfffff000;
+    uint32_t pg_cnt = DIV_ROUND_UP(paddr + size - pg_start, PG_SIZE);
+
+    lock_acquire(&kernel_pool.lock);
+    void * vaddr_start = vaddr_get(PF_KERNEL, pg_cnt);
+    if (vaddr_start == NULL)
+    {
+        lock_release(&kernel_pool.lock);
+        return NULL;
+    }
+
+    uint32_t i;
+    for (i = 0; i < pg_cnt; i++)
+    {
+        uint32_t vaddr = (uint32_t)vaddr_start + i * PG_SIZE;
+        page_table_add((void *)vaddr, (void *)(pg_start + i * PG_SIZE));
+        *get_pte(vaddr) |= PG_PWT_1 | PG_PCD_1;
+        asm volatile ("invlpg %0" : : "m" (*(char *)vaddr) : "memory");
+    }
+    lock_release(&kernel_pool.lock);
+
+    return (void *)((uint32_t)vaddr_start + (paddr - pg_start));
+}
+
+/* 把内核物理内存池中已占用的pg_cnt个物理页pg_phy_addr映射到连续的内核虚拟地址，
+ * 用于访问loader放在内存池中的数据，用完后和get_kernel_pages得到的页一样
+ * 用mfree_page释放。成功则返回虚拟地址，失败则返回NULL
+ */
+void * kernel_pages_map(uint32_t pg_phy_addr, uint32_t pg_cnt)
+{
+    kassert(pg_phy_addr >= kernel_pool.pm_start &&
+            pg_phy_addr + pg_cnt * PG_SIZE <=
+            kernel_pool.pm_start + kernel_pool.size);
+
+    lock_acquire(&kernel_pool.lock);
+    void * vaddr_start = vaddr_get(PF_KERNEL, pg_cnt);
+    if (vaddr_start == NULL)
+    {
+        lock_release(&kernel_pool.lock);
+        return NULL;
+    }
+
+    uint32_t i;
+    for (i = 0; i < pg_cnt; i++)
+    {
+        page_table_add((void *)((uint32_t)vaddr_start + i * PG_SIZE),
+                    (void *)(pg_phy_addr + i * PG_SIZE));
+    }
+    lock_release(&kernel_pool.lock);
+    return vaddr_start;
+}
+
 /* 返回虚拟地址映射到的物理地址 */
 uint32_t addr_v2p(uint32_t vaddr)
 {
@@ -332,6 +423,120 @@ uint32_t addr_v2p(uint32_t vaddr)
     return ((*pte & 0xfffff000) + (vaddr & 0x00000fff));
 }
 
+/* 判断用户虚拟地址vaddr所在的页是否已映射且用户态可访问
+ * 在读写用户给的地址之前检查，避免内核中发生缺页
+ */
+bool user_page_mapped(uint32_t vaddr)
+{
+    if (vaddr >= 0xc0000000)
+    {
+        return false;
+    }
+    if (!(*get_pde(vaddr) & PG_P_1))
+    {
+        return false;
+    }
+    uint32_t pte = *get_pte(vaddr);
+    return (pte & PG_P_1) && (pte & PG_US_U);
+}
+
+/* 用本cpu的临时映射页访问物理地址paddr，返回对应的内核虚拟地址
+ * 内核页表为各进程共用，映射对所有进程有效。调用时须已关中断，
+ * 在再次调用之前一直有效，期间不能睡眠
+ */
+void * kmap_atomic(uint32_t paddr)
+{
+    kassert(INTR_OFF == intr_get_status());
+    uint32_t vaddr = kmap_base + this_cpu()->id * PG_SIZE;
+    *get_pte(vaddr) = (paddr & 0xfffff000) | PG_US_S | PG_RW_W | PG_P_1;
+    asm volatile ("invlpg %0" : : "m" (*(char *)vaddr) : "memory");
+    return (void *)(vaddr + (paddr & 0x00000fff));
+}
+
+/* 查pthread的页表，返回其用户虚拟地址vaddr对应的物理地址，
+ * 未映射、不是用户页或要写而页只读时返回0。调用时须已关中断
+ */
+uint32_t task_v2p(struct task_struct * pthread, uint32_t vaddr, bool write)
+{
+    if (vaddr >= 0xc0000000)
+    {
+        return 0;
+    }
+    uint32_t pde = pthread->group_leader->pgdir[vaddr >> 22];
+    if (!(pde & PG_P_1))
+    {
+        return 0;
+    }
+
+    /* 页表所在的页框不一定在内核空间中映射着，临时映射过来 */
+    uint32_t * pt = kmap_atomic(pde & 0xfffff000);
+    uint32_t pte = pt[(vaddr >> 12) & 0x3ff];
+    if (!(pte & PG_P_1) || !(pte & PG_US_U) || (write && !(pte & PG_RW_W)))
+    {
+        return 0;
+    }
+    return (pte & 0xfffff000) + (vaddr & 0x00000fff);
+}
+
+/* 共享的用户物理页多了一个映射 */
+void page_ref_get(uint32_t pg_phy_addr)
+{
+    uint32_t idx = (pg_phy_addr - user_pool.pm_start) / PG_SIZE;
+
+    intr_status old_status = spin_lock_irqsave(&user_pool.bm_lock);
+    user_page_refs[idx]++;
+    spin_unlock_irqrestore(&user_pool.bm_lock, old_status);
+}
+
+/* 共享的用户物理页少了一个映射，返回剩余的映射数，为0时可以释放 */
+uint32_t page_ref_put(uint32_t pg_phy_addr)
+{
+    uint32_t idx = (pg_phy_addr - user_pool.pm_start) / PG_SIZE;
+
+    intr_status old_status = spin_lock_irqsave(&user_pool.bm_lock);
+    kassert(user_page_refs[idx] > 0);
+    uint32_t refs = --user_page_refs[idx];
+    spin_unlock_irqrestore(&user_pool.bm_lock, old_status);
+    return refs;
+}
+
+/* 返回共享的用户物理页当前的映射数 */
+uint32_t page_ref_cnt(uint32_t pg_phy_addr)
+{
+    uint32_t idx = (pg_phy_addr - user_pool.pm_start) / PG_SIZE;
+    return user_page_refs[idx];
+}
+
+/* 从用户物理内存池分配一页，不建立映射，返回物理地址，失败返回0 */
+uint32_t user_frame_alloc(void)
+{
+    return (uint32_t)palloc(&user_pool);
+}
+
+/* 在当前进程中找一段连续的虚拟地址，依次映射phy_addrs中的pg_cnt个
+ * 共享物理页，每页的映射数加1，返回起始虚拟地址，失败返回NULL
+ */
+void * map_shared_pages(uint32_t * phy_addrs, uint32_t pg_cnt)
+{
+    lock_acquire(&user_pool.lock);
+    void * vaddr = vaddr_get(PF_USER, pg_cnt);
+    if (vaddr == NULL)
+    {
+        lock_release(&user_pool.lock);
+        return NULL;
+    }
+
+    uint32_t i;
+    for (i = 0; i < pg_cnt; i++)
+    {
+        page_ref_get(phy_addrs[i]);
+        page_map((void *)((uint32_t)vaddr + i * PG_SIZE), (void *)phy_addrs[i],
+                    PG_US_U | PG_RW_W | PG_SHARED);
+    }
+    lock_release(&user_pool.lock);
+    return vaddr;
+}
+
 /* 返回arena中第idx个内存块的地址 */
 static struct mem_block * arena2block(struct arena * a, uint32_t idx)
 {
@@ -345,32 +550,12 @@ static struct arena * block2arena(struct mem_block * b)
     return (struct arena *)((uint32_t)b & 0xfffff000);
 }
 
-/* 在堆中申请size字节内存 */
-void * sys_malloc(uint32_t size)
+/* 在pf对应的堆中按内存块描述符descs申请size字节内存 */
+static void * do_malloc(poolfg pf, struct mem_block_desc * descs,
+                uint32_t size)
 {
-    enum pool_flag pf;
-    struct phm_pool * mem_pool;
-    uint32_t pool_size;
-    struct mem_block_desc * descs;
-    struct task_struct * cur_thread = running_thread();
-
-    /* 判断用哪个内存池 */
-    if (cur_thread->pgdir == NULL)
-    {
-        /* 若为内核线程 */
-        pf = PF_KERNEL;
-        pool_size = kernel_pool.size;
-        mem_pool  = &kernel_pool;
-        descs = k_block_descs;
-    }
-    else 
-    {
-        /* 用户进程pcb中的pgdir会在为其分配页表时创建 */
-        pf = PF_USER;
-        pool_size = user_pool.size;
-        mem_pool  = &user_pool;
-        descs = cur_thread->u_block_desc;
-    }
+    struct phm_pool * mem_pool = (pf == PF_KERNEL) ? &kernel_pool : &user_pool;
+    uint32_t pool_size = mem_pool->size;
 
     /* 若申请的内存不在内存池容量范围内则直接返回NULL */
     if (!(size > 0 && size < pool_size))
@@ -443,9 +628,10 @@ void * sys_malloc(uint32_t size)
             a->cnt = descs[desc_idx].blocks;
 
             uint32_t block_idx;
-            intr_status old_status = intr_disable();
 
-            /* 开始将arena拆分成内存块，并添加到内存块描述符的free_list中 */
+            /* 开始将arena拆分成内存块，并添加到内存块描述符的free_list中，
+             * free_list已由mem_pool->lock保护，不需要再关中断
+             */
             for (block_idx = 0; block_idx < descs[desc_idx].blocks; 
                         block_idx++)
             {
@@ -453,8 +639,6 @@ void * sys_malloc(uint32_t size)
                 kassert(!elem_find(&a->desc->free_list, &b->free_elem));
                 list_append(&a->desc->free_list, &b->free_elem);
             }    
-                        
-            intr_set_status(old_status);            
         }   
 
         /* 开始分配内存块 */
@@ -469,6 +653,57 @@ void * sys_malloc(uint32_t size)
     }
 }
 
+/* 在堆中申请size字节内存，内核线程用内核堆，用户进程用自己的用户堆 */
+void * sys_malloc(uint32_t size)
+{
+    struct task_struct * cur_thread = running_thread();
+
+    /* 用户进程pcb中的pgdir会在为其分配页表时创建 */
+    if (cur_thread->pgdir == NULL)
+    {
+        return do_malloc(PF_KERNEL, k_block_descs, size);
+    }
+
+    /* 同组的线程共用组长的内存块描述符，由用户内存池的锁互斥 */
+    return do_malloc(PF_USER, cur_thread->group_leader->u_block_desc, size);
+}
+
+/* 在当前进程中申请size字节的共享内存，按页对齐，失败返回NULL
+ * fork时子进程映射同一组物理页而不是复制，父子进程可以在其中放futex等
+ */
+void * sys_mmap_shared(uint32_t size)
+{
+    if (running_thread()->pgdir == NULL || size == 0)
+    {
+        return NULL;
+    }
+
+    uint32_t pg_cnt = DIV_ROUND_UP(size, PG_SIZE);
+    void * vaddr = get_user_pages(pg_cnt);
+    if (vaddr == NULL)
+    {
+        return NULL;
+    }
+
+    uint32_t i;
+    for (i = 0; i < pg_cnt; i++)
+    {
+        uint32_t page = (uint32_t)vaddr + i * PG_SIZE;
+        *get_pte(page) |= PG_SHARED;
+        page_ref_get(addr_v2p(page));
+    }
+    return vaddr;
+}
+
+/* 在内核堆中申请size字节内存
+ * 在用户进程的系统调用中分配、要交给内核线程使用的内存要用这个，
+ * sys_malloc此时会从进程的用户堆中分配，内核线程访问不到
+ */
+void * kmalloc(uint32_t size)
+{
+    return do_malloc(PF_KERNEL, k_block_descs, size);
+}
+
 
 /* 将物理地址pg_phy_addr回收到物理内存池 */
 void pfree(uint32_t pg_phy_addr)
@@ -490,7 +725,22 @@ void pfree(uint32_t pg_phy_addr)
     }
 
     /* 将位图中该位清0 */
+    intr_status old_status = spin_lock_irqsave(&mem_pool->bm_lock);
     bitmap_set(&mem_pool->bm, bit_idx, 0);
+    mem_pool->free_pages++;
+    spin_unlock_irqrestore(&mem_pool->bm_lock, old_status);
+}
+
+/* 返回pf对应的物理内存池中空闲的页数 */
+uint32_t mem_free_pages(poolfg pf)
+{
+    return (pf == PF_KERNEL) ? kernel_pool.free_pages : user_pool.free_pages;
+}
+
+/* 返回pf对应的物理内存池的总页数 */
+uint32_t mem_total_pages(poolfg pf)
+{
+    return (pf == PF_KERNEL) ? kernel_pool.bm.len * 8 : user_pool.bm.len * 8;
 }
 
 /* 去掉页表中虚拟地址vaddr的映射，只去掉vaddr对应的pte */
@@ -558,8 +808,13 @@ void mfree_page(poolfg pf, void * _vaddr, uint32_t pg_cnt)
             kassert((pg_phy_addr % PG_SIZE) == 0    \
                 && pg_phy_addr >= user_pool.pm_start);
 
-            /* 先将对应的物理页框归还到内存池 */
-            pfree(pg_phy_addr);
+            /* 先将对应的物理页框归还到内存池，
+             * 共享页要等最后一个映射去掉时才归还
+             */
+            if (!(*get_pte(vaddr) & PG_SHARED) || page_ref_put(pg_phy_addr) == 0)
+            {
+                pfree(pg_phy_addr);
+            }
 
             /* 再从页表中清除此虚拟地址所在的页表项pte */
             page_table_pte_remove(vaddr);
@@ -569,6 +824,12 @@ void mfree_page(poolfg pf, void * _vaddr, uint32_t pg_cnt)
 
         /* 清空虚拟地址的位图中的相应位 */
         vaddr_remove(pf, _vaddr, pg_cnt);
+
+        /* 同组的其它线程可能正在别的cpu上用这张页表 */
+        if (running_thread()->group_leader->nr_threads > 1)
+        {
+            smp_tlb_shootdown();
+        }
     }
     else
     {
@@ -593,37 +854,18 @@ void mfree_page(poolfg pf, void * _vaddr, uint32_t pg_cnt)
             page_cnt++;
         }
 
+        /* 内核空间为所有cpu共享，别的cpu的快表中可能还缓存着这些页 */
+        smp_tlb_shootdown();
+
         /* 清空虚拟地址的位图中的相应位 */
         vaddr_remove(pf, _vaddr, pg_cnt);
     }
 }
 
-/* 回收ptr所指向的内存 */
-void sys_free(void * ptr)
+/* 回收pf对应的堆中ptr所指向的内存 */
+static void do_free(poolfg pf, void * ptr)
 {
-    kassert(ptr != NULL);
-
-    if (ptr == NULL)
-        return;
-
-    poolfg pf;
-    struct phm_pool * mem_pool;
-
-    /* 判断是线程还是进程 */
-    if (running_thread()->pgdir == NULL)    
-    {
-        /* 是线程，内核内存空间 */
-        kassert((uint32_t)ptr >= K_HEAP_START);
-
-        pf = PF_KERNEL;
-        mem_pool = &kernel_pool;
-    }
-    else
-    {
-        /* 是进程，用户内存空间 */
-        pf = PF_USER;
-        mem_pool = &user_pool;
-    }
+    struct phm_pool * mem_pool = (pf == PF_KERNEL) ? &kernel_pool : &user_pool;
 
     lock_acquire(&mem_pool->lock);
 
@@ -666,6 +908,35 @@ void sys_free(void * ptr)
     lock_release(&mem_pool->lock);
 }
 
+/* 回收ptr所指向的内存 */
+void sys_free(void * ptr)
+{
+    kassert(ptr != NULL);
+
+    if (ptr == NULL)
+        return;
+
+    /* 判断是线程还是进程 */
+    if (running_thread()->pgdir == NULL)    
+    {
+        /* 是线程，内核内存空间 */
+        kassert((uint32_t)ptr >= K_HEAP_START);
+        do_free(PF_KERNEL, ptr);
+    }
+    else
+    {
+        /* 是进程，用户内存空间 */
+        do_free(PF_USER, ptr);
+    }
+}
+
+/* 回收kmalloc分配的内存 */
+void kfree(void * ptr)
+{
+    kassert(ptr != NULL && (uint32_t)ptr >= K_HEAP_START);
+    do_free(PF_KERNEL, ptr);
+}
+
 
 /* 根据内存容量的大小初始化物理内存池的相关结构 */
 static void mem_pool_init(uint32_t all_mem)
@@ -749,6 +1020,19 @@ static void mem_pool_init(uint32_t all_mem)
 
     lock_init(&kernel_pool.lock);
     lock_init(&user_pool.lock);
+    spin_init(&kernel_pool.bm_lock);
+    spin_init(&user_pool.bm_lock);
+    kernel_pool.free_pages = kbm_len * 8;
+    user_pool.free_pages = ubm_len * 8;
+
+    /* loader读入的initramfs在内核内存池的开头，先占住，解包后由ramdisk释放 */
+    kassert(kp_start == INITRD_BASE_ADDR);
+    uint32_t pg_idx;
+    for (pg_idx = 0; pg_idx < INITRD_PAGES; pg_idx++)
+    {
+        bitmap_set(&kernel_pool.bm, pg_idx, 1);
+    }
+    kernel_pool.free_pages -= INITRD_PAGES;
     
     /* 下面初始化内核虚拟地址的位图，按实际物理内存大小生成数组
      * 用于维护内核堆的虚拟地址，所以要和内核内存池大小一致
@@ -802,6 +1086,15 @@ void mem_init(void)
 
     mem_pool_init(mem_bytes_total); /* 初始化物理内存池 */
 
+    /* 用户物理页的引用计数，每页2字节 */
+    user_page_refs = get_kernel_pages(
+                DIV_ROUND_UP(user_pool.bm.len * 8 * sizeof(uint16_t), PG_SIZE));
+    kassert(user_page_refs != NULL);
+
+    /* 临时映射页只占虚拟地址，它们的页表在loader中已建好 */
+    kmap_base = (uint32_t)vaddr_get(PF_KERNEL, MAX_CPUS);
+    kassert(kmap_base != 0 && (*get_pde(kmap_base) & PG_P_1));
+
     /* 初始化mem_block_desc数组descs，为malloc做准备 */
     block_desc_init(k_block_descs);
     
@@ -0,0 +1,221 @@
+/* shm.c
+ *   按名字打开的共享内存段
+ *
+ * 段自己对每个物理页持有一个引用，每个映射再持有一个，
+ * 映射的页表项带PG_SHARED，fork时子进程跟着映射，进程退出时去掉映射。
+ * 映射过的段在只剩自己的引用时（最后一个映射已去掉）被回收，
+ * 打开后从未映射过的段一直保留，直到被映射再去掉映射
+ */
+
+#include <shm.h>
+#include <memory.h>
+#include <thread.h>
+#include <sync.h>
+#include <string.h>
+#include <debug.h>
+#include <global.h>
+
+struct shm_seg
+{
+    char name[SHM_NAME_LEN];    /* 为空表示此项未用 */
+    uint32_t pg_cnt;
+    uint32_t pages[SHM_MAX_PAGES];  /* 各页的物理地址 */
+    bool mapped;                /* 是否被映射过，之后才可能被回收 */
+    bool zeroed;                /* 页是否已清0，第一次映射时清 */
+};
+
+static struct shm_seg shm_segs[SHM_MAX_SEGS];
+static struct lock shm_lock;    /* 保护shm_segs */
+
+/* 释放段的物理页，调用时已持有shm_lock */
+static void shm_release(struct shm_seg * seg)
+{
+    uint32_t i;
+    for (i = 0; i < seg->pg_cnt; i++)
+    {
+        if (page_ref_put(seg->pages[i]) == 0)
+        {
+            pfree(seg->pages[i]);
+        }
+    }
+    seg->name[0] = 0;
+    seg->pg_cnt = 0;
+}
+
+/* 段只剩自己的引用时回收，调用时已持有shm_lock */
+static void shm_try_release(struct shm_seg * seg)
+{
+    if (seg->name[0] != 0 && seg->mapped && page_ref_cnt(seg->pages[0]) == 1)
+    {
+        shm_release(seg);
+    }
+}
+
+/* 打开名为name的段，不存在时创建size字节的段，按页对齐
+ * 段已存在时size不能超过它的大小，为0表示只打开已有的段
+ * 成功返回段号，失败返回-1
+ */
+int32_t sys_shm_open(const char * name, uint32_t size)
+{
+    if (name == NULL || name[0] == 0 || strlen(name) >= SHM_NAME_LEN ||
+            size > SHM_MAX_PAGES * PG_SIZE)
+    {
+        return -1;
+    }
+
+    lock_acquire(&shm_lock);
+
+    int32_t free_id = -1;
+    int32_t id;
+    for (id = 0; id < SHM_MAX_SEGS; id++)
+    {
+        if (shm_segs[id].name[0] == 0)
+        {
+            if (free_id == -1)
+            {
+                free_id = id;
+            }
+            continue;
+        }
+        if (!strcmp(shm_segs[id].name, name))
+        {
+            if (size > shm_segs[id].pg_cnt * PG_SIZE)
+            {
+                id = -1;
+            }
+            lock_release(&shm_lock);
+            return id;
+        }
+    }
+
+    if (free_id == -1 || size == 0)
+    {
+        lock_release(&shm_lock);
+        return -1;
+    }
+
+    struct shm_seg * seg = &shm_segs[free_id];
+    uint32_t pg_cnt = DIV_ROUND_UP(size, PG_SIZE);
+    uint32_t i;
+    for (i = 0; i < pg_cnt; i++)
+    {
+        seg->pages[i] = user_frame_alloc();
+        if (seg->pages[i] == 0)
+        {
+            while (i-- > 0)
+            {
+                page_ref_put(seg->pages[i]);
+                pfree(seg->pages[i]);
+            }
+            lock_release(&shm_lock);
+            return -1;
+        }
+        page_ref_get(seg->pages[i]);
+    }
+    strcpy(seg->name, name);
+    seg->pg_cnt = pg_cnt;
+    seg->mapped = false;
+    seg->zeroed = false;
+
+    lock_release(&shm_lock);
+    return free_id;
+}
+
+/* 把段shmid映射到当前进程，返回起始地址，失败返回NULL */
+void * sys_shm_map(int32_t shmid)
+{
+    if (shmid < 0 || shmid >= SHM_MAX_SEGS || running_thread()->pgdir == NULL)
+    {
+        return NULL;
+    }
+
+    lock_acquire(&shm_lock);
+    struct shm_seg * seg = &shm_segs[shmid];
+    if (seg->name[0] == 0)
+    {
+        lock_release(&shm_lock);
+        return NULL;
+    }
+
+    void * vaddr = map_shared_pages(seg->pages, seg->pg_cnt);
+    if (vaddr != NULL)
+    {
+        /* 新分配的物理页中是别的进程留下的数据 */
+        if (!seg->zeroed)
+        {
+            memset(vaddr, 0, seg->pg_cnt * PG_SIZE);
+            seg->zeroed = true;
+        }
+        seg->mapped = true;
+    }
+    lock_release(&shm_lock);
+    return vaddr;
+}
+
+/* 去掉sys_shm_map得到的映射addr，是段的最后一个映射时回收段
+ * 成功返回0，addr不是段的映射时返回-1
+ */
+int32_t sys_shm_unmap(void * addr)
+{
+    uint32_t vaddr = (uint32_t)addr;
+    if ((vaddr & (PG_SIZE - 1)) != 0 || !user_page_mapped(vaddr) ||
+            !(*get_pte(vaddr) & PG_SHARED))
+    {
+        return -1;
+    }
+
+    lock_acquire(&shm_lock);
+
+    /* 由第一页的物理地址找到段，再确认每一页都是它的 */
+    uint32_t pg_phy_addr = addr_v2p(vaddr);
+    struct shm_seg * seg = NULL;
+    int32_t id;
+    for (id = 0; id < SHM_MAX_SEGS; id++)
+    {
+        if (shm_segs[id].name[0] != 0 && shm_segs[id].pages[0] == pg_phy_addr)
+        {
+            seg = &shm_segs[id];
+            break;
+        }
+    }
+
+    uint32_t i;
+    for (i = 0; seg != NULL && i < seg->pg_cnt; i++)
+    {
+        uint32_t page = vaddr + i * PG_SIZE;
+        if (!user_page_mapped(page) || addr_v2p(page) != seg->pages[i])
+        {
+            seg = NULL;
+        }
+    }
+    if (seg == NULL)
+    {
+        lock_release(&shm_lock);
+        return -1;
+    }
+
+    mfree_page(PF_USER, addr, seg->pg_cnt);
+    shm_try_release(seg);
+
+    lock_release(&shm_lock);
+    return 0;
+}
+
+/* 进程退出去掉映射之后调用，回收已没有映射的段 */
+void shm_reap(void)
+{
+    lock_acquire(&shm_lock);
+    int32_t id;
+    for (id = 0; id < SHM_MAX_SEGS; id++)
+    {
+        shm_try_release(&shm_segs[id]);
+    }
+    lock_release(&shm_lock);
+}
+
+/* 初始化段表 */
+void shm_init(void)
+{
+    lock_init(&shm_lock);
+    memset(shm_segs, 0, sizeof(shm_segs));
+}
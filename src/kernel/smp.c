@@ -0,0 +1,667 @@
+/* smp.c
+ *   多处理器支持
+ *
+ * 1.解析BIOS提供的MP配置表，找不到时再解析ACPI的MADT表，得到各cpu的APIC ID
+ * 2.通过本地APIC向各AP发送INIT-SIPI-SIPI，使其从AP_BOOT_ADDR处的启动代码
+ *   进入保护模式并开启分页，最终跳转到ap_main
+ * 3.每个AP加载自己的GDT、TSS，启用本地APIC时钟后成为该cpu的idle线程
+ *
+ * 外部设备的中断仍经8259A只送往BSP，AP只响应本地APIC时钟和处理器间中断
+ */
+
+#include <smp.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <global.h>
+#include <memory.h>
+#include <interrupt.h>
+#include <thread.h>
+#include <pid.h>
+#include <timer.h>
+#include <tss.h>
+#include <io.h>
+#include <print.h>
+#include <printk.h>
+#include <debug.h>
+#include <fpu.h>
+#include <vma.h>
+#include <atomic.h>
+
+/* 本地APIC寄存器偏移 */
+#define LAPIC_ID        0x020   /* 本地APIC ID */
+#define LAPIC_TPR       0x080   /* 任务优先级 */
+#define LAPIC_EOI       0x0b0   /* 中断结束 */
+#define LAPIC_SVR       0x0f0   /* 伪中断向量 */
+#define LAPIC_ICR_LO    0x300   /* 中断命令寄存器低32位 */
+#define LAPIC_ICR_HI    0x310   /* 中断命令寄存器高32位 */
+#define LAPIC_LVT_TIMER 0x320   /* 时钟本地向量表项 */
+#define LAPIC_LVT_LINT0 0x350
+#define LAPIC_LVT_LINT1 0x360
+#define LAPIC_LVT_ERR   0x370
+#define LAPIC_TICR      0x380   /* 时钟初始计数 */
+#define LAPIC_TCCR      0x390   /* 时钟当前计数 */
+#define LAPIC_TDCR      0x3e0   /* 时钟分频 */
+
+#define LAPIC_SVR_ENABLE    0x100       /* 软件使能本地APIC */
+#define LAPIC_MASKED        0x10000     /* 屏蔽此本地中断 */
+#define LAPIC_TIMER_PERIODIC 0x20000    /* 时钟周期模式 */
+#define LAPIC_TDCR_DIV16    0x3         /* 时钟16分频 */
+
+#define ICR_INIT        0x00000500
+#define ICR_STARTUP     0x00000600
+#define ICR_DELIVS      0x00001000      /* 发送中 */
+#define ICR_ASSERT      0x00004000
+#define ICR_LEVEL       0x00008000
+#define ICR_ALL_BUT_SELF 0x000c0000     /* 广播给除自己以外的所有cpu */
+
+#define LAPIC_DEFAULT_PADDR 0xfee00000  /* 本地APIC寄存器的默认物理地址 */
+
+/* 低端1M物理内存在内核空间中的映射 */
+#define LOW_MEM_VADDR(paddr)    ((void *)((uint32_t)(paddr) + 0xc0000000))
+
+/* MP浮点结构，BIOS将其放在EBDA、基本内存末尾1K或BIOS ROM中 */
+struct mp_fps {
+    char signature[4];      /* "_MP_" */
+    uint32_t config_paddr;  /* MP配置表的物理地址 */
+    uint8_t length;         /* 以16字节为单位 */
+    uint8_t spec_rev;
+    uint8_t checksum;
+    uint8_t feature1;       /* 非0表示使用默认配置，没有配置表 */
+    uint8_t feature2;
+    uint8_t reserved[3];
+} __attribute__ ((packed));
+
+/* MP配置表头 */
+struct mp_config {
+    char signature[4];      /* "PCMP" */
+    uint16_t length;        /* 基本表的长度，含表头 */
+    uint8_t spec_rev;
+    uint8_t checksum;
+    char oem_id[8];
+    char product_id[12];
+    uint32_t oem_table;
+    uint16_t oem_table_size;
+    uint16_t entry_cnt;     /* 表项个数 */
+    uint32_t lapic_paddr;   /* 本地APIC寄存器的物理地址 */
+    uint16_t ext_length;
+    uint8_t ext_checksum;
+    uint8_t reserved;
+} __attribute__ ((packed));
+
+/* MP配置表中的处理器表项，其它类型的表项都是8字节 */
+struct mp_proc {
+    uint8_t type;           /* 为0 */
+    uint8_t apic_id;
+    uint8_t apic_ver;
+    uint8_t flags;          /* 第0位表示可用，第1位表示是BSP */
+    uint32_t signature;
+    uint32_t feature;
+    uint32_t reserved[2];
+} __attribute__ ((packed));
+
+#define MP_PROC         0
+#define MP_PROC_EN      0x01
+
+/* ACPI的RSDP结构 */
+struct acpi_rsdp {
+    char signature[8];      /* "RSD PTR " */
+    uint8_t checksum;
+    char oem_id[6];
+    uint8_t revision;
+    uint32_t rsdt_paddr;
+} __attribute__ ((packed));
+
+/* ACPI各表的通用表头 */
+struct acpi_header {
+    char signature[4];
+    uint32_t length;
+    uint8_t revision;
+    uint8_t checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} __attribute__ ((packed));
+
+#define MADT_LAPIC      0   /* MADT中的本地APIC表项 */
+
+struct cpu cpus[MAX_CPUS];
+uint8_t nr_cpus = 1;        /* 在AP启动前只有BSP */
+
+static volatile uint32_t * lapic;       /* 本地APIC寄存器的虚拟地址 */
+static uint32_t lapic_paddr = LAPIC_DEFAULT_PADDR;
+static uint32_t lapic_timer_count;      /* 本地APIC时钟一个嘀嗒的计数值 */
+
+static uint8_t apic_ids[MAX_CPUS];      /* 从配置表中找到的各cpu的APIC ID */
+static uint8_t nr_apic_ids;
+
+/* 定义在ap_boot.S中的AP启动代码 */
+extern uint8_t ap_boot_start[];
+extern uint8_t ap_boot_end[];
+extern uint32_t ap_boot_stack;
+extern uint32_t ap_boot_entry;
+
+/* 正在启动的AP和BSP谁先改变状态谁说了算：
+ * AP先进入ap_main则BSP一直等它上线，BSP先超时放弃则AP在ap_main中停下
+ */
+#define AP_BOOT_WAIT        0
+#define AP_BOOT_CLAIMED     1   /* AP已进入ap_main */
+#define AP_BOOT_ABANDONED   2   /* BSP已放弃等待 */
+static volatile uint32_t ap_boot_state;
+
+/* 初始化cpu结构c */
+void cpu_init(struct cpu * c, uint8_t id)
+{
+    memset(c, 0, sizeof(*c));
+    c->id = id;
+    spin_init(&c->rq_lock);
+    list_init(&c->ready_list);
+}
+
+/* 返回当前代码所运行的cpu */
+struct cpu * this_cpu(void)
+{
+    return running_thread()->cpu;
+}
+
+static uint32_t lapic_read(uint32_t reg)
+{
+    return lapic[reg / 4];
+}
+
+static void lapic_write(uint32_t reg, uint32_t value)
+{
+    lapic[reg / 4] = value;
+    lapic[LAPIC_ID / 4];    /* 读一次，等待写操作完成 */
+}
+
+/* 向本地APIC发送中断结束命令 */
+static void lapic_eoi(void)
+{
+    lapic_write(LAPIC_EOI, 0);
+}
+
+/* 向APIC ID为apic_id的cpu发送处理器间中断，icr为命令低32位 */
+static void lapic_send_ipi(uint8_t apic_id, uint32_t icr)
+{
+    lapic_write(LAPIC_ICR_HI, (uint32_t)apic_id << 24);
+    lapic_write(LAPIC_ICR_LO, icr);
+    while (lapic_read(LAPIC_ICR_LO) & ICR_DELIVS)
+        ;
+}
+
+/* 约1微秒的延时，向0x80端口写数据不会产生任何副作用 */
+static void io_delay(uint32_t us)
+{
+    while (us-- > 0)
+    {
+        outb(0x80, 0);
+    }
+}
+
+/* 软件使能本地APIC，并接收所有优先级的中断 */
+static void lapic_enable(void)
+{
+    lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | SPURIOUS_VEC);
+    lapic_write(LAPIC_LVT_ERR, LAPIC_MASKED);
+    lapic_write(LAPIC_TPR, 0);
+}
+
+/* 以PIT时钟为基准，测量本地APIC时钟在一个嘀嗒(10ms)内的计数值
+ * 须在开中断后由BSP调用
+ */
+static void lapic_timer_calibrate(void)
+{
+    uint32_t start;
+
+    lapic_write(LAPIC_TDCR, LAPIC_TDCR_DIV16);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_MASKED | LAPIC_TIMER_VEC);
+
+    /* 先对齐到嘀嗒的边界 */
+    start = *(volatile uint32_t *)&ticks;
+    while (*(volatile uint32_t *)&ticks == start)
+        ;
+
+    lapic_write(LAPIC_TICR, 0xffffffff);
+    start = *(volatile uint32_t *)&ticks;
+    while (*(volatile uint32_t *)&ticks == start)
+        ;
+
+    lapic_timer_count = 0xffffffff - lapic_read(LAPIC_TCCR);
+    lapic_write(LAPIC_TICR, 0);     /* 停止计数 */
+}
+
+/* 以和PIT相同的频率开启本地APIC的周期时钟中断 */
+static void lapic_timer_start(void)
+{
+    lapic_write(LAPIC_TDCR, LAPIC_TDCR_DIV16);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_TIMER_PERIODIC | LAPIC_TIMER_VEC);
+    lapic_write(LAPIC_TICR, lapic_timer_count);
+}
+
+/* 本地APIC时钟中断的处理函数，只在AP上产生 */
+static void intr_lapic_timer_handler(void)
+{
+    /* 先发EOI，task_tick中可能会调度到别的任务 */
+    lapic_eoi();
+    task_tick();
+}
+
+/* 重新调度中断，用来把cpu从idle的hlt中唤醒 */
+static void intr_resched_handler(void)
+{
+    lapic_eoi();
+}
+
+/* 刷新本cpu的快表 */
+static void tlb_flush_local(struct cpu * c)
+{
+    uint32_t cr3;
+
+    asm volatile ("movl %%cr3, %0; movl %0, %%cr3"
+                : "=r"(cr3) : : "memory");
+    c->tlb_flush_pending = false;
+}
+
+/* 快表刷新中断 */
+static void intr_tlb_handler(void)
+{
+    struct cpu * c = this_cpu();
+
+    if (c->tlb_flush_pending)
+    {
+        tlb_flush_local(c);
+    }
+    lapic_eoi();
+}
+
+/* 本地APIC的伪中断不需要发EOI */
+static void intr_spurious_handler(void)
+{
+}
+
+/* 唤醒cpu c，使其尽快从就绪队列中取任务 */
+void smp_send_resched(struct cpu * c)
+{
+    if (lapic != NULL && c->online)
+    {
+        lapic_send_ipi(c->apic_id, ICR_ASSERT | RESCHED_IPI_VEC);
+    }
+}
+
+/* 内核页表项被清除后，要求其它cpu刷新快表，并等待全部完成
+ *
+ * 调用时不能持有任何自旋锁。等待期间若本cpu也收到刷新请求，
+ * 先处理自己的，避免两个cpu关中断互相等待
+ */
+void smp_tlb_shootdown(void)
+{
+    if (nr_cpus < 2)
+    {
+        return;
+    }
+
+    struct cpu * self = this_cpu();
+    uint8_t i;
+
+    for (i = 0; i < nr_cpus; i++)
+    {
+        if (&cpus[i] != self)
+        {
+            cpus[i].tlb_flush_pending = true;
+        }
+    }
+    lapic_write(LAPIC_ICR_HI, 0);
+    lapic_write(LAPIC_ICR_LO, ICR_ALL_BUT_SELF | ICR_ASSERT | TLB_IPI_VEC);
+
+    for (i = 0; i < nr_cpus; i++)
+    {
+        while (cpus[i].tlb_flush_pending && &cpus[i] != self)
+        {
+            if (self->tlb_flush_pending)
+            {
+                tlb_flush_local(self);
+            }
+            asm volatile ("pause" : : : "memory");
+        }
+    }
+}
+
+/* 计算len字节的校验和，表合法时结果为0 */
+static uint8_t checksum(void * addr, uint32_t len)
+{
+    uint8_t * p = addr;
+    uint8_t sum = 0;
+
+    while (len-- > 0)
+    {
+        sum += *p++;
+    }
+    return sum;
+}
+
+/* 返回物理地址paddr起始的size字节的虚拟地址，
+ * 低端1M已映射在内核空间，其余的物理地址需要临时映射
+ */
+static void * phys_map(uint32_t paddr, uint32_t size)
+{
+    if (paddr + size <= 0x100000)
+    {
+        return LOW_MEM_VADDR(paddr);
+    }
+    return ioremap(paddr, size);
+}
+
+/* 记录一个cpu的APIC ID */
+static void apic_id_add(uint8_t apic_id)
+{
+    if (nr_apic_ids < MAX_CPUS)
+    {
+        apic_ids[nr_apic_ids++] = apic_id;
+    }
+}
+
+/* 在低端内存[paddr, paddr+len)中以16字节为步长查找长度为sig_len的签名sig */
+static void * low_mem_search(uint32_t paddr, uint32_t len,
+                const char * sig, uint32_t sig_len, uint32_t sum_len)
+{
+    uint8_t * p   = LOW_MEM_VADDR(paddr);
+    uint8_t * end = p + len;
+
+    for (; p < end; p += 16)
+    {
+        if (memcmp(p, sig, sig_len) == 0 && checksum(p, sum_len) == 0)
+        {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+/* 按MP规范查找签名sig：EBDA的第1K、基本内存的最后1K、BIOS ROM区 */
+static void * bios_search(const char * sig, uint32_t sig_len,
+                uint32_t sum_len)
+{
+    void * p;
+    uint32_t ebda = (*(uint16_t *)LOW_MEM_VADDR(0x40e)) << 4;
+    uint32_t base_mem = (*(uint16_t *)LOW_MEM_VADDR(0x413)) * 1024;
+
+    if (ebda != 0 &&
+        (p = low_mem_search(ebda, 1024, sig, sig_len, sum_len)) != NULL)
+    {
+        return p;
+    }
+    if (base_mem != 0 &&
+        (p = low_mem_search(base_mem - 1024, 1024, sig, sig_len, sum_len))
+                != NULL)
+    {
+        return p;
+    }
+    return low_mem_search(0xe0000, 0x20000, sig, sig_len, sum_len);
+}
+
+/* 解析MP配置表，成功返回true */
+static bool mp_config_parse(void)
+{
+    struct mp_fps * fps = bios_search("_MP_", 4, sizeof(struct mp_fps));
+    if (fps == NULL || fps->config_paddr == 0 || fps->feature1 != 0)
+    {
+        return false;
+    }
+
+    struct mp_config * conf = phys_map(fps->config_paddr,
+                        sizeof(struct mp_config));
+    if (conf == NULL || memcmp(conf->signature, "PCMP", 4) != 0)
+    {
+        return false;
+    }
+    conf = phys_map(fps->config_paddr, conf->length);
+    if (conf == NULL || checksum(conf, conf->length) != 0)
+    {
+        return false;
+    }
+    lapic_paddr = conf->lapic_paddr;
+
+    uint8_t * entry = (uint8_t *)(conf + 1);
+    uint16_t i;
+    for (i = 0; i < conf->entry_cnt; i++)
+    {
+        if (*entry == MP_PROC)
+        {
+            struct mp_proc * proc = (struct mp_proc *)entry;
+            if (proc->flags & MP_PROC_EN)
+            {
+                apic_id_add(proc->apic_id);
+            }
+            entry += sizeof(struct mp_proc);
+        }
+        else
+        {
+            entry += 8;
+        }
+    }
+    return nr_apic_ids > 0;
+}
+
+/* 映射并返回物理地址paddr处的整张ACPI表 */
+static struct acpi_header * acpi_table_map(uint32_t paddr)
+{
+    struct acpi_header * hdr = phys_map(paddr, sizeof(*hdr));
+    if (hdr == NULL)
+    {
+        return NULL;
+    }
+    return phys_map(paddr, hdr->length);
+}
+
+/* 在MP配置表不存在时，解析ACPI的MADT表，成功返回true */
+static bool acpi_madt_parse(void)
+{
+    struct acpi_rsdp * rsdp = bios_search("RSD PTR ", 8,
+                        sizeof(struct acpi_rsdp));
+    if (rsdp == NULL)
+    {
+        return false;
+    }
+
+    struct acpi_header * rsdt = acpi_table_map(rsdp->rsdt_paddr);
+    if (rsdt == NULL || memcmp(rsdt->signature, "RSDT", 4) != 0)
+    {
+        return false;
+    }
+
+    uint32_t * tables = (uint32_t *)(rsdt + 1);
+    uint32_t nr_tables = (rsdt->length - sizeof(*rsdt)) / 4;
+    uint32_t i;
+    for (i = 0; i < nr_tables; i++)
+    {
+        struct acpi_header * madt = acpi_table_map(tables[i]);
+        if (madt == NULL || memcmp(madt->signature, "APIC", 4) != 0)
+        {
+            continue;
+        }
+
+        /* 表头之后是本地APIC地址和标志，然后是各个变长的表项 */
+        lapic_paddr = *(uint32_t *)(madt + 1);
+        uint8_t * entry = (uint8_t *)(madt + 1) + 8;
+        uint8_t * end   = (uint8_t *)madt + madt->length;
+        while (entry < end && entry[1] != 0)
+        {
+            /* 本地APIC表项：类型，长度，处理器ID，APIC ID，4字节标志 */
+            if (entry[0] == MADT_LAPIC && (*(uint32_t *)(entry + 4) & 1))
+            {
+                apic_id_add(entry[3]);
+            }
+            entry += entry[1];
+        }
+        return nr_apic_ids > 0;
+    }
+    return false;
+}
+
+/* AP在ap_boot.S中开启分页后跳转到这里，
+ * 此时esp已指向BSP为其准备好的idle线程pcb的顶端
+ */
+static void ap_main(void)
+{
+    /* BSP已放弃时idle线程的pcb随时会被释放，不能再使用，就此停下 */
+    if (cmpxchg(&ap_boot_state, AP_BOOT_WAIT, AP_BOOT_CLAIMED) != AP_BOOT_WAIT)
+    {
+        while (1)
+        {
+            asm volatile ("cli; hlt");
+        }
+    }
+
+    struct cpu * c = this_cpu();
+
+    tss_cpu_init(c->id);    /* 加载本cpu的gdt和tss */
+    idt_load();
+    fpu_cpu_init();
+    vma_cpu_init();
+
+    lapic_enable();
+    lapic_write(LAPIC_LVT_LINT0, LAPIC_MASKED);
+    lapic_write(LAPIC_LVT_LINT1, LAPIC_MASKED);
+    lapic_timer_start();
+
+    /* 成为本cpu的idle线程，不再返回 */
+    thread_ap_idle(c);
+}
+
+/* 启动APIC ID为apic_id的AP，成功则返回true */
+static bool ap_boot(uint8_t apic_id)
+{
+    struct cpu * c = &cpus[nr_cpus];
+    char name[TASK_NAME_LEN];
+
+    cpu_init(c, nr_cpus);
+    c->apic_id = apic_id;
+
+    /* 为AP准备idle线程的pcb，AP启动后就使用它的栈 */
+    struct task_struct * idle = get_kernel_pages(1);
+    if (idle == NULL)
+    {
+        return false;
+    }
+    sprintf(name, "idle%d", c->id);
+    init_thread(idle, name, 10);
+    idle->status = TASK_RUNNING;
+    idle->cpu = c;
+
+    /* 填写启动代码中的栈和入口地址 */
+    uint8_t * boot = LOW_MEM_VADDR(AP_BOOT_ADDR);
+    volatile uint32_t * boot_stack = (uint32_t *)(boot +
+                ((uint32_t)&ap_boot_stack - (uint32_t)ap_boot_start));
+    volatile uint32_t * boot_entry = (uint32_t *)(boot +
+                ((uint32_t)&ap_boot_entry - (uint32_t)ap_boot_start));
+    *boot_stack = (uint32_t)idle + PG_SIZE;
+    *boot_entry = (uint32_t)ap_main;
+    ap_boot_state = AP_BOOT_WAIT;
+
+    /* INIT-SIPI-SIPI，SIPI的向量号是启动代码所在的页框号 */
+    lapic_send_ipi(apic_id, ICR_INIT | ICR_LEVEL | ICR_ASSERT);
+    io_delay(200);
+    lapic_send_ipi(apic_id, ICR_INIT | ICR_LEVEL);
+    mtime_sleep(10);
+
+    int i;
+    for (i = 0; i < 2; i++)
+    {
+        lapic_send_ipi(apic_id, ICR_STARTUP | (AP_BOOT_ADDR >> 12));
+        io_delay(200);
+    }
+
+    /* 最多等待100ms */
+    uint32_t start = ticks;
+    while (!c->online && ticks - start < 10)
+    {
+        thread_yield();
+    }
+
+    if (!c->online &&
+        cmpxchg(&ap_boot_state, AP_BOOT_WAIT, AP_BOOT_ABANDONED) ==
+            AP_BOOT_CLAIMED)
+    {
+        /* AP来晚了但已进入ap_main，很快就会上线 */
+        while (!c->online)
+        {
+            thread_yield();
+        }
+    }
+
+    if (!c->online)
+    {
+        /* 先清入口再清栈，启动代码先读栈后读入口，
+         * 还没读到它们的AP会停在启动代码中
+         */
+        *boot_entry = 0;
+        *boot_stack = 0;
+
+        /* 已越过启动代码的AP用INIT复位，之后才能释放idle线程的pcb */
+        lapic_send_ipi(apic_id, ICR_INIT | ICR_LEVEL | ICR_ASSERT);
+        io_delay(200);
+        lapic_send_ipi(apic_id, ICR_INIT | ICR_LEVEL);
+        mtime_sleep(10);
+
+        printk("smp: cpu apic id %d does not respond\n", apic_id);
+        pid_free(idle->pid);
+        mfree_page(PF_KERNEL, idle, 1);
+        return false;
+    }
+    nr_cpus++;
+    return true;
+}
+
+/* 发现并启动所有AP，须在开中断之后调用 */
+void smp_init(void)
+{
+    put_str("smp_init ... ");
+
+    if (!mp_config_parse() && !acpi_madt_parse())
+    {
+        put_str("no MP table, single cpu\n");
+        return;
+    }
+    if (nr_apic_ids < 2)
+    {
+        put_str("single cpu\n");
+        return;
+    }
+
+    lapic = ioremap(lapic_paddr, PG_SIZE);
+    if (lapic == NULL)
+    {
+        put_str("map lapic failed\n");
+        return;
+    }
+
+    lapic_enable();
+    cpus[0].apic_id = lapic_read(LAPIC_ID) >> 24;
+    lapic_timer_calibrate();
+
+    register_handler(LAPIC_TIMER_VEC, intr_lapic_timer_handler);
+    register_handler(RESCHED_IPI_VEC, intr_resched_handler);
+    register_handler(TLB_IPI_VEC, intr_tlb_handler);
+    register_handler(SPURIOUS_VEC, intr_spurious_handler);
+
+    /* 将启动代码复制到低端内存 */
+    memcpy(LOW_MEM_VADDR(AP_BOOT_ADDR), ap_boot_start,
+                (uint32_t)ap_boot_end - (uint32_t)ap_boot_start);
+
+    uint8_t i;
+    for (i = 0; i < nr_apic_ids && nr_cpus < MAX_CPUS; i++)
+    {
+        /* 有AP启动失败时不再启动后面的，
+         * 免得下一个AP复用这个cpu结构时，失败的AP仍在使用它
+         */
+        if (apic_ids[i] != cpus[0].apic_id && !ap_boot(apic_ids[i]))
+        {
+            break;
+        }
+    }
+
+    printk("%d cpus online\n", nr_cpus);
+}
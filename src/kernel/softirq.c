@@ -0,0 +1,199 @@
+/* softirq.c
+ *   软中断（中断下半部）及中断处理耗时的统计
+ *
+ * 硬件中断处理程序只做必须在关中断时完成的工作（读端口、应答设备），
+ * 其余工作用raise_softirq推迟到irq_exit中开中断执行。
+ * 时钟中断也只在时间片用完时设置need_resched，由irq_exit统一调度，
+ * 这样关中断的时间只剩下硬件中断处理程序本身
+ */
+
+#include <softirq.h>
+#include <interrupt.h>
+#include <thread.h>
+#include <smp.h>
+#include <debug.h>
+#include <tsc.h>
+#include <global.h>
+#include <stdio.h>
+#include <string.h>
+#include <file.h>
+#include <fs.h>
+#include <trace.h>
+#include <acct.h>
+
+static softirq_handler softirq_vec[NR_SOFTIRQS];
+
+struct irq_stat irq_stats[INTR_ENTRY_CNT];  /* 各硬件中断处理程序的耗时 */
+struct irq_stat softirq_stats[NR_SOFTIRQS]; /* 各软中断的耗时 */
+
+static const char * softirq_name[NR_SOFTIRQS] = { "keyboard", "block" };
+
+/* 注册软中断nr的处理函数 */
+void open_softirq(uint8_t nr, softirq_handler handler)
+{
+    kassert(nr < NR_SOFTIRQS);
+    softirq_vec[nr] = handler;
+}
+
+/* 在当前cpu上标记软中断nr待处理，一般在硬件中断处理程序中调用，
+ * 待处理标记是每个cpu私有的，只需关中断即可
+ */
+void raise_softirq(uint8_t nr)
+{
+    kassert(nr < NR_SOFTIRQS);
+    intr_status old_status = intr_disable();
+    this_cpu()->softirq_pending |= (1 << nr);
+    intr_set_status(old_status);
+}
+
+/* 记录一次耗时cycles，多个cpu同时更新时可能丢失个别样本 */
+static void irq_stat_update(struct irq_stat * st, uint32_t cycles)
+{
+    st->count++;
+    if (cycles > st->max_cycles)
+    {
+        st->max_cycles = cycles;
+    }
+
+    /* 权重为1/8的滑动平均，避免64位除法 */
+    st->avg_cycles = st->avg_cycles - (st->avg_cycles >> 3) + (cycles >> 3);
+}
+
+/* 处理当前cpu上所有待处理的软中断
+ * 调用时已关中断，处理各软中断时开中断，返回时仍为关中断。
+ * 软中断执行期间到来的硬件中断不会再嵌套执行软中断
+ */
+void do_softirq(void)
+{
+    kassert(intr_get_status() == INTR_OFF);
+
+    struct cpu * c = this_cpu();
+    if (c->in_softirq)
+    {
+        return;
+    }
+    c->in_softirq = true;
+
+    uint32_t pending;
+    uint8_t restart = 0;
+    while ((pending = c->softirq_pending) != 0 &&
+            restart++ < SOFTIRQ_MAX_RESTART)
+    {
+        c->softirq_pending = 0;
+        intr_enable();
+
+        uint8_t nr = 0;
+        while (pending != 0)
+        {
+            if ((pending & 1) && softirq_vec[nr] != NULL)
+            {
+                uint64_t start = rdtsc();
+                softirq_vec[nr]();
+                irq_stat_update(&softirq_stats[nr],
+                            (uint32_t)(rdtsc() - start));
+            }
+            pending >>= 1;
+            nr++;
+        }
+
+        intr_disable();
+    }
+
+    c->in_softirq = false;
+}
+
+/* 进入中断处理程序之前调用，记录开始时间
+ * cs为被中断代码的段选择子，用来判断是否从用户态进入
+ */
+void irq_enter(uint8_t vec_nr, uint32_t cs)
+{
+    /* 经中断门进入时已关中断，之前未结束的关中断时段已被开中断打断 */
+    trace_irqs_clear();
+
+    if ((cs & 3) == 3)
+    {
+        acct_user_exit();
+    }
+
+    if (vec_nr < 0x20)
+    {
+        return;
+    }
+    this_cpu()->irq_enter_tsc = rdtsc();
+}
+
+/* 硬件中断处理程序返回之后调用，仍处于关中断状态
+ * 统计处理程序的耗时，执行软中断，需要时调度
+ * 异常（0x00~0x1f）不统计，也不在其后处理软中断
+ */
+void irq_exit(uint8_t vec_nr)
+{
+    if (vec_nr < 0x20)
+    {
+        return;
+    }
+
+    struct cpu * c = this_cpu();
+    irq_stat_update(&irq_stats[vec_nr],
+                (uint32_t)(rdtsc() - c->irq_enter_tsc));
+
+    /* 嵌套在软中断中的硬件中断直接返回，由外层处理 */
+    if (c->in_softirq)
+    {
+        return;
+    }
+
+    if (c->softirq_pending != 0)
+    {
+        do_softirq();
+    }
+
+    /* 禁止抢占时保留need_resched，由preempt_enable补上调度 */
+    if (c->need_resched && running_thread()->preempt_count == 0)
+    {
+        c->need_resched = false;
+        schedule();
+    }
+}
+
+/* 按列输出一行统计 */
+static void irqstat_print(const char * name, struct irq_stat * st)
+{
+    char buf[80];
+
+    sprintf(buf, "%s", name);
+    uint32_t len = strlen(buf);
+    while (len < 16)
+    {
+        buf[len++] = ' ';
+    }
+    sprintf(buf + len, "%d\t%d\t%d\n",
+                st->count, st->avg_cycles, st->max_cycles);
+    sys_write(stdout_no, buf, strlen(buf));
+}
+
+/* 打印各中断和软中断的次数及耗时(时钟周期) */
+void sys_irqstat(void)
+{
+    char * title = "IRQ             COUNT\tAVG\tMAX\n";
+    sys_write(stdout_no, title, strlen(title));
+
+    char name[16];
+    uint32_t vec_nr;
+    for (vec_nr = 0x20; vec_nr < INTR_ENTRY_CNT; vec_nr++)
+    {
+        if (irq_stats[vec_nr].count == 0)
+        {
+            continue;
+        }
+        sprintf(name, "0x%x", vec_nr);
+        irqstat_print(name, &irq_stats[vec_nr]);
+    }
+
+    uint32_t nr;
+    for (nr = 0; nr < NR_SOFTIRQS; nr++)
+    {
+        sprintf(name, "soft:%s", softirq_name[nr]);
+        irqstat_print(name, &softirq_stats[nr]);
+    }
+}
@@ -0,0 +1,159 @@
+/* trace.c
+ *   关中断和禁止抢占时长的跟踪
+ *
+ * intr_disable使中断由开变关时记下开始时间和调用者，
+ * intr_enable使中断由关变开时算出这一段的时长，比最大值长则记录下来。
+ * 硬件中断处理程序本身的耗时由softirq.c中的irq_stats统计，不计入这里：
+ * 中断门关中断、iret开中断都不经过intr_disable/intr_enable，
+ * 所以irq_enter和irq_exit会丢弃未结束的一段，避免把跨越开中断的时间算进来
+ */
+
+#include <trace.h>
+#include <smp.h>
+#include <thread.h>
+#include <spinlock.h>
+#include <tsc.h>
+#include <global.h>
+#include <stdio.h>
+#include <string.h>
+#include <file.h>
+#include <fs.h>
+
+struct trace_record irqsoff_max;        /* 最长的关中断时段 */
+struct trace_record preemptoff_max;     /* 最长的禁止抢占时段 */
+
+/* thread_init之前running_thread()->cpu尚未初始化，不能跟踪 */
+static bool trace_enabled;
+
+/* 保护上面两项记录，更新时已关中断 */
+static struct spinlock trace_lock;
+
+/* 开始跟踪 */
+void trace_init(void)
+{
+    spin_init(&trace_lock);
+    trace_enabled = true;
+}
+
+/* 清除已记录的最大值 */
+void trace_reset(void)
+{
+    intr_status old_status = spin_lock_irqsave(&trace_lock);
+    memset(&irqsoff_max, 0, sizeof(irqsoff_max));
+    memset(&preemptoff_max, 0, sizeof(preemptoff_max));
+    spin_unlock_irqrestore(&trace_lock, old_status);
+}
+
+/* 长度为cycles的一段比rec中记录的长时替换之 */
+static void trace_update(struct trace_record * rec, uint32_t cycles,
+                void * start_ip, void * end_ip)
+{
+    if (cycles <= rec->max_cycles)
+    {
+        return;
+    }
+
+    spin_lock(&trace_lock);
+    if (cycles > rec->max_cycles)
+    {
+        rec->max_cycles = cycles;
+        rec->start_ip = start_ip;
+        rec->end_ip = end_ip;
+        rec->cpu_id = this_cpu()->id;
+        rec->pid = running_thread()->pid;
+    }
+    spin_unlock(&trace_lock);
+}
+
+/* 中断由开变关，ip为调用者地址 */
+void trace_irqs_off(void * ip)
+{
+    if (!trace_enabled)
+    {
+        return;
+    }
+    struct cpu * c = this_cpu();
+    c->irqsoff_start_tsc = rdtsc();
+    c->irqsoff_start_ip = ip;
+}
+
+/* 中断由关变开，调用时仍为关中断 */
+void trace_irqs_on(void * ip)
+{
+    if (!trace_enabled)
+    {
+        return;
+    }
+    struct cpu * c = this_cpu();
+    if (c->irqsoff_start_tsc == 0)
+    {
+        return;
+    }
+    uint32_t cycles = (uint32_t)(rdtsc() - c->irqsoff_start_tsc);
+    c->irqsoff_start_tsc = 0;
+    trace_update(&irqsoff_max, cycles, c->irqsoff_start_ip, ip);
+}
+
+/* 丢弃当前cpu上未结束的关中断时段 */
+void trace_irqs_clear(void)
+{
+    if (!trace_enabled)
+    {
+        return;
+    }
+    this_cpu()->irqsoff_start_tsc = 0;
+}
+
+/* 当前线程的抢占计数由0变为1 */
+void trace_preempt_off(void * ip)
+{
+    if (!trace_enabled)
+    {
+        return;
+    }
+    struct task_struct * cur = running_thread();
+    cur->preempt_start_tsc = rdtsc();
+    cur->preempt_start_ip = ip;
+}
+
+/* 当前线程的抢占计数由1变为0 */
+void trace_preempt_on(void * ip)
+{
+    if (!trace_enabled)
+    {
+        return;
+    }
+    struct task_struct * cur = running_thread();
+    if (cur->preempt_start_tsc == 0)
+    {
+        return;
+    }
+    uint32_t cycles = (uint32_t)(rdtsc() - cur->preempt_start_tsc);
+    cur->preempt_start_tsc = 0;
+
+    intr_status old_status = intr_disable();
+    trace_update(&preemptoff_max, cycles, cur->preempt_start_ip, ip);
+    intr_set_status(old_status);
+}
+
+/* 输出一项记录 */
+static void trace_print(const char * name, struct trace_record * rec)
+{
+    char buf[128];
+
+    sprintf(buf, "%s max %d cycles, cpu %d, pid %d, from 0x%x to 0x%x\n",
+                name, rec->max_cycles, rec->cpu_id, rec->pid,
+                (uint32_t)rec->start_ip, (uint32_t)rec->end_ip);
+    sys_write(stdout_no, buf, strlen(buf));
+}
+
+/* 打印最长的关中断和禁止抢占时段，reset不为0时打印后清除 */
+void sys_latency(int32_t reset)
+{
+    trace_print("irqs off:    ", &irqsoff_max);
+    trace_print("preempt off: ", &preemptoff_max);
+    if (reset)
+    {
+        trace_reset();
+    }
+}
@@ -0,0 +1,112 @@
+/* vdso.c
+ *   映射到每个进程中的只读数据页
+ *
+ * 全局数据页只由BSP写：时钟中断里更新时间，每5秒更新负载和内存提示，
+ * 写之前把seq加成奇数，写完再加成偶数，读者据此判断是否读到一半。
+ * 内核通过自己的虚拟地址写，进程中的映射是只读的
+ */
+
+#include <vdso.h>
+#include <thread.h>
+#include <memory.h>
+#include <interrupt.h>
+#include <timer.h>
+#include <smp.h>
+#include <tsc.h>
+#include <debug.h>
+#include <print.h>
+
+static struct vdso_data * vdso_data;
+
+/* 开始更新，调用时已关中断 */
+static void vdso_write_begin(void)
+{
+    vdso_data->seq++;
+    asm volatile ("" : : : "memory");
+}
+
+/* 结束更新 */
+static void vdso_write_end(void)
+{
+    asm volatile ("" : : : "memory");
+    vdso_data->seq++;
+}
+
+/* 在当前页表中映射数据页，为pthread建立进程数据页
+ * 须在pthread的页表生效时调用，成功返回0，失败返回-1
+ */
+int32_t vdso_map(struct task_struct * pthread)
+{
+    struct vdso_proc * proc = get_kernel_pages(1);
+    if (proc == NULL)
+    {
+        return -1;
+    }
+    proc->pid = pthread->pid;
+    proc->ppid = pthread->parent_pid;
+
+    page_map((void *)VDSO_DATA_VADDR,
+                (void *)addr_v2p((uint32_t)vdso_data), PG_US_U | PG_RW_R);
+    page_map((void *)VDSO_PROC_VADDR,
+                (void *)addr_v2p((uint32_t)proc), PG_US_U | PG_RW_R);
+
+    pthread->vdso = proc;
+    return 0;
+}
+
+/* 在BSP的时钟中断中ticks加1之后调用 */
+void vdso_update_tick(void)
+{
+    vdso_write_begin();
+    vdso_data->ticks = ticks;
+    vdso_data->tsc_base = rdtsc();
+    vdso_data->ns_base = (uint64_t)ticks * vdso_data->ns_per_tick;
+    vdso_write_end();
+}
+
+/* tsc校准之后调用，算出tsc周期数换算为纳秒的乘数 */
+void vdso_set_tsc(uint32_t tsc_per_tick)
+{
+    uint32_t rem;
+    uint32_t mult = (uint32_t)div_u64_rem(
+                (uint64_t)vdso_data->ns_per_tick << VDSO_TSC_SHIFT,
+                tsc_per_tick, &rem);
+
+    intr_status old_status = intr_disable();
+    vdso_write_begin();
+    vdso_data->tsc_per_tick = tsc_per_tick;
+    vdso_data->tsc_mult = mult;
+    vdso_write_end();
+    intr_set_status(old_status);
+}
+
+/* 在BSP的时钟中断中随负载均值一起更新 */
+void vdso_update_load(uint32_t * avenrun, uint32_t nr_running)
+{
+    vdso_write_begin();
+    vdso_data->loadavg[0] = avenrun[0];
+    vdso_data->loadavg[1] = avenrun[1];
+    vdso_data->loadavg[2] = avenrun[2];
+    vdso_data->nr_running = nr_running;
+    vdso_data->nr_cpus = nr_cpus;
+    vdso_data->user_free_pages = mem_free_pages(PF_USER);
+    vdso_data->kernel_free_pages = mem_free_pages(PF_KERNEL);
+    vdso_write_end();
+}
+
+/* 分配全局数据页，须在mem_init之后、开中断之前调用 */
+void vdso_init(void)
+{
+    put_str("vdso_init ... ");
+    vdso_data = get_kernel_pages(1);
+    kassert(vdso_data != NULL);
+
+    vdso_data->hz = IRQ0_FREQUENCY;
+    vdso_data->ns_per_tick = 1000000000 / IRQ0_FREQUENCY;
+    vdso_data->nr_cpus = 1;
+    vdso_data->user_total_pages = mem_total_pages(PF_USER);
+    vdso_data->user_free_pages = mem_free_pages(PF_USER);
+    vdso_data->kernel_total_pages = mem_total_pages(PF_KERNEL);
+    vdso_data->kernel_free_pages = mem_free_pages(PF_KERNEL);
+    put_str("ok\n");
+}
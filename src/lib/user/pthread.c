@@ -0,0 +1,188 @@
+/* pthread.c
+ *   基于clone的用户线程
+ *
+ * pthread_create从堆上分配线程栈，控制块放在栈顶，
+ * 新线程的gs指向控制块，从pthread_start开始执行。
+ * 线程结束时内核把控制块中的done置1并唤醒join，join再释放整个栈
+ */
+
+#include <pthread.h>
+#include <syscall.h>
+#include <string.h>
+#include <atomic.h>
+#include <global.h>
+
+/* 主线程没有用clone创建，用这个控制块代表它 */
+static struct pthread main_thread = { .self = &main_thread };
+
+/* 新线程的入口，栈上是一个不会用到的返回地址和控制块的地址 */
+static void pthread_start(struct pthread * t)
+{
+    pthread_exit(t->start_routine(t->arg));
+}
+
+/* 创建线程执行start_routine(arg)，成功时写入*thread并返回0，失败返回-1 */
+int32_t pthread_create(pthread_t * thread,
+                void * (*start_routine)(void *), void * arg)
+{
+    char * stack = malloc(PTHREAD_STACK_SIZE);
+    if (stack == NULL)
+    {
+        return -1;
+    }
+
+    struct pthread * t = (struct pthread *)
+            (stack + PTHREAD_STACK_SIZE - sizeof(struct pthread));
+    memset(t, 0, sizeof(struct pthread));
+    t->self = t;
+    t->start_routine = start_routine;
+    t->arg = arg;
+    t->stack = stack;
+
+    /* 在控制块之下按16字节对齐，放入pthread_start的参数和返回地址 */
+    uint32_t * sp = (uint32_t *)((uint32_t)t & ~0xf);
+    *--sp = (uint32_t)t;
+    *--sp = 0;
+
+    int32_t tid = clone(pthread_start, sp, t);
+    if (tid == -1)
+    {
+        free(stack);
+        return -1;
+    }
+    t->tid = tid;
+    *thread = t;
+    return 0;
+}
+
+/* 等待线程结束，retval不为NULL时写入线程的返回值
+ * 只能join一次，之后控制块随栈一起释放。不能join主线程
+ */
+int32_t pthread_join(pthread_t thread, void ** retval)
+{
+    if (thread == NULL || thread == &main_thread)
+    {
+        return -1;
+    }
+
+    while (!thread->done)
+    {
+        futex(&thread->done, FUTEX_WAIT, 0);
+    }
+
+    if (retval != NULL)
+    {
+        *retval = thread->retval;
+    }
+    free(thread->stack);
+    return 0;
+}
+
+/* 结束当前线程，主线程调用时会一直阻塞 */
+void pthread_exit(void * retval)
+{
+    struct pthread * self = pthread_self();
+    self->retval = retval;
+    thread_exit(self == &main_thread ? NULL : &self->done);
+}
+
+/* 返回当前线程的控制块 */
+pthread_t pthread_self(void)
+{
+    uint32_t gs;
+    asm volatile ("movl %%gs, %0" : "=r"(gs));
+    if (gs != SELECTOR_U_TLS)
+    {
+        return &main_thread;
+    }
+
+    struct pthread * self;
+    asm volatile ("movl %%gs:0, %0" : "=r"(self));
+    return self;
+}
+
+void pthread_mutex_init(pthread_mutex_t * mutex)
+{
+    mutex->locked = 0;
+}
+
+/* 加锁，没有争用时只有一条cmpxchg
+ * 拿不到锁时把locked置为2，表示解锁的线程需要唤醒等待者
+ */
+void pthread_mutex_lock(pthread_mutex_t * mutex)
+{
+    uint32_t c = cmpxchg(&mutex->locked, 0, 1);
+    if (c == 0)
+    {
+        return;
+    }
+
+    if (c != 2)
+    {
+        c = xchg(&mutex->locked, 2);
+    }
+    while (c != 0)
+    {
+        futex(&mutex->locked, FUTEX_WAIT, 2);
+        c = xchg(&mutex->locked, 2);
+    }
+}
+
+/* 尝试加锁，成功返回true */
+bool pthread_mutex_trylock(pthread_mutex_t * mutex)
+{
+    return cmpxchg(&mutex->locked, 0, 1) == 0;
+}
+
+/* 解锁，可能有等待者时才陷入内核唤醒一个 */
+void pthread_mutex_unlock(pthread_mutex_t * mutex)
+{
+    if (xchg(&mutex->locked, 0) == 2)
+    {
+        futex(&mutex->locked, FUTEX_WAKE, 1);
+    }
+}
+
+void pthread_cond_init(pthread_cond_t * cond)
+{
+    cond->seq = 0;
+    cond->mutex = NULL;
+}
+
+/* 释放mutex并等待条件，返回时重新持有mutex
+ * 可能被虚假唤醒，调用者要在循环中重新检查条件
+ */
+void pthread_cond_wait(pthread_cond_t * cond, pthread_mutex_t * mutex)
+{
+    uint32_t seq = cond->seq;
+    cond->mutex = mutex;
+
+    pthread_mutex_unlock(mutex);
+    futex(&cond->seq, FUTEX_WAIT, seq);
+
+    /* 可能是被broadcast转到mutex上唤醒的，别的等待者还在mutex上，
+     * 只能按有争用的方式加锁，解锁时才会唤醒它们
+     */
+    while (xchg(&mutex->locked, 2) != 0)
+    {
+        futex(&mutex->locked, FUTEX_WAIT, 2);
+    }
+}
+
+/* 唤醒一个等待者 */
+void pthread_cond_signal(pthread_cond_t * cond)
+{
+    atomic_inc(&cond->seq);
+    futex(&cond->seq, FUTEX_WAKE, 1);
+}
+
+/* 唤醒所有等待者，只唤醒一个，其余的直接转到互斥锁上排队 */
+void pthread_cond_broadcast(pthread_cond_t * cond)
+{
+    atomic_inc(&cond->seq);
+    if (cond->mutex == NULL)
+    {
+        return;
+    }
+    futex(&cond->seq, FUTEX_REQUEUE, (uint32_t)&cond->mutex->locked);
+}
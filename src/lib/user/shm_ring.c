@@ -0,0 +1,107 @@
+/* shm_ring.c
+ *   放在共享内存段中的单生产者单消费者环
+ *
+ * 睡眠的一方先置等待标志再检查计数，唤醒的一方先改计数再检查标志，
+ * 两边都用xchg作为屏障，不会出现双方都没看到对方的情况
+ */
+
+#include <shm_ring.h>
+#include <syscall.h>
+#include <atomic.h>
+#include <global.h>
+
+/* 返回序号为seq的槽的地址 */
+static void * ring_slot(struct shm_ring * ring, uint32_t seq)
+{
+    return (char *)(ring + 1) + (seq & (ring->nr_slots - 1)) * ring->slot_size;
+}
+
+/* 在大小为size的共享内存mem中建立槽大小为slot_size的环
+ * 只由一方调用一次，放不下一个槽时返回NULL
+ */
+struct shm_ring * shm_ring_init(void * mem, uint32_t size, uint32_t slot_size)
+{
+    struct shm_ring * ring = mem;
+    slot_size = (slot_size + 3) & ~3;
+    if (slot_size == 0 || size < sizeof(struct shm_ring) + slot_size)
+    {
+        return NULL;
+    }
+
+    uint32_t nr_slots = 1;
+    while (nr_slots * 2 * slot_size <= size - sizeof(struct shm_ring))
+    {
+        nr_slots *= 2;
+    }
+
+    ring->head = 0;
+    ring->tail = 0;
+    ring->rd_waiting = 0;
+    ring->wr_waiting = 0;
+    ring->slot_size = slot_size;
+    ring->nr_slots = nr_slots;
+    return ring;
+}
+
+/* 取一个空槽给生产者填写，环满时等消费者取走，填好后调用shm_ring_publish */
+void * shm_ring_produce(struct shm_ring * ring)
+{
+    uint32_t head = ring->head;
+    while (true)
+    {
+        uint32_t tail = ring->tail;
+        if (head - tail < ring->nr_slots)
+        {
+            break;
+        }
+        xchg(&ring->wr_waiting, 1);
+        if (ring->tail == tail)
+        {
+            futex(&ring->tail, FUTEX_WAIT, tail);
+        }
+    }
+    return ring_slot(ring, head);
+}
+
+/* 把shm_ring_produce取到的槽交给消费者 */
+void shm_ring_publish(struct shm_ring * ring)
+{
+    xchg(&ring->head, ring->head + 1);
+    if (ring->rd_waiting)
+    {
+        ring->rd_waiting = 0;
+        futex(&ring->head, FUTEX_WAKE, 1);
+    }
+}
+
+/* 取最早的一个有数据的槽，环空时等生产者，读完后调用shm_ring_release */
+void * shm_ring_consume(struct shm_ring * ring)
+{
+    uint32_t tail = ring->tail;
+    while (true)
+    {
+        uint32_t head = ring->head;
+        if (head != tail)
+        {
+            break;
+        }
+        xchg(&ring->rd_waiting, 1);
+        if (ring->head == head)
+        {
+            futex(&ring->head, FUTEX_WAIT, head);
+        }
+    }
+    asm volatile ("" : : : "memory");
+    return ring_slot(ring, tail);
+}
+
+/* 把shm_ring_consume取到的槽还给生产者 */
+void shm_ring_release(struct shm_ring * ring)
+{
+    xchg(&ring->tail, ring->tail + 1);
+    if (ring->wr_waiting)
+    {
+        ring->wr_waiting = 0;
+        futex(&ring->tail, FUTEX_WAKE, 1);
+    }
+}
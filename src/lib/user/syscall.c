@@ -5,61 +5,180 @@
 
 #include <syscall.h>
 #include <thread.h>
+#include <timer.h>
+#include <tsc.h>
 
-/* 无参数的系统调用 */
-#define _syscall0(number) ({    \
+/* 经int 0x80进入内核的系统调用 */
+#define _int80_syscall(number, arg1, arg2, arg3) ({    \
     int retval;                 \
     asm volatile (              \
         "int $0x80"             \
         : "=a"(retval)          \
-        : "a"(number)           \
+        : "a"(number), "b"(arg1), "c"(arg2), "d"(arg3)   \
         : "memory"              \
     );                          \
     retval;                     \
 })
 
-/* 一个参数的系统调用 */
-#define _syscall1(NUMBER, ARG1) ({			       \
-   int retval;					               \
-   asm volatile (					       \
-   "int $0x80"						       \
-   : "=a" (retval)					       \
-   : "a" (NUMBER), "b" (ARG1)				       \
-   : "memory"						       \
-   );							       \
-   retval;						       \
-})
-
-/* 两个参数的系统调用 */
-#define _syscall2(number, arg1, arg2) ({    \
+/* 经sysenter进入内核的系统调用，调用约定见intr_entry.S中的sysenter_entry
+ * call把下一条指令的地址压栈作为返回地址，内核用sysexit返回到那里时
+ * esp等于ebp，弹出ebp后跳过sysenter。ecx和edx被sysexit破坏
+ */
+#define _fast_syscall(number, arg1, arg2, arg3) ({    \
     int retval;                 \
+    uint32_t ecx_out = (uint32_t)(arg2);    \
+    uint32_t edx_out = (uint32_t)(arg3);    \
     asm volatile (              \
-        "int $0x80"             \
-        : "=a"(retval)          \
-        : "a"(number), "b"(arg1), "c"(arg2) \
-        : "memory"              \
+        "push %%ebp\n\t"        \
+        "mov %%esp, %%ebp\n\t"  \
+        "call 1f\n\t"           \
+        "pop %%ebp\n\t"         \
+        "jmp 2f\n"              \
+        "1:\n\t"                \
+        "sysenter\n"            \
+        "2:"                    \
+        : "=a"(retval), "+c"(ecx_out), "+d"(edx_out)   \
+        : "a"(number), "b"(arg1)    \
+        : "memory", "cc"        \
     );                          \
     retval;                     \
 })
 
+/* 是否运行在用户态，内核线程也会调用这里的函数 */
+static bool in_user_mode(void)
+{
+    uint32_t cs;
+    asm volatile ("movl %%cs, %0" : "=r"(cs));
+    return (cs & 3) == 3;
+}
+
+/* sysenter是否可用，-1表示尚未向内核查询 */
+static int32_t fast_syscall_ok = -1;
+
+/* 判断能否走sysenter，sysexit总是返回用户态，在内核态中调用时只能用int 0x80 */
+static bool use_fast_syscall(void)
+{
+    if (fast_syscall_ok < 0)
+    {
+        if (!in_user_mode())
+        {
+            return false;
+        }
+        fast_syscall_ok = _int80_syscall(SYS_FASTCALL, 0, 0, 0);
+    }
+    return fast_syscall_ok > 0;
+}
+
+/* 系统调用，能用sysenter时走快速路径，否则用int 0x80 */
+#define _syscall(number, arg1, arg2, arg3) \
+    (use_fast_syscall() ?                   \
+        _fast_syscall(number, arg1, arg2, arg3) :    \
+        _int80_syscall(number, arg1, arg2, arg3))
+
+/* 无参数的系统调用 */
+#define _syscall0(number)   _syscall(number, 0, 0, 0)
+
+/* 一个参数的系统调用 */
+#define _syscall1(number, arg1)     _syscall(number, arg1, 0, 0)
+
+/* 两个参数的系统调用 */
+#define _syscall2(number, arg1, arg2)   _syscall(number, arg1, arg2, 0)
+
 /* 三个参数的系统调用 */
-#define _syscall3(number, arg1, arg2, arg3) ({    \
-    int retval;                 \
-    asm volatile (              \
-        "int $0x80"             \
-        : "=a"(retval)          \
-        : "a"(number), "b"(arg1), "c"(arg2), "d"(arg3)   \
-        : "memory"              \
-    );                          \
-    retval;                     \
-})
+#define _syscall3(number, arg1, arg2, arg3) _syscall(number, arg1, arg2, arg3)
+
+/* 打开或关闭sysenter快速系统调用，内核不支持时无法打开，
+ * 返回设置后是否在使用sysenter，供对比两种方式的开销
+ */
+bool fast_syscall(bool enable)
+{
+    fast_syscall_ok = enable ? -1 : 0;
+    return use_fast_syscall();
+}
 
-/* 返回当前任务pid */
+/* 返回当前任务pid，用户态从进程数据页中读取 */
 uint32_t getpid(void)
 {
+    if (in_user_mode())
+    {
+        return ((struct vdso_proc *)VDSO_PROC_VADDR)->pid;
+    }
     return _syscall0(SYS_GETPID);
 }
 
+/* 返回父进程pid */
+int16_t getppid(void)
+{
+    if (in_user_mode())
+    {
+        return ((struct vdso_proc *)VDSO_PROC_VADDR)->ppid;
+    }
+    return _syscall0(SYS_GETPPID);
+}
+
+/* 返回数据页，其中的负载和内存提示每5秒更新一次，
+ * 内核态中没有映射，返回NULL
+ */
+const struct vdso_data * vdso(void)
+{
+    if (in_user_mode())
+    {
+        return (const struct vdso_data *)VDSO_DATA_VADDR;
+    }
+    return NULL;
+}
+
+/* 返回开机以来的嘀嗒数 */
+uint32_t getticks(void)
+{
+    if (in_user_mode())
+    {
+        return ((const struct vdso_data *)VDSO_DATA_VADDR)->ticks;
+    }
+    return times(NULL);
+}
+
+/* 返回开机以来的纳秒数，用户态不陷入内核，内核态中只精确到嘀嗒 */
+uint64_t clock_ns(void)
+{
+    if (!in_user_mode())
+    {
+        return (uint64_t)times(NULL) * (1000000000 / IRQ0_FREQUENCY);
+    }
+
+    const struct vdso_data * data = (const struct vdso_data *)VDSO_DATA_VADDR;
+    uint32_t seq;
+    uint64_t ns;
+    uint64_t delta;
+    uint32_t tsc_per_tick;
+    uint32_t mult;
+    uint32_t ns_per_tick;
+
+    /* 读到一半被时钟中断更新时重读 */
+    do
+    {
+        seq = data->seq;
+        asm volatile ("" : : : "memory");
+        ns = data->ns_base;
+        delta = rdtsc() - data->tsc_base;
+        tsc_per_tick = data->tsc_per_tick;
+        mult = data->tsc_mult;
+        ns_per_tick = data->ns_per_tick;
+        asm volatile ("" : : : "memory");
+    } while ((seq & 1) || seq != data->seq);
+
+    /* 各cpu的tsc未必同步，差值为负或超过一个嘀嗒时截断，保证时间不回退 */
+    if ((int64_t)delta < 0 || mult == 0)
+    {
+        return ns;
+    }
+    if (delta >= tsc_per_tick)
+    {
+        return ns + ns_per_tick;
+    }
+    return ns + ((delta * mult) >> VDSO_TSC_SHIFT);
+}
+
 
 /* 把buf中count个字符写入文件描述符fd */
 uint32_t write(int32_t fd, const void * buf, uint32_t count) 
@@ -182,10 +301,10 @@ int32_t chdir(const char* path)
     return _syscall1(SYS_CHDIR, path);
 }
 
-/* 显示任务列表 */
-void ps(void) 
+/* 显示任务列表，mode为PS_DEFAULT、PS_RUSAGE或PS_SCHED */
+void ps(int32_t mode) 
 {
-    _syscall0(SYS_PS);
+    _syscall1(SYS_PS, mode);
 }
 
 int execv(const char* pathname, char** argv) 
@@ -193,3 +312,224 @@ int execv(const char* pathname, char** argv)
     return _syscall2(SYS_EXECV, pathname, argv);
 }
 
+/* 显示各中断的次数及处理耗时 */
+void irqstat(void) 
+{
+    _syscall0(SYS_IRQSTAT);
+}
+
+/* 显示最长的关中断和禁止抢占时段，reset不为0时随后清除记录 */
+void latency(int32_t reset) 
+{
+    _syscall1(SYS_LATENCY, reset);
+}
+
+/* 获取资源使用情况，who为RUSAGE_SELF或RUSAGE_CHILDREN */
+int32_t getrusage(int32_t who, struct rusage * ru) 
+{
+    return _syscall2(SYS_GETRUSAGE, who, ru);
+}
+
+/* 获取当前进程的执行时间，返回开机以来的嘀嗒数 */
+uint32_t times(struct tms * buf) 
+{
+    return _syscall1(SYS_TIMES, buf);
+}
+
+/* 获取全局的调度统计 */
+int32_t schedstat(struct schedstat * buf) 
+{
+    return _syscall1(SYS_SCHEDSTAT, buf);
+}
+
+/* 休眠m_seconds毫秒 */
+void msleep(uint32_t m_seconds) 
+{
+    _syscall1(SYS_SLEEP, m_seconds);
+}
+
+/* 建立异步提交文件操作的环，返回映射到进程空间的共享页 */
+struct io_ring * ring_setup(void) 
+{
+    return (struct io_ring *)_syscall0(SYS_RING_SETUP);
+}
+
+/* 提交环中最多to_submit个操作，并等待至少min_complete个完成 */
+int32_t ring_enter(uint32_t to_submit, uint32_t min_complete) 
+{
+    return _syscall2(SYS_RING_ENTER, to_submit, min_complete);
+}
+
+/* 在当前进程中创建线程，从entry开始执行，栈顶为stack，
+ * tls非空时线程的gs:0处可以访问它。返回线程的tid，失败返回-1
+ */
+int32_t clone(void * entry, void * stack, void * tls) 
+{
+    return _syscall3(SYS_CLONE, entry, stack, tls);
+}
+
+/* 结束当前线程，内核不再使用线程的栈之后把*done置1 */
+void thread_exit(volatile uint32_t * done) 
+{
+    _syscall1(SYS_THREAD_EXIT, done);
+}
+
+/* 返回当前线程自己的tid，主线程的tid就是进程的pid */
+uint32_t gettid(void) 
+{
+    return _syscall0(SYS_GETTID);
+}
+
+/* 让出处理器 */
+void sched_yield(void) 
+{
+    _syscall0(SYS_SCHED_YIELD);
+}
+
+/* futex操作，op见futex.h */
+int32_t futex(volatile uint32_t * uaddr, uint32_t op, uint32_t val) 
+{
+    return _syscall3(SYS_FUTEX, uaddr, op, val);
+}
+
+/* 申请size字节的共享内存，fork出的子进程与父进程共用 */
+void * mmap_shared(uint32_t size) 
+{
+    return (void *)_syscall1(SYS_MMAP_SHARED, size);
+}
+
+/* 结束当前进程，status由父进程的wait取得 */
+void exit(int32_t status) 
+{
+    _syscall1(SYS_EXIT, status);
+}
+
+/* 等待任意一个子进程退出，返回其pid，没有子进程时返回-1 */
+int16_t wait(int32_t * status) 
+{
+    return _syscall1(SYS_WAIT, status);
+}
+
+/* 创建管道，pipefd[0]为读端，pipefd[1]为写端 */
+int32_t pipe(int32_t pipefd[2]) 
+{
+    return _syscall1(SYS_PIPE, pipefd);
+}
+
+/* 使文件描述符newfd指向oldfd所指的文件 */
+int32_t dup2(int32_t oldfd, int32_t newfd) 
+{
+    return _syscall2(SYS_DUP2, oldfd, newfd);
+}
+
+/* 打开名为name的共享内存段，不存在时创建size字节的段，返回段号 */
+int32_t shm_open(const char * name, uint32_t size) 
+{
+    return _syscall2(SYS_SHM_OPEN, name, size);
+}
+
+/* 把段shmid映射到当前进程，返回起始地址 */
+void * shm_map(int32_t shmid) 
+{
+    return (void *)_syscall1(SYS_SHM_MAP, shmid);
+}
+
+/* 去掉shm_map得到的映射 */
+int32_t shm_unmap(void * addr) 
+{
+    return _syscall1(SYS_SHM_UNMAP, addr);
+}
+
+/* 消息传递，消息的两个字经esi、edi传入传出，收到的字节数经ebx返回
+ * 没有长消息时不把msg交给内核，内核不必访问用户内存
+ */
+static int32_t ipc(uint32_t op, int32_t partner, struct ipc_msg * msg)
+{
+    int32_t retval;
+    uint32_t ebx = op;
+    uint32_t esi = msg->words[0];
+    uint32_t edi = msg->words[1];
+    struct ipc_msg * long_msg = (msg->buf != NULL) ? msg : NULL;
+
+    if (use_fast_syscall())
+    {
+        uint32_t ecx = (uint32_t)partner;
+        uint32_t edx = (uint32_t)long_msg;
+        asm volatile (
+            "push %%ebp\n\t"
+            "mov %%esp, %%ebp\n\t"
+            "call 1f\n\t"
+            "pop %%ebp\n\t"
+            "jmp 2f\n"
+            "1:\n\t"
+            "sysenter\n"
+            "2:"
+            : "=a"(retval), "+b"(ebx), "+c"(ecx), "+d"(edx),
+              "+S"(esi), "+D"(edi)
+            : "a"(SYS_IPC)
+            : "memory", "cc"
+        );
+    }
+    else
+    {
+        asm volatile (
+            "int $0x80"
+            : "=a"(retval), "+b"(ebx), "+S"(esi), "+D"(edi)
+            : "a"(SYS_IPC), "c"(partner), "d"(long_msg)
+            : "memory"
+        );
+    }
+
+    /* 收到了消息 */
+    if (retval > 0)
+    {
+        msg->words[0] = esi;
+        msg->words[1] = edi;
+        msg->len = ebx;
+    }
+    return retval;
+}
+
+/* 发送给dest，等到对方收下，成功返回0 */
+int32_t ipc_send(int32_t dest, struct ipc_msg * msg)
+{
+    return ipc(IPC_SEND, dest, msg);
+}
+
+/* 接收from发来的消息，from为IPC_ANY时接收任意发送者，返回发送者的pid */
+int32_t ipc_receive(int32_t from, struct ipc_msg * msg)
+{
+    return ipc(IPC_RECEIVE, from, msg);
+}
+
+/* 发送给dest并等待它的回复，回复放回msg中，返回dest的pid */
+int32_t ipc_call(int32_t dest, struct ipc_msg * msg)
+{
+    return ipc(IPC_CALL, dest, msg);
+}
+
+/* 回复正在等待的dest，对方不在等待时返回-1 */
+int32_t ipc_reply(int32_t dest, struct ipc_msg * msg)
+{
+    return ipc(IPC_REPLY, dest, msg);
+}
+
+/* 等待fds中的文件描述符上发生关心的事件，最多等timeout毫秒，为负数时一直等 */
+int32_t poll(struct pollfd * fds, uint32_t nfds, int32_t timeout)
+{
+    return _syscall3(SYS_POLL, fds, nfds, timeout);
+}
+
+/* 设置控制台的模式，mode为负数时只查询，返回原来的模式 */
+int32_t tty_mode(int32_t mode)
+{
+    return _syscall1(SYS_TTY_MODE, mode);
+}
+
+/* 不复制当前进程，直接由pathname创建子进程，
+ * fds不为NULL时依次是子进程的标准输入、输出、错误所用的描述符
+ */
+int16_t spawn(const char* pathname, char** argv, const int32_t* fds)
+{
+    return _syscall3(SYS_SPAWN, pathname, argv, fds);
+}
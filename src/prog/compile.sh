@@ -11,34 +11,49 @@ if [[ ! -d "../include" || ! -d "../build" ]];then
    exit
 fi
 
-BIN="prog_arg"
+####  用法：./compile.sh [程序名]，默认为prog_arg
+####  EXTRA_CFLAGS可以追加编译选项，如"-O2 -msse2"
+
+BIN=${1:-"prog_arg"}
 CFLAGS="-Wall -c -fno-builtin -W -Wstrict-prototypes \
-      -Wmissing-prototypes -Wsystem-headers"
-LIBS="-I ../include -I ../include/fs"
-OBJS="../build/string.o ../build/syscall.o \
+      -Wmissing-prototypes -Wsystem-headers $EXTRA_CFLAGS"
+LIBS="-I ../include -I ../include/fs -I ../include/kernel -I ../include/thread \
+      -I ../include/user -I ../include/dev"
+OBJS="../build/string.o ../build/syscall.o ../build/pthread.o ../build/shm_ring.o \
       ../build/stdio.o ../build/assert.o start.o \
       ../build/vsprintf.o"
 
-DD_IN=$BIN
+####  编译好的程序都放到INITRD_DIR中，打包成cpio newc格式的initramfs，
+####  写入硬盘第300扇区起，内核启动时解包到内存盘上的根文件系统
+INITRD_DIR="./initramfs"
+INITRD_IMG="./initrd.cpio"
+INITRD_MAX=$((1024*512))      # 与boot.h中的INITRD_SECTORS一致
 DD_OUT="/root/tools/bochs/hd60M.img"
 
 nasm -f elf ./start.S -o ./start.o
 ar rcs simple_crt.a $OBJS start.o
 gcc $CFLAGS $LIBS -o $BIN".o" $BIN".c"
 ld $BIN".o" simple_crt.a -o $BIN
-SEC_CNT=$(ls -l $BIN|awk '{printf("%d", ($5+511)/512)}')
-
 if [[ -f $BIN ]];then
-   dd if=./$DD_IN of=$DD_OUT bs=512 \
-   count=$SEC_CNT seek=300 conv=notrunc
+   mkdir -p $INITRD_DIR
+   cp $BIN $INITRD_DIR/
+   (cd $INITRD_DIR && find . -mindepth 1 | cpio -o -H newc --quiet) \
+      > $INITRD_IMG
+   INITRD_SIZE=$(stat -c %s $INITRD_IMG)
+   if [[ $INITRD_SIZE -gt $INITRD_MAX ]];then
+      echo "initramfs is $INITRD_SIZE bytes, larger than $INITRD_MAX"
+      exit 1
+   fi
+   dd if=$INITRD_IMG of=$DD_OUT bs=512 seek=300 conv=notrunc
 fi
 
-##########   以上核心就是下面这五条命令   ##########
+##########   以上核心就是下面这六条命令   ##########
 #nasm -f elf ./start.S -o ./start.o
 #ar rcs simple_crt.a ../build/string.o ../build/syscall.o \
 #   ../build/stdio.o ../build/assert.o ./start.o
 #gcc -Wall -c -fno-builtin -W -Wstrict-prototypes -Wmissing-prototypes \
 #   -Wsystem-headers -I ../lib/ -I ../lib/user -I ../fs prog_arg.c -o prog_arg.o
 #ld prog_arg.o simple_crt.a -o prog_arg
-#dd if=prog_arg of=/home/work/my_workspace/bochs/hd60M.img \
-#   bs=512 count=11 seek=300 conv=notrunc
+#(cd initramfs && find . -mindepth 1 | cpio -o -H newc) > initrd.cpio
+#dd if=initrd.cpio of=/home/work/my_workspace/bochs/hd60M.img \
+#   bs=512 seek=300 conv=notrunc
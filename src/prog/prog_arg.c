@@ -21,7 +21,7 @@ int main(int argc, char** argv)
         while(delay--);
         printf("\n      I'm father prog, my pid: %d, "
                         "I will show process list\n", getpid()); 
-        ps();
+        ps(PS_DEFAULT);
     } 
     else 
     {
@@ -0,0 +1,46 @@
+/* prog_cat.c
+ *
+ * 把文件或标准输入的内容输出到标准输出，用于测试管道，
+ * 如"ls -l | prog_cat"、"prog_cat /file1 | prog_cat"
+ */
+
+#include <stdio.h>
+#include <user/syscall.h>
+#include <string.h>
+
+#define BUF_SIZE    512
+
+int main(int argc, char** argv) 
+{
+    int32_t fd = 0;       /* 默认读标准输入 */
+    if (argc > 1)
+    {
+        char abs_path[512] = {0};
+        if (argv[1][0] != '/') 
+        {
+            getcwd(abs_path, 512);
+            strcat(abs_path, "/");
+        }
+        strcat(abs_path, argv[1]);
+        fd = open(abs_path, O_RDONLY);
+        if (fd == -1)
+        {
+            printf("prog_cat: open %s failed\n", argv[1]);
+            return -1;
+        }
+    }
+
+    /* 写满管道后write会等读者取走，读到结尾时read返回-1 */
+    char buf[BUF_SIZE];
+    int32_t n;
+    while ((n = read(fd, buf, BUF_SIZE)) > 0)
+    {
+        write(1, buf, n);
+    }
+
+    if (fd != 0)
+    {
+        close(fd);
+    }
+    return 0;
+}
@@ -0,0 +1,67 @@
+/* prog_fpu.c
+ *
+ * 浮点测试程序：父子进程同时做浮点点积，检查任务切换之后结果仍然正确，
+ * 并用rdtsc统计每次点积的时钟周期数。
+ * 用EXTRA_CFLAGS="-O2 -msse2 -ffast-math" ./compile.sh prog_fpu
+ * 编译即可和x87版本做对比，浮点累加要-ffast-math才允许向量化
+ */
+
+#include <stdio.h>
+#include <user/syscall.h>
+#include <string.h>
+
+#define N       1024
+#define ROUNDS  200
+
+static float a[N], b[N];
+
+static inline uint64_t rdtsc(void)
+{
+    uint32_t low, high;
+
+    asm volatile ("rdtsc" : "=a"(low), "=d"(high));
+    return ((uint64_t)high << 32) | low;
+}
+
+static float dot(const float* x, const float* y, uint32_t n)
+{
+    float sum = 0;
+    uint32_t i;
+    for (i = 0; i < n; i++)
+    {
+        sum += x[i] * y[i];
+    }
+    return sum;
+}
+
+int main(void) 
+{
+    uint32_t i;
+    for (i = 0; i < N; i++)
+    {
+        a[i] = i * 0.5f;
+        b[i] = 2.0f;
+    }
+
+    /* 父子进程用不同的系数，互相破坏了对方的浮点状态就会算错 */
+    int pid = fork();
+    float scale = pid ? 1.0f : 3.0f;
+    float expect = (N * (N - 1) / 2) * scale;
+
+    uint32_t errors = 0;
+    uint64_t start = rdtsc();
+    for (i = 0; i < ROUNDS; i++)
+    {
+        if (dot(a, b, N) * scale != expect)
+        {
+            errors++;
+        }
+    }
+    uint32_t cycles = (uint32_t)(rdtsc() - start) / ROUNDS;
+
+    printf("prog_fpu %s: %d rounds, %d errors, %d cycles per dot\n",
+                pid ? "parent" : "child", ROUNDS, errors, cycles);
+    while(1)
+        ;
+    return 0;
+}
@@ -0,0 +1,58 @@
+/* prog_futex.c
+ *
+ * futex测试程序：fork出的父子进程在共享内存中用互斥锁累加同一个计数器，
+ * 再用条件变量让父进程等到子进程做完，检查计数结果
+ */
+
+#include <stdio.h>
+#include <user/syscall.h>
+#include <pthread.h>
+
+#define LOOPS   100000
+
+struct shared
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    uint32_t counter;
+    uint32_t child_done;
+};
+
+int main(void) 
+{
+    struct shared * sh = mmap_shared(sizeof(struct shared));
+    if (sh == NULL)
+    {
+        printf("mmap_shared failed\n");
+        return -1;
+    }
+    pthread_mutex_init(&sh->mutex);
+    pthread_cond_init(&sh->cond);
+
+    int16_t pid = fork();
+    uint32_t i;
+    for (i = 0; i < LOOPS; i++)
+    {
+        pthread_mutex_lock(&sh->mutex);
+        sh->counter++;
+        pthread_mutex_unlock(&sh->mutex);
+    }
+
+    if (pid == 0)
+    {
+        pthread_mutex_lock(&sh->mutex);
+        sh->child_done = 1;
+        pthread_cond_signal(&sh->cond);
+        pthread_mutex_unlock(&sh->mutex);
+        return 0;
+    }
+
+    pthread_mutex_lock(&sh->mutex);
+    while (!sh->child_done)
+    {
+        pthread_cond_wait(&sh->cond, &sh->mutex);
+    }
+    printf("counter %d (expect %d)\n", sh->counter, 2 * LOOPS);
+    pthread_mutex_unlock(&sh->mutex);
+    return 0;
+}
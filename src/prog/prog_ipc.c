@@ -0,0 +1,103 @@
+/* prog_ipc.c
+ *
+ * 消息传递测试程序：子进程作为服务端，收到消息后把两个字加1、
+ * 把长消息的每个字节加1后回复；父进程先测只用寄存器的往返耗时，
+ * 再用长消息检查内容是否正确
+ */
+
+#include <stdio.h>
+#include <user/syscall.h>
+#include <string.h>
+
+#define ROUNDS      10000
+#define LONG_LEN    1000
+
+static char server_buf[IPC_MAX_LEN];
+static char client_buf[IPC_MAX_LEN];
+
+static void server(void)
+{
+    struct ipc_msg msg;
+    while (true)
+    {
+        msg.buf = server_buf;
+        msg.size = sizeof(server_buf);
+        int32_t client = ipc_receive(IPC_ANY, &msg);
+        if (client == -1)
+        {
+            continue;
+        }
+        if (msg.words[0] == 0xffffffff)
+        {
+            break;
+        }
+
+        msg.words[0]++;
+        msg.words[1]++;
+        uint32_t i;
+        for (i = 0; i < msg.len; i++)
+        {
+            server_buf[i]++;
+        }
+        if (msg.len == 0)
+        {
+            msg.buf = NULL;
+        }
+        ipc_reply(client, &msg);
+    }
+}
+
+int main(void) 
+{
+    int16_t pid = fork();
+    if (pid == 0)
+    {
+        server();
+        return 0;
+    }
+
+    /* 只用寄存器传递的往返 */
+    struct ipc_msg msg;
+    memset(&msg, 0, sizeof(msg));
+    uint32_t errors = 0;
+    uint64_t start = clock_ns();
+    uint32_t i;
+    for (i = 0; i < ROUNDS; i++)
+    {
+        msg.words[0] = i;
+        msg.words[1] = 2 * i;
+        if (ipc_call(pid, &msg) != pid || msg.words[0] != i + 1 ||
+                msg.words[1] != 2 * i + 1)
+        {
+            errors++;
+        }
+    }
+    uint32_t ns = (uint32_t)(clock_ns() - start);
+    printf("prog_ipc: %d short round trips, %d ns each, %d errors\n",
+                ROUNDS, ns / ROUNDS, errors);
+
+    /* 带长消息的往返 */
+    errors = 0;
+    for (i = 0; i < 100; i++)
+    {
+        memset(client_buf, i, LONG_LEN);
+        msg.buf = client_buf;
+        msg.len = LONG_LEN;
+        msg.size = sizeof(client_buf);
+        if (ipc_call(pid, &msg) != pid || msg.len != LONG_LEN ||
+                client_buf[0] != (char)(i + 1) ||
+                client_buf[LONG_LEN - 1] != (char)(i + 1))
+        {
+            errors++;
+        }
+    }
+    printf("prog_ipc: 100 long round trips, %d errors\n", errors);
+
+    msg.buf = NULL;
+    msg.words[0] = 0xffffffff;
+    ipc_send(pid, &msg);
+
+    int32_t status;
+    wait(&status);
+    return 0;
+}
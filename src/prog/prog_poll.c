@@ -0,0 +1,83 @@
+/* prog_poll.c
+ *
+ * poll测试程序：子进程每隔半秒往管道里写一条消息，写5条后退出，
+ * 父进程用poll同时等待键盘和管道，超时1秒，
+ * 把收到的消息、按下的键和超时都打印出来，管道写端关闭后结束。
+ * 控制台切换到不回显的原始模式，每个键立即可读
+ */
+
+#include <stdio.h>
+#include <user/syscall.h>
+#include <string.h>
+
+int main(void) 
+{
+    int32_t pipefd[2];
+    if (pipe(pipefd) == -1)
+    {
+        printf("pipe failed\n");
+        return -1;
+    }
+
+    int16_t pid = fork();
+    if (pid == 0)
+    {
+        close(pipefd[0]);
+        char msg[32];
+        int32_t i;
+        for (i = 0; i < 5; i++)
+        {
+            msleep(500);
+            sprintf(msg, "message %d", i);
+            write(pipefd[1], msg, strlen(msg));
+        }
+        close(pipefd[1]);
+        return 0;
+    }
+    close(pipefd[1]);
+    int32_t old_mode = tty_mode(0);
+
+    struct pollfd fds[2];
+    fds[0].fd = 0;
+    fds[0].events = POLLIN;
+    fds[1].fd = pipefd[0];
+    fds[1].events = POLLIN;
+
+    while (true)
+    {
+        int32_t n = poll(fds, 2, 1000);
+        if (n == 0)
+        {
+            printf("poll: timeout\n");
+            continue;
+        }
+        if (n == -1)
+        {
+            printf("poll failed\n");
+            break;
+        }
+
+        if (fds[0].revents & POLLIN)
+        {
+            char c;
+            read(0, &c, 1);
+            printf("poll: key '%c'\n", c);
+        }
+        if (fds[1].revents & POLLIN)
+        {
+            char buf[64] = {0};
+            if (read(pipefd[0], buf, sizeof(buf) - 1) <= 0)
+            {
+                printf("poll: pipe closed\n");
+                break;
+            }
+            printf("poll: pipe '%s'\n", buf);
+        }
+    }
+
+    tty_mode(old_mode);
+    close(pipefd[0]);
+    int32_t status;
+    wait(&status);
+    return 0;
+}
@@ -0,0 +1,73 @@
+/* prog_shm.c
+ *
+ * 共享内存段测试程序：父进程按名字创建段并在其中建立环，
+ * 子进程按名字重新打开、映射同一个段，父进程往环里写消息，
+ * 子进程在槽里直接读并累加，最后检查结果
+ */
+
+#include <stdio.h>
+#include <user/syscall.h>
+#include <shm_ring.h>
+
+#define SHM_NAME    "prog_shm"
+#define SHM_SIZE    (4 * 4096)
+#define MSGS        10000
+
+struct msg
+{
+    uint32_t seq;
+    uint32_t value;
+};
+
+int main(void) 
+{
+    int32_t shmid = shm_open(SHM_NAME, SHM_SIZE);
+    if (shmid == -1)
+    {
+        printf("shm_open failed\n");
+        return -1;
+    }
+    void * mem = shm_map(shmid);
+    if (mem == NULL)
+    {
+        printf("shm_map failed\n");
+        return -1;
+    }
+    struct shm_ring * ring = shm_ring_init(mem, SHM_SIZE, sizeof(struct msg));
+
+    int16_t pid = fork();
+    if (pid == 0)
+    {
+        /* 子进程不依赖继承来的映射，按名字找到同一个段 */
+        struct shm_ring * r = shm_map(shm_open(SHM_NAME, 0));
+        uint32_t sum = 0;
+        uint32_t i;
+        for (i = 0; i < MSGS; i++)
+        {
+            struct msg * m = shm_ring_consume(r);
+            if (m->seq != i)
+            {
+                printf("child: bad seq %d, expect %d\n", m->seq, i);
+            }
+            sum += m->value;
+            shm_ring_release(r);
+        }
+        printf("child: sum %d (expect %d)\n", sum, MSGS * (MSGS - 1));
+        shm_unmap(r);
+        return 0;
+    }
+
+    uint32_t i;
+    for (i = 0; i < MSGS; i++)
+    {
+        struct msg * m = shm_ring_produce(ring);
+        m->seq = i;
+        m->value = 2 * i;
+        shm_ring_publish(ring);
+    }
+
+    int32_t status;
+    wait(&status);
+    shm_unmap(mem);
+    return 0;
+}
@@ -0,0 +1,61 @@
+/* prog_thread.c
+ *
+ * 线程测试程序：几个线程在互斥锁保护下累加同一个计数器，
+ * 检查结果，并打印各线程的tid、pid和线程局部存储
+ */
+
+#include <stdio.h>
+#include <user/syscall.h>
+#include <pthread.h>
+
+#define NR_THREADS  4
+#define LOOPS       100000
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t counter;
+
+static void * worker(void * arg)
+{
+    uint32_t i;
+    for (i = 0; i < LOOPS; i++)
+    {
+        pthread_mutex_lock(&mutex);
+        counter++;
+        pthread_mutex_unlock(&mutex);
+    }
+
+    printf("thread %d: tid %d, pid %d, self 0x%x\n",
+            (uint32_t)arg, gettid(), getpid(), (uint32_t)pthread_self());
+    return (void *)((uint32_t)arg * 10);
+}
+
+int main(void) 
+{
+    pthread_t threads[NR_THREADS];
+    uint32_t i;
+
+    printf("main: tid %d, pid %d, self 0x%x\n",
+            gettid(), getpid(), (uint32_t)pthread_self());
+
+    for (i = 0; i < NR_THREADS; i++)
+    {
+        if (pthread_create(&threads[i], worker, (void *)i) == -1)
+        {
+            printf("pthread_create %d failed\n", i);
+            return -1;
+        }
+    }
+
+    uint32_t sum = 0;
+    for (i = 0; i < NR_THREADS; i++)
+    {
+        void * ret;
+        pthread_join(threads[i], &ret);
+        sum += (uint32_t)ret;
+    }
+
+    printf("counter %d (expect %d), retval sum %d (expect %d)\n",
+            counter, NR_THREADS * LOOPS,
+            sum, 10 * NR_THREADS * (NR_THREADS - 1) / 2);
+    return 0;
+}
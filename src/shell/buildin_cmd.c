@@ -10,6 +10,7 @@
 #include <dir.h>
 #include <shell.h>
 #include <assert.h>
+#include <tsc.h>
  
 /* 将路径old_abs_path中的..和.转换为实际路径后存入new_abs_path */
 static void wash_path(char* old_abs_path, char* new_abs_path) 
@@ -290,15 +291,319 @@ void buildin_ls(uint32_t argc, char** argv)
     }
 }
 
-/* ps命令内建函数 */
-void buildin_ps(uint32_t argc, char** argv UNUSED) 
+/* ps命令内建函数，-r表示显示各任务的资源使用情况，-s表示显示调度统计 */
+void buildin_ps(uint32_t argc, char** argv) 
+{
+    if (argc == 1) 
+    {
+        ps(PS_DEFAULT);
+    }
+    else if (argc == 2 && !strcmp(argv[1], "-r"))
+    {
+        ps(PS_RUSAGE);
+    }
+    else if (argc == 2 && !strcmp(argv[1], "-s"))
+    {
+        ps(PS_SCHED);
+    }
+    else
+    {
+        printf("usage: ps [-r|-s]\n");
+    }
+}
+
+/* irqstat命令内建函数 */
+void buildin_irqstat(uint32_t argc, char** argv UNUSED) 
 {
     if (argc != 1) 
     {
-      printf("ps: no argument support!\n");
+      printf("irqstat: no argument support!\n");
       return;
     }
-    ps();
+    irqstat();
+}
+
+/* latency命令内建函数，-r表示显示后清除记录 */
+void buildin_latency(uint32_t argc, char** argv) 
+{
+    if (argc == 1) 
+    {
+        latency(0);
+    }
+    else if (argc == 2 && !strcmp(argv[1], "-r"))
+    {
+        latency(1);
+    }
+    else
+    {
+        printf("usage: latency [-r]\n");
+    }
+}
+
+/* 打印定点数表示的负载均值，保留两位小数 */
+static void top_print_load(uint32_t load)
+{
+    printf(" %d.%02d", load >> FSHIFT,
+                ((load & (FIXED_1 - 1)) * 100) >> FSHIFT);
+}
+
+/* 打印一次调度统计，空闲比例和切换次数是相对于上一次prev的增量 */
+static void top_print(struct schedstat * cur, struct schedstat * prev)
+{
+    uint32_t dticks = cur->nr_ticks - prev->nr_ticks;
+    uint32_t idle = 0;
+    if (dticks != 0)
+    {
+        idle = (cur->idle_ticks - prev->idle_ticks) * 100 / dticks;
+    }
+
+    printf("load average:");
+    top_print_load(cur->loadavg[0]);
+    top_print_load(cur->loadavg[1]);
+    top_print_load(cur->loadavg[2]);
+    printf("\ncpus: %d  running: %d  switches: %d  idle: %d%%  "
+                "run delay: %dms\n", cur->nr_cpus, cur->nr_running,
+                cur->nr_switches - prev->nr_switches, idle,
+                cur->run_delay_ms);
+
+    /* tsc频率未测量时直接以时钟周期为单位 */
+    uint32_t unit = cur->cycles_per_us;
+    printf("wakeup latency (%s):", unit != 0 ? "us" : "cycles");
+    if (unit == 0)
+    {
+        unit = 1;
+    }
+
+    uint32_t b;
+    for (b = 0; b < SCHED_HIST_BUCKETS; b++)
+    {
+        if (cur->lat_hist[b] != 0)
+        {
+            printf(" [%d+]%d", (1U << b) / unit, cur->lat_hist[b]);
+        }
+    }
+    printf("\n\n");
+}
+
+/* top命令内建函数，每秒刷新一次调度统计，共刷新count次，默认5次 */
+void buildin_top(uint32_t argc, char** argv) 
+{
+    uint32_t count = 5;
+
+    if (argc == 2)
+    {
+        char* p = argv[1];
+        count = 0;
+        while (*p >= '0' && *p <= '9')
+        {
+            count = count * 10 + (*p - '0');
+            p++;
+        }
+        if (*p != 0 || count == 0)
+        {
+            printf("usage: top [count]\n");
+            return;
+        }
+    }
+    else if (argc != 1)
+    {
+        printf("usage: top [count]\n");
+        return;
+    }
+
+    struct schedstat prev, cur;
+    memset(&prev, 0, sizeof(struct schedstat));
+    while (count-- > 0)
+    {
+        if (schedstat(&cur) == -1)
+        {
+            return;
+        }
+        clear();
+        top_print(&cur, &prev);
+        ps(PS_SCHED);
+        memcpy(&prev, &cur, sizeof(struct schedstat));
+
+        if (count > 0)
+        {
+            msleep(1000);
+        }
+    }
+}
+
+/* 执行count次times(NULL)，返回平均每次的时钟周期数
+ * getpid已改为读数据页，不再陷入内核，这里用几乎不做事的times
+ */
+static uint32_t null_syscall_cycles(uint32_t count)
+{
+    uint32_t i;
+    uint64_t start = rdtsc();
+    for (i = 0; i < count; i++)
+    {
+        times(NULL);
+    }
+    return (uint32_t)(rdtsc() - start) / count;
+}
+
+/* 执行count次getpid，返回平均每次的时钟周期数 */
+static uint32_t vdso_getpid_cycles(uint32_t count)
+{
+    uint32_t i;
+    uint64_t start = rdtsc();
+    for (i = 0; i < count; i++)
+    {
+        getpid();
+    }
+    return (uint32_t)(rdtsc() - start) / count;
+}
+
+/* sysbench命令内建函数，对比int 0x80、sysenter的空系统调用
+ * 和从数据页读取getpid的开销
+ */
+void buildin_sysbench(uint32_t argc, char** argv UNUSED) 
+{
+    if (argc != 1) 
+    {
+        printf("sysbench: no argument support!\n");
+        return;
+    }
+
+    const uint32_t count = 100000;
+
+    fast_syscall(false);
+    printf("int 0x80: %d cycles per times\n", null_syscall_cycles(count));
+
+    if (fast_syscall(true))
+    {
+        printf("sysenter: %d cycles per times\n",
+                    null_syscall_cycles(count));
+    }
+    else
+    {
+        printf("sysenter: not supported\n");
+    }
+
+    printf("vdso:     %d cycles per getpid\n", vdso_getpid_cycles(count));
+}
+
+/* uptime命令内建函数，从数据页读取运行时间、负载和内存，不陷入内核 */
+void buildin_uptime(uint32_t argc, char** argv UNUSED) 
+{
+    if (argc != 1) 
+    {
+        printf("uptime: no argument support!\n");
+        return;
+    }
+
+    const struct vdso_data * data = vdso();
+    uint32_t rem;
+    uint32_t ms = (uint32_t)div_u64_rem(clock_ns(), 1000000, &rem);
+    uint32_t secs = ms / 1000;
+
+    printf("up %d:%02d:%02d.%03d, %d cpus, %d running, load average:",
+                secs / 3600, secs / 60 % 60, secs % 60, ms % 1000,
+                data->nr_cpus, data->nr_running);
+    top_print_load(data->loadavg[0]);
+    top_print_load(data->loadavg[1]);
+    top_print_load(data->loadavg[2]);
+    printf("\n");
+
+    printf("mem: user %d/%d pages free, kernel %d/%d pages free\n",
+                data->user_free_pages, data->user_total_pages,
+                data->kernel_free_pages, data->kernel_total_pages);
+}
+
+/* ringbench命令内建函数，对比逐个read和经环批量读取同一个文件的开销 */
+void buildin_ringbench(uint32_t argc, char** argv) 
+{
+    if (argc != 2) 
+    {
+        printf("ringbench: only support 1 argument!\n");
+        return;
+    }
+    make_clear_abs_path(argv[1], final_path);
+
+    struct io_ring * ring = ring_setup();
+    if (ring == NULL)
+    {
+        printf("ringbench: ring_setup failed\n");
+        return;
+    }
+
+    const uint32_t chunk = 512;
+    const uint32_t batch = 16;
+    char * buf = malloc(chunk * batch);
+    if (buf == NULL)
+    {
+        printf("ringbench: malloc failed\n");
+        return;
+    }
+
+    /* 每次read一块 */
+    int32_t fd = open(final_path, O_RDONLY);
+    if (fd == -1)
+    {
+        printf("ringbench: open %s failed\n", argv[1]);
+        free(buf);
+        return;
+    }
+    uint32_t calls = 0;
+    uint32_t bytes = 0;
+    int32_t n;
+    uint64_t start = rdtsc();
+    do
+    {
+        n = read(fd, buf, chunk);
+        calls++;
+        if (n > 0)
+        {
+            bytes += n;
+        }
+    } while (n > 0);
+    printf("read:  %d bytes, %d syscalls, %d cycles\n",
+                bytes, calls, (uint32_t)(rdtsc() - start));
+    close(fd);
+
+    /* 每次ring_enter提交batch块，并等它们全部完成 */
+    fd = open(final_path, O_RDONLY);
+    calls = 0;
+    bytes = 0;
+    bool eof = false;
+    start = rdtsc();
+    while (!eof)
+    {
+        uint32_t i;
+        for (i = 0; i < batch; i++)
+        {
+            struct io_sqe * sqe = ioring_get_sqe(ring);
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd = fd;
+            sqe->addr = buf + i * chunk;
+            sqe->len = chunk;
+            sqe->user_data = i;
+            ioring_sqe_commit(ring);
+        }
+        ring_enter(batch, batch);
+        calls++;
+
+        struct io_cqe * cqe;
+        while ((cqe = ioring_peek_cqe(ring)) != NULL)
+        {
+            if (cqe->res > 0)
+            {
+                bytes += cqe->res;
+            }
+            else
+            {
+                eof = true;
+            }
+            ioring_cqe_seen(ring);
+        }
+    }
+    printf("ring:  %d bytes, %d syscalls, %d cycles\n",
+                bytes, calls, (uint32_t)(rdtsc() - start));
+    close(fd);
+    free(buf);
 }
 
 /* clear命令内建函数 */
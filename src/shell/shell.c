@@ -24,7 +24,7 @@ char final_path[MAX_PATH_LEN] = {0};
 char cwd_cache[MAX_PATH_LEN] = {0};
 
 
-/* argv必须为全局变量，为了以后exec的程序可访问参数 */
+/* 当前命令的参数，exec会把参数复制到新程序的栈顶 */
 char* argv[MAX_ARG_NR] = { NULL };    
 int32_t argc = -1;
 
@@ -35,57 +35,24 @@ void print_prompt(void)
     printf("[user@localhost %s]$ ", cwd_cache);
 }
 
-/* 从键盘缓冲区中最多读入count个字节到buf */
+/* 从键盘读入一行，最多count-1个字符存入buf
+ * 回显、退格、ctrl+u和ctrl+l由内核的行规程处理，read一次返回整行
+ */
 static void readline(char* buf, int32_t count) 
 {
     assert(buf != NULL && count > 0);
-    char* pos = buf;
-    
-    while (read(stdin_no, pos, 1) != -1 && (pos - buf) < count) 
-    {   
-        /* 在不出错情况下，直到找到回车符才返回 */
-        switch (*pos) 
-        {
-            /* 找到回车或换行符后认为键入的命令结束，直接返回 */
-            case '\n':
-            case '\r':
-                *pos = 0;      /* 添加cmd_line的终止字符0 */
-                putchar('\n');
-                return;
-
-            case '\b':         
-                if (cmd_line[0] != '\b')     /* 阻止删除非本次输入的信息 */
-                {       
-                    --pos;              /* 退回到缓冲区cmd_line中上一个字符 */
-                    putchar('\b');
-                }
-                break;
-
-            /* ctrl+l 清屏 */
-            case 'l' - 'a':               
-                *pos = 0;           /* 1 先将当前的字符'l'-'a'置为0 */
-                clear();            /* 2 再将屏幕清空 */                
-                print_prompt();     /* 3 打印提示符 */                
-                printf("%s", buf);  /* 4 将之前键入的内容再次打印 */
-                break;
-
-            /* ctrl+u 清掉输入 */
-            case 'u' - 'a':
-                while (buf != pos)
-                {
-                    putchar('\b');
-                    *(pos--) = 0;
-                }
-                break;
-
-            /* 非控制键则输出字符 */
-            default:
-                putchar(*pos);
-                pos++;
-        }
+    int32_t len = read(stdin_no, buf, count - 1);
+    if (len < 0)
+    {
+        len = 0;
+    }
+
+    /* 去掉行尾的换行符 */
+    if (len > 0 && buf[len - 1] == '\n')
+    {
+        len--;
     }
-    printf("readline: can't find enter_key in the cmd_line, "
-                        "max num of char is 128\n");
+    buf[len] = 0;
 }
 
 
@@ -147,6 +114,240 @@ static int32_t cmd_parse(char* cmd_str, char** argv, char token)
 }
 
 
+/* 内部命令的名字，与下面的cmd_buildin一致 */
+static const char* buildin_names[] = {
+    "ls", "cd", "pwd", "ps", "irqstat", "latency", "top", "sysbench",
+    "ringbench", "uptime", "clear", "mkdir", "rmdir", "rm", NULL
+};
+
+/* name是否是内部命令 */
+static bool cmd_is_buildin(const char* name) 
+{
+    const char** pname = buildin_names;
+    while (*pname != NULL)
+    {
+        if (!strcmp(*pname, name))
+        {
+            return true;
+        }
+        pname++;
+    }
+    return false;
+}
+
+
+/* 执行内部命令，argv[0]不是内部命令时返回false */
+static bool cmd_buildin(uint32_t argc, char** argv) 
+{
+    if (!strcmp("ls", argv[0])) 
+    {
+        buildin_ls(argc, argv);
+    } 
+    else if (!strcmp("cd", argv[0]))
+    {
+        if (buildin_cd(argc, argv) != NULL) 
+        {
+            memset(cwd_cache, 0, MAX_PATH_LEN);
+            strcpy(cwd_cache, final_path);
+        }
+    } 
+    else if (!strcmp("pwd", argv[0])) 
+    {
+        buildin_pwd(argc, argv);
+    } 
+    else if (!strcmp("ps", argv[0])) 
+    {
+        buildin_ps(argc, argv);
+    } 
+    else if (!strcmp("irqstat", argv[0])) 
+    {
+        buildin_irqstat(argc, argv);
+    } 
+    else if (!strcmp("latency", argv[0])) 
+    {
+        buildin_latency(argc, argv);
+    } 
+    else if (!strcmp("top", argv[0])) 
+    {
+        buildin_top(argc, argv);
+    } 
+    else if (!strcmp("sysbench", argv[0])) 
+    {
+        buildin_sysbench(argc, argv);
+    } 
+    else if (!strcmp("ringbench", argv[0])) 
+    {
+        buildin_ringbench(argc, argv);
+    } 
+    else if (!strcmp("uptime", argv[0])) 
+    {
+        buildin_uptime(argc, argv);
+    } 
+    else if (!strcmp("clear", argv[0])) 
+    {
+        buildin_clear(argc, argv);
+    } 
+    else if (!strcmp("mkdir", argv[0]))
+    {
+        buildin_mkdir(argc, argv);
+    } 
+    else if (!strcmp("rmdir", argv[0]))
+    {
+        buildin_rmdir(argc, argv);
+    } 
+    else if (!strcmp("rm", argv[0])) 
+    {
+        buildin_rm(argc, argv);
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+
+/* 在新进程中执行外部命令，不复制shell自己
+ * fds不为NULL时依次是新进程的标准输入、输出、错误所用的描述符，
+ * 返回新进程的pid，失败返回-1
+ */
+static int16_t cmd_spawn(char** argv, const int32_t* fds) 
+{
+    /* final_path在内核空间中，为各进程共用，用自己栈上的缓冲 */
+    char path[MAX_PATH_LEN] = {0};
+    make_clear_abs_path(argv[0], path);
+    argv[0] = path;
+    
+    /* 先判断下文件是否存在 */
+    struct stat file_stat;
+    memset(&file_stat, 0, sizeof(struct stat));
+    if (stat(argv[0], &file_stat) == -1)
+    {
+        printf("my_shell: cannot access %s: No such file "
+                        "or directory\n", argv[0]);
+        return -1;
+    } 
+
+    /* 参数在spawn返回前已复制到内核中，path可以是栈上的缓冲 */
+    int16_t pid = spawn(argv[0], argv, fds);
+    if (pid == -1)
+    {
+        printf("my_shell: cannot execute %s\n", argv[0]);
+    }
+    return pid;
+}
+
+
+/* 执行一条命令，外部命令在子进程中执行，等它结束后返回 */
+static void cmd_execute(uint32_t argc, char** argv) 
+{
+    if (cmd_buildin(argc, argv))
+    {
+        return;
+    }
+
+    /* 如果是外部命令,需要从磁盘上加载 */
+    int16_t pid = cmd_spawn(argv, NULL);
+    if (pid != -1)
+    {
+        int32_t status;
+        int16_t child_pid;
+        do
+        {
+            child_pid = wait(&status);
+        } while (child_pid != pid && child_pid != -1);
+    } 
+}
+
+
+/* 执行以'|'连接的一组命令，每个命令在一个子进程中执行，
+ * 前一个命令的标准输出经管道接到后一个命令的标准输入，全部结束后返回
+ */
+static void cmd_pipeline(char* cmd_str) 
+{
+    char* cmds[MAX_ARG_NR];
+    int32_t cmd_cnt = cmd_parse(cmd_str, cmds, '|');
+    if (cmd_cnt == -1)
+    {
+        printf("num of commands exceed %d\n", MAX_ARG_NR);
+        return;
+    }
+
+    int32_t prev_rd = -1;   /* 前一个命令输出到的管道的读端 */
+    int32_t children = 0;
+    int32_t i;
+    for (i = 0; i < cmd_cnt; i++)
+    {
+        /* 各命令的参数指向cmd_line中互不重叠的部分，子进程结束前不会被改动 */
+        char* cmd_argv[MAX_ARG_NR];
+        int32_t cmd_argc = cmd_parse(cmds[i], cmd_argv, ' ');
+        if (cmd_argc <= 0)
+        {
+            printf("my_shell: syntax error near '|'\n");
+            break;
+        }
+
+        int32_t pipefd[2] = {-1, -1};
+        if (i < cmd_cnt - 1 && pipe(pipefd) == -1)
+        {
+            printf("my_shell: pipe failed\n");
+            break;
+        }
+
+        /* 外部命令直接spawn，只有内部命令要fork出子进程来执行 */
+        int32_t fds[3];
+        fds[0] = (prev_rd != -1) ? prev_rd : stdin_no;
+        fds[1] = (pipefd[1] != -1) ? pipefd[1] : stdout_no;
+        fds[2] = stderr_no;
+        int16_t pid = -1;
+        if (!cmd_is_buildin(cmd_argv[0]))
+        {
+            pid = cmd_spawn(cmd_argv, fds);
+        }
+        else if ((pid = fork()) == 0)
+        {
+            if (prev_rd != -1)
+            {
+                dup2(prev_rd, stdin_no);
+                close(prev_rd);
+            }
+            if (pipefd[1] != -1)
+            {
+                dup2(pipefd[1], stdout_no);
+                close(pipefd[1]);
+                close(pipefd[0]);
+            }
+            cmd_buildin(cmd_argc, cmd_argv);
+            exit(0);
+        }
+        if (pid != -1)
+        {
+            children++;
+        }
+
+        /* shell自己不读写管道，关掉用过的一端，否则读者看不到结尾 */
+        if (prev_rd != -1)
+        {
+            close(prev_rd);
+        }
+        if (pipefd[1] != -1)
+        {
+            close(pipefd[1]);
+        }
+        prev_rd = pipefd[0];
+    }
+
+    if (prev_rd != -1)
+    {
+        close(prev_rd);
+    }
+    while (children-- > 0)
+    {
+        wait(NULL);
+    }
+}
+
+
 /* 简单的shell */
 void my_shell(void) 
 {
@@ -162,6 +363,12 @@ void my_shell(void)
             /* 若只键入了一个回车 */
             continue;
         }
+
+        if (strchr(cmd_line, '|') != NULL)
+        {
+            cmd_pipeline(cmd_line);
+            continue;
+        }
         
         argc = -1;
         argc = cmd_parse(cmd_line, argv, ' ');
@@ -170,77 +377,9 @@ void my_shell(void)
             printf("num of arguments exceed %d\n", MAX_ARG_NR);
             continue;
         }
-
-        if (!strcmp("ls", argv[0])) 
-        {
-            buildin_ls(argc, argv);
-        } 
-        else if (!strcmp("cd", argv[0]))
+        if (argc > 0)
         {
-            if (buildin_cd(argc, argv) != NULL) 
-            {
-                memset(cwd_cache, 0, MAX_PATH_LEN);
-                strcpy(cwd_cache, final_path);
-            }
-        } 
-        else if (!strcmp("pwd", argv[0])) 
-        {
-            buildin_pwd(argc, argv);
-        } 
-        else if (!strcmp("ps", argv[0])) 
-        {
-            buildin_ps(argc, argv);
-        } 
-        else if (!strcmp("clear", argv[0])) 
-        {
-            buildin_clear(argc, argv);
-        } 
-        else if (!strcmp("mkdir", argv[0]))
-        {
-            buildin_mkdir(argc, argv);
-        } 
-        else if (!strcmp("rmdir", argv[0]))
-        {
-            buildin_rmdir(argc, argv);
-        } 
-        else if (!strcmp("rm", argv[0])) 
-        {
-            buildin_rm(argc, argv);
-        }
-        else 
-        {      
-            /* 如果是外部命令,需要从磁盘上加载 */
-            int32_t pid = fork();
-            if (pid)    /* 父进程 */
-            {      
-                /* 下面这个while必须要加上，否则父进程一般情况下会比子进程
-                 * 先执行，因此会进行下一轮循环将findl_path清空，这样子进程
-                 * 将无法从final_path中获得参数
-                 */
-                while(1)
-                    ;
-            } 
-            else    /* 子进程 */
-            {      
-                make_clear_abs_path(argv[0], final_path);
-                argv[0] = final_path;
-                
-                /* 先判断下文件是否存在 */
-                struct stat file_stat;
-                memset(&file_stat, 0, sizeof(struct stat));
-                if (stat(argv[0], &file_stat) == -1)
-                {
-                    printf("my_shell: cannot access %s: No such file "
-                                    "or directory\n", argv[0]);
-                } 
-                else 
-                {
-                    execv(argv[0], argv);
-                }
-                
-                while(1)
-                    ;
-            }
+            cmd_execute(argc, argv);
         }
         
         int32_t arg_idx = 0;
@@ -0,0 +1,214 @@
+/* futex.c
+ *   用户态同步用的快速互斥
+ *
+ * 等待者在自己的内核栈上放一个futex_q，按字的物理地址散列到桶中，
+ * 检查字的值和入队都在桶锁之内完成，唤醒者改完字后再唤醒，不会丢失唤醒。
+ * 被唤醒者由唤醒者从桶中取下，醒来后不需要再访问桶
+ */
+
+#include <futex.h>
+#include <thread.h>
+#include <memory.h>
+#include <vma.h>
+#include <spinlock.h>
+#include <interrupt.h>
+#include <list.h>
+#include <debug.h>
+#include <global.h>
+
+/* 一个在futex上睡眠的线程 */
+struct futex_q
+{
+    struct node tag;            /* 在桶的waiters链表中的结点 */
+    uint32_t key;               /* 字的物理地址 */
+    struct task_struct * task;
+};
+
+struct futex_bucket
+{
+    struct spinlock lock;       /* 保护waiters，唤醒可能来自别的cpu */
+    struct list waiters;
+};
+
+static struct futex_bucket futex_hash[FUTEX_HASH_SIZE];
+
+/* 由用户地址得到键，地址无效时返回0
+ * 字必须4字节对齐，不会跨页
+ */
+static uint32_t futex_key(volatile uint32_t * uaddr)
+{
+    uint32_t vaddr = (uint32_t)uaddr;
+    if ((vaddr & 3) != 0 || !user_fault_in((void *)vaddr, 4, false))
+    {
+        return 0;
+    }
+    return addr_v2p(vaddr);
+}
+
+static struct futex_bucket * key2bucket(uint32_t key)
+{
+    return &futex_hash[((key >> 2) * 0x9e3779b1) >> (32 - FUTEX_HASH_BITS)];
+}
+
+/* 唤醒b中键为key的最多nr_wake个线程，调用时已持有b的锁，返回唤醒的个数 */
+static uint32_t futex_wake_locked(struct futex_bucket * b, uint32_t key,
+                uint32_t nr_wake)
+{
+    uint32_t cnt = 0;
+    struct node * elem = b->waiters.head.next;
+
+    while (elem != &b->waiters.tail && cnt < nr_wake)
+    {
+        struct node * next = elem->next;
+        struct futex_q * q = container_of(struct futex_q, tag, elem);
+        if (q->key == key)
+        {
+            list_remove(elem);
+            thread_unblock(q->task);
+            cnt++;
+        }
+        elem = next;
+    }
+    return cnt;
+}
+
+/* *uaddr仍等于val时睡眠，被唤醒返回0，值已改变或地址无效返回-1 */
+static int32_t futex_wait(volatile uint32_t * uaddr, uint32_t val)
+{
+    uint32_t key = futex_key(uaddr);
+    if (key == 0)
+    {
+        return -1;
+    }
+
+    struct futex_bucket * b = key2bucket(key);
+    struct futex_q q;
+    q.key = key;
+    q.task = running_thread();
+
+    intr_status old_status = spin_lock_irqsave(&b->lock);
+    if (*uaddr != val)
+    {
+        spin_unlock_irqrestore(&b->lock, old_status);
+        return -1;
+    }
+    list_append(&b->waiters, &q.tag);
+    thread_block_unlock(TASK_BLOCKED, &b->lock);
+    intr_set_status(old_status);
+    return 0;
+}
+
+/* 唤醒最多nr_wake个在uaddr上睡眠的线程，返回唤醒的个数，地址无效返回-1
+ * 内核中也可以调用，如线程退出时唤醒等待它的线程
+ */
+int32_t futex_wake(volatile uint32_t * uaddr, uint32_t nr_wake)
+{
+    uint32_t key = futex_key(uaddr);
+    if (key == 0)
+    {
+        return -1;
+    }
+
+    struct futex_bucket * b = key2bucket(key);
+    intr_status old_status = spin_lock_irqsave(&b->lock);
+    uint32_t cnt = futex_wake_locked(b, key, nr_wake);
+    spin_unlock_irqrestore(&b->lock, old_status);
+    return cnt;
+}
+
+/* 唤醒uaddr上的一个线程，其余的转到uaddr2上睡眠，返回唤醒和转移的总数
+ * 条件变量广播时把等待者直接转到互斥锁上，避免它们同时醒来争抢
+ */
+static int32_t futex_requeue(volatile uint32_t * uaddr,
+                volatile uint32_t * uaddr2)
+{
+    uint32_t key = futex_key(uaddr);
+    uint32_t key2 = futex_key(uaddr2);
+    if (key == 0 || key2 == 0)
+    {
+        return -1;
+    }
+
+    struct futex_bucket * b = key2bucket(key);
+    struct futex_bucket * b2 = key2bucket(key2);
+
+    /* 按地址顺序加两个桶的锁，避免两个方向的转移互相死锁 */
+    intr_status old_status = intr_disable();
+    if (b == b2)
+    {
+        spin_lock(&b->lock);
+    }
+    else if (b < b2)
+    {
+        spin_lock(&b->lock);
+        spin_lock(&b2->lock);
+    }
+    else
+    {
+        spin_lock(&b2->lock);
+        spin_lock(&b->lock);
+    }
+
+    uint32_t cnt = futex_wake_locked(b, key, 1);
+
+    /* 同一个字上转移没有意义，直接追加到同一个桶还会被遍历再次找到 */
+    if (key != key2)
+    {
+        /* 先取到局部链表上，再整体放入b2 */
+        struct list moved;
+        list_init(&moved);
+        struct node * elem = b->waiters.head.next;
+        while (elem != &b->waiters.tail)
+        {
+            struct node * next = elem->next;
+            struct futex_q * q = container_of(struct futex_q, tag, elem);
+            if (q->key == key)
+            {
+                list_remove(elem);
+                q->key = key2;
+                list_append(&moved, elem);
+                cnt++;
+            }
+            elem = next;
+        }
+        while (!list_empty(&moved))
+        {
+            list_append(&b2->waiters, list_pop(&moved));
+        }
+    }
+
+    if (b != b2)
+    {
+        spin_unlock(&b2->lock);
+    }
+    spin_unlock(&b->lock);
+    intr_set_status(old_status);
+    return cnt;
+}
+
+/* futex系统调用，op见futex.h，出错返回-1 */
+int32_t sys_futex(volatile uint32_t * uaddr, uint32_t op, uint32_t val)
+{
+    switch (op)
+    {
+    case FUTEX_WAIT:
+        return futex_wait(uaddr, val);
+    case FUTEX_WAKE:
+        return futex_wake(uaddr, val);
+    case FUTEX_REQUEUE:
+        return futex_requeue(uaddr, (volatile uint32_t *)val);
+    default:
+        return -1;
+    }
+}
+
+/* 初始化散列桶 */
+void futex_init(void)
+{
+    uint32_t i;
+    for (i = 0; i < FUTEX_HASH_SIZE; i++)
+    {
+        spin_init(&futex_hash[i].lock);
+        list_init(&futex_hash[i].waiters);
+    }
+}
@@ -0,0 +1,308 @@
+/* ipc.c
+ *   线程之间同步的消息传递
+ *
+ * 所有状态由一个自旋锁保护。消息总是由后到的一方在自己的上下文中传递：
+ * 发送者先到时挂在接收者的senders中睡眠，接收者到来后从它那里取；
+ * 接收者先到时睡眠，发送者到来后把消息放到它那里。
+ * 两个字直接写进对方保存在内核栈顶的esi、edi，
+ * 长消息经临时映射在对方空间和自己空间之间复制一次
+ */
+
+#include <ipc.h>
+#include <thread.h>
+#include <memory.h>
+#include <vma.h>
+#include <pid.h>
+#include <spinlock.h>
+#include <interrupt.h>
+#include <string.h>
+#include <debug.h>
+#include <global.h>
+
+static struct spinlock ipc_lock;
+
+/* 返回任务从用户态进入内核时保存的寄存器 */
+static struct intr_stack * task_regs(struct task_struct * pthread)
+{
+    return (struct intr_stack *)
+            ((uint32_t)pthread + PG_SIZE - sizeof(struct intr_stack));
+}
+
+/* 在当前空间的local和remote空间的rvaddr之间复制len字节，
+ * to_remote为true时写到remote中。任一边未映射时返回-1
+ */
+static int32_t ipc_copy(struct task_struct * remote, uint32_t rvaddr,
+                uint32_t local, uint32_t len, bool to_remote)
+{
+    while (len > 0)
+    {
+        uint32_t chunk = PG_SIZE - (rvaddr & (PG_SIZE - 1));
+        uint32_t local_left = PG_SIZE - (local & (PG_SIZE - 1));
+        if (chunk > local_left)
+        {
+            chunk = local_left;
+        }
+        if (chunk > len)
+        {
+            chunk = len;
+        }
+
+        uint32_t paddr = task_v2p(remote, rvaddr, to_remote);
+        if (paddr == 0 || !user_page_mapped(local))
+        {
+            return -1;
+        }
+        void * rptr = kmap_atomic(paddr);
+        if (to_remote)
+        {
+            memcpy(rptr, (void *)local, chunk);
+        }
+        else
+        {
+            memcpy((void *)local, rptr, chunk);
+        }
+
+        rvaddr += chunk;
+        local += chunk;
+        len -= chunk;
+    }
+    return 0;
+}
+
+/* 把from的消息交给to，其中一方是当前任务，调用时已持有ipc_lock
+ * 收到的字节数写到to的ebx中，复制失败时返回-1
+ */
+static int32_t ipc_transfer(struct task_struct * from, struct task_struct * to)
+{
+    struct intr_stack * from_regs = task_regs(from);
+    struct intr_stack * to_regs = task_regs(to);
+    to_regs->esi = from_regs->esi;
+    to_regs->edi = from_regs->edi;
+
+    uint32_t len = from->ipc.len;
+    if (to->ipc.buf == 0)
+    {
+        len = 0;
+    }
+    else if (len > to->ipc.size)
+    {
+        len = to->ipc.size;
+    }
+
+    to_regs->ebx = len;
+    if (len == 0 || from->ipc.buf == 0)
+    {
+        to_regs->ebx = 0;
+        return 0;
+    }
+
+    if (from == running_thread())
+    {
+        return ipc_copy(to, to->ipc.buf, from->ipc.buf, len, true);
+    }
+    return ipc_copy(from, from->ipc.buf, to->ipc.buf, len, false);
+}
+
+/* 唤醒阻塞的pthread，它在本cpu上时直接切换过去
+ * 调用时已关中断，已释放ipc_lock
+ */
+static void ipc_wake(struct task_struct * pthread)
+{
+    if (pthread->cpu == running_thread()->cpu)
+    {
+        thread_handoff(pthread);
+    }
+    else
+    {
+        thread_unblock(pthread);
+        if (running_thread()->status != TASK_RUNNING)
+        {
+            schedule();
+        }
+    }
+}
+
+/* 把正在等待的接收者dest所等的消息交给它，并唤醒它
+ * 调用时已持有ipc_lock，返回时已释放。call为true时当前任务接着等待回复
+ */
+static int32_t ipc_deliver(struct task_struct * dest, bool call,
+                intr_status old_status)
+{
+    struct task_struct * cur = running_thread();
+    int32_t res = ipc_transfer(cur, dest);
+
+    dest->ipc.state = IPC_IDLE;
+    dest->ipc.result = (res == -1) ? -1 : cur->pid;
+
+    if (call && res != -1)
+    {
+        cur->ipc.state = IPC_RECEIVING;
+        cur->ipc.partner = dest->pid;
+        cur->status = TASK_BLOCKED;
+    }
+    spin_unlock(&ipc_lock);
+    ipc_wake(dest);
+    intr_set_status(old_status);
+
+    if (call && res != -1)
+    {
+        return cur->ipc.result;
+    }
+    return res;
+}
+
+/* 发送、接收、调用或回复，op见ipc.h
+ * 消息的两个字在esi、edi中，msg为NULL时没有长消息
+ * 收到消息时返回发送者的pid，发送和回复成功时返回0，失败返回-1
+ */
+int32_t sys_ipc(uint32_t op, int32_t partner, struct ipc_msg * msg)
+{
+    struct task_struct * cur = running_thread();
+    struct ipc_tcb * me = &cur->ipc;
+    if (cur->pgdir == NULL || op > IPC_REPLY)
+    {
+        return -1;
+    }
+
+    /* 缓冲区的描述留在pcb中，供对方在它的上下文中访问 */
+    me->buf = me->len = me->size = 0;
+    if (msg != NULL)
+    {
+        if (!user_fault_in(msg, sizeof(*msg), false) ||
+                msg->len > IPC_MAX_LEN)
+        {
+            return -1;
+        }
+
+        /* 对方在持有ipc_lock时经页表访问缓冲区，不能缺页，先映射好 */
+        uint32_t span = (msg->size > msg->len) ? msg->size : msg->len;
+        if (span > 0 && !user_fault_in(msg->buf, span, msg->size > 0))
+        {
+            return -1;
+        }
+        me->buf = (uint32_t)msg->buf;
+        me->len = msg->len;
+        me->size = msg->size;
+    }
+
+    intr_status old_status = spin_lock_irqsave(&ipc_lock);
+    me->result = -1;
+
+    if (op == IPC_RECEIVE)
+    {
+        /* 已有发送者在等待时直接取它的消息 */
+        struct node * elem = me->senders.head.next;
+        while (elem != &me->senders.tail)
+        {
+            struct task_struct * s = container_of(struct task_struct,
+                        ipc.send_tag, elem);
+            if (partner == IPC_ANY || partner == s->pid)
+            {
+                list_remove(elem);
+                int32_t res = ipc_transfer(s, cur);
+
+                if (s->ipc.calling && res != -1)
+                {
+                    /* 发送者接着等待本任务的回复，仍然阻塞 */
+                    s->ipc.state = IPC_RECEIVING;
+                    s->ipc.partner = cur->pid;
+                    spin_unlock_irqrestore(&ipc_lock, old_status);
+                }
+                else
+                {
+                    s->ipc.state = IPC_IDLE;
+                    s->ipc.result = (res == -1) ? -1 : 0;
+                    spin_unlock_irqrestore(&ipc_lock, old_status);
+                    thread_unblock(s);
+                }
+                return (res == -1) ? -1 : s->pid;
+            }
+            elem = elem->next;
+        }
+
+        me->state = IPC_RECEIVING;
+        me->partner = partner;
+        thread_block_unlock(TASK_BLOCKED, &ipc_lock);
+        intr_set_status(old_status);
+        return me->result;
+    }
+
+    struct task_struct * dest = pid2thread(partner);
+    if (dest == NULL || dest == cur || dest->pgdir == NULL ||
+            dest->ipc.state == IPC_DEAD)
+    {
+        spin_unlock_irqrestore(&ipc_lock, old_status);
+        return -1;
+    }
+
+    /* 接收者已在等待，消息直接交给它 */
+    if (dest->ipc.state == IPC_RECEIVING &&
+            (dest->ipc.partner == IPC_ANY || dest->ipc.partner == cur->pid))
+    {
+        int32_t res = ipc_deliver(dest, op == IPC_CALL, old_status);
+        if (op == IPC_CALL)
+        {
+            return res;
+        }
+        return (res == -1) ? -1 : 0;
+    }
+
+    if (op == IPC_REPLY)
+    {
+        spin_unlock_irqrestore(&ipc_lock, old_status);
+        return -1;
+    }
+
+    /* 挂在接收者上等它来取 */
+    me->state = IPC_SENDING;
+    me->partner = dest->pid;
+    me->calling = (op == IPC_CALL);
+    list_append(&dest->ipc.senders, &me->send_tag);
+    thread_block_unlock(TASK_BLOCKED, &ipc_lock);
+    intr_set_status(old_status);
+    return me->result;
+}
+
+/* 让等待pid回复的线程失败返回，调用时已持有ipc_lock */
+static bool fail_waiter(struct node * pelem, int pid)
+{
+    struct task_struct * pthread =
+            container_of(struct task_struct, all_list_tag, pelem);
+    if (pthread->ipc.state == IPC_RECEIVING && pthread->ipc.partner == pid)
+    {
+        pthread->ipc.state = IPC_IDLE;
+        pthread->ipc.result = -1;
+        thread_unblock(pthread);
+    }
+    return false;
+}
+
+/* 线程退出前调用，让等待向它发送和等待它回复的线程都失败返回 */
+void ipc_exit(struct task_struct * pthread)
+{
+    intr_status old_status = spin_lock_irqsave(&ipc_lock);
+    pthread->ipc.state = IPC_DEAD;
+
+    while (!list_empty(&pthread->ipc.senders))
+    {
+        struct task_struct * s = container_of(struct task_struct,
+                    ipc.send_tag, list_pop(&pthread->ipc.senders));
+        s->ipc.state = IPC_IDLE;
+        s->ipc.result = -1;
+        thread_unblock(s);
+    }
+    thread_all_list_find(fail_waiter, pthread->pid);
+
+    spin_unlock_irqrestore(&ipc_lock, old_status);
+}
+
+void ipc_tcb_init(struct ipc_tcb * ipc)
+{
+    memset(ipc, 0, sizeof(struct ipc_tcb));
+    list_init(&ipc->senders);
+}
+
+void ipc_init(void)
+{
+    spin_init(&ipc_lock);
+}
@@ -0,0 +1,145 @@
+/* pid.c
+ *   pid的分配、回收，以及由pid查找任务的散列表
+ *
+ * pid用位图管理，可以回收重用。分配时从上次分配的位置之后开始找，
+ * 刚释放的pid不会马上被重用，整字节已分配时一次跳过8个pid，
+ * 连续fork时每次分配一般只需检查一两个字节
+ */
+
+#include <pid.h>
+#include <bitmap.h>
+#include <list.h>
+#include <spinlock.h>
+#include <interrupt.h>
+#include <debug.h>
+
+static uint8_t pid_bits[PID_MAX / 8];
+static bitmap pid_bitmap;
+static uint32_t pid_cursor;         /* 下次分配时开始查找的位置 */
+static uint32_t nr_pids;            /* 已分配的pid数 */
+
+/* 按pid的低位散列，冲突的任务通过pid_tag链在同一个桶中 */
+static struct list pid_hash[PID_HASH_SIZE];
+
+/* 保护上面各项，fork时在中断门中调用，用关中断的自旋锁 */
+static struct spinlock pid_lock;
+
+/* 初始化pid位图和散列表 */
+void pid_init(void)
+{
+    spin_init(&pid_lock);
+    pid_bitmap.bits = pid_bits;
+    pid_bitmap.len = sizeof(pid_bits);
+    bitmap_init(&pid_bitmap);
+    bitmap_set(&pid_bitmap, 0, 1);  /* pid 0保留 */
+    nr_pids = 0;
+    pid_cursor = 1;
+
+    uint32_t i;
+    for (i = 0; i < PID_HASH_SIZE; i++)
+    {
+        list_init(&pid_hash[i]);
+    }
+}
+
+/* 分配一个pid，pid已用完时返回-1 */
+pid_t pid_alloc(void)
+{
+    intr_status old_status = spin_lock_irqsave(&pid_lock);
+
+    if (nr_pids == PID_MAX - 1)
+    {
+        spin_unlock_irqrestore(&pid_lock, old_status);
+        return -1;
+    }
+
+    /* 还有空闲的pid，从pid_cursor起循环查找一定能找到 */
+    uint32_t idx = pid_cursor;
+    while (1)
+    {
+        if (idx >= PID_MAX)
+        {
+            idx = 1;
+        }
+        if ((idx % 8) == 0 && pid_bits[idx / 8] == 0xff)
+        {
+            idx += 8;
+            continue;
+        }
+        if (!bit_true(&pid_bitmap, idx))
+        {
+            break;
+        }
+        idx++;
+    }
+
+    bitmap_set(&pid_bitmap, idx, 1);
+    nr_pids++;
+    pid_cursor = idx + 1;
+
+    spin_unlock_irqrestore(&pid_lock, old_status);
+    return (pid_t)idx;
+}
+
+/* 释放pid */
+void pid_free(pid_t pid)
+{
+    kassert(pid > 0);
+
+    intr_status old_status = spin_lock_irqsave(&pid_lock);
+    kassert(bit_true(&pid_bitmap, pid));
+    bitmap_set(&pid_bitmap, pid, 0);
+    nr_pids--;
+    spin_unlock_irqrestore(&pid_lock, old_status);
+}
+
+/* 在散列表中查找pid对应的任务，调用时已持有pid_lock */
+static struct task_struct * pid_hash_find(pid_t pid)
+{
+    struct list * bucket = &pid_hash[pid & (PID_HASH_SIZE - 1)];
+    struct node * elem = bucket->head.next;
+
+    while (elem != &bucket->tail)
+    {
+        struct task_struct * pthread = container_of(struct task_struct,
+                    pid_tag, elem);
+        if (pthread->pid == pid)
+        {
+            return pthread;
+        }
+        elem = elem->next;
+    }
+    return NULL;
+}
+
+/* 把任务pthread加入散列表 */
+void pid_hash_add(struct task_struct * pthread)
+{
+    intr_status old_status = spin_lock_irqsave(&pid_lock);
+    kassert(pid_hash_find(pthread->pid) == NULL);
+    list_append(&pid_hash[pthread->pid & (PID_HASH_SIZE - 1)],
+                &pthread->pid_tag);
+    spin_unlock_irqrestore(&pid_lock, old_status);
+}
+
+/* 把任务pthread从散列表中去掉 */
+void pid_hash_remove(struct task_struct * pthread)
+{
+    intr_status old_status = spin_lock_irqsave(&pid_lock);
+    list_remove(&pthread->pid_tag);
+    spin_unlock_irqrestore(&pid_lock, old_status);
+}
+
+/* 返回pid对应的任务，不存在时返回NULL */
+struct task_struct * pid2thread(pid_t pid)
+{
+    if (pid <= 0)
+    {
+        return NULL;
+    }
+
+    intr_status old_status = spin_lock_irqsave(&pid_lock);
+    struct task_struct * pthread = pid_hash_find(pid);
+    spin_unlock_irqrestore(&pid_lock, old_status);
+    return pthread;
+}
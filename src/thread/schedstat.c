@@ -0,0 +1,204 @@
+/* schedstat.c
+ *   调度统计
+ *
+ * 入队和出队的路径上只记录时间戳、累加计数，换算和汇总都在读取时进行。
+ * 负载均值的算法与Linux相同：每5秒对可运行的任务数做一次指数衰减平均
+ */
+
+#include <schedstat.h>
+#include <thread.h>
+#include <smp.h>
+#include <timer.h>
+#include <tsc.h>
+#include <acct.h>
+#include <list.h>
+#include <stdio.h>
+#include <string.h>
+#include <file.h>
+#include <fs.h>
+#include <global.h>
+#include <vdso.h>
+
+#define LOAD_FREQ   (5 * IRQ0_FREQUENCY + 1)    /* 5秒多一个嘀嗒，避免和周期性任务同步 */
+#define EXP_1       1884    /* 1/exp(5sec/1min)，定点数 */
+#define EXP_5       2014    /* 1/exp(5sec/5min) */
+#define EXP_15      2037    /* 1/exp(5sec/15min) */
+
+static uint32_t avenrun[3];     /* 1、5、15分钟的负载均值 */
+static uint32_t load_countdown = LOAD_FREQ;
+
+/* 任务进入就绪队列时调用，调用时已持有队列的锁
+ * wakeup为true表示任务是从阻塞中被唤醒的
+ */
+void sched_info_queued(struct task_struct * pthread, bool wakeup)
+{
+    pthread->sched.last_queued = rdtsc();
+    pthread->sched.wakeup = wakeup;
+}
+
+/* 返回延迟所在的直方图桶，即延迟的二进制位数减1 */
+static uint32_t lat_bucket(uint64_t delta)
+{
+    uint32_t high = (uint32_t)(delta >> 32);
+    uint32_t low = (uint32_t)delta;
+
+    if (high != 0)
+    {
+        return SCHED_HIST_BUCKETS - 1;
+    }
+    if (low == 0)
+    {
+        return 0;
+    }
+    return 31 - __builtin_clz(low);
+}
+
+/* schedule选出next之后调用，调用时已持有c的rq_lock
+ * next可能和prev相同，这时只是prev重新入队后又被选中
+ */
+void sched_info_switch(struct cpu * c, struct task_struct * prev,
+            struct task_struct * next)
+{
+    struct cpu_sched_stat * st = &c->sched_stat;
+
+    if (next != prev)
+    {
+        st->nr_switches++;
+    }
+
+    if (next == c->idle)
+    {
+        if (prev != next)
+        {
+            st->nr_idle++;
+        }
+        return;
+    }
+
+    uint64_t delta = rdtsc() - next->sched.last_queued;
+    next->sched.run_delay += delta;
+    next->sched.pcount++;
+    st->run_delay += delta;
+
+    if (next->sched.wakeup)
+    {
+        st->lat_hist[lat_bucket(delta)]++;
+        next->sched.wakeup = false;
+    }
+}
+
+/* 每个时钟嘀嗒在该cpu的时钟中断中调用，统计空闲比例 */
+void sched_tick(struct cpu * c, struct task_struct * cur)
+{
+    c->sched_stat.nr_ticks++;
+    if (cur == c->idle)
+    {
+        c->sched_stat.idle_ticks++;
+    }
+}
+
+/* 统计当前可运行的任务数，读其它cpu的计数不加锁，只求近似 */
+static uint32_t nr_active(void)
+{
+    uint32_t nr = 0;
+    uint8_t i;
+
+    for (i = 0; i < nr_cpus; i++)
+    {
+        nr += cpus[i].nr_ready;
+        if (cpus[i].curr != cpus[i].idle)
+        {
+            nr++;
+        }
+    }
+    return nr;
+}
+
+/* 对负载做一次指数衰减平均 */
+static uint32_t calc_load(uint32_t load, uint32_t exp, uint32_t active)
+{
+    load *= exp;
+    load += active * (FIXED_1 - exp);
+    return load >> FSHIFT;
+}
+
+/* 在BSP的时钟中断中每个嘀嗒调用一次，每LOAD_FREQ个嘀嗒更新负载均值 */
+void calc_global_load(void)
+{
+    if (--load_countdown != 0)
+    {
+        return;
+    }
+    load_countdown = LOAD_FREQ;
+
+    uint32_t nr = nr_active();
+    uint32_t active = nr * FIXED_1;
+    avenrun[0] = calc_load(avenrun[0], EXP_1, active);
+    avenrun[1] = calc_load(avenrun[1], EXP_5, active);
+    avenrun[2] = calc_load(avenrun[2], EXP_15, active);
+    vdso_update_load(avenrun, nr);
+}
+
+/* 获取全局的调度统计，成功返回0，失败返回-1 */
+int32_t sys_schedstat(struct schedstat * buf)
+{
+    if (buf == NULL)
+    {
+        return -1;
+    }
+
+    memset(buf, 0, sizeof(struct schedstat));
+    buf->loadavg[0] = avenrun[0];
+    buf->loadavg[1] = avenrun[1];
+    buf->loadavg[2] = avenrun[2];
+    buf->nr_cpus = nr_cpus;
+    buf->nr_running = nr_active();
+    buf->cycles_per_us = tsc_per_tick / (1000000 / IRQ0_FREQUENCY);
+
+    uint64_t run_delay = 0;
+    uint8_t i;
+    for (i = 0; i < nr_cpus; i++)
+    {
+        struct cpu_sched_stat * st = &cpus[i].sched_stat;
+        buf->nr_switches += st->nr_switches;
+        buf->nr_ticks += st->nr_ticks;
+        buf->idle_ticks += st->idle_ticks;
+        run_delay += st->run_delay;
+
+        uint32_t b;
+        for (b = 0; b < SCHED_HIST_BUCKETS; b++)
+        {
+            buf->lat_hist[b] += cpus[i].sched_stat.lat_hist[b];
+        }
+    }
+    buf->run_delay_ms = acct_cycles_to_ms(run_delay);
+    return 0;
+}
+
+/* thread_all_list_print的回调函数，把一个任务的调度统计格式化到buf中 */
+static uint32_t sched_task_info(struct task_struct * pthread, char * buf)
+{
+    struct sched_info * si = &pthread->sched;
+
+    /* 平均等待时间以微秒为单位 */
+    uint32_t avg_us = 0;
+    if (si->pcount != 0)
+    {
+        uint32_t rem;
+        uint64_t avg = div_u64_rem(si->run_delay, si->pcount, &rem);
+        avg_us = acct_cycles_to_ms(avg * 1000);
+    }
+
+    sprintf(buf, "%-8d%-8d%-10d%-10d%-8d%s\n", pthread->pid, si->pcount,
+                acct_cycles_to_ms(si->run_delay), avg_us,
+                pthread->priority, pthread->name);
+    return strlen(buf);
+}
+
+/* 打印各任务的调度次数和就绪等待时间 */
+void schedstat_ps(void)
+{
+    char * title = "PID     RUNS    DELAY(ms) AVG(us)   PRI     COMMAND\n";
+    sys_write(stdout_no, title, strlen(title));
+    thread_all_list_print(sched_task_info);
+}
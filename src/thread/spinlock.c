@@ -0,0 +1,89 @@
+/* spinlock.c
+ *   排队自旋锁的实现
+ *
+ * spin_lock本身不负责开关中断，调用者需先关中断再加锁，
+ * 否则持锁期间被本cpu上的中断处理程序抢占并再次加锁，会造成死锁。
+ * 在可能被中断处理程序使用的锁上应使用spin_lock_irqsave
+ */
+
+#include <spinlock.h>
+#include <atomic.h>
+
+/* 初始化自旋锁 */
+void spin_init(struct spinlock * plock)
+{
+    plock->owner = 0;
+    plock->next  = 0;
+    plock->acquire_cnt = 0;
+    plock->contend_cnt = 0;
+}
+
+/* 获取自旋锁，获取不到时一直自旋等待 */
+void spin_lock(struct spinlock * plock)
+{
+    /* 取号，next回绕到0也不影响比较 */
+    uint16_t ticket = atomic_add16(&plock->next, 1);
+    bool contended = false;
+
+    /* 等待时只读不写，不会反复抢占总线 */
+    while (plock->owner != ticket)
+    {
+        contended = true;
+        cpu_relax();
+    }
+
+    plock->acquire_cnt++;
+    if (contended)
+    {
+        plock->contend_cnt++;
+    }
+}
+
+/* 尝试获取自旋锁，成功返回true，锁已被占用则立即返回false */
+bool spin_trylock(struct spinlock * plock)
+{
+    uint16_t owner = plock->owner;
+    uint32_t old = ((uint32_t)owner << 16) | owner;  /* 锁空闲时next等于owner */
+    uint32_t new = ((uint32_t)(uint16_t)(owner + 1) << 16) | owner;
+
+    /* owner和next相邻存放，作为一个32位整体比较交换 */
+    if (cmpxchg((volatile uint32_t *)&plock->owner, old, new) != old)
+    {
+        return false;
+    }
+    plock->acquire_cnt++;
+    return true;
+}
+
+/* 释放自旋锁，把锁交给下一个号 */
+void spin_unlock(struct spinlock * plock)
+{
+    /* 编译屏障，保证临界区内的访存不会被挪到释放锁之后，
+     * x86上写操作不会和之前的读写乱序，普通的写即可
+     */
+    asm volatile ("" : : : "memory");
+    plock->owner++;
+}
+
+/* 判断锁是否被持有 */
+bool spin_is_locked(struct spinlock * plock)
+{
+    return plock->owner != plock->next;
+}
+
+/* 关中断并获取自旋锁，返回关中断之前的中断状态
+ * 关中断时长记在调用者名下，而不是本函数
+ */
+intr_status spin_lock_irqsave(struct spinlock * plock)
+{
+    intr_status old_status = intr_disable_at(__builtin_return_address(0));
+    spin_lock(plock);
+    return old_status;
+}
+
+/* 释放自旋锁并恢复中断状态为status */
+void spin_unlock_irqrestore(struct spinlock * plock, intr_status status)
+{
+    spin_unlock(plock);
+    intr_set_status_at(status, __builtin_return_address(0));
+}
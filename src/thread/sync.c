@@ -1,14 +1,116 @@
 /* sync.c
  */
 #include <sync.h>
+#include <thread.h>
 #include <interrupt.h>
 #include <debug.h>
+#include <atomic.h>
+
+/* 保护优先级继承相关的状态：锁的holder，线程的blocked_on、held_locks
+ * 和priority。静态变量初值全为0，即为未加锁的自旋锁
+ */
+static struct spinlock pi_lock;
+
+/* 初始化等待队列 */
+void wait_queue_init(struct wait_queue * wq)
+{
+    list_init(&wq->waiters);
+    list_init(&wq->entries);
+}
+
+/* 判断等待队列是否为空，调用时已持有保护wq的锁 */
+bool wait_queue_empty(struct wait_queue * wq)
+{
+    return list_empty(&wq->waiters);
+}
+
+/* 当前线程在wq上睡眠
+ * 调用时已关中断并持有保护wq的自旋锁plock，
+ * 阻塞时释放plock，被唤醒后重新获取，返回时仍持有
+ */
+void wait_queue_sleep(struct wait_queue * wq, struct spinlock * plock)
+{
+    struct task_struct * cur = running_thread();
+
+    kassert(intr_get_status() == INTR_OFF);
+
+    /* 当前线程不应该已在等待队列中 */
+    if (elem_find(&wq->waiters, &cur->general_tag))
+    {
+        PANIC("wait_queue_sleep: thread blocked has been in waiters_list\n");
+    }
+
+    list_append(&wq->waiters, &cur->general_tag);
+    thread_block_unlock(TASK_BLOCKED, plock);
+    spin_lock(plock);
+}
+
+/* 通知wq的全部观察者 */
+static void wait_queue_notify(struct wait_queue * wq)
+{
+    struct node * elem = wq->entries.head.next;
+    while (elem != &wq->entries.tail)
+    {
+        struct wait_entry * entry = container_of(struct wait_entry, tag, elem);
+        elem = elem->next;
+        entry->func(entry);
+    }
+}
+
+/* 唤醒wq上最早睡眠的一个线程 */
+static bool wake_waiter(struct wait_queue * wq)
+{
+    if (list_empty(&wq->waiters))
+    {
+        return false;
+    }
+    struct task_struct * waiter = container_of(struct task_struct,
+                general_tag, list_pop(&wq->waiters));
+    thread_unblock(waiter);
+    return true;
+}
+
+/* 唤醒wq上最早睡眠的一个线程，并通知全部观察者，调用时已持有保护wq的锁
+ * 没有睡眠的线程时返回false
+ */
+bool wait_queue_wake_one(struct wait_queue * wq)
+{
+    wait_queue_notify(wq);
+    return wake_waiter(wq);
+}
+
+/* 唤醒wq上的所有线程，并通知全部观察者，返回唤醒的线程数，
+ * 调用时已持有保护wq的锁
+ */
+uint32_t wait_queue_wake_all(struct wait_queue * wq)
+{
+    uint32_t cnt = 0;
+    wait_queue_notify(wq);
+    while (wake_waiter(wq))
+    {
+        cnt++;
+    }
+    return cnt;
+}
+
+/* 在wq上登记观察者entry，调用时已持有保护wq的锁 */
+void wait_queue_add_entry(struct wait_queue * wq, struct wait_entry * entry)
+{
+    list_append(&wq->entries, &entry->tag);
+}
+
+/* 去掉登记的观察者entry，调用时已持有保护它所在队列的锁 */
+void wait_queue_del_entry(struct wait_entry * entry)
+{
+    list_remove(&entry->tag);
+}
 
 /* 初始化信号量 */
-void sema_init(struct semaphore * psema, uint8_t value)
+void sema_init(struct semaphore * psema, uint32_t value)
 {
+    spin_init(&psema->lock);
     psema->value = value;   /* 为信号量赋初值 */
-    list_init(&psema->waiters);     /* 初始化信号量的阻塞队列 */
+    wait_queue_init(&psema->wq);    /* 初始化信号量的阻塞队列 */
 }
 
 /* 初始化锁plock */
@@ -16,74 +118,163 @@ void lock_init(struct lock * plock)
 {
     plock->holder = NULL;
     plock->holder_repeat_nr = 0;
+    plock->acquire_cnt = 0;
+    plock->contend_cnt = 0;
     sema_init(&plock->semaphore, 1);
 }
 
 /* 信号量down操作 */
 void sema_down(struct semaphore * psema)
 {
-    /* 关中断来保证原子操作 */
-    intr_status old_status = intr_disable();
+    /* 关中断后再加自旋锁，防止本cpu上的中断处理程序再次加锁 */
+    intr_status old_status = spin_lock_irqsave(&psema->lock);
 
     /* 若value为0,表示已经被别人持有
      * 用while不用if的原因，线程在被唤醒后要重新判断
      */
     while(psema->value == 0)
     {
-        kassert(!elem_find(&psema->waiters, &running_thread()->general_tag));
-
-        /* 当前线程不应该已在信号量的waiters队列中 */
-        if (elem_find(&psema->waiters, &running_thread()->general_tag))
-        {
-            PANIC("sema_down: thread blocked has been in waiters_list\n");
-        }
-
         /* 若信号量的值等于0，则当前线程把自己加入该锁的等待队列，
          * 然后阻塞自己
          */
-        list_append(&psema->waiters, &running_thread()->general_tag);
-        thread_block(TASK_BLOCKED);
+        wait_queue_sleep(&psema->wq, &psema->lock);
     }
 
-    /* 若value为1或被唤醒后，会执行下面的代码，也就是获得了锁 */
+    /* 若value大于0或被唤醒后，会执行下面的代码，也就是获得了信号量 */
     psema->value--;
-    kassert(psema->value == 0);
 
     /* 恢复之前的中断状态 */
-    intr_set_status(old_status);
+    spin_unlock_irqrestore(&psema->lock, old_status);
 }
 
 /* 信号量的up操作 */
 void sema_up(struct semaphore * psema)
 {
     /* 关中断，保证原子操作 */
-    intr_status old_status = intr_disable();
+    intr_status old_status = spin_lock_irqsave(&psema->lock);
 
-    kassert(psema->value == 0);
-    if (!list_empty(&psema->waiters))
+    /* 唤醒优先级最高的等待者，同优先级的按先来后到 */
+    wait_queue_notify(&psema->wq);
+    struct node * elem = psema->wq.waiters.head.next;
+    struct task_struct * best = NULL;
+    while (elem != &psema->wq.waiters.tail)
     {
-        struct task_struct * thread_blocked = container_of(
-                struct task_struct, general_tag, list_pop(&psema->waiters));
-        thread_unblock(thread_blocked);
+        struct task_struct * waiter = container_of(struct task_struct,
+                    general_tag, elem);
+        if (best == NULL || waiter->priority > best->priority)
+        {
+            best = waiter;
+        }
+        elem = elem->next;
+    }
+    if (best != NULL)
+    {
+        list_remove(&best->general_tag);
+        thread_unblock(best);
     }
     psema->value++;
-    kassert(psema->value == 1);
 
     /* 恢复之前的中断状态 */
-    intr_set_status(old_status);
+    spin_unlock_irqrestore(&psema->lock, old_status);
+}
+
+/* 沿锁的等待链提升各持有者的优先级至pri，调用时已持有pi_lock
+ * 持有者本身又在等待别的锁时，继续提升那个锁的持有者
+ */
+static void pi_boost(struct lock * plock, uint8_t pri)
+{
+    uint8_t depth = 0;
+
+    while (plock != NULL && depth++ < PI_CHAIN_MAX)
+    {
+        struct task_struct * holder = plock->holder;
+        if (holder == NULL || holder->priority >= pri)
+        {
+            break;
+        }
+        thread_set_priority(holder, pri);
+        plock = holder->blocked_on;
+    }
+}
+
+/* 计算pthread应有的优先级，调用时已持有pi_lock
+ * 即其自身优先级与所持有的各锁上等待者的最高优先级中的较大者
+ */
+static uint8_t pi_effective_priority(struct task_struct * pthread)
+{
+    uint8_t pri = pthread->base_priority;
+    struct node * lock_elem = pthread->held_locks.head.next;
+
+    while (lock_elem != &pthread->held_locks.tail)
+    {
+        struct lock * plock = container_of(struct lock, holder_tag, lock_elem);
+        struct semaphore * psema = &plock->semaphore;
+
+        spin_lock(&psema->lock);
+        struct node * waiter_elem = psema->wq.waiters.head.next;
+        while (waiter_elem != &psema->wq.waiters.tail)
+        {
+            struct task_struct * waiter = container_of(struct task_struct,
+                        general_tag, waiter_elem);
+            if (waiter->priority > pri)
+            {
+                pri = waiter->priority;
+            }
+            waiter_elem = waiter_elem->next;
+        }
+        spin_unlock(&psema->lock);
+
+        lock_elem = lock_elem->next;
+    }
+    return pri;
 }
 
 /* 获取锁plock */
 void lock_acquire(struct lock * plock)
 {
+    struct task_struct * cur = running_thread();
+
     /* 排除曾经自己已经持有锁但还未将其释放的情况 */
-    if (plock->holder != running_thread())
+    if (plock->holder != cur)
     {
+        /* 只用于统计，不要求精确 */
+        bool contended = (plock->semaphore.value == 0);
+
+        /* 锁已被持有时，把持有者的优先级提升到当前线程的优先级，
+         * 避免持有者被中等优先级的线程长期抢占，导致当前线程无限期等待
+         */
+        intr_status old_status = spin_lock_irqsave(&pi_lock);
+        if (plock->holder != NULL)
+        {
+            cur->blocked_on = plock;
+            pi_boost(plock, cur->priority);
+        }
+        spin_unlock_irqrestore(&pi_lock, old_status);
+
         /* 对信号量P（减）操作，原子操作 */
         sema_down(&plock->semaphore);   
-        plock->holder = running_thread();
+
+        old_status = spin_lock_irqsave(&pi_lock);
+        cur->blocked_on = NULL;
+        plock->holder = cur;
+        list_append(&cur->held_locks, &plock->holder_tag);
+
+        /* 还有线程在等这把锁时，新持有者要继承其中的最高优先级 */
+        uint8_t pri = pi_effective_priority(cur);
+        if (pri > cur->priority)
+        {
+            pi_boost(plock, pri);
+        }
+        spin_unlock_irqrestore(&pi_lock, old_status);
+
         kassert(plock->holder_repeat_nr == 0);
         plock->holder_repeat_nr = 1;
+
+        plock->acquire_cnt++;
+        if (contended)
+        {
+            plock->contend_cnt++;
+        }
     }
     else
     {
@@ -102,7 +293,221 @@ void lock_release(struct lock * plock)
     }
     kassert(plock->holder_repeat_nr == 1);
 
+    struct task_struct * cur = running_thread();
+    intr_status old_status = spin_lock_irqsave(&pi_lock);
+    list_remove(&plock->holder_tag);
     plock->holder = NULL;   /* 把锁的持有者置空放在V（增）操作之前 */
     plock->holder_repeat_nr = 0;
+
+    /* 恢复优先级：可能还持有别的锁，其上的等待者仍需要继承 */
+    uint8_t pri = pi_effective_priority(cur);
+    if (pri != cur->priority)
+    {
+        thread_set_priority(cur, pri);
+    }
+    spin_unlock_irqrestore(&pi_lock, old_status);
+
     sema_up(&plock->semaphore);
 }
+
+/* 初始化互斥锁pmutex */
+void mutex_init(struct mutex * pmutex)
+{
+    pmutex->owner = NULL;
+    spin_init(&pmutex->wait_lock);
+    wait_queue_init(&pmutex->wq);
+    pmutex->acquire_cnt = 0;
+    pmutex->contend_cnt = 0;
+    pmutex->block_cnt = 0;
+}
+
+/* 尝试获取互斥锁，成功返回true */
+bool mutex_trylock(struct mutex * pmutex)
+{
+    struct task_struct * cur = running_thread();
+
+    if (cmpxchg((volatile uint32_t *)&pmutex->owner, 0, (uint32_t)cur) == 0)
+    {
+        pmutex->acquire_cnt++;
+        return true;
+    }
+    return false;
+}
+
+/* 获取互斥锁pmutex，不支持同一线程重复获取 */
+void mutex_lock(struct mutex * pmutex)
+{
+    struct task_struct * cur = running_thread();
+    kassert(pmutex->owner != cur);
+
+    /* 快速路径：锁空闲 */
+    if (mutex_trylock(pmutex))
+    {
+        return;
+    }
+
+    /* 持有者正在别的cpu上运行时自旋等待，
+     * 自旋期间禁止抢占，避免时间片用完后白白自旋了却仍要排队
+     */
+    uint32_t spin = 0;
+    preempt_disable();
+    while (spin++ < MUTEX_SPIN_MAX)
+    {
+        struct task_struct * owner = pmutex->owner;
+        if (owner == NULL)
+        {
+            if (mutex_trylock(pmutex))
+            {
+                pmutex->contend_cnt++;
+                preempt_enable();
+                return;
+            }
+            continue;
+        }
+        if (owner->status != TASK_RUNNING)
+        {
+            break;
+        }
+        cpu_relax();
+    }
+    preempt_enable();
+
+    /* 慢速路径：加入等待队列并阻塞，
+     * 释放者在wait_lock保护下清除owner并唤醒等待者，
+     * 所以持有wait_lock时检查owner不会错过唤醒
+     */
+    intr_status old_status = spin_lock_irqsave(&pmutex->wait_lock);
+    while (cmpxchg((volatile uint32_t *)&pmutex->owner, 0, (uint32_t)cur)
+                != 0)
+    {
+        wait_queue_sleep(&pmutex->wq, &pmutex->wait_lock);
+    }
+    pmutex->acquire_cnt++;
+    pmutex->contend_cnt++;
+    pmutex->block_cnt++;
+    spin_unlock_irqrestore(&pmutex->wait_lock, old_status);
+}
+
+/* 释放互斥锁pmutex，唤醒一个等待者 */
+void mutex_unlock(struct mutex * pmutex)
+{
+    kassert(pmutex->owner == running_thread());
+
+    intr_status old_status = spin_lock_irqsave(&pmutex->wait_lock);
+    pmutex->owner = NULL;
+    wait_queue_wake_one(&pmutex->wq);
+    spin_unlock_irqrestore(&pmutex->wait_lock, old_status);
+}
+
+/* 初始化条件变量 */
+void cond_init(struct condition * cond)
+{
+    spin_init(&cond->lock);
+    wait_queue_init(&cond->wq);
+}
+
+/* 释放plock并等待条件cond，被唤醒后重新获取plock再返回
+ * plock须由当前线程持有且只获取了一次
+ * 在释放plock之前已持有cond->lock并加入等待队列之前不会放开它，
+ * 所以在plock保护下改变条件再发出的通知不会丢失
+ */
+void cond_wait(struct condition * cond, struct lock * plock)
+{
+    kassert(plock->holder == running_thread());
+    kassert(plock->holder_repeat_nr == 1);
+
+    /* 加锁顺序：cond->lock在pi_lock、信号量的锁及就绪队列锁之前 */
+    intr_status old_status = spin_lock_irqsave(&cond->lock);
+    lock_release(plock);
+    wait_queue_sleep(&cond->wq, &cond->lock);
+    spin_unlock_irqrestore(&cond->lock, old_status);
+
+    lock_acquire(plock);
+}
+
+/* 唤醒一个等待条件cond的线程 */
+void cond_signal(struct condition * cond)
+{
+    intr_status old_status = spin_lock_irqsave(&cond->lock);
+    wait_queue_wake_one(&cond->wq);
+    spin_unlock_irqrestore(&cond->lock, old_status);
+}
+
+/* 唤醒所有等待条件cond的线程 */
+void cond_broadcast(struct condition * cond)
+{
+    intr_status old_status = spin_lock_irqsave(&cond->lock);
+    wait_queue_wake_all(&cond->wq);
+    spin_unlock_irqrestore(&cond->lock, old_status);
+}
+
+/* 初始化读写锁 */
+void rwlock_init(struct rwlock * rw)
+{
+    spin_init(&rw->lock);
+    rw->readers = 0;
+    rw->writers_waiting = 0;
+    rw->writer = NULL;
+    wait_queue_init(&rw->read_wq);
+    wait_queue_init(&rw->write_wq);
+}
+
+/* 获取读锁，有写者持有或等待时阻塞 */
+void read_lock(struct rwlock * rw)
+{
+    intr_status old_status = spin_lock_irqsave(&rw->lock);
+    while (rw->writer != NULL || rw->writers_waiting > 0)
+    {
+        wait_queue_sleep(&rw->read_wq, &rw->lock);
+    }
+    rw->readers++;
+    spin_unlock_irqrestore(&rw->lock, old_status);
+}
+
+/* 释放读锁，最后一个读者离开时唤醒一个写者 */
+void read_unlock(struct rwlock * rw)
+{
+    intr_status old_status = spin_lock_irqsave(&rw->lock);
+    kassert(rw->readers > 0);
+    if (--rw->readers == 0)
+    {
+        wait_queue_wake_one(&rw->write_wq);
+    }
+    spin_unlock_irqrestore(&rw->lock, old_status);
+}
+
+/* 获取写锁，有读者或别的写者持有时阻塞 */
+void write_lock(struct rwlock * rw)
+{
+    struct task_struct * cur = running_thread();
+
+    intr_status old_status = spin_lock_irqsave(&rw->lock);
+    kassert(rw->writer != cur);
+    rw->writers_waiting++;
+    while (rw->writer != NULL || rw->readers > 0)
+    {
+        wait_queue_sleep(&rw->write_wq, &rw->lock);
+    }
+    rw->writers_waiting--;
+    rw->writer = cur;
+    spin_unlock_irqrestore(&rw->lock, old_status);
+}
+
+/* 释放写锁
+ * 还有写者在等待时交给下一个写者，否则唤醒所有等待的读者
+ */
+void write_unlock(struct rwlock * rw)
+{
+    intr_status old_status = spin_lock_irqsave(&rw->lock);
+    kassert(rw->writer == running_thread());
+    rw->writer = NULL;
+    if (rw->writers_waiting > 0)
+    {
+        wait_queue_wake_one(&rw->write_wq);
+    }
+    else
+    {
+        wait_queue_wake_all(&rw->read_wq);
+    }
+    spin_unlock_irqrestore(&rw->lock, old_status);
+}
@@ -14,13 +14,23 @@
 #include <global.h>
 #include <file.h>
 #include <stdio.h>
+#include <smp.h>
+#include <spinlock.h>
+#include <atomic.h>
+#include <trace.h>
+#include <pid.h>
+#include <schedstat.h>
+#include <syscall.h>
+#include <wait_exit.h>
 
 struct task_struct * main_thread;       /* 主线程PCB */
-struct task_struct * idle_thread;       /* idle线程 */
-struct list thread_ready_list;          /* 就绪队列 */
+struct task_struct * idle_thread;       /* BSP的idle线程 */
 struct list thread_all_list;            /* 所有任务队列 */
-struct lock pid_lock;                   /* 分配pid锁 */
-static struct node * thread_tag;        /* 用于保存队列中的线程结点 */
+static struct spinlock all_list_lock;   /* 保护thread_all_list */
+
+/* 已退出、等待回收pcb的任务 */
+static struct list dead_list;
+static struct spinlock dead_lock;       /* 保护dead_list */
 
 extern void switch_to(struct task_struct * cur, struct task_struct *next);
 extern void init(void);
@@ -55,6 +65,11 @@ struct task_struct * running_thread(void)
 /* 由kernel_thread去执行function(func_arg) */
 static void kernel_thread(thread_func *func, void *func_arg)
 {
+    /* 第一次上cpu时是从schedule中的switch_to返回到这里的，
+     * 要释放schedule中获取的就绪队列锁
+     */
+    schedule_tail();
+
     /* 执行function前要开中断，避免后面的时钟中断被屏蔽，
      * 而无法调度其它线程
      */
@@ -63,27 +78,6 @@ static void kernel_thread(thread_func *func, void *func_arg)
     func(func_arg);
 }
 
-/* 分配pid */
-static pid_t allocate_pid(void)
-{
-    static pid_t next_pid = 0;
-    lock_acquire(&pid_lock);
-    next_pid++;
-    lock_release(&pid_lock);
-
-    return next_pid;
-}
-
-
-/* fork进程时为其分配pid，因为allocate_pid已经是静态的，别的文件无法调用
- * 不想改变函数定义了，故定义fork_pid函数来封装一下
- */
-pid_t fork_pid(void) 
-{
-    return allocate_pid();
-}
-
-
 /* 初始化线程栈thread_stack，将待执行的函数和参数放到thread_stack
  * 中相应的位置
  */
@@ -111,7 +105,16 @@ void thread_create(struct task_struct * pthread, thread_func func,
 void init_thread(task_struct * pthread, char * name, int pri)
 {
     memset(pthread, 0, sizeof(*pthread));
-    pthread->pid = allocate_pid();
+
+    pthread->blocked_on = NULL;
+    list_init(&pthread->held_locks);
+    ipc_tcb_init(&pthread->ipc);
+
+    pthread->pid = pid_alloc();
+    if (pthread->pid == -1)
+    {
+        PANIC("init_thread: no free pid\n");
+    }
     strcpy(pthread->name, name);
 
     /* 由于把main函数也封装成一个线程，并且它一直是运行的，
@@ -131,11 +134,13 @@ void init_thread(task_struct * pthread, char * name, int pri)
      */
     pthread->self_kstack = (uint32_t *)((uint32_t)pthread + PG_SIZE);
     pthread->priority    = pri;
+    pthread->base_priority = pri;
 
     /* 任务运行时间由优先级决定，优先级越高，ticks越大 */
     pthread->ticks       = pri;
 
     pthread->elapsed_ticks = 0;
+    acct_init_task(pthread);
     pthread->pgdir       = NULL;
 
     /* 预留标准输入、标准输出、标准错误 */
@@ -144,7 +149,7 @@ void init_thread(task_struct * pthread, char * name, int pri)
     pthread->fd_table[2] = 2;
 
     /* 其余的全置为-1 */
-    uint8_t fd_idx = 0;
+    uint8_t fd_idx = 3;
     while (fd_idx < MAX_FILES_OPEN_PER_PROC) 
     {
         pthread->fd_table[fd_idx] = -1;
@@ -153,6 +158,10 @@ void init_thread(task_struct * pthread, char * name, int pri)
 
     pthread->cwd_inode_nr = 0;	    /* 以根目录做为默认工作路径 */
     pthread->parent_pid = -1;       /* 1表示没有父进程 */
+    pthread->group_leader = pthread;
+    pthread->nr_threads = 1;
+    list_init(&pthread->vmas);
+    lock_init(&pthread->vma_lock);
     
     pthread->stack_magic = STACK_BORDER_MAGIC;
 }
@@ -172,15 +181,115 @@ struct task_struct * thread_start(char * name, int pri,
     init_thread(pthread, name, pri);
     thread_create(pthread, func, func_arg);
 
-    /* 加入就绪线程队列，并确保此队列之前并没有此线程 */
-    kassert(!elem_find(&thread_ready_list, &pthread->general_tag));
-    list_append(&thread_ready_list, &pthread->general_tag);
+    /* 加入全部线程队列和就绪队列 */
+    thread_all_list_add(pthread);
+    thread_enqueue(pthread);
+
+    return pthread;
+}
 
-    /* 加入全部线程队列，并确保此队列之前并没有此线程 */
-    kassert(!elem_find(&thread_all_list, &pthread->all_list_tag));
+/* 将pthread加入全部线程队列，并确保此队列之前并没有此线程 */
+void thread_all_list_add(struct task_struct * pthread)
+{
+    /* pid_hash_add中会检查pid是否重复，不必再遍历队列 */
+    pid_hash_add(pthread);
+
+    intr_status old_status = spin_lock_irqsave(&all_list_lock);
     list_append(&thread_all_list, &pthread->all_list_tag);
+    spin_unlock_irqrestore(&all_list_lock, old_status);
+}
 
-    return pthread;
+/* 在持有队列锁时依次对全部线程队列中的任务调用check，
+ * 返回第一个使check返回true的任务，没有时返回NULL
+ */
+struct task_struct * thread_all_list_find(check_elem check, int arg)
+{
+    intr_status old_status = spin_lock_irqsave(&all_list_lock);
+    struct node * elem = list_traversal(&thread_all_list, check, arg);
+    spin_unlock_irqrestore(&all_list_lock, old_status);
+
+    if (elem == NULL)
+    {
+        return NULL;
+    }
+    return container_of(struct task_struct, all_list_tag, elem);
+}
+
+/* 依次输出全部任务的信息
+ * 输出可能睡眠，不能持all_list_lock进行，先在锁内格式化到内核缓冲区，
+ * 放开锁后再一起输出，期间退出的任务不会被访问到
+ */
+void thread_all_list_print(task_info_fmt * fmt)
+{
+    intr_status old_status = spin_lock_irqsave(&all_list_lock);
+    uint32_t cnt = list_len(&thread_all_list);
+    spin_unlock_irqrestore(&all_list_lock, old_status);
+
+    /* 多留一些给期间新建的任务，还放不下的就不输出了 */
+    uint32_t pg_cnt = DIV_ROUND_UP((cnt + 8) * TASK_INFO_LEN, PG_SIZE);
+    char * buf = get_kernel_pages(pg_cnt);
+    if (buf == NULL)
+    {
+        return;
+    }
+
+    uint32_t len = 0;
+    old_status = spin_lock_irqsave(&all_list_lock);
+    struct node * elem = thread_all_list.head.next;
+    while (elem != &thread_all_list.tail &&
+            len + TASK_INFO_LEN <= pg_cnt * PG_SIZE)
+    {
+        len += fmt(container_of(struct task_struct, all_list_tag, elem),
+                    buf + len);
+        elem = elem->next;
+    }
+    spin_unlock_irqrestore(&all_list_lock, old_status);
+
+    sys_write(stdout_no, buf, len);
+    mfree_page(PF_KERNEL, buf, pg_cnt);
+}
+
+/* 将pthread从全部线程队列和pid散列表中去掉 */
+void thread_all_list_remove(struct task_struct * pthread)
+{
+    intr_status old_status = spin_lock_irqsave(&all_list_lock);
+    list_remove(&pthread->all_list_tag);
+    spin_unlock_irqrestore(&all_list_lock, old_status);
+
+    pid_hash_remove(pthread);
+}
+
+/* 将新建的任务pthread放入就绪任务最少的cpu的就绪队列 */
+void thread_enqueue(struct task_struct * pthread)
+{
+    intr_status old_status = intr_disable();
+    struct cpu * target = &cpus[0];
+    uint8_t i;
+
+    /* 这里读nr_ready不加锁，只用于粗略的负载均衡 */
+    for (i = 1; i < nr_cpus; i++)
+    {
+        if (cpus[i].nr_ready < target->nr_ready)
+        {
+            target = &cpus[i];
+        }
+    }
+
+    spin_lock(&target->rq_lock);
+    kassert(!elem_find(&target->ready_list, &pthread->general_tag));
+    list_append(&target->ready_list, &pthread->general_tag);
+    target->nr_ready++;
+    pthread->cpu = target;
+    pthread->status = TASK_READY;
+    sched_info_queued(pthread, false);
+    spin_unlock(&target->rq_lock);
+
+    /* 目标cpu正在idle中hlt时，将其唤醒 */
+    if (target != this_cpu() && target->curr == target->idle)
+    {
+        smp_send_resched(target);
+    }
+    intr_set_status(old_status);
 }
 
 /* 将kernel中的main函数完善为主线程 */
@@ -192,60 +301,264 @@ static void make_main_thread(void)
      */
     main_thread = running_thread();
     init_thread(main_thread, "main", 31);
+    main_thread->cpu = &cpus[0];
+    main_thread->on_cpu = true;
+    cpus[0].curr = main_thread;
 
-    /* main函数是当前线程,当前线程不在thread_ready_list中，
+    /* main函数是当前线程,当前线程不在就绪队列中，
      * 所以只将其加在thread_all_list中
      */
-    kassert(!elem_find(&thread_all_list, &main_thread->all_list_tag));
-    list_append(&thread_all_list, &main_thread->all_list_tag);
+    thread_all_list_add(main_thread);
 }
 
-/* 实现任务调度 */
-void schedule(void)
+/* 从其它cpu的就绪队列尾部偷取一个任务给cpu c运行，
+ * 调用时已持有c的就绪队列锁，为避免两个cpu互相偷取时死锁，
+ * 对其它cpu的就绪队列锁只做尝试
+ */
+static struct task_struct * steal_task(struct cpu * c)
 {
-    kassert( INTR_OFF == intr_get_status());
+    uint8_t i;
 
-    struct task_struct * cur = running_thread();
+    for (i = 1; i < nr_cpus; i++)
+    {
+        struct cpu * victim = &cpus[(c->id + i) % nr_cpus];
+        if (victim->nr_ready == 0 || !spin_trylock(&victim->rq_lock))
+        {
+            continue;
+        }
+
+        /* 队尾的任务最晚入队，其缓存最可能已经冷了 */
+        struct node * pelem = victim->ready_list.tail.prev;
+        while (pelem != &victim->ready_list.head)
+        {
+            struct task_struct * pthread =
+                    container_of(struct task_struct, general_tag, pelem);
+
+            /* 刚被唤醒、还没在原来的cpu上换下的任务不能偷 */
+            if (pthread != victim->idle && !pthread->on_cpu)
+            {
+                list_remove(pelem);
+                victim->nr_ready--;
+
+                /* 在释放victim的锁之前改cpu，别人持有victim的锁时
+                 * 就能据此判断pthread已不在victim的就绪队列中
+                 */
+                pthread->cpu = c;
+                spin_unlock(&victim->rq_lock);
+                c->nr_steal++;
+                return pthread;
+            }
+            pelem = pelem->prev;
+        }
+        spin_unlock(&victim->rq_lock);
+    }
+    return NULL;
+}
 
+/* 当前任务只是让出cpu时将其放回就绪队列尾，调用时已持有c的rq_lock */
+static void put_prev_task(struct cpu * c, struct task_struct * cur)
+{
     /* 若此线程只是cpu时间片到了，将其加入到就绪队列尾 */
     if (TASK_RUNNING == cur->status)
     {
-        kassert(!elem_find(&thread_ready_list, &cur->general_tag));
-        list_append(&thread_ready_list, &cur->general_tag);
-
         /* 重新将当前线程的ticks再重置为其priority */
         cur->ticks = cur->priority;
 
-        cur->status = TASK_READY;
+        if (cur == c->idle)
+        {
+            /* idle不进入就绪队列，队列为空时直接选它 */
+            cur->status = TASK_BLOCKED;
+        }
+        else
+        {
+            kassert(!elem_find(&c->ready_list, &cur->general_tag));
+            list_append(&c->ready_list, &cur->general_tag);
+            c->nr_ready++;
+            cur->status = TASK_READY;
+            sched_info_queued(cur, false);
+        }
     }
     else
     {
         /* 若此线程需要某事件发生后才能继续上cpu运行，
-         * 不需要将其加入队列，因为当前线程不在就绪队列中
+         * 不需要将其加入队列，因为当前线程不在就绪队列中。
+         * 它也可能在释放锁之后、进入schedule之前已被别的cpu唤醒，
+         * 这时它已在就绪队列中，状态为TASK_READY
          */
     }
+}
+
+/* 从cur切换到next，调用时已持有c的rq_lock，由schedule_tail释放 */
+static void context_switch(struct cpu * c, struct task_struct * cur,
+                struct task_struct * next)
+{
+    sched_info_switch(c, cur, next);
+    next->status = TASK_RUNNING;
+    next->cpu = c;
+    c->curr = next;
 
-    /* 如果就绪队列中没有可运行的任务，就唤醒idle */
-    if (list_empty(&thread_ready_list))
+    if (next != cur)
     {
-        thread_unblock(idle_thread);
+        /* next若刚在别的cpu上阻塞，等那边保存完它的上下文 */
+        while (next->on_cpu)
+        {
+            cpu_relax();
+        }
+        next->on_cpu = true;
+
+        /* cur还在用自己的内核栈，切换完成后由schedule_tail处理 */
+        c->prev = cur;
+
+        acct_switch(cur, next);
+        fpu_switch(cur);
+
+        /* 击活任务页表等 */
+        process_activate(next);
+        switch_to(cur, next);
     }
-    
-    kassert(!list_empty(&thread_ready_list));
-    thread_tag = NULL;
 
-    /* 将thread_ready_list队列中的第一个就绪线程弹出，
-     * 准备将其调度上cpu
+    schedule_tail();
+}
+
+/* 实现任务调度
+ *
+ * 本cpu的就绪队列锁在switch_to期间一直持有，由切换上来的任务在
+ * schedule_tail中释放，这样其它cpu在当前任务换下之前不能把它放回
+ * 本cpu的就绪队列。阻塞的任务则可能在释放自旋锁之后、进入这里之前
+ * 就被唤醒放回就绪队列，靠on_cpu保证它在上下文保存完之前
+ * 不会被别的cpu偷走或运行
+ */
+void schedule(void)
+{
+    kassert( INTR_OFF == intr_get_status());
+
+    struct task_struct * cur = running_thread();
+    struct cpu * c = cur->cpu;
+
+    spin_lock(&c->rq_lock);
+    put_prev_task(c, cur);
+
+    struct task_struct * next;
+
+    /* 将就绪队列中的第一个就绪线程弹出，准备将其调度上cpu，
+     * 本cpu没有就绪任务时先从别的cpu偷取，偷不到才运行idle
      */
-    thread_tag = list_pop(&thread_ready_list);
-    struct task_struct * next = container_of(struct task_struct,
-            general_tag, thread_tag);
-    next->status = TASK_RUNNING;
+    if (!list_empty(&c->ready_list))
+    {
+        next = container_of(struct task_struct, general_tag,
+                    list_pop(&c->ready_list));
+        c->nr_ready--;
+    }
+    else if ((next = steal_task(c)) == NULL)
+    {
+        next = c->idle;
+    }
 
-    /* 击活任务页表等 */
-    process_activate(next);
+    context_switch(c, cur, next);
+}
 
-    switch_to(cur, next);
+/* 不经过就绪队列，把cpu直接交给next，调用时须已关中断
+ * next须是在本cpu上阻塞的任务，且除调用者外没有别人会唤醒它。
+ * 当前任务仍为TASK_RUNNING时放回就绪队列尾，否则和schedule一样换下
+ */
+void thread_handoff(struct task_struct * next)
+{
+    kassert(INTR_OFF == intr_get_status());
+
+    struct task_struct * cur = running_thread();
+    struct cpu * c = cur->cpu;
+    kassert(next != cur && next->cpu == c);
+
+    spin_lock(&c->rq_lock);
+    kassert(TASK_BLOCKED == next->status);
+    put_prev_task(c, cur);
+    sched_info_queued(next, true);
+    context_switch(c, cur, next);
+}
+
+/* 任务切换完成后释放本cpu的就绪队列锁
+ * 新任务第一次上cpu时不经过schedule的返回路径，要自己调用此函数
+ */
+void schedule_tail(void)
+{
+    struct cpu * c = running_thread()->cpu;
+
+    /* 换下的任务上下文已保存，从此可以在别的cpu上运行或被回收 */
+    struct task_struct * prev = c->prev;
+    c->prev = NULL;
+    struct task_struct * dead = NULL;
+    if (prev != NULL)
+    {
+        if (TASK_DIED == prev->status)
+        {
+            dead = prev;
+        }
+        asm volatile ("" : : : "memory");
+        prev->on_cpu = false;
+    }
+    spin_unlock(&c->rq_lock);
+
+    /* 退出的任务放入dead_list等待回收
+     * 放入后pcb随时可能被释放，组长要先取出来
+     */
+    if (dead != NULL)
+    {
+        struct task_struct * leader = dead->group_leader;
+        spin_lock(&dead_lock);
+        list_append(&dead_list, &dead->general_tag);
+        spin_unlock(&dead_lock);
+
+        /* 同组的线程已不再使用组的页表，组长可以继续退出了 */
+        if (leader != dead)
+        {
+            thread_group_put(leader);
+        }
+    }
+}
+
+/* 等到pthread在别的cpu上换下，之后才能释放它的pcb和页表 */
+void thread_wait_off_cpu(struct task_struct * pthread)
+{
+    while (pthread->on_cpu)
+    {
+        cpu_relax();
+    }
+    asm volatile ("" : : : "memory");
+}
+
+/* 当前任务退出，不再返回
+ * pcb页要等切换到别的任务之后，由thread_reap_dead回收
+ */
+void thread_exit_current(void)
+{
+    struct task_struct * cur = running_thread();
+
+    thread_all_list_remove(cur);
+    pid_free(cur->pid);
+
+    intr_disable();
+    cur->status = TASK_DIED;
+    schedule();
+    PANIC("thread_exit_current: dead task scheduled\n");
+}
+
+/* 释放已退出任务的pcb页，释放内存会睡眠，要在进程上下文中调用 */
+void thread_reap_dead(void)
+{
+    while (true)
+    {
+        intr_status old_status = spin_lock_irqsave(&dead_lock);
+        if (list_empty(&dead_list))
+        {
+            spin_unlock_irqrestore(&dead_lock, old_status);
+            break;
+        }
+        struct task_struct * dead = container_of(struct task_struct,
+                    general_tag, list_pop(&dead_list));
+        spin_unlock_irqrestore(&dead_lock, old_status);
+
+        mfree_page(PF_KERNEL, dead, 1);
+    }
 }
 
 /* 当前进程主动将自己阻塞，标志其状态为stat */
@@ -268,7 +581,21 @@ void thread_block(task_status stat)
     intr_set_status(old_status);
 }
 
-/* 将线程pthread解除阻塞 */
+/* 阻塞当前线程并释放自旋锁plock，调用时须已关中断
+ * 先置状态再释放锁，这样释放锁后立即到来的唤醒不会丢失
+ */
+void thread_block_unlock(task_status stat, struct spinlock * plock)
+{
+    kassert(INTR_OFF == intr_get_status());
+    kassert(TASK_BLOCKED == stat || TASK_WAITING == stat
+            || TASK_HANGING == stat);
+
+    running_thread()->status = stat;
+    spin_unlock(plock);
+    schedule();
+}
+
+/* 将线程pthread解除阻塞，放回它所在cpu的就绪队列 */
 void thread_unblock(struct task_struct * pthread)
 {
     intr_status old_status = intr_disable();
@@ -276,17 +603,27 @@ void thread_unblock(struct task_struct * pthread)
     kassert(TASK_BLOCKED == pthread->status || TASK_WAITING == pthread->status
             || TASK_HANGING == pthread->status);
 
+    struct cpu * c = pthread->cpu;
+    spin_lock(&c->rq_lock);
     if (pthread->status != TASK_READY)
     {
-        kassert(!elem_find(&thread_ready_list, &pthread->general_tag));
-        if (elem_find(&thread_ready_list, &pthread->general_tag))
+        kassert(!elem_find(&c->ready_list, &pthread->general_tag));
+        if (elem_find(&c->ready_list, &pthread->general_tag))
         {
             PANIC("thread_unblock: blocked thread in ready_list\n");
         }
 
         /* 放到队列的最前面，使其尽快得到调度 */
-        list_push(&thread_ready_list, &pthread->general_tag);
+        list_push(&c->ready_list, &pthread->general_tag);
+        c->nr_ready++;
         pthread->status = TASK_READY;
+        sched_info_queued(pthread, true);
+    }
+    spin_unlock(&c->rq_lock);
+
+    if (c != this_cpu() && c->curr == c->idle)
+    {
+        smp_send_resched(c);
     }
     intr_set_status(old_status);
 }
@@ -294,18 +631,97 @@ void thread_unblock(struct task_struct * pthread)
 /* 主动让出cpu，换其它线程运行 */
 void thread_yield(void)
 {
-    struct task_struct * cur = running_thread();
+    /* 当前任务状态为TASK_RUNNING，schedule会将其放到就绪队列尾 */
     intr_status old_status = intr_disable();
-    kassert(!elem_find(&thread_ready_list, &cur->general_tag));
-    list_append(&thread_ready_list, &cur->general_tag);
-    cur->status = TASK_READY;
     schedule();
     intr_set_status(old_status);
 }
 
+/* 禁止当前线程被抢占，可以嵌套
+ * 期间时间片用完不会在中断返回前被调度，但中断照常处理。
+ * 禁止抢占期间不能阻塞
+ */
+void preempt_disable(void)
+{
+    struct task_struct * cur = running_thread();
+    if (cur->preempt_count++ == 0)
+    {
+        trace_preempt_off(__builtin_return_address(0));
+    }
+    asm volatile ("" : : : "memory");
+}
+
+/* 允许当前线程被抢占，计数减为0时补上期间被推迟的调度 */
+void preempt_enable(void)
+{
+    struct task_struct * cur = running_thread();
+
+    asm volatile ("" : : : "memory");
+    kassert(cur->preempt_count > 0);
+    if (--cur->preempt_count != 0)
+    {
+        return;
+    }
+    trace_preempt_on(__builtin_return_address(0));
+
+    /* 已关中断时留给之后的中断返回处理 */
+    intr_status old_status = intr_disable();
+    struct cpu * c = cur->cpu;
+    if (old_status == INTR_ON && c->need_resched)
+    {
+        c->need_resched = false;
+        schedule();
+    }
+    intr_set_status(old_status);
+}
 
-/* 以填充空格的方式对齐输出buf */
-static void pad_print(char* buf, int32_t buf_len, void* ptr, char format) 
+/* 修改任务pthread的优先级，用于优先级继承
+ * 提升优先级时，若pthread正在就绪队列中，将其移到队首，
+ * 使其尽快运行并释放锁
+ */
+void thread_set_priority(struct task_struct * pthread, uint8_t pri)
+{
+    intr_status old_status = intr_disable();
+    struct cpu * c = pthread->cpu;
+
+    spin_lock(&c->rq_lock);
+    bool raise = pri > pthread->priority;
+    pthread->priority = pri;
+    if (raise)
+    {
+        /* 时间片也按新的优先级补足 */
+        if (pthread->ticks < pri)
+        {
+            pthread->ticks = pri;
+        }
+
+        if (TASK_READY == pthread->status && pthread->cpu == c)
+        {
+            list_remove(&pthread->general_tag);
+            list_push(&c->ready_list, &pthread->general_tag);
+        }
+    }
+    spin_unlock(&c->rq_lock);
+    intr_set_status(old_status);
+}
+
+/* AP进入空闲循环，当前栈所在的pcb即为BSP为该cpu准备的idle线程 */
+void thread_ap_idle(struct cpu * c)
+{
+    struct task_struct * idle_pcb = running_thread();
+
+    c->idle = idle_pcb;
+    c->curr = idle_pcb;
+    idle_pcb->on_cpu = true;
+    thread_all_list_add(idle_pcb);
+    c->online = true;
+
+    idle(NULL);
+}
+
+
+/* 以填充空格的方式对齐，在buf中写入buf_len-1个字符，返回写入的长度 */
+static uint32_t pad_print(char* buf, int32_t buf_len, void* ptr, char format) 
 {
     memset(buf, 0, buf_len);
     uint8_t out_pad_0idx = 0;
@@ -327,77 +743,83 @@ static void pad_print(char* buf, int32_t buf_len, void* ptr, char format)
         buf[out_pad_0idx] = ' ';
         out_pad_0idx++;
     }
-    sys_write(stdout_no, buf, buf_len - 1);
+    return buf_len - 1;
 }
 
 
-/* 此函数用作list_traversal函数中的回调函数，
- * 用于针对线程队列的处理，打印任务信息 
- */
-static bool elem2thread_info(struct node* pelem, int arg UNUSED) 
+/* thread_all_list_print的回调函数，把任务信息格式化到buf中 */
+static uint32_t thread_info(struct task_struct* pthread, char* buf) 
 {
-    struct task_struct* pthread = 
-                container_of(struct task_struct, all_list_tag, pelem);
-    char out_pad[16] = {0};
+    uint32_t len = 0;
 
-    pad_print(out_pad, 16, &pthread->pid, 'd');
+    len += pad_print(buf + len, 16, &pthread->pid, 'd');
 
     if (pthread->parent_pid == -1) 
     {
-        pad_print(out_pad, 16, "NULL", 's');
+        len += pad_print(buf + len, 16, "NULL", 's');
     } 
     else 
     { 
-        pad_print(out_pad, 16, &pthread->parent_pid, 'd');
+        len += pad_print(buf + len, 16, &pthread->parent_pid, 'd');
     }
 
+    char* stat = "";
     switch (pthread->status) 
     {
         case 0:
-            pad_print(out_pad, 16, "RUNNING", 's');
+            stat = "RUNNING";
             break;
 
         case 1:
-            pad_print(out_pad, 16, "READY", 's');
+            stat = "READY";
             break;
 
         case 2:
-            pad_print(out_pad, 16, "BLOCKED", 's');
+            stat = "BLOCKED";
             break;
 
         case 3:
-            pad_print(out_pad, 16, "WAITING", 's');
+            stat = "WAITING";
             break;
 
         case 4:
-            pad_print(out_pad, 16, "HANGING", 's');
+            stat = "HANGING";
             break;
 
         case 5:
-            pad_print(out_pad, 16, "DIED", 's');
+            stat = "DIED";
     }
-    pad_print(out_pad, 16, &pthread->elapsed_ticks, 'x');
+    len += pad_print(buf + len, 16, stat, 's');
+    len += pad_print(buf + len, 16, &pthread->elapsed_ticks, 'x');
 
-    memset(out_pad, 0, 16);
     kassert(strlen(pthread->name) < 17);
-    memcpy(out_pad, pthread->name, strlen(pthread->name));
-    strcat(out_pad, "\n");
-    sys_write(stdout_no, out_pad, strlen(out_pad));
-
-    /* 此处返回false是为了迎合主调函数list_traversal，
-     * 只有回调函数返回false时才会继续调用此函数
-     */
-    return false;	
+    memcpy(buf + len, pthread->name, strlen(pthread->name));
+    len += strlen(pthread->name);
+    buf[len++] = '\n';
+    return len;
 }
 
 
-/* 打印任务列表 */
-void sys_ps(void) 
+/* 打印任务列表，mode为PS_RUSAGE时打印各任务的资源使用情况，
+ * 为PS_SCHED时打印各任务的调度统计
+ */
+void sys_ps(int32_t mode) 
 {
+    if (PS_RUSAGE == mode)
+    {
+        acct_ps();
+        return;
+    }
+    if (PS_SCHED == mode)
+    {
+        schedstat_ps();
+        return;
+    }
+
     char* ps_title = "PID            PPID           "
                      "STAT           TICKS          COMMAND\n";
     sys_write(stdout_no, ps_title, strlen(ps_title));
-    list_traversal(&thread_all_list, elem2thread_info, 0);
+    thread_all_list_print(thread_info);
 }
 
 
@@ -405,9 +827,20 @@ void sys_ps(void)
 void thread_init(void)
 {
     put_str("thread_init ... ");
-    list_init(&thread_ready_list);
+    cpu_init(&cpus[0], 0);
+    cpus[0].online = true;
+
+    /* 主线程的pcb在make_main_thread中才会初始化，
+     * 在此之前创建init进程时也要用到this_cpu
+     */
+    running_thread()->cpu = &cpus[0];
+    running_thread()->blocked_on = NULL;
+    list_init(&running_thread()->held_locks);
     list_init(&thread_all_list);
-    lock_init(&pid_lock);
+    spin_init(&all_list_lock);
+    list_init(&dead_list);
+    spin_init(&dead_lock);
+    pid_init();
 
     
     /* 先创建第一个用户进程: init 
@@ -420,6 +853,7 @@ void thread_init(void)
 
     /* 创建idle线程 */
     idle_thread = thread_start("idle", 10, idle, NULL);
+    cpus[0].idle = idle_thread;
     
     put_str("ok\n");
 }
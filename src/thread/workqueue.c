@@ -0,0 +1,111 @@
+/* workqueue.c
+ *   工作队列
+ *
+ * 中断处理程序、软中断和文件系统可以把不需要立即完成、
+ * 或可能阻塞的工作（如回写、清零页面）提交到工作队列，
+ * 由工作线程在进程上下文中开中断执行
+ */
+
+#include <workqueue.h>
+#include <thread.h>
+#include <memory.h>
+#include <interrupt.h>
+#include <atomic.h>
+#include <debug.h>
+#include <print.h>
+
+struct workqueue * system_wq;   /* 通用的工作队列 */
+
+/* 初始化工作work，执行时调用func(arg) */
+void work_init(struct work_struct * work, work_func func, void * arg)
+{
+    work->func = func;
+    work->arg = arg;
+    work->pending = false;
+}
+
+/* 工作线程，不断取出工作执行，没有工作时睡眠 */
+static void worker_thread(void * arg)
+{
+    struct workqueue * wq = arg;
+
+    while (1)
+    {
+        intr_status old_status = spin_lock_irqsave(&wq->lock);
+        while (list_empty(&wq->works))
+        {
+            wait_queue_sleep(&wq->idle_workers, &wq->lock);
+        }
+        struct work_struct * work = container_of(struct work_struct, entry,
+                    list_pop(&wq->works));
+
+        /* 执行前清除标记，func中可以再次提交自己 */
+        work->pending = false;
+        spin_unlock_irqrestore(&wq->lock, old_status);
+
+        work->func(work->arg);
+        atomic_inc(&wq->nr_done);
+    }
+}
+
+/* 创建名为name、有nr_workers个工作线程的工作队列，失败返回NULL */
+struct workqueue * workqueue_create(const char * name, uint8_t nr_workers)
+{
+    kassert(nr_workers > 0 && nr_workers <= WQ_MAX_WORKERS);
+
+    struct workqueue * wq = get_kernel_pages(1);
+    if (wq == NULL)
+    {
+        return NULL;
+    }
+
+    wq->name = name;
+    spin_init(&wq->lock);
+    list_init(&wq->works);
+    wait_queue_init(&wq->idle_workers);
+    wq->nr_queued = 0;
+    wq->nr_done = 0;
+    wq->nr_workers = nr_workers;
+
+    uint8_t i;
+    for (i = 0; i < nr_workers; i++)
+    {
+        wq->workers[i] = thread_start((char *)name, WQ_WORKER_PRIO,
+                    worker_thread, wq);
+    }
+    return wq;
+}
+
+/* 把work提交到wq，可在中断处理程序中调用
+ * work已在队列中尚未执行时不重复提交，返回false
+ */
+bool queue_work(struct workqueue * wq, struct work_struct * work)
+{
+    intr_status old_status = spin_lock_irqsave(&wq->lock);
+    if (work->pending)
+    {
+        spin_unlock_irqrestore(&wq->lock, old_status);
+        return false;
+    }
+    work->pending = true;
+    list_append(&wq->works, &work->entry);
+    wq->nr_queued++;
+    wait_queue_wake_one(&wq->idle_workers);
+    spin_unlock_irqrestore(&wq->lock, old_status);
+    return true;
+}
+
+/* 把work提交到通用工作队列 */
+bool schedule_work(struct work_struct * work)
+{
+    return queue_work(system_wq, work);
+}
+
+/* 创建通用工作队列 */
+void workqueue_init(void)
+{
+    put_str("workqueue_init ... ");
+    system_wq = workqueue_create("kworker", 2);
+    kassert(system_wq != NULL);
+    put_str("ok\n");
+}
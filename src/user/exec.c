@@ -8,6 +8,15 @@
 #include <string.h>
 #include <global.h>
 #include <memory.h>
+#include <fpu.h>
+#include <ioring.h>
+#include <process.h>
+#include <file.h>
+#include <pid.h>
+#include <vdso.h>
+#include <wait_exit.h>
+#include <vma.h>
+#include <inode.h>
 
 extern void intr_exit(void);
 typedef uint32_t Elf32_Word, Elf32_Addr, Elf32_Off;
@@ -54,167 +63,288 @@ enum segment_type {
     PT_PHDR,             /* 程序头表 */
 };
 
-/* 将文件描述符fd指向的文件中，偏移为offset，
- * 大小为filesz的段加载到虚拟地址为vaddr的内存 
+/* 程序头中p_flags的可写位 */
+#define PF_W    0x2
+
+/* 记录inode中由prog_header描述的段，映射到它的p_vaddr处，
+ * 超出p_filesz的部分(bss)填0，页面在第一次访问时才读入
  */
-static bool segment_load(int32_t fd, uint32_t offset, 
-                        uint32_t filesz, uint32_t vaddr) 
+static bool segment_load(struct inode* inode, struct Elf32_Phdr* prog_header) 
 {
-    /* vaddr地址所在的页框 */
-    uint32_t vaddr_first_page = vaddr & 0xfffff000;   
-    
-    /* 加载到内存后,文件在第一个页框中占用的字节大小 */
-    uint32_t size_in_first_page = PG_SIZE - (vaddr & 0x00000fff);     
-    uint32_t occupy_pages = 0;
-    
-    /* 若一个页框容不下该段 */
-    if (filesz > size_in_first_page) 
-    {
-        uint32_t left_size = filesz - size_in_first_page;
+    uint32_t flags = (prog_header->p_flags & PF_W) ? VMA_WRITE : 0;
+    return vma_add(prog_header->p_vaddr, prog_header->p_memsz, flags, inode,
+                prog_header->p_offset, prog_header->p_filesz) == 0;
+}
 
-        /* 1是指vaddr_first_page */
-        occupy_pages = DIV_ROUND_UP(left_size, PG_SIZE) + 1;       
-    } 
-    else 
+/* 从fd的开头读入elf头并校验，是可执行的32位elf文件时返回true */
+static bool elf_read_header(int32_t fd, struct Elf32_Ehdr* elf_header)
+{
+    memset(elf_header, 0, sizeof(struct Elf32_Ehdr));
+    sys_lseek(fd, 0, SEEK_SET);
+    if (sys_read(fd, elf_header, sizeof(struct Elf32_Ehdr)) 
+                        != sizeof(struct Elf32_Ehdr)) 
     {
-        occupy_pages = 1;
+        return false;
     }
 
-    /* 为进程分配内存 */
-    uint32_t page_idx = 0;
-    uint32_t vaddr_page = vaddr_first_page;
-    
-    while (page_idx < occupy_pages) 
+    /* 校验elf头 */
+    if (memcmp(elf_header->e_ident, "\177ELF\1\1\1", 7) \
+        || elf_header->e_type != 2 \
+        || elf_header->e_machine != 3 \
+        || elf_header->e_version != 1 \
+        || elf_header->e_phnum > 1024 \
+        || elf_header->e_phentsize != sizeof(struct Elf32_Phdr)) 
     {
-        uint32_t* pde = get_pde(vaddr_page);
-        uint32_t* pte = get_pte(vaddr_page);
+        return false;
+    }
+    return true;
+}
+
+/* 检查可加载段是否落在用户空间内，放得下文件中的内容 */
+static bool segment_check(struct task_struct* cur,
+                struct Elf32_Phdr* prog_header)
+{
+    uint32_t start = prog_header->p_vaddr;
+    uint32_t end = start + prog_header->p_memsz;
+    return prog_header->p_filesz <= prog_header->p_memsz \
+        && start >= cur->user_vaddr.vm_start \
+        && end > start && end <= 0xc0000000;
+}
 
-        /* 如果pde不存在,或者pte不存在就分配内存。
-        * pde的判断要在pte之前，否则pde若不存在会导致
-        * 判断pte时缺页异常 */
-        if (!(*pde & 0x00000001) || !(*pte & 0x00000001)) 
+/* 去掉原来程序的堆
+ * 区域已经去掉，位图中剩下的不共享的页就是堆的arena，
+ * 内存块描述符的空闲链表指向这些页，要一起重置
+ */
+static void heap_release(struct task_struct* cur)
+{
+    struct task_struct* leader = cur->group_leader;
+    uint32_t idx;
+    for (idx = 0; idx < leader->user_vaddr.bm.len * 8; idx++)
+    {
+        if (!bit_true(&leader->user_vaddr.bm, idx))
         {
-            if (get_a_page(PF_USER, vaddr_page) == NULL)
-            {
-                    return false;
-            }
-        } 
-        /* 如果原进程的页表已经分配了，利用现有的物理页，直接覆盖进程体 */
-        
-        vaddr_page += PG_SIZE;
-        page_idx++;
-    }
-    sys_lseek(fd, offset, SEEK_SET);
-    sys_read(fd, (void*)vaddr, filesz);
-    
-    return true;
+            continue;
+        }
+        uint32_t vaddr = idx * PG_SIZE + leader->user_vaddr.vm_start;
+        if (user_page_mapped(vaddr) && !(*get_pte(vaddr) & PG_SHARED))
+        {
+            mfree_page(PF_USER, (void*)vaddr, 1);
+        }
+    }
+    block_desc_init(leader->u_block_desc);
 }
 
-/* 从文件系统上加载用户程序pathname，成功则返回程序的起始地址，否则返回-1 */
-static int32_t load(const char* pathname) 
+/* 从文件系统上加载用户程序pathname，成功则返回程序的起始地址，否则返回-1
+ * 程序头全部读入并校验通过后才去掉原来的程序，此后再失败时released置为true，
+ * 调用者已无法返回原来的程序
+ */
+static int32_t load(const char* pathname, bool* released) 
 {
     int32_t ret = -1;
     struct Elf32_Ehdr elf_header;
-    struct Elf32_Phdr prog_header;
-    memset(&elf_header, 0, sizeof(struct Elf32_Ehdr));
+    struct Elf32_Phdr* prog_headers = NULL;
 
+    *released = false;
     int32_t fd = sys_open(pathname, O_RDONLY);
     if (fd == -1) 
     {
         return -1;
     }
 
-    if (sys_read(fd, &elf_header, sizeof(struct Elf32_Ehdr)) 
-                        != sizeof(struct Elf32_Ehdr)) 
+    if (!elf_read_header(fd, &elf_header)) 
     {
-        ret = -1;
         goto done;
     }
 
-    /* 校验elf头 */
-    if (memcmp(elf_header.e_ident, "\177ELF\1\1\1", 7) \
-        || elf_header.e_type != 2 \
-        || elf_header.e_machine != 3 \
-        || elf_header.e_version != 1 \
-        || elf_header.e_phnum > 1024 \
-        || elf_header.e_phentsize != sizeof(struct Elf32_Phdr)) 
+    /* 先读入全部程序头 */
+    uint32_t size = elf_header.e_phnum * sizeof(struct Elf32_Phdr);
+    if (size == 0)
     {
-       ret = -1;
-       goto done;
+        goto done;
     }
-
-    Elf32_Off prog_header_offset = elf_header.e_phoff; 
-    Elf32_Half prog_header_size = elf_header.e_phentsize;
-
-    /* 遍历所有程序头 */
-    uint32_t prog_idx = 0;
-    while (prog_idx < elf_header.e_phnum) 
+    prog_headers = kmalloc(size);
+    if (prog_headers == NULL)
     {
-        memset(&prog_header, 0, prog_header_size);
-
-        /* 将文件的指针定位到程序头 */
-        sys_lseek(fd, prog_header_offset, SEEK_SET);
+        goto done;
+    }
+    sys_lseek(fd, elf_header.e_phoff, SEEK_SET);
+    if (sys_read(fd, prog_headers, size) != (int32_t)size) 
+    {
+        goto done;
+    }
 
-        /* 只获取程序头 */
-        if (sys_read(fd, &prog_header, prog_header_size) != prog_header_size) 
+    /* 校验全部可加载段 */
+    struct task_struct* cur = running_thread();
+    uint32_t prog_idx;
+    for (prog_idx = 0; prog_idx < elf_header.e_phnum; prog_idx++)
+    {
+        struct Elf32_Phdr* prog_header = &prog_headers[prog_idx];
+        if (PT_LOAD == prog_header->p_type && prog_header->p_memsz > 0 &&
+                !segment_check(cur, prog_header))
         {
-            ret = -1;
             goto done;
         }
+    }
+
+    /* 原来程序的区域和堆不再有效，新的段按需从此文件读入 */
+    struct inode* inode = 
+        file_table[cur->group_leader->fd_table[fd]].fd_inode;
+    vma_release(cur->group_leader, true);
+    heap_release(cur);
+    *released = true;
 
-        /* 如果是可加载段就调用segment_load加载到内存 */
-        if (PT_LOAD == prog_header.p_type) 
+    /* 如果是可加载段就调用segment_load记录下来 */
+    for (prog_idx = 0; prog_idx < elf_header.e_phnum; prog_idx++)
+    {
+        struct Elf32_Phdr* prog_header = &prog_headers[prog_idx];
+        if (PT_LOAD == prog_header->p_type && prog_header->p_memsz > 0 &&
+                !segment_load(inode, prog_header))
         {
-            if (!segment_load(fd, prog_header.p_offset, 
-                            prog_header.p_filesz, prog_header.p_vaddr))
-            {
-                ret = -1;
-                goto done;
-            }
+            goto done;
         }
-
-        /* 更新下一个程序头的偏移 */
-        prog_header_offset += elf_header.e_phentsize;
-        prog_idx++;
     }
     ret = elf_header.e_entry;
 
 done:
+    if (prog_headers != NULL)
+    {
+        kfree(prog_headers);
+    }
     sys_close(fd);
     return ret;
 }
 
+/* 把argv中的参数串依次复制到buf，连同栈顶的argv数组不超过size字节
+ * 参数个数存入argc，返回参数串的总长度，放不下时返回-1
+ */
+static int32_t copy_args(const char* argv[], char* buf, uint32_t size,
+                uint32_t* argc)
+{
+    uint32_t cnt = 0;
+    uint32_t arg_len = 0;
+    while (argv[cnt])
+    {
+        uint32_t len = strlen(argv[cnt]) + 1;
+        if (arg_len + len + (cnt + 2) * sizeof(char*) > size) 
+        {
+            return -1;
+        }
+        memcpy(buf + arg_len, argv[cnt], len);
+        arg_len += len;
+        cnt++;
+    }
+    *argc = cnt;
+    return arg_len;
+}
+
+/* 为当前进程建立用户栈区域，在栈顶依次放参数串和以NULL结尾的argv数组，
+ * 返回新的argv，用户栈从它之下开始，失败返回NULL
+ */
+static char** push_args(const char* arg_buf, uint32_t arg_len, uint32_t argc)
+{
+    char* str_base = (char*)(USER_STACK_TOP - ((arg_len + 3) & ~3));
+    char** new_argv = (char**)str_base - (argc + 1);
+
+    /* copy_args保证参数不超过一页，总在栈区域之内 */
+    if (vma_add_stack() == -1 || !user_fault_in(new_argv,
+                USER_STACK_TOP - (uint32_t)new_argv, true))
+    {
+        return NULL;
+    }
+    memcpy(str_base, arg_buf, arg_len);
+    uint32_t arg_idx;
+    char* str = str_base;
+    for (arg_idx = 0; arg_idx < argc; arg_idx++)
+    {
+        new_argv[arg_idx] = str;
+        str += strlen(str) + 1;
+    }
+    new_argv[argc] = NULL;
+    return new_argv;
+}
+
 /* 用path指向的程序替换当前进程 */
 int32_t sys_execv(const char* path, const char* argv[]) 
 {
+    /* 同组的其它线程还在原来的程序中运行，不能替换掉它们共用的地址空间
+     * 只剩一个线程时它就是组长，也不会有别的线程再clone出新线程
+     */
+    if (running_thread()->group_leader->nr_threads > 1)
+    {
+        return -1;
+    }
+
+    if (strlen(path) >= MAX_PATH_LEN)
+    {
+        return -1;
+    }
+
+    /* 路径和参数可能在调用者的栈上或会被新程序覆盖的位置，
+     * 先把参数串依次复制到内核缓冲区，再在新程序的栈顶重建argv，
+     * 路径放在缓冲区的末尾，原来的程序去掉后还要用它作进程名
+     */
+    char* arg_buf = get_kernel_pages(1);
+    if (arg_buf == NULL)
+    {
+        return -1;
+    }
+    char* kpath = arg_buf + PG_SIZE - MAX_PATH_LEN;
+    strcpy(kpath, path);
     uint32_t argc = 0;
-    while (argv[argc])
+    int32_t arg_len = copy_args(argv, arg_buf, PG_SIZE - MAX_PATH_LEN, &argc);
+    if (arg_len == -1)
     {
-        argc++;
+        mfree_page(PF_KERNEL, arg_buf, 1);
+        return -1;
     }
-    int32_t entry_point = load(path);     
+
+    bool released;
+    int32_t entry_point = load(kpath, &released);     
     if (entry_point == -1) 
     {  
-        /* 若加载失败则返回-1 */
+        /* 若加载失败则返回-1，原来的程序已不在时只能退出 */
+        mfree_page(PF_KERNEL, arg_buf, 1);
+        if (released)
+        {
+            sys_exit(-1);
+        }
         return -1;
     }
 
+    /* 原来的用户栈已随区域一起去掉，参数放在新栈的顶端 */
+    char** new_argv = push_args(arg_buf, arg_len, argc);
+    if (new_argv == NULL)
+    {
+        /* 原来的程序已不在了，无法返回 */
+        mfree_page(PF_KERNEL, arg_buf, 1);
+        sys_exit(-1);
+    }
+
     struct task_struct* cur = running_thread();
-    
+
     /* 修改进程名 */
-    memcpy(cur->name, path, TASK_NAME_LEN);
+    memcpy(cur->name, kpath, TASK_NAME_LEN);
     cur->name[TASK_NAME_LEN-1] = 0;
+    mfree_page(PF_KERNEL, arg_buf, 1);
+    
+    /* 新程序从默认的浮点状态开始，也没有线程局部存储 */
+    fpu_release(cur);
+    cur->tls = 0;
+
+    /* 等在途的异步读写做完，丢弃原来的环 */
+    ioring_release(cur);
 
     struct intr_stack* intr_0_stack = (struct intr_stack*)
                     ((uint32_t)cur + PG_SIZE - sizeof(struct intr_stack));
     
     /* 参数传递给用户进程 */
-    intr_0_stack->ebx = (int32_t)argv;
+    intr_0_stack->ebx = (int32_t)new_argv;
     intr_0_stack->ecx = argc;
     intr_0_stack->eip = (void*)entry_point;
+    intr_0_stack->gs = 0;
     
-    /* 使新用户进程的栈地址为最高用户空间地址 */
-    intr_0_stack->esp = (void*)0xc0000000;
+    /* 新用户进程的栈从argv数组之下开始 */
+    intr_0_stack->esp = (void*)new_argv;
 
     /* exec不同于fork，为使新进程更快被执行，直接从中断返回 */
     asm volatile ("movl %0, %%esp; jmp intr_exit" \
@@ -222,3 +352,157 @@ int32_t sys_execv(const char* path, const char* argv[])
     return 0;
 }
 
+
+/* spawn交给新进程的参数，放在一个内核页的开头，参数串紧随其后 */
+struct spawn_args
+{
+    char path[MAX_PATH_LEN];
+    uint32_t argc;
+    uint32_t arg_len;
+};
+
+/* spawn出的进程第一次被调度时从这里开始，此时已是它自己的页表
+ * 在自己的地址空间中加载程序、建立用户栈，然后进入用户态
+ */
+static void spawn_start(void* arg)
+{
+    struct spawn_args* sa = arg;
+    struct task_struct* cur = running_thread();
+
+    int32_t entry_point = -1;
+    bool released;
+    if (vdso_map(cur) == 0)
+    {
+        entry_point = load(sa->path, &released);
+    }
+    uint32_t argc = sa->argc;
+    char** new_argv = NULL;
+    if (entry_point != -1)
+    {
+        new_argv = push_args((char*)(sa + 1), sa->arg_len, argc);
+    }
+    mfree_page(PF_KERNEL, sa, 1);
+
+    /* 父进程已检查过elf头，到这里多半是内存不够 */
+    if (new_argv == NULL)
+    {
+        sys_exit(-1);
+    }
+
+    process_enter_user((void*)entry_point, new_argv, new_argv, argc);
+}
+
+/* 检查path是否是可执行的elf文件 */
+static bool elf_check(const char* path)
+{
+    struct Elf32_Ehdr elf_header;
+    int32_t fd = sys_open(path, O_RDONLY);
+    if (fd == -1)
+    {
+        return false;
+    }
+    bool ret = elf_read_header(fd, &elf_header);
+    sys_close(fd);
+    return ret;
+}
+
+/* 不复制当前进程，直接由path指向的程序创建子进程，参数为argv
+ * 子进程的标准输入、输出、错误依次为当前进程的描述符fds[0]、fds[1]、fds[2]，
+ * fds为NULL时沿用当前进程的0、1、2，其余描述符不继承。
+ * 返回子进程的pid，失败返回-1
+ */
+pid_t sys_spawn(const char* path, const char* argv[], const int32_t* fds)
+{
+    struct task_struct* parent = running_thread();
+    struct task_struct* leader = parent->group_leader;
+    if (parent->pgdir == NULL || strlen(path) >= MAX_PATH_LEN)
+    {
+        return -1;
+    }
+
+    /* 子进程的标准输入输出在文件表中的下标 */
+    int32_t std_fds[3];
+    uint32_t i;
+    for (i = 0; i < 3; i++)
+    {
+        int32_t local_fd = (fds != NULL) ? fds[i] : (int32_t)i;
+        if (local_fd < 0 || local_fd >= MAX_FILES_OPEN_PER_PROC ||
+                leader->fd_table[local_fd] < 0)
+        {
+            return -1;
+        }
+        std_fds[i] = leader->fd_table[local_fd];
+    }
+
+    /* 先检查elf头，免得建好进程后才发现加载不了 */
+    if (!elf_check(path))
+    {
+        return -1;
+    }
+
+    /* 参数在当前进程的用户空间中，子进程访问不到，先复制到内核页中 */
+    struct spawn_args* sa = get_kernel_pages(1);
+    if (sa == NULL)
+    {
+        return -1;
+    }
+    strcpy(sa->path, path);
+    int32_t arg_len = copy_args(argv, (char*)(sa + 1),
+                PG_SIZE - sizeof(struct spawn_args), &sa->argc);
+    if (arg_len == -1)
+    {
+        mfree_page(PF_KERNEL, sa, 1);
+        return -1;
+    }
+    sa->arg_len = arg_len;
+
+    struct task_struct* child = get_kernel_pages(1);
+    if (child == NULL)
+    {
+        mfree_page(PF_KERNEL, sa, 1);
+        return -1;
+    }
+
+    /* 进程名是程序的路径，可能比pcb中的名字长 */
+    char name[TASK_NAME_LEN];
+    memcpy(name, sa->path, TASK_NAME_LEN);
+    name[TASK_NAME_LEN - 1] = 0;
+    init_thread(child, name, parent->base_priority);
+
+    create_user_vaddr_bitmap(child);
+    child->pgdir = create_page_dir();
+    if (child->user_vaddr.bm.bits == NULL || child->pgdir == NULL)
+    {
+        if (child->user_vaddr.bm.bits != NULL)
+        {
+            mfree_page(PF_KERNEL, child->user_vaddr.bm.bits,
+                DIV_ROUND_UP((0xc0000000 - USER_VADDR_START) / PG_SIZE / 8,
+                            PG_SIZE));
+        }
+        if (child->pgdir != NULL)
+        {
+            mfree_page(PF_KERNEL, child->pgdir, 1);
+        }
+        pid_free(child->pid);
+        mfree_page(PF_KERNEL, child, 1);
+        mfree_page(PF_KERNEL, sa, 1);
+        return -1;
+    }
+    block_desc_init(child->u_block_desc);
+
+    child->parent_pid = leader->pid;
+    child->cwd_inode_nr = leader->cwd_inode_nr;
+    for (i = 0; i < 3; i++)
+    {
+        child->fd_table[i] = std_fds[i];
+        if (std_fds[i] > stderr_no)
+        {
+            file_get(std_fds[i]);
+        }
+    }
+
+    thread_create(child, spawn_start, sa);
+    thread_all_list_add(child);
+    thread_enqueue(child);
+    return child->pid;
+}
@@ -9,9 +9,53 @@
 #include <thread.h>    
 #include <string.h>
 #include <file.h>
+#include <atomic.h>
+#include <pid.h>
+#include <fpu.h>
+#include <vdso.h>
+#include <ioring.h>
+#include <global.h>
+#include <futex.h>
+#include <wait_exit.h>
+#include <ipc.h>
+#include <vma.h>
 
 extern void intr_exit(void);
 
+/* 复制parent的pcb页给child，并重置不能继承的部分
+ * pcb页中包含parent进入系统调用时的0级栈，child从中断返回时用到
+ */
+static int32_t copy_pcb(struct task_struct * child_thread,
+                struct task_struct * parent_thread)
+{
+    memcpy(child_thread, parent_thread, PG_SIZE);
+    child_thread->pid = pid_alloc();
+    if (child_thread->pid == -1)
+    {
+        return -1;
+    }
+    child_thread->elapsed_ticks = 0;
+    acct_init_task(child_thread);
+    memset(&child_thread->sched, 0, sizeof(struct sched_info));
+    child_thread->status = TASK_READY;
+    child_thread->priority = child_thread->base_priority;
+    child_thread->ticks = child_thread->priority;   /* 为新任务把时间片充满 */
+    child_thread->blocked_on = NULL;
+    list_init(&child_thread->held_locks);
+    child_thread->preempt_count = 0;
+    child_thread->preempt_start_tsc = 0;
+    child_thread->general_tag.prev = child_thread->general_tag.next = NULL;
+    child_thread->all_list_tag.prev = child_thread->all_list_tag.next = NULL;
+    child_thread->pid_tag.prev = child_thread->pid_tag.next = NULL;
+    list_init(&child_thread->vmas);
+    lock_init(&child_thread->vma_lock);
+
+    /* 不继承父任务的环，fork出的子进程中共享页只是一份普通的内存拷贝 */
+    child_thread->ioring = NULL;
+    ipc_tcb_init(&child_thread->ipc);
+    return 0;
+}
+
 /* 将父进程的pcb、虚拟地址位图拷贝给子进程 */
 static int32_t copy_pcb_vaddrbitmap_stack0(
        struct task_struct* child_thread, struct task_struct* parent_thread) 
@@ -19,15 +63,27 @@ static int32_t copy_pcb_vaddrbitmap_stack0(
     /* a.复制pcb所在的整个页，里面包含进程pcb信息及特级0极的栈，
      * 里面包含了返回地址，然后再单独修改个别部分 
      */
-    memcpy(child_thread, parent_thread, PG_SIZE);
-    child_thread->pid = fork_pid();
-    child_thread->elapsed_ticks = 0;
-    child_thread->status = TASK_READY;
-    child_thread->ticks = child_thread->priority;   /* 为新进程把时间片充满 */
-    child_thread->parent_pid = parent_thread->pid;
-    child_thread->general_tag.prev = child_thread->general_tag.next = NULL;
-    child_thread->all_list_tag.prev = child_thread->all_list_tag.next = NULL;
+    if (copy_pcb(child_thread, parent_thread) == -1)
+    {
+        return -1;
+    }
+    child_thread->parent_pid = parent_thread->group_leader->pid;
     block_desc_init(child_thread->u_block_desc);
+
+    /* 从线程fork时，文件描述符和工作目录以组长中的为准，
+     * 子进程自成一个线程组
+     */
+    struct task_struct * leader = parent_thread->group_leader;
+    memcpy(child_thread->fd_table, leader->fd_table,
+                sizeof(child_thread->fd_table));
+    child_thread->cwd_inode_nr = leader->cwd_inode_nr;
+    child_thread->group_leader = child_thread;
+    child_thread->nr_threads = 1;
+
+    if (fpu_fork(child_thread, parent_thread) == -1)
+    {
+        goto free_pid;
+    }
     
     /* b.复制父进程的虚拟地址池的位图 */
     uint32_t bitmap_pg_cnt = 
@@ -35,7 +91,9 @@ static int32_t copy_pcb_vaddrbitmap_stack0(
     
     void* vaddr_btmp = get_kernel_pages(bitmap_pg_cnt);
     if (vaddr_btmp == NULL) 
-        return -1;
+    {
+        goto free_fpu;
+    }
     
     /* 此时child_thread->userprog_vaddr.vaddr_bitmap.bits 
      * 还是指向父进程虚拟地址的位图地址
@@ -47,6 +105,22 @@ static int32_t copy_pcb_vaddrbitmap_stack0(
     child_thread->user_vaddr.bm.bits = vaddr_btmp;
         
     return 0;
+
+free_fpu:
+    fpu_release(child_thread);
+free_pid:
+    pid_free(child_thread->pid);
+    return -1;
+}
+
+/* copy_pcb_vaddrbitmap_stack0之后的步骤失败时，释放它申请的资源 */
+static void release_pcb_vaddrbitmap(struct task_struct* child_thread)
+{
+    uint32_t bitmap_pg_cnt = 
+        DIV_ROUND_UP((0xc0000000 - USER_VADDR_START) / PG_SIZE / 8 , PG_SIZE);
+    mfree_page(PF_KERNEL, child_thread->user_vaddr.bm.bits, bitmap_pg_cnt);
+    fpu_release(child_thread);
+    pid_free(child_thread->pid);
 }
 
 /* 复制子进程的进程体(代码和数据)及用户栈 */
@@ -72,6 +146,29 @@ static void copy_body_stack3(struct task_struct* child_thread,
                 {
                     prog_vaddr = (idx_byte * 8 + idx_bit) * PG_SIZE 
                                                         + vaddr_start;
+
+                    /* 还没有访问过的页由子进程自己缺页读入 */
+                    if (!user_page_mapped(prog_vaddr))
+                    {
+                        idx_bit++;
+                        continue;
+                    }
+
+                    /* 共享页不复制，子进程映射同一个物理页，
+                     * 缓存中的程序页是只读的，子进程也只读
+                     */
+                    uint32_t parent_pte = *get_pte(prog_vaddr);
+                    if (parent_pte & PG_SHARED)
+                    {
+                        uint32_t pg_phy_addr = addr_v2p(prog_vaddr);
+                        page_ref_get(pg_phy_addr);
+                        page_dir_activate(child_thread);
+                        page_map((void *)prog_vaddr, (void *)pg_phy_addr,
+                                    PG_US_U | (parent_pte & PG_RW_W) | PG_SHARED);
+                        page_dir_activate(parent_thread);
+                        idx_bit++;
+                        continue;
+                    }
                     
                     /* 下面的操作是将父进程用户空间中的数据通过
                      * 内核空间做中转，最终复制到子进程的用户空间 
@@ -90,8 +187,14 @@ static void copy_body_stack3(struct task_struct* child_thread,
                     /* c.申请虚拟地址prog_vaddr */
                     get_a_page_without_opvaddrbitmap(PF_USER, prog_vaddr);
 
-                    /* d.从内核缓冲区中将父进程数据复制到子进程的用户空间 */
+                    /* d.从内核缓冲区中将父进程数据复制到子进程的用户空间，
+                     * 只读的页复制后同样设为只读
+                     */
                     memcpy((void*)prog_vaddr, buf_page, PG_SIZE);
+                    if (!(parent_pte & PG_RW_W))
+                    {
+                        *get_pte(prog_vaddr) &= ~PG_RW_W;
+                    }
 
                     /* e.恢复父进程页表 */
                     page_dir_activate(parent_thread);
@@ -103,6 +206,19 @@ static void copy_body_stack3(struct task_struct* child_thread,
     }
 }
 
+/* 子进程第一次被调度上cpu时，switch_to返回到这里
+ * 先释放schedule中持有的就绪队列锁，再经intr_exit返回用户态
+ */
+static void fork_child_ret(void)
+{
+    schedule_tail();
+
+    struct intr_stack * intr_0_stack = (struct intr_stack *)
+            ((uint32_t)running_thread() + PG_SIZE - sizeof(struct intr_stack));
+    asm volatile ("movl %0, %%esp; jmp intr_exit" \
+                : : "g"(intr_0_stack) : "memory");
+}
+
 /* 为子进程构建thread_stack和修改返回值 */
 static int32_t build_child_stack(struct task_struct* child_thread)
 {
@@ -131,8 +247,8 @@ static int32_t build_child_stack(struct task_struct* child_thread)
      */
     uint32_t* ebp_ptr_in_thread_stack = (uint32_t*)intr_0_stack - 5; 
 
-    /* switch_to的返回地址更新为intr_exit，直接从中断返回 */
-    *ret_addr_in_thread_stack = (uint32_t)intr_exit;
+    /* switch_to的返回地址更新为fork_child_ret，再从中断返回 */
+    *ret_addr_in_thread_stack = (uint32_t)fork_child_ret;
 
     /* 下面这两行赋值只是为了使构建的thread_stack更加清晰,其实也不需要，
      * 因为在进入intr_exit后一系列的pop会把寄存器中的数据覆盖 
@@ -146,17 +262,19 @@ static int32_t build_child_stack(struct task_struct* child_thread)
     return 0;
 }
 
-/* 更新inode打开数 */
-static void update_inode_open_cnts(struct task_struct* thread) 
+/* 子进程复制了文件描述符，父子进程共用文件表中的项，增加其引用数
+ * 标准输入输出可能已重定向到管道或文件，也要算上
+ */
+static void update_fd_refs(struct task_struct* thread) 
 {
-    int32_t local_fd = 3, global_fd = 0;
+    int32_t local_fd = 0, global_fd = 0;
     while (local_fd < MAX_FILES_OPEN_PER_PROC) 
     {
         global_fd = thread->fd_table[local_fd];
         kassert(global_fd < MAX_FILE_OPEN);
-        if (global_fd != -1) 
+        if (global_fd > stderr_no) 
         {
-            file_table[global_fd].fd_inode->i_open_cnts++;
+            file_get(global_fd);
         }
         local_fd++;
     }
@@ -176,14 +294,32 @@ static int32_t copy_process(struct task_struct* child_thread,
     /* a.复制父进程的pcb、虚拟地址位图、内核栈到子进程 */
     if (copy_pcb_vaddrbitmap_stack0(child_thread, parent_thread) == -1) 
     {
-        return -1;
+        goto free_buf;
+    }
+
+    /* 复制按需映射的区域，失败时已复制的部分留在子进程中，一起释放 */
+    if (vma_copy(child_thread, parent_thread) == -1)
+    {
+        goto free_vmas;
     }
 
     /* b.为子进程创建页表，此页表仅包括内核空间 */
     child_thread->pgdir = create_page_dir();
     if(child_thread->pgdir == NULL) 
     {
-        return -1;
+        goto free_vmas;
+    }
+
+    /* 数据页不在虚拟地址位图中，不会被复制，
+     * 子进程的pid不同，要在它的页表中重新映射。
+     * 在复制进程体之前做，失败时子进程的页表中还没有用户页
+     */
+    page_dir_activate(child_thread);
+    int32_t ret = vdso_map(child_thread);
+    page_dir_activate(parent_thread);
+    if (ret == -1)
+    {
+        goto free_pgdir;
     }
 
     /* c.复制父进程进程体及用户栈给子进程 */
@@ -192,11 +328,21 @@ static int32_t copy_process(struct task_struct* child_thread,
     /* d.构建子进程thread_stack和修改返回值pid */
     build_child_stack(child_thread);
 
-    /* e.更新文件inode的打开数 */
-    update_inode_open_cnts(child_thread);
+    /* e.增加文件表中各项的引用数 */
+    update_fd_refs(child_thread);
 
     mfree_page(PF_KERNEL, buf_page, 1);
     return 0;
+
+free_pgdir:
+    mfree_page(PF_KERNEL, child_thread->pgdir, 1);
+    child_thread->pgdir = NULL;
+free_vmas:
+    vma_release(child_thread, false);
+    release_pcb_vaddrbitmap(child_thread);
+free_buf:
+    mfree_page(PF_KERNEL, buf_page, 1);
+    return -1;
 }
 
 /* fork子进程,内核线程不可直接调用 */
@@ -214,16 +360,96 @@ pid_t sys_fork(void)
 
     if (copy_process(child_thread, parent_thread) == -1) 
     {
+        mfree_page(PF_KERNEL, child_thread, 1);
         return -1;
     }
 
     /* 添加到就绪线程队列和所有线程队列，子进程由调试器安排运行 */
-    kassert(!elem_find(&thread_ready_list, &child_thread->general_tag));
-    list_append(&thread_ready_list, &child_thread->general_tag);
-    
-    kassert(!elem_find(&thread_all_list, &child_thread->all_list_tag));
-    list_append(&thread_all_list, &child_thread->all_list_tag);
+    thread_all_list_add(child_thread);
+    thread_enqueue(child_thread);
 
     return child_thread->pid;    /* 父进程返回子进程的pid */
 }
 
+/* 创建与当前进程共享页表、虚拟地址空间、文件描述符和堆的线程
+ * 新线程在用户态从entry开始执行，esp为stack，线程局部存储的基址为tls，
+ * 调用者要事先在stack处放好entry的返回地址和参数。
+ * 返回新线程的pid，失败返回-1
+ */
+pid_t sys_clone(void * entry, void * stack, void * tls)
+{
+    struct task_struct * parent_thread = running_thread();
+    if (parent_thread->pgdir == NULL || entry == NULL || stack == NULL)
+    {
+        return -1;
+    }
+
+    /* 顺便回收之前退出的线程 */
+    thread_reap_dead();
+
+    struct task_struct * child_thread = get_kernel_pages(1);
+    if (child_thread == NULL)
+    {
+        return -1;
+    }
+    if (copy_pcb(child_thread, parent_thread) == -1)
+    {
+        mfree_page(PF_KERNEL, child_thread, 1);
+        return -1;
+    }
+
+    /* 父进程、页表、虚拟地址位图、组长都沿用复制来的，
+     * 新线程从默认的浮点状态开始
+     */
+    child_thread->fpu = NULL;
+    child_thread->fpu_used = false;
+    child_thread->tls = (uint32_t)tls;
+    atomic_inc(&child_thread->group_leader->nr_threads);
+
+    /* 从中断返回时直接进入entry，gs指向自己的线程局部存储 */
+    struct intr_stack * intr_0_stack = (struct intr_stack *)
+            ((uint32_t)child_thread + PG_SIZE - sizeof(struct intr_stack));
+    intr_0_stack->eip = entry;
+    intr_0_stack->esp = stack;
+    intr_0_stack->gs = (tls != NULL) ? SELECTOR_U_TLS : 0;
+    build_child_stack(child_thread);
+
+    thread_all_list_add(child_thread);
+    thread_enqueue(child_thread);
+    return child_thread->pid;
+}
+
+/* 当前线程退出，不再返回
+ * done不为NULL时向其中写入1并唤醒在它上面等待的线程，
+ * 此后线程不再使用自己的用户栈，等待它的线程看到后就可以释放这个栈
+ */
+void sys_thread_exit(volatile uint32_t * done)
+{
+    struct task_struct * cur = running_thread();
+
+    /* 组长的pcb中有同组线程共用的文件描述符、内存块描述符，
+     * 组长退出就是进程退出，等其它线程都结束后再回收
+     */
+    if (cur == cur->group_leader)
+    {
+        if (done != NULL)
+        {
+            *done = 1;
+            futex_wake(done, 1);
+        }
+        sys_exit(0);
+    }
+
+    ipc_exit(cur);
+    ioring_release(cur);
+    fpu_release(cur);
+
+    if (done != NULL)
+    {
+        *done = 1;
+        futex_wake(done, 1);
+    }
+
+    /* 换下cpu后由schedule_tail减少组的线程数 */
+    thread_exit_current();
+}
@@ -0,0 +1,164 @@
+/* image_cache.c
+ *   可执行文件只读页的缓存
+ *
+ * 缓存中的物理页是共享页，缓存自己持有一个映射数，
+ * 进程映射时加1，进程退出或exec时减1，因此进程都结束后页仍留在缓存中。
+ * 文件被写或删除时丢掉它的所有页，已映射的进程继续用原来的页，
+ * 它们都结束后页才被释放
+ */
+
+#include <image_cache.h>
+#include <memory.h>
+#include <list.h>
+#include <spinlock.h>
+#include <interrupt.h>
+#include <debug.h>
+#include <global.h>
+
+#define IMAGE_HASH_BITS     6
+#define IMAGE_HASH_SIZE     (1 << IMAGE_HASH_BITS)
+
+/* 缓存的一页 */
+struct image_page
+{
+    struct node tag;        /* 在散列桶中的结点 */
+    uint32_t i_no;          /* 所属文件的inode编号 */
+    uint32_t vaddr;         /* 页在进程中的虚拟地址 */
+    uint32_t pg_phy_addr;
+};
+
+static struct list image_hash[IMAGE_HASH_SIZE];
+static uint32_t image_pages;        /* 缓存中的页数 */
+
+/* 每次丢掉缓存页时加1，读入页之前取得的值已过时的，不能再加入缓存 */
+static volatile uint32_t image_gen;
+static struct spinlock image_lock;  /* 保护散列表和image_pages */
+
+static struct list * image_bucket(uint32_t i_no, uint32_t vaddr)
+{
+    uint32_t key = (vaddr >> 12) ^ (i_no * 0x9e3779b1);
+    return &image_hash[(key * 0x9e3779b1) >> (32 - IMAGE_HASH_BITS)];
+}
+
+/* 调用时已持有image_lock */
+static struct image_page * image_find(uint32_t i_no, uint32_t vaddr)
+{
+    struct list * bucket = image_bucket(i_no, vaddr);
+    struct node * elem = bucket->head.next;
+    while (elem != &bucket->tail)
+    {
+        struct image_page * ip = container_of(struct image_page, tag, elem);
+        if (ip->i_no == i_no && ip->vaddr == vaddr)
+        {
+            return ip;
+        }
+        elem = elem->next;
+    }
+    return NULL;
+}
+
+/* 查找文件i_no映射在vaddr处的页，找到时映射数加1，返回其物理地址，
+ * 调用者用这个映射数把它映射进进程。没有缓存时返回0
+ */
+uint32_t image_cache_get(uint32_t i_no, uint32_t vaddr)
+{
+    uint32_t pg_phy_addr = 0;
+
+    intr_status old_status = spin_lock_irqsave(&image_lock);
+    struct image_page * ip = image_find(i_no, vaddr);
+    if (ip != NULL)
+    {
+        pg_phy_addr = ip->pg_phy_addr;
+        page_ref_get(pg_phy_addr);
+    }
+    spin_unlock_irqrestore(&image_lock, old_status);
+    return pg_phy_addr;
+}
+
+/* 读入要加入缓存的页之前调用，取得当前的代数 */
+uint32_t image_cache_gen(void)
+{
+    return image_gen;
+}
+
+/* 把刚读入的共享页pg_phy_addr作为文件i_no在vaddr处的页加入缓存，
+ * gen为读入前取得的代数，读的过程中文件被写过时页可能已过时，
+ * 此时与已有缓存或缓存已满时一样什么都不做
+ */
+void image_cache_add(uint32_t i_no, uint32_t vaddr, uint32_t pg_phy_addr,
+                uint32_t gen)
+{
+    /* kmalloc可能睡眠，在加锁之前分配 */
+    struct image_page * ip = kmalloc(sizeof(struct image_page));
+    if (ip == NULL)
+    {
+        return;
+    }
+    ip->i_no = i_no;
+    ip->vaddr = vaddr;
+    ip->pg_phy_addr = pg_phy_addr;
+
+    intr_status old_status = spin_lock_irqsave(&image_lock);
+    if (gen != image_gen || image_pages >= IMAGE_CACHE_MAX ||
+            image_find(i_no, vaddr) != NULL)
+    {
+        spin_unlock_irqrestore(&image_lock, old_status);
+        kfree(ip);
+        return;
+    }
+    page_ref_get(pg_phy_addr);
+    list_append(image_bucket(i_no, vaddr), &ip->tag);
+    image_pages++;
+    spin_unlock_irqrestore(&image_lock, old_status);
+}
+
+/* 丢掉文件i_no的所有缓存页，文件被写或删除时调用 */
+void image_cache_invalidate(uint32_t i_no)
+{
+    struct list dropped;
+    list_init(&dropped);
+
+    intr_status old_status = spin_lock_irqsave(&image_lock);
+    image_gen++;
+    uint32_t i;
+    for (i = 0; i < IMAGE_HASH_SIZE; i++)
+    {
+        struct node * elem = image_hash[i].head.next;
+        while (elem != &image_hash[i].tail)
+        {
+            struct node * next = elem->next;
+            if (container_of(struct image_page, tag, elem)->i_no == i_no)
+            {
+                list_remove(elem);
+                list_append(&dropped, elem);
+                image_pages--;
+            }
+            elem = next;
+        }
+    }
+    spin_unlock_irqrestore(&image_lock, old_status);
+
+    /* 没有进程映射着的页现在就释放 */
+    while (!list_empty(&dropped))
+    {
+        struct image_page * ip = container_of(struct image_page, tag,
+                    list_pop(&dropped));
+        if (page_ref_put(ip->pg_phy_addr) == 0)
+        {
+            pfree(ip->pg_phy_addr);
+        }
+        kfree(ip);
+    }
+}
+
+void image_cache_init(void)
+{
+    uint32_t i;
+    for (i = 0; i < IMAGE_HASH_SIZE; i++)
+    {
+        list_init(&image_hash[i]);
+    }
+    image_pages = 0;
+    image_gen = 0;
+    spin_init(&image_lock);
+}
@@ -11,6 +11,8 @@
 #include <interrupt.h>
 #include <string.h>
 #include <printk.h>
+#include <vdso.h>
+#include <vma.h>
 
 extern void intr_exit(void);
 
@@ -21,19 +23,38 @@ void start_process(void * filename_)
 {
     void * function = filename_;
     struct task_struct * cur = running_thread();
-    /* 使指针self_kstack跨过线程线程，指向中断栈，
-     * 保存用户进程的上下文环境
-     */
-    cur->self_kstack += sizeof(struct thread_stack);
-    struct intr_stack * proc_stack =
-                        (struct intr_stack *)cur->self_kstack;
+
+    /* 此时已是进程自己的页表，映射只读的数据页 */
+    if (vdso_map(cur) == -1)
+    {
+        PANIC("start_process: vdso_map failed\n");
+    }
+
+    /* 特权级3的栈只建立区域，esp指向栈的上边界，用到时才缺页分配 */
+    if (vma_add_stack() == -1)
+    {
+        PANIC("start_process: vma_add_stack failed\n");
+    }
+    process_enter_user(function, (void *)USER_STACK_TOP, NULL, 0);
+}
+
+/* 构建用户进程的中断栈，从中断返回进入用户态，不再返回
+ * 从entry开始执行，用户栈顶为esp，ebx和ecx分别传递argv和argc
+ */
+void process_enter_user(void * entry, void * esp, char ** argv, uint32_t argc)
+{
+    struct task_struct * cur = running_thread();
+
+    /* 中断栈在pcb页的顶端，保存用户进程的上下文环境 */
+    struct intr_stack * proc_stack = (struct intr_stack *)
+                ((uint32_t)cur + PG_SIZE - sizeof(struct intr_stack));
     proc_stack->edi = 0;
     proc_stack->esi = 0;
     proc_stack->ebp = 0;
     proc_stack->esp_dummy = 0;
-    proc_stack->ebx = 0;
+    proc_stack->ebx = (uint32_t)argv;
     proc_stack->edx = 0;
-    proc_stack->ecx = 0;
+    proc_stack->ecx = argc;
     proc_stack->eax = 0;
 
     /* 用户态用不上显存段，直接初始为0 */
@@ -43,13 +64,10 @@ void start_process(void * filename_)
     proc_stack->fs = SELECTOR_U_DATA;
 
     /* 待执行的用户程序地址 */
-    proc_stack->eip = function;
+    proc_stack->eip = entry;
     proc_stack->cs = SELECTOR_U_CODE;
     proc_stack->eflags = (EFLAGS_IOPL_0 | EFLAGS_MBS | EFLAGS_IF_1);
-
-    /* 先获取特权级3的栈的下边界地址，再将esp指向栈的上边界 */
-    proc_stack->esp = (void *)((uint32_t)get_a_page(PF_USER, \
-                    USER_STACK3_VADDR) + PG_SIZE);
+    proc_stack->esp = esp;
     proc_stack->ss = SELECTOR_U_DATA;
     asm volatile ("movl %0, %%esp; jmp intr_exit" \
                 : : "g"(proc_stack) : "memory");
@@ -73,6 +91,14 @@ void page_dir_activate(struct task_struct * pthread)
         pagedir_phy_addr = addr_v2p((uint32_t)pthread->pgdir);
     }
 
+    /* 同一进程的线程共用页表，cr3不变时不重新加载，免得白白刷新快表 */
+    uint32_t cr3;
+    asm volatile ("movl %%cr3, %0" : "=r"(cr3));
+    if (cr3 == pagedir_phy_addr)
+    {
+        return;
+    }
+
     /* 更新页目录寄存器cr3，使新页表生效 */
     asm volatile ("movl %0, %%cr3" : : "r"(pagedir_phy_addr) : "memory");
 }
@@ -92,6 +118,7 @@ void process_activate(struct task_struct * pthread)
     {
         /* 更新该进程的esp0，用于此进程被中断时保留上下文 */
         update_tss_esp(pthread);
+        tls_switch(pthread);
     }
 }
 
@@ -152,11 +179,6 @@ void process_execute(void *filename, char *name)
     /* 初始化用户进程内存块描述符 */
     block_desc_init(thread->u_block_desc);
 
-    intr_status old_status = intr_disable();
-    kassert(!elem_find(&thread_ready_list, &thread->general_tag));
-    list_append(&thread_ready_list, &thread->general_tag);
-
-    kassert(!elem_find(&thread_all_list, &thread->all_list_tag));
-    list_append(&thread_all_list, &thread->all_list_tag);
-    intr_set_status(old_status);
+    thread_all_list_add(thread);
+    thread_enqueue(thread);
 }
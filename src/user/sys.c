@@ -11,20 +11,46 @@
 #include <fs.h>
 #include <fork.h>
 #include <exec.h>
+#include <softirq.h>
+#include <trace.h>
+#include <acct.h>
+#include <schedstat.h>
+#include <timer.h>
+#include <tss.h>
+#include <ioring.h>
+#include <futex.h>
+#include <wait_exit.h>
+#include <pipe.h>
+#include <shm.h>
+#include <ipc.h>
+#include <poll.h>
+#include <tty.h>
 
 /* 系统调用子功能个数 */
-#define syscall_nr 32
+#define syscall_nr 64
 
 typedef void * syscall;
 
 syscall syscall_table[syscall_nr];
 
-/* 返回当前任务的pid */
+/* 返回当前进程的pid，即线程组组长的pid */
 uint32_t sys_getpid(void)
+{
+    return running_thread()->group_leader->pid;
+}
+
+/* 返回当前线程自己的pid */
+uint32_t sys_gettid(void)
 {
     return running_thread()->pid;
 }
 
+/* 返回父进程的pid */
+int16_t sys_getppid(void)
+{
+    return running_thread()->parent_pid;
+}
+
 /* 初始化系统调用 */
 void syscall_init(void)
 {
@@ -53,6 +79,33 @@ void syscall_init(void)
     syscall_table[SYS_STAT]	    = sys_stat;
     syscall_table[SYS_PS]	    = sys_ps;
     syscall_table[SYS_EXECV]	 = sys_execv;
+    syscall_table[SYS_IRQSTAT]	 = sys_irqstat;
+    syscall_table[SYS_LATENCY]	 = sys_latency;
+    syscall_table[SYS_GETRUSAGE] = sys_getrusage;
+    syscall_table[SYS_TIMES]	 = sys_times;
+    syscall_table[SYS_SCHEDSTAT] = sys_schedstat;
+    syscall_table[SYS_SLEEP]	 = sys_sleep;
+    syscall_table[SYS_FASTCALL]	 = sys_fastcall;
+    syscall_table[SYS_RING_SETUP] = sys_ring_setup;
+    syscall_table[SYS_RING_ENTER] = sys_ring_enter;
+    syscall_table[SYS_GETPPID]	 = sys_getppid;
+    syscall_table[SYS_CLONE]	 = sys_clone;
+    syscall_table[SYS_THREAD_EXIT] = sys_thread_exit;
+    syscall_table[SYS_GETTID]	 = sys_gettid;
+    syscall_table[SYS_SCHED_YIELD] = thread_yield;
+    syscall_table[SYS_FUTEX]	 = sys_futex;
+    syscall_table[SYS_MMAP_SHARED] = sys_mmap_shared;
+    syscall_table[SYS_EXIT]	 = sys_exit;
+    syscall_table[SYS_WAIT]	 = sys_wait;
+    syscall_table[SYS_PIPE]	 = sys_pipe;
+    syscall_table[SYS_DUP2]	 = sys_dup2;
+    syscall_table[SYS_SHM_OPEN]	 = sys_shm_open;
+    syscall_table[SYS_SHM_MAP]	 = sys_shm_map;
+    syscall_table[SYS_SHM_UNMAP]	 = sys_shm_unmap;
+    syscall_table[SYS_IPC]	 = sys_ipc;
+    syscall_table[SYS_POLL]	 = sys_poll;
+    syscall_table[SYS_TTY_MODE]	 = sys_tty_mode;
+    syscall_table[SYS_SPAWN]	 = sys_spawn;
     
     put_str("ok\n");
 }
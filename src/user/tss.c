@@ -6,6 +6,10 @@
 #include <global.h>
 #include <string.h>
 #include <print.h>
+#include <smp.h>
+#include <msr.h>
+
+#define GDT_DESC_NR     12  /* gdt中描述符的个数 */
 
 /* 任务状态段tss结构 */
 struct tss {
@@ -38,12 +42,25 @@ struct tss {
     uint32_t io_base;
 };
 
-static struct tss tss;
+/* 每个cpu各有一个tss，处理器从用户态进入中断时使用本cpu的tss */
+static struct tss tss[MAX_CPUS];
+
+/* AP的gdt，内容和BSP的相同，只有tss描述符指向各自的tss，
+ * BSP沿用loader在0x900处建立的gdt
+ */
+static struct gdt_desc ap_gdt[MAX_CPUS][GDT_DESC_NR];
+
+static bool sysenter_ok;    /* 是否支持sysenter/sysexit */
+
+/* 各cpu的TLS描述符当前的段基址，和要切换的线程相同时不必重写 */
+static uint32_t cpu_tls[MAX_CPUS];
+
+extern void sysenter_entry(void);
 
-/* 更新tss中esp0字段的值为pthread的0级线程 */
+/* 更新本cpu的tss中esp0字段的值为pthread的0级线程 */
 void update_tss_esp(struct task_struct * pthread)
 {
-    tss.esp0 = (uint32_t *)((uint32_t)pthread + PG_SIZE);
+    tss[this_cpu()->id].esp0 = (uint32_t *)((uint32_t)pthread + PG_SIZE);
 }
 
 /* 创建gdt描述符 */
@@ -64,20 +81,86 @@ static struct gdt_desc make_gdt_desc(uint32_t * desc_addr,
     return desc;
 }
 
+/* 返回第cpu_id个cpu正在使用的gdt */
+static struct gdt_desc * cpu_gdt(uint8_t cpu_id)
+{
+    return (cpu_id == 0) ? (struct gdt_desc *)0xc0000900 : ap_gdt[cpu_id];
+}
+
+/* 切换到用户任务pthread之前调用，把本cpu的TLS描述符的基址改为它的tls
+ * 描述符只在加载gs时读取，回到用户态时intr_exit或sysexit之前会重新加载gs
+ */
+void tls_switch(struct task_struct * pthread)
+{
+    uint8_t cpu_id = this_cpu()->id;
+    if (cpu_tls[cpu_id] == pthread->tls)
+    {
+        return;
+    }
+    cpu_tls[cpu_id] = pthread->tls;
+    cpu_gdt(cpu_id)[GDT_TLS_IDX] = make_gdt_desc((uint32_t *)pthread->tls,
+                    0xfffff, GDT_DATA_ATTR_LOW_DPL3, GDT_ATTR_HIGH);
+}
+
+/* 初始化tss t */
+static void tss_setup(struct tss * t)
+{
+    memset(t, 0, sizeof(*t));
+    t->ss0     = SELECTOR_K_STACK;
+    t->io_base = sizeof(*t);
+}
+
+/* 检测处理器是否支持sysenter/sysexit */
+static bool sysenter_detect(void)
+{
+    uint32_t eax = 1, ebx, ecx, edx;
+    asm volatile ("cpuid"
+                : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+
+    /* Pentium Pro报告了SEP位却不支持，见Intel手册对cpuid的说明 */
+    uint32_t family = (eax >> 8) & 0xf;
+    uint32_t model = (eax >> 4) & 0xf;
+    uint32_t stepping = eax & 0xf;
+    if (family == 6 && model < 3 && stepping < 3)
+    {
+        return false;
+    }
+    return (edx & (1 << 11)) != 0;
+}
+
+/* 设置本cpu的sysenter入口
+ * esp指向本cpu的tss，入口代码从中取出当前任务的内核栈，
+ * 这样任务切换时只需更新tss.esp0，不必每次都写MSR
+ */
+static void sysenter_cpu_init(uint8_t cpu_id)
+{
+    if (!sysenter_ok)
+    {
+        return;
+    }
+    wrmsr(MSR_SYSENTER_CS, SELECTOR_SYSENTER_CS);
+    wrmsr(MSR_SYSENTER_ESP, (uint32_t)&tss[cpu_id]);
+    wrmsr(MSR_SYSENTER_EIP, (uint32_t)sysenter_entry);
+}
+
+/* 返回是否可以用sysenter进行系统调用，供用户态的系统调用桩查询 */
+int32_t sys_fastcall(void)
+{
+    return sysenter_ok ? 1 : 0;
+}
+
 /* 在gdt中创建tss并重新加载gdt */
 void tss_init(void)
 {
     put_str("tss_init ... ");
 
-    uint32_t tss_size = sizeof(tss);
-    memset(&tss, 0, tss_size);
-    tss.ss0     = SELECTOR_K_STACK;
-    tss.io_base = tss_size;
+    uint32_t tss_size = sizeof(struct tss);
+    tss_setup(&tss[0]);
 
     /* gdt段基址为0x900，把tss放到第4个位置，也就是0x900+0x20的位置 */
 
     /* 在gdt中添加dpl为0的TSS描述符 */
-    *((struct gdt_desc*)0xc0000920) = make_gdt_desc((uint32_t*)&tss, \
+    *((struct gdt_desc*)0xc0000920) = make_gdt_desc((uint32_t*)&tss[0], \
                     tss_size - 1, TSS_ATTR_LOW, TSS_ATTR_HIGH);
 
     /* 在gdt中添加dpl为3的数据段和代码段描述符 
@@ -88,14 +171,54 @@ void tss_init(void)
     *((struct gdt_desc*)0xc0000930) = make_gdt_desc((uint32_t*)0, \
                     0xfffff, GDT_DATA_ATTR_LOW_DPL3, GDT_ATTR_HIGH);
 
+    /* sysenter/sysexit使用的4个描述符 */
+    *((struct gdt_desc*)0xc0000938) = make_gdt_desc((uint32_t*)0, \
+                    0xfffff, GDT_CODE_ATTR_LOW_DPL0, GDT_ATTR_HIGH);
+    *((struct gdt_desc*)0xc0000940) = make_gdt_desc((uint32_t*)0, \
+                    0xfffff, GDT_DATA_ATTR_LOW_DPL0, GDT_ATTR_HIGH);
+    *((struct gdt_desc*)0xc0000948) = make_gdt_desc((uint32_t*)0, \
+                    0xfffff, GDT_CODE_ATTR_LOW_DPL3, GDT_ATTR_HIGH);
+    *((struct gdt_desc*)0xc0000950) = make_gdt_desc((uint32_t*)0, \
+                    0xfffff, GDT_DATA_ATTR_LOW_DPL3, GDT_ATTR_HIGH);
+
+    /* 线程局部存储的描述符，基址随线程切换 */
+    *((struct gdt_desc*)0xc0000958) = make_gdt_desc((uint32_t*)0, \
+                    0xfffff, GDT_DATA_ATTR_LOW_DPL3, GDT_ATTR_HIGH);
+
     /* 重新加载GDT 
      * gdt 16位的limit 和 32位的段基址 
-     * 7个描述符大小
+     * GDT_DESC_NR个描述符大小，loader在0x900处预留了足够的空位
      */
-    uint64_t gdt_operand = ((8 * 7 - 1) | \
+    uint64_t gdt_operand = ((8 * GDT_DESC_NR - 1) | \
                 (((uint64_t)(uint32_t)0xc0000900) << 16)); 
     asm volatile ("lgdt %0" : : "m" (gdt_operand));
     asm volatile ("ltr %w0" : : "r" (SELECTOR_TSS));
+
+    sysenter_ok = sysenter_detect();
+    sysenter_cpu_init(0);
     
-    put_str("ok\n");
+    put_str(sysenter_ok ? "sysenter ok\n" : "ok\n");
+}
+
+/* AP启动时调用，为第cpu_id个cpu建立自己的gdt和tss并加载
+ * 各cpu不能共用同一个tss描述符，ltr会置位描述符中的忙标志
+ */
+void tss_cpu_init(uint8_t cpu_id)
+{
+    struct tss * t = &tss[cpu_id];
+    struct gdt_desc * gdt = ap_gdt[cpu_id];
+
+    tss_setup(t);
+
+    /* 复制BSP的gdt，此时其中已有用户代码段和数据段描述符 */
+    memcpy(gdt, (void *)0xc0000900, sizeof(ap_gdt[cpu_id]));
+    gdt[4] = make_gdt_desc((uint32_t *)t, sizeof(*t) - 1,
+                    TSS_ATTR_LOW, TSS_ATTR_HIGH);
+
+    uint64_t gdt_operand = ((sizeof(ap_gdt[cpu_id]) - 1) | \
+                (((uint64_t)(uint32_t)gdt) << 16));
+    asm volatile ("lgdt %0" : : "m" (gdt_operand));
+    asm volatile ("ltr %w0" : : "r" (SELECTOR_TSS));
+
+    sysenter_cpu_init(cpu_id);
 }
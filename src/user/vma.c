@@ -0,0 +1,396 @@
+/* vma.c
+ *   按需建立映射的区域和缺页异常处理
+ *
+ * 区域中的页在虚拟地址位图中已占用，但页表中没有映射，
+ * 第一次访问时在缺页异常中分配物理页并填入内容。
+ * elf的两个段可能共用一页，填页时要把覆盖此页的区域都算上。
+ *
+ * 缺页处理可能要读硬盘而睡眠，内核持有自旋锁时不能缺页，
+ * 这类地方要先用user_fault_in把用户缓冲区映射好。
+ * 填页和对区域链表的修改由组长pcb中的vma_lock串行化，只限于同一进程，
+ * 不同进程的缺页互不等待。
+ * 进程访问不属于任何区域的地址时被结束，不影响其它进程
+ */
+
+#include <vma.h>
+#include <thread.h>
+#include <memory.h>
+#include <interrupt.h>
+#include <inode.h>
+#include <file.h>
+#include <fs.h>
+#include <sync.h>
+#include <image_cache.h>
+#include <process.h>
+#include <wait_exit.h>
+#include <string.h>
+#include <printk.h>
+#include <debug.h>
+#include <global.h>
+
+/* 缺页异常错误码中的位 */
+#define PF_ERR_PROT     0x1     /* 页存在，访问权限不符 */
+
+#define CR0_WP          (1 << 16)   /* 置位时特权级0也不能写只读页 */
+
+/* 把vma中落在页page上的内容填入此页，此页已映射并清0，
+ * 返回是否读了硬盘
+ */
+static bool vma_fill_page(struct vm_area * vma, uint32_t page)
+{
+    if (vma->inode == NULL || vma->file_size == 0)
+    {
+        return false;
+    }
+
+    /* 此页与文件内容所在范围的交集 */
+    uint32_t start = page > vma->file_vaddr ? page : vma->file_vaddr;
+    uint32_t end = vma->file_vaddr + vma->file_size;
+    if (end > page + PG_SIZE)
+    {
+        end = page + PG_SIZE;
+    }
+    if (start >= end)
+    {
+        return false;
+    }
+
+    /* 不占用文件表，直接用临时的文件结构读inode */
+    struct file file;
+    memset(&file, 0, sizeof(file));
+    file.fd_inode = vma->inode;
+    file.fd_pos = vma->file_off + (start - vma->file_vaddr);
+    file_read(&file, (void *)start, end - start);
+    return true;
+}
+
+/* 为当前进程的用户页page建立映射并填入内容，
+ * 调用时已持有组长的vma_lock，page不在任何区域中时返回false
+ */
+static bool vma_map_page(uint32_t page)
+{
+    struct task_struct * cur = running_thread();
+    struct list * vmas = &cur->group_leader->vmas;
+
+    /* 别的线程可能已经映射好了 */
+    if (user_page_mapped(page))
+    {
+        return true;
+    }
+
+    uint32_t flags = 0;
+    bool found = false;
+    struct inode * inode = NULL;    /* 覆盖此页的区域都来自它时才可缓存 */
+    struct node * elem = vmas->head.next;
+    while (elem != &vmas->tail)
+    {
+        struct vm_area * vma = container_of(struct vm_area, tag, elem);
+        if (page >= vma->start && page < vma->end)
+        {
+            flags |= vma->flags;
+            inode = (!found || vma->inode == inode) ? vma->inode : NULL;
+            found = true;
+        }
+        elem = elem->next;
+    }
+    if (!found)
+    {
+        return false;
+    }
+
+    /* 只读的文件页先到缓存中找，找到就直接映射共享页 */
+    bool cacheable = !(flags & VMA_WRITE) && inode != NULL;
+    if (cacheable)
+    {
+        uint32_t pg_phy_addr = image_cache_get(inode->i_no, page);
+        if (pg_phy_addr != 0)
+        {
+            page_map((void *)page, (void *)pg_phy_addr,
+                        PG_US_U | PG_RW_R | PG_SHARED);
+            cur->acct.min_flt++;
+            return true;
+        }
+    }
+
+    if (get_a_page_without_opvaddrbitmap(PF_USER, page) == NULL)
+    {
+        return false;
+    }
+    memset((void *)page, 0, PG_SIZE);
+
+    /* 读的过程中文件被写时，读到的页不能进缓存 */
+    uint32_t gen = image_cache_gen();
+
+    bool major = false;
+    elem = vmas->head.next;
+    while (elem != &vmas->tail)
+    {
+        struct vm_area * vma = container_of(struct vm_area, tag, elem);
+        if (page >= vma->start && page < vma->end &&
+                vma_fill_page(vma, page))
+        {
+            major = true;
+        }
+        elem = elem->next;
+    }
+
+    /* 内容填好后再去掉写权限 */
+    if (!(flags & VMA_WRITE))
+    {
+        *get_pte(page) &= ~PG_RW_W;
+        asm volatile ("invlpg %0" : : "m" (*(char *)page) : "memory");
+    }
+
+    /* 先把本进程的映射变成共享页，再交给缓存 */
+    if (cacheable)
+    {
+        uint32_t pg_phy_addr = addr_v2p(page);
+        *get_pte(page) |= PG_SHARED;
+        page_ref_get(pg_phy_addr);
+        image_cache_add(inode->i_no, page, pg_phy_addr, gen);
+    }
+
+    if (major)
+    {
+        cur->acct.maj_flt++;
+    }
+    else
+    {
+        cur->acct.min_flt++;
+    }
+    return true;
+}
+
+/* 确保当前进程中从addr开始的len字节都已映射，write为true时还要可写
+ * 在持有自旋锁访问用户内存之前调用，地址无效时返回false
+ */
+bool user_fault_in(const void * addr, uint32_t len, bool write)
+{
+    struct task_struct * cur = running_thread();
+    uint32_t start = (uint32_t)addr;
+    if (cur->pgdir == NULL || len == 0 ||
+            start + len < start || start + len > 0xc0000000)
+    {
+        return false;
+    }
+
+    uint32_t page;
+    for (page = start & 0xfffff000; page < start + len; page += PG_SIZE)
+    {
+        if (!user_page_mapped(page))
+        {
+            lock_acquire(&cur->group_leader->vma_lock);
+            bool ok = vma_map_page(page);
+            lock_release(&cur->group_leader->vma_lock);
+            if (!ok)
+            {
+                return false;
+            }
+        }
+        if (write && !(*get_pte(page) & PG_RW_W))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* 缺页异常处理程序
+ * VECTOR宏调用处理函数前压入的中断号之上就是中断栈的其余部分，
+ * 由此取得cpu压入的错误码
+ */
+static void intr_page_fault_handler(uint8_t vec_nr UNUSED)
+{
+    struct intr_stack * stack = (struct intr_stack *)
+                ((uint32_t)__builtin_frame_address(0) + 8);
+    uint32_t vaddr;
+    asm volatile ("movl %%cr2, %0" : "=r"(vaddr));
+
+    struct task_struct * cur = running_thread();
+    if (!(stack->err_code & PF_ERR_PROT) && cur->pgdir != NULL &&
+            vaddr < 0xc0000000)
+    {
+        lock_acquire(&cur->group_leader->vma_lock);
+        bool ok = vma_map_page(vaddr & 0xfffff000);
+        lock_release(&cur->group_leader->vma_lock);
+        if (ok)
+        {
+            return;
+        }
+    }
+
+    printk("page fault: %s(pid %d) vaddr 0x%x eip 0x%x err 0x%x\n",
+                cur->name, cur->pid, vaddr, (uint32_t)stack->eip,
+                stack->err_code);
+
+    /* 进程访问了无效的用户地址(包括栈溢出到保护页)，只结束这个进程 */
+    if (cur->pgdir != NULL && vaddr < 0xc0000000 && cur->pid != INIT_PID)
+    {
+        sys_exit(-1);
+    }
+    PANIC("unhandled page fault\n");
+}
+
+/* 在当前进程中加入从vaddr开始mem_size字节的区域，
+ * 其中开头的file_size字节来自inode中偏移file_off处，inode可以为NULL。
+ * 区域中原有的映射会被去掉，成功返回0，失败返回-1
+ */
+int32_t vma_add(uint32_t vaddr, uint32_t mem_size, uint32_t flags,
+            struct inode * inode, uint32_t file_off, uint32_t file_size)
+{
+    struct task_struct * cur = running_thread();
+    uint32_t start = vaddr & 0xfffff000;
+    uint32_t end = DIV_ROUND_UP(vaddr + mem_size, PG_SIZE) * PG_SIZE;
+    if (cur->pgdir == NULL || mem_size == 0 || file_size > mem_size ||
+            start < cur->user_vaddr.vm_start || end > 0xc0000000 ||
+            end <= start)
+    {
+        return -1;
+    }
+
+    struct vm_area * vma = kmalloc(sizeof(struct vm_area));
+    if (vma == NULL)
+    {
+        return -1;
+    }
+    vma->start = start;
+    vma->end = end;
+    vma->flags = flags;
+    vma->inode = (inode != NULL) ? inode_open(cur_part, inode->i_no) : NULL;
+    vma->file_vaddr = vaddr;
+    vma->file_size = file_size;
+    vma->file_off = file_off;
+
+    lock_acquire(&cur->group_leader->vma_lock);
+
+    /* exec时此处可能还留着原来程序的页，去掉后才会缺页重新读入 */
+    uint32_t page;
+    for (page = start; page < end; page += PG_SIZE)
+    {
+        if (user_page_mapped(page))
+        {
+            mfree_page(PF_USER, (void *)page, 1);
+        }
+        bitmap_set(&cur->user_vaddr.bm,
+                    (page - cur->user_vaddr.vm_start) / PG_SIZE, 1);
+    }
+    list_append(&cur->group_leader->vmas, &vma->tag);
+
+    lock_release(&cur->group_leader->vma_lock);
+    return 0;
+}
+
+/* 在当前进程的用户空间顶端加入最大USER_STACK_MAX字节的栈区域，
+ * 栈向下增长时逐页缺页映射。区域之下的一页是保护页，
+ * 占用虚拟地址而不属于任何区域，栈溢出时访问它会结束进程。
+ * 成功返回0，失败返回-1
+ */
+int32_t vma_add_stack(void)
+{
+    struct task_struct * cur = running_thread();
+    uint32_t start = USER_STACK_TOP - USER_STACK_MAX;
+    if (vma_add(start, USER_STACK_MAX, VMA_WRITE | VMA_STACK,
+                NULL, 0, 0) == -1)
+    {
+        return -1;
+    }
+
+    /* 保护页也不能被堆占用 */
+    uint32_t guard = start - PG_SIZE;
+    lock_acquire(&cur->group_leader->vma_lock);
+    if (user_page_mapped(guard))
+    {
+        mfree_page(PF_USER, (void *)guard, 1);
+    }
+    bitmap_set(&cur->user_vaddr.bm,
+                (guard - cur->user_vaddr.vm_start) / PG_SIZE, 1);
+    lock_release(&cur->group_leader->vma_lock);
+    return 0;
+}
+
+/* 释放pthread的所有区域
+ * unmap为true时还要去掉区域中的映射并释放虚拟地址，调用时须是pthread的页表，
+ * 进程退出时用户内存已按位图释放，unmap为false
+ */
+void vma_release(struct task_struct * pthread, bool unmap)
+{
+    struct list * vmas = &pthread->vmas;
+
+    lock_acquire(&pthread->vma_lock);
+    while (!list_empty(vmas))
+    {
+        struct vm_area * vma = container_of(struct vm_area, tag,
+                    list_pop(vmas));
+        uint32_t page;
+        for (page = vma->start; unmap && page < vma->end; page += PG_SIZE)
+        {
+            if (user_page_mapped(page))
+            {
+                mfree_page(PF_USER, (void *)page, 1);
+            }
+            bitmap_set(&pthread->user_vaddr.bm,
+                        (page - pthread->user_vaddr.vm_start) / PG_SIZE, 0);
+        }
+        if (unmap && (vma->flags & VMA_STACK))
+        {
+            bitmap_set(&pthread->user_vaddr.bm,
+                (vma->start - PG_SIZE - pthread->user_vaddr.vm_start) / PG_SIZE,
+                0);
+        }
+        if (vma->inode != NULL)
+        {
+            inode_close(vma->inode);
+        }
+        kfree(vma);
+    }
+    lock_release(&pthread->vma_lock);
+}
+
+/* fork时复制父进程的区域，尚未访问的页由子进程自己缺页读入
+ * 成功返回0，失败返回-1
+ */
+int32_t vma_copy(struct task_struct * child, struct task_struct * parent)
+{
+    struct list * vmas = &parent->group_leader->vmas;
+    int32_t ret = 0;
+
+    lock_acquire(&parent->group_leader->vma_lock);
+    struct node * elem = vmas->head.next;
+    while (elem != &vmas->tail)
+    {
+        struct vm_area * vma = container_of(struct vm_area, tag, elem);
+        struct vm_area * new_vma = kmalloc(sizeof(struct vm_area));
+        if (new_vma == NULL)
+        {
+            ret = -1;
+            break;
+        }
+        memcpy(new_vma, vma, sizeof(struct vm_area));
+        if (vma->inode != NULL)
+        {
+            new_vma->inode = inode_open(cur_part, vma->inode->i_no);
+        }
+        list_append(&child->vmas, &new_vma->tag);
+        elem = elem->next;
+    }
+    lock_release(&parent->group_leader->vma_lock);
+    return ret;
+}
+
+/* 置本cpu的cr0.WP，内核也不能写只读的用户页，
+ * 免得写坏多个进程共享的代码页，每个cpu都要调用一次
+ */
+void vma_cpu_init(void)
+{
+    uint32_t cr0;
+    asm volatile ("movl %%cr0, %0" : "=r"(cr0));
+    asm volatile ("movl %0, %%cr0" : : "r"(cr0 | CR0_WP));
+}
+
+/* 注册缺页异常处理程序 */
+void vma_init(void)
+{
+    image_cache_init();
+    register_handler(14, intr_page_fault_handler);
+    vma_cpu_init();
+}
@@ -0,0 +1,256 @@
+/* wait_exit.c
+ *   进程的退出和父进程对子进程的回收
+ *
+ * exit在进程自己的上下文中释放用户内存、关闭文件，
+ * 然后挂起(TASK_HANGING)成为僵尸，退出状态留在pcb中；
+ * pcb、页目录和页表由父进程在wait中释放。
+ * 父进程先退出时，子进程过继给init，由init回收
+ */
+
+#include <wait_exit.h>
+#include <thread.h>
+#include <memory.h>
+#include <process.h>
+#include <fork.h>
+#include <fs.h>
+#include <file.h>
+#include <pid.h>
+#include <sync.h>
+#include <spinlock.h>
+#include <atomic.h>
+#include <interrupt.h>
+#include <ioring.h>
+#include <fpu.h>
+#include <shm.h>
+#include <ipc.h>
+#include <vma.h>
+#include <vdso.h>
+#include <debug.h>
+#include <global.h>
+
+/* 保护父子关系，并串行化挂起和查找僵尸，避免父进程错过唤醒 */
+static struct spinlock exit_lock;
+
+/* 等待子进程退出的任务 */
+static struct wait_queue exit_wq;
+
+/* 释放进程的用户内存、虚拟地址位图和打开的文件等
+ * 在进程自己的上下文中调用，页表仍在使用，留给父进程释放
+ */
+static void release_prog_resource(struct task_struct * pthread)
+{
+    /* 别的线程不能再往要释放的用户内存中传递消息 */
+    ipc_exit(pthread);
+
+    /* 1.异步读写还可能在使用文件，先等它们做完 */
+    ioring_release(pthread);
+    fpu_release(pthread);
+
+    /* 2.用户空间的物理页，共享页等最后一个映射去掉时再释放 */
+    uint8_t * bits = pthread->user_vaddr.bm.bits;
+    uint32_t idx_byte, idx_bit;
+    for (idx_byte = 0; idx_byte < pthread->user_vaddr.bm.len; idx_byte++)
+    {
+        if (bits[idx_byte] == 0)
+        {
+            continue;
+        }
+        for (idx_bit = 0; idx_bit < 8; idx_bit++)
+        {
+            if (!((BITMAP_MASK << idx_bit) & bits[idx_byte]))
+            {
+                continue;
+            }
+            uint32_t vaddr = (idx_byte * 8 + idx_bit) * PG_SIZE
+                        + pthread->user_vaddr.vm_start;
+            if (!user_page_mapped(vaddr))
+            {
+                continue;
+            }
+            uint32_t pg_phy_addr = addr_v2p(vaddr);
+            if (!(*get_pte(vaddr) & PG_SHARED) ||
+                    page_ref_put(pg_phy_addr) == 0)
+            {
+                pfree(pg_phy_addr);
+            }
+        }
+    }
+
+    /* 最后一个映射可能刚被去掉 */
+    shm_reap();
+
+    /* 页已按位图释放，只需释放区域本身 */
+    vma_release(pthread, false);
+
+    /* 3.虚拟地址位图 */
+    uint32_t bitmap_pg_cnt =
+        DIV_ROUND_UP((0xc0000000 - USER_VADDR_START) / PG_SIZE / 8, PG_SIZE);
+    mfree_page(PF_KERNEL, bits, bitmap_pg_cnt);
+    pthread->user_vaddr.bm.bits = NULL;
+
+    /* 4.关闭打开的文件，管道的对端因此能看到结尾 */
+    int32_t fd;
+    for (fd = 0; fd < MAX_FILES_OPEN_PER_PROC; fd++)
+    {
+        if (pthread->fd_table[fd] > stderr_no)
+        {
+            sys_close(fd);
+        }
+    }
+
+    /* 5.进程数据页，过继时要在exit_lock内修改其中的ppid，先在锁内摘下 */
+    intr_status old_status = spin_lock_irqsave(&exit_lock);
+    struct vdso_proc * proc = pthread->vdso;
+    pthread->vdso = NULL;
+    spin_unlock_irqrestore(&exit_lock, old_status);
+    if (proc != NULL)
+    {
+        mfree_page(PF_KERNEL, proc, 1);
+    }
+}
+
+/* 释放已退出的子进程的页表和页目录 */
+static void release_page_dir(struct task_struct * child)
+{
+    uint32_t * pgdir = child->pgdir;
+    uint32_t pde_idx;
+
+    /* 第768项之后是各进程共享的内核空间 */
+    for (pde_idx = 0; pde_idx < 0x300; pde_idx++)
+    {
+        if (pgdir[pde_idx] & PG_P_1)
+        {
+            pfree(pgdir[pde_idx] & 0xfffff000);
+        }
+    }
+    mfree_page(PF_KERNEL, pgdir, 1);
+}
+
+/* 是pid为ppid的进程的子进程，线程不算 */
+static bool is_child(struct node * pelem, int ppid)
+{
+    struct task_struct * pthread = container_of(struct task_struct,
+                all_list_tag, pelem);
+    return pthread->parent_pid == ppid && pthread == pthread->group_leader;
+}
+
+/* 是pid为ppid的进程已退出的子进程 */
+static bool is_hanging_child(struct node * pelem, int ppid)
+{
+    struct task_struct * pthread = container_of(struct task_struct,
+                all_list_tag, pelem);
+    return is_child(pelem, ppid) && pthread->status == TASK_HANGING;
+}
+
+/* 把pid为ppid的进程的子进程过继给init，总是返回false以遍历整个队列 */
+static bool adopt_child(struct node * pelem, int ppid)
+{
+    struct task_struct * pthread = container_of(struct task_struct,
+                all_list_tag, pelem);
+    if (pthread->parent_pid == ppid)
+    {
+        pthread->parent_pid = INIT_PID;
+
+        /* 用户态的getppid读的是进程数据页，内核线程没有 */
+        if (pthread->vdso != NULL)
+        {
+            pthread->vdso->ppid = INIT_PID;
+        }
+    }
+    return false;
+}
+
+/* 等待任意一个子进程退出，status不为NULL时写入其退出状态
+ * 返回子进程的pid，没有子进程时返回-1
+ */
+pid_t sys_wait(int32_t * status)
+{
+    pid_t ppid = running_thread()->group_leader->pid;
+    struct task_struct * child;
+
+    intr_status old_status = spin_lock_irqsave(&exit_lock);
+    while (true)
+    {
+        child = thread_all_list_find(is_hanging_child, ppid);
+        if (child != NULL)
+        {
+            break;
+        }
+        if (thread_all_list_find(is_child, ppid) == NULL)
+        {
+            spin_unlock_irqrestore(&exit_lock, old_status);
+            return -1;
+        }
+        wait_queue_sleep(&exit_wq, &exit_lock);
+    }
+    thread_all_list_remove(child);
+    spin_unlock_irqrestore(&exit_lock, old_status);
+
+    /* 子进程挂起后可能还没在别的cpu上换下 */
+    thread_wait_off_cpu(child);
+
+    if (status != NULL)
+    {
+        *status = child->exit_status;
+    }
+    pid_t child_pid = child->pid;
+    release_page_dir(child);
+    mfree_page(PF_KERNEL, child, 1);
+    pid_free(child_pid);
+    return child_pid;
+}
+
+/* 结束当前进程，不再返回
+ * 在线程中调用时只结束这一个线程，组长调用时先等其它线程结束
+ */
+void sys_exit(int32_t status)
+{
+    struct task_struct * cur = running_thread();
+    kassert(cur->pid != INIT_PID);
+
+    if (cur != cur->group_leader)
+    {
+        sys_thread_exit(NULL);
+    }
+
+    /* 还不能强制结束同组的线程，睡眠等它们都退出 */
+    intr_status old_status = spin_lock_irqsave(&exit_lock);
+    while (cur->nr_threads > 1)
+    {
+        wait_queue_sleep(&exit_wq, &exit_lock);
+    }
+    spin_unlock_irqrestore(&exit_lock, old_status);
+
+    cur->exit_status = status;
+    release_prog_resource(cur);
+
+    old_status = spin_lock_irqsave(&exit_lock);
+    thread_all_list_find(adopt_child, cur->pid);
+
+    /* 父进程和init都可能在等待，都唤醒后各自重新查找 */
+    wait_queue_wake_all(&exit_wq);
+    thread_block_unlock(TASK_HANGING, &exit_lock);
+
+    intr_set_status(old_status);
+    PANIC("sys_exit: hanging task scheduled\n");
+}
+
+/* 线程组中的一个线程已退出并换下cpu，不再使用组的页表
+ * 剩下组长一个时唤醒在sys_exit中等待的组长
+ */
+void thread_group_put(struct task_struct * leader)
+{
+    intr_status old_status = spin_lock_irqsave(&exit_lock);
+    atomic_dec(&leader->nr_threads);
+    if (leader->nr_threads == 1)
+    {
+        wait_queue_wake_all(&exit_wq);
+    }
+    spin_unlock_irqrestore(&exit_lock, old_status);
+}
+
+void wait_exit_init(void)
+{
+    spin_init(&exit_lock);
+    wait_queue_init(&exit_wq);
+}